@@ -30,6 +30,7 @@
 #include "gegl-buffer.h"
 #include "gegl-buffer-private.h"
 #include "gegl-tile-storage.h"
+#include "gegl-tile-handler-cache.h"
 #include "gegl-utils.h"
 #include "gegl-sampler-nearest.h"
 #include "gegl-sampler-linear.h"
@@ -730,17 +731,39 @@ resample_nearest (void   *dest_buf,
     }
 }
 
+/* component types the box filter resampler knows how to weigh */
+typedef enum
+{
+  BOX_FILTER_U8,
+  BOX_FILTER_U16,
+  BOX_FILTER_FLOAT
+} BoxFilterType;
+
+/* weights of the 9 surrounding source pixels, in the order of
+ * box_filter's src argument
+ */
+#define BOX_FILTER_WEIGHTS(lt,ct,rt,lm,cm,rm,lb,cb,rb) \
+   lt = left_weight * top_weight;       \
+   lm = left_weight * middle_weight;    \
+   lb = left_weight * bottom_weight;    \
+   ct = center_weight * top_weight;     \
+   cm = center_weight * middle_weight;  \
+   cb = center_weight * bottom_weight;  \
+   rt = right_weight * top_weight;      \
+   rm = right_weight * middle_weight;   \
+   rb = right_weight * bottom_weight;
+
 static inline void
-box_filter (guint          left_weight,
-            guint          center_weight,
-            guint          right_weight,
-            guint          top_weight,
-            guint          middle_weight,
-            guint          bottom_weight,
-            guint          sum,
-            const guchar **src,   /* the 9 surrounding source pixels */
-            guchar        *dest,
-            gint           components)
+box_filter_u8 (guint          left_weight,
+               guint          center_weight,
+               guint          right_weight,
+               guint          top_weight,
+               guint          middle_weight,
+               guint          bottom_weight,
+               guint          sum,
+               const guchar **src,   /* the 9 surrounding source pixels */
+               guchar        *dest,
+               gint           components)
 {
   /* NOTE: this box filter presumes pre-multiplied alpha, if there
    * is alpha.
@@ -749,15 +772,7 @@ box_filter (guint          left_weight,
    guint ct, cm, cb;
    guint rt, rm, rb;
 
-   lt = left_weight * top_weight;
-   lm = left_weight * middle_weight;
-   lb = left_weight * bottom_weight;
-   ct = center_weight * top_weight;
-   cm = center_weight * middle_weight;
-   cb = center_weight * bottom_weight;
-   rt = right_weight * top_weight;
-   rm = right_weight * middle_weight;
-   rb = right_weight * bottom_weight;
+   BOX_FILTER_WEIGHTS (lt, ct, rt, lm, cm, rm, lb, cb, rb)
 
 #define docomponent(i) \
       dest[i] = (src[0][i] * lt + src[3][i] * lm + src[6][i] * lb + \
@@ -774,23 +789,89 @@ box_filter (guint          left_weight,
 #undef docomponent
 }
 
+static inline void
+box_filter_u16 (guint          left_weight,
+                guint          center_weight,
+                guint          right_weight,
+                guint          top_weight,
+                guint          middle_weight,
+                guint          bottom_weight,
+                guint          sum,
+                const guchar **src,   /* the 9 surrounding source pixels */
+                guchar        *dest,
+                gint           components)
+{
+  /* 16bit values times weights of up to 2^16 overflow 32bit, accumulate
+   * in 64bit
+   */
+   guint64 lt, lm, lb;
+   guint64 ct, cm, cb;
+   guint64 rt, rm, rb;
+   const guint16 **s = (const guint16 **) src;
+   guint16        *d = (guint16 *) dest;
+   gint            i;
+
+   BOX_FILTER_WEIGHTS (lt, ct, rt, lm, cm, rm, lb, cb, rb)
+
+   for (i = 0; i < components; i++)
+     d[i] = (s[0][i] * lt + s[3][i] * lm + s[6][i] * lb +
+             s[1][i] * ct + s[4][i] * cm + s[7][i] * cb +
+             s[2][i] * rt + s[5][i] * rm + s[8][i] * rb) / sum;
+}
+
+static inline void
+box_filter_float (guint          left_weight,
+                  guint          center_weight,
+                  guint          right_weight,
+                  guint          top_weight,
+                  guint          middle_weight,
+                  guint          bottom_weight,
+                  guint          sum,
+                  const guchar **src,   /* the 9 surrounding source pixels */
+                  guchar        *dest,
+                  gint           components)
+{
+   const gfloat   norm = 1.0f / sum;
+   gfloat         lt, lm, lb;
+   gfloat         ct, cm, cb;
+   gfloat         rt, rm, rb;
+   const gfloat **s = (const gfloat **) src;
+   gfloat        *d = (gfloat *) dest;
+   gint           i;
+
+   BOX_FILTER_WEIGHTS (lt, ct, rt, lm, cm, rm, lb, cb, rb)
+
+   lt *= norm; lm *= norm; lb *= norm;
+   ct *= norm; cm *= norm; cb *= norm;
+   rt *= norm; rm *= norm; rb *= norm;
+
+   for (i = 0; i < components; i++)
+     d[i] = s[0][i] * lt + s[3][i] * lm + s[6][i] * lb +
+            s[1][i] * ct + s[4][i] * cm + s[7][i] * cb +
+            s[2][i] * rt + s[5][i] * rm + s[8][i] * rb;
+}
+
+#undef BOX_FILTER_WEIGHTS
+
 static void
-resample_boxfilter_u8 (void   *dest_buf,
-                       void   *source_buf,
-                       gint    dest_w,
-                       gint    dest_h,
-                       gint    source_w,
-                       gint    source_h,
-                       gdouble offset_x,
-                       gdouble offset_y,
-                       gdouble scale,
-                       gint    components,
-                       gint    rowstride)
+resample_boxfilter (void          *dest_buf,
+                    void          *source_buf,
+                    gint           dest_w,
+                    gint           dest_h,
+                    gint           source_w,
+                    gint           source_h,
+                    gdouble        offset_x,
+                    gdouble        offset_y,
+                    gdouble        scale,
+                    gint           bpp,
+                    gint           components,
+                    BoxFilterType  type,
+                    gint           rowstride)
 {
   gint x, y;
   gint iscale      = scale * 256;
-  gint s_rowstride = source_w * components;
-  gint d_rowstride = dest_w * components;
+  gint s_rowstride = source_w * bpp;
+  gint d_rowstride = dest_w * bpp;
 
   gint          footprint_x;
   gint          footprint_y;
@@ -845,7 +926,6 @@ resample_boxfilter_u8 (void   *dest_buf,
       sx = (offset_x *65536) / iscale;
       xdelta = 65536/iscale;
 
-      /* XXX: needs quite a bit of optimization */
       for (x = 0; x < dest_w; x++)
         {
           gint          dx;
@@ -866,17 +946,17 @@ resample_boxfilter_u8 (void   *dest_buf,
 
           center_weight = footprint_x - left_weight - right_weight;
 
-          src[4] = src_base + (sx >> 8) * components;
+          src[4] = src_base + (sx >> 8) * bpp;
           src[1] = src[4] - s_rowstride;
           src[7] = src[4] + s_rowstride;
 
-          src[2] = src[1] + components;
-          src[5] = src[4] + components;
-          src[8] = src[7] + components;
+          src[2] = src[1] + bpp;
+          src[5] = src[4] + bpp;
+          src[8] = src[7] + bpp;
 
-          src[0] = src[1] - components;
-          src[3] = src[4] - components;
-          src[6] = src[7] - components;
+          src[0] = src[1] - bpp;
+          src[3] = src[4] - bpp;
+          src[6] = src[7] - bpp;
 
           if ((sx >>8) - 1<0)
             {
@@ -904,19 +984,26 @@ resample_boxfilter_u8 (void   *dest_buf,
               src[8]=src[5];
             }
 
-          box_filter (left_weight,
-                      center_weight,
-                      right_weight,
-                      top_weight,
-                      middle_weight,
-                      bottom_weight,
-                      foosum,
-                      src,   /* the 9 surrounding source pixels */
-                      dst,
-                      components);
-
+          switch (type)
+            {
+              case BOX_FILTER_U8:
+                box_filter_u8 (left_weight, center_weight, right_weight,
+                               top_weight, middle_weight, bottom_weight,
+                               foosum, src, dst, components);
+                break;
+              case BOX_FILTER_U16:
+                box_filter_u16 (left_weight, center_weight, right_weight,
+                                top_weight, middle_weight, bottom_weight,
+                                foosum, src, dst, components);
+                break;
+              case BOX_FILTER_FLOAT:
+                box_filter_float (left_weight, center_weight, right_weight,
+                                  top_weight, middle_weight, bottom_weight,
+                                  foosum, src, dst, components);
+                break;
+            }
 
-          dst += components;
+          dst += bpp;
           sx += xdelta;
         }
     }
@@ -989,6 +1076,7 @@ gegl_buffer_get_unlocked (GeglBuffer          *buffer,
       gint          factor = 1;
       gdouble       offset_x;
       gdouble       offset_y;
+      const Babl   *type;
 
       sample_rect.x = floor(rect->x/scale);
       sample_rect.y = floor(rect->y/scale);
@@ -1016,32 +1104,42 @@ gegl_buffer_get_unlocked (GeglBuffer          *buffer,
 
       sample_buf = g_malloc (buf_width * buf_height * bpp);
       gegl_buffer_iterate (buffer, &sample_rect, sample_buf, GEGL_AUTO_ROWSTRIDE, FALSE, format, level);
-#if 1
-  /* slows testing of rendering code speed too much for now and
-   * no time to make a fast implementation
-   */
-
-      if (babl_format_get_type (format, 0) == babl_type ("u8")
-          && !(level == 0 && scale > 1.99))
-        { /* do box-filter resampling if we're 8bit (which projections are) */
-
-          /* XXX: use box-filter also for > 1.99 when testing and probably
-           * later, there are some bugs when doing so
-           */
-          resample_boxfilter_u8 (dest_buf,
-                                 sample_buf,
-                                 rect->width,
-                                 rect->height,
-                                 buf_width,
-                                 buf_height,
-                                 offset_x,
-                                 offset_y,
-                                 scale,
-                                 bpp,
-                                 rowstride);
+      type = babl_format_get_type (format, 0);
+
+      /* do box-filter resampling for the component types we know to
+       * weigh (8bit projections, and the u16 and float buffers of
+       * zoomed out views), for the rest pick nearest neighbours.
+       *
+       * XXX: use box-filter also for > 1.99 when testing and probably
+       * later, there are some bugs when doing so
+       */
+      if (!(level == 0 && scale > 1.99) &&
+          (type == babl_type ("u8") ||
+           type == babl_type ("u16") ||
+           type == babl_type ("float")))
+        {
+          BoxFilterType filter_type = BOX_FILTER_U8;
+
+          if (type == babl_type ("u16"))
+            filter_type = BOX_FILTER_U16;
+          else if (type == babl_type ("float"))
+            filter_type = BOX_FILTER_FLOAT;
+
+          resample_boxfilter (dest_buf,
+                              sample_buf,
+                              rect->width,
+                              rect->height,
+                              buf_width,
+                              buf_height,
+                              offset_x,
+                              offset_y,
+                              scale,
+                              bpp,
+                              babl_format_get_n_components (format),
+                              filter_type,
+                              rowstride);
         }
       else
-#endif
         {
           resample_nearest (dest_buf,
                             sample_buf,
@@ -1138,13 +1236,146 @@ gegl_buffer_sample_cleanup (GeglBuffer *buffer)
     }
 }
 
+/* Copies the tiles of src that the copy covers completely by sharing them
+ * copy-on-write with dst, the pixel data is only duplicated once either
+ * of the buffers writes to such a tile. Returns the part of dst_rect that
+ * was copied, which is empty when the buffers are not laid out alike.
+ */
+static GeglRectangle
+gegl_buffer_copy_tiles (GeglBuffer          *src,
+                        const GeglRectangle *src_rect,
+                        GeglBuffer          *dst,
+                        const GeglRectangle *dst_rect)
+{
+  GeglTileStorage *storage     = dst->tile_storage;
+  gint             tile_width  = dst->tile_width;
+  gint             tile_height = dst->tile_height;
+  gint             offset_x    = src_rect->x - dst_rect->x;
+  gint             offset_y    = src_rect->y - dst_rect->y;
+  GeglRectangle    copied      = { 0, 0, 0, 0 };
+  GeglRectangle    abyss;
+  gint             first_x, first_y, last_x, last_y;
+  gint             x, y, z, zx, zy;
+
+  if (cl_state.is_accelerated ||
+      src->format != dst->format ||
+      src->tile_width != tile_width ||
+      src->tile_height != tile_height ||
+      src->tile_storage == storage ||
+      !storage->cache ||
+      gegl_buffer_is_shared (dst) ||
+      /* a single tile spanning the buffer can be the caller's memory of a
+       * linear buffer */
+      (src->tile_width >= src->extent.width &&
+       src->tile_height >= src->extent.height))
+    return copied;
+
+  /* the tile grids of both buffers have to line up over the copy */
+  if (gegl_tile_offset (src_rect->x + src->shift_x, tile_width) !=
+      gegl_tile_offset (dst_rect->x + dst->shift_x, tile_width) ||
+      gegl_tile_offset (src_rect->y + src->shift_y, tile_height) !=
+      gegl_tile_offset (dst_rect->y + dst->shift_y, tile_height))
+    return copied;
+
+  /* pixels outside either abyss are left to the pixel copy */
+  abyss    = src->abyss;
+  abyss.x -= offset_x;
+  abyss.y -= offset_y;
+  gegl_rectangle_intersect (&copied, dst_rect, &dst->abyss);
+  gegl_rectangle_intersect (&copied, &copied, &abyss);
+
+  /* tile indices in the storage of dst of the tiles fully inside */
+  first_x = gegl_tile_indice (copied.x + dst->shift_x + tile_width - 1, tile_width);
+  first_y = gegl_tile_indice (copied.y + dst->shift_y + tile_height - 1, tile_height);
+  last_x  = gegl_tile_indice (copied.x + copied.width + dst->shift_x, tile_width);
+  last_y  = gegl_tile_indice (copied.y + copied.height + dst->shift_y, tile_height);
+
+  if (copied.width <= 0 || copied.height <= 0 ||
+      last_x <= first_x || last_y <= first_y)
+    {
+      copied.width = copied.height = 0;
+      return copied;
+    }
+
+  for (y = first_y; y < last_y; y++)
+    for (x = first_x; x < last_x; x++)
+      {
+        gint      src_x = x * tile_width  - dst->shift_x + offset_x + src->shift_x;
+        gint      src_y = y * tile_height - dst->shift_y + offset_y + src->shift_y;
+        GeglTile *src_tile;
+        GeglTile *dst_tile;
+
+        src_tile = gegl_tile_source_get_tile ((GeglTileSource *) (src),
+                                              gegl_tile_indice (src_x, tile_width),
+                                              gegl_tile_indice (src_y, tile_height),
+                                              0);
+        if (!src_tile)
+          {
+            g_warning ("didn't get tile, trying to continue");
+            continue;
+          }
+
+        /* drop the tile dst had here, and the levels scaled from it */
+        for (z = 0, zx = x, zy = y; z == 0 || z <= storage->seen_zoom;
+             z++, zx /= 2, zy /= 2)
+          gegl_tile_source_void (GEGL_TILE_SOURCE (storage), zx, zy, z);
+
+        dst_tile = gegl_tile_dup (src_tile);
+        dst_tile->tile_storage = storage;
+        dst_tile->x = x;
+        dst_tile->y = y;
+        dst_tile->z = 0;
+        dst_tile->rev++; /* not stored in the backend of dst yet */
+
+        gegl_tile_handler_cache_insert (storage->cache, dst_tile, x, y, 0);
+
+        gegl_tile_unref (dst_tile);
+        gegl_tile_unref (src_tile);
+      }
+
+  if (dst->hot_tile)
+    {
+      gegl_tile_unref (dst->hot_tile);
+      dst->hot_tile = NULL;
+    }
+
+  copied.x      = first_x * tile_width - dst->shift_x;
+  copied.y      = first_y * tile_height - dst->shift_y;
+  copied.width  = (last_x - first_x) * tile_width;
+  copied.height = (last_y - first_y) * tile_height;
+
+  return copied;
+}
+
+static void
+gegl_buffer_copy_pixels (GeglBuffer          *src,
+                         const GeglRectangle *src_rect,
+                         GeglBuffer          *dst,
+                         const GeglRectangle *dst_rect)
+{
+  Babl               *fish = babl_fish (src->format, dst->format);
+  GeglBufferIterator *i;
+  gint                read;
+
+  if (src_rect->width <= 0 || src_rect->height <= 0)
+    return;
+
+  i = gegl_buffer_iterator_new (dst, dst_rect, dst->format, GEGL_BUFFER_WRITE);
+  read = gegl_buffer_iterator_add (i, src, src_rect, src->format, GEGL_BUFFER_READ);
+  while (gegl_buffer_iterator_next (i))
+    babl_process (fish, i->data[read], i->data[0], i->length);
+}
+
 void
 gegl_buffer_copy (GeglBuffer          *src,
                   const GeglRectangle *src_rect,
                   GeglBuffer          *dst,
                   const GeglRectangle *dst_rect)
 {
-  Babl         *fish;
+  GeglRectangle dest_rect_r;
+  GeglRectangle copied;
+  GeglRectangle parts[4];
+  gint          j;
 
   g_return_if_fail (GEGL_IS_BUFFER (src));
   g_return_if_fail (GEGL_IS_BUFFER (dst));
@@ -1159,20 +1390,47 @@ gegl_buffer_copy (GeglBuffer          *src,
       dst_rect = src_rect;
     }
 
-  fish = babl_fish (src->format, dst->format);
+  dest_rect_r        = *dst_rect;
+  dest_rect_r.width  = src_rect->width;
+  dest_rect_r.height = src_rect->height;
+
+  copied = gegl_buffer_copy_tiles (src, src_rect, dst, &dest_rect_r);
 
+  if (copied.width <= 0 || copied.height <= 0)
+    {
+      gegl_buffer_copy_pixels (src, src_rect, dst, &dest_rect_r);
+      return;
+    }
+
+  /* the rows above and below the shared tiles, and the columns left and
+   * right of them, are copied pixel by pixel
+   */
+  j = 0;
+  gegl_rectangle_set (&parts[j++],
+                      dest_rect_r.x, dest_rect_r.y,
+                      dest_rect_r.width, copied.y - dest_rect_r.y);
+  gegl_rectangle_set (&parts[j++],
+                      dest_rect_r.x, copied.y + copied.height,
+                      dest_rect_r.width,
+                      dest_rect_r.y + dest_rect_r.height -
+                      (copied.y + copied.height));
+  gegl_rectangle_set (&parts[j++],
+                      dest_rect_r.x, copied.y,
+                      copied.x - dest_rect_r.x, copied.height);
+  gegl_rectangle_set (&parts[j++],
+                      copied.x + copied.width, copied.y,
+                      dest_rect_r.x + dest_rect_r.width -
+                      (copied.x + copied.width),
+                      copied.height);
+
+  for (j = 0; j < G_N_ELEMENTS (parts); j++)
     {
-      GeglRectangle dest_rect_r = *dst_rect;
-      GeglBufferIterator *i;
-      gint read;
+      GeglRectangle part_src = parts[j];
 
-      dest_rect_r.width = src_rect->width;
-      dest_rect_r.height = src_rect->height;
+      part_src.x += src_rect->x - dest_rect_r.x;
+      part_src.y += src_rect->y - dest_rect_r.y;
 
-      i = gegl_buffer_iterator_new (dst, &dest_rect_r, dst->format, GEGL_BUFFER_WRITE);
-      read = gegl_buffer_iterator_add (i, src, src_rect, src->format, GEGL_BUFFER_READ);
-      while (gegl_buffer_iterator_next (i))
-        babl_process (fish, i->data[read], i->data[0], i->length);
+      gegl_buffer_copy_pixels (src, &part_src, dst, &parts[j]);
     }
 }
 
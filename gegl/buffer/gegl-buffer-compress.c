@@ -0,0 +1,366 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-buffer-index.h"
+#include "gegl-buffer-compress.h"
+
+/* GEGL_TILE_CODEC_SHUFFLE_LZ
+ *
+ * The bytes of the tile are first regrouped into planes, one for each
+ * byte of a pixel, and each plane is delta coded. For float data this
+ * puts the slowly varying sign and exponent bytes next to each other,
+ * for 8 bit data the planes are the components. The planes are then
+ * compressed with a byte oriented LZ77 coder, stored as a sequence of:
+ *
+ *   token                 high nibble: literal count, low nibble: match
+ *                         length - LZ_MIN_MATCH, 15 means more follows
+ *   [literal count - 15]  as bytes of 255 ended by a byte below 255
+ *   literals
+ *   offset                2 bytes little endian, back from the match
+ *   [match length - 19]   as for the literal count
+ *
+ * The last sequence has no match and ends at the end of the data.
+ */
+
+#define LZ_HASH_BITS  12
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 65535
+
+static inline guint32
+lz_read32 (const guchar *p)
+{
+  guint32 v;
+  memcpy (&v, p, 4);
+  return v;
+}
+
+static inline guint
+lz_hash (guint32 v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static guchar *
+lz_put_length (guchar *dst,
+               guchar *end,
+               gsize   length)
+{
+  while (length >= 255)
+    {
+      if (dst >= end)
+        return NULL;
+      *dst++ = 255;
+      length -= 255;
+    }
+  if (dst >= end)
+    return NULL;
+  *dst++ = length;
+  return dst;
+}
+
+/* appends a sequence, returns NULL when it doesn't fit before end */
+static guchar *
+lz_put_sequence (guchar       *dst,
+                 guchar       *end,
+                 const guchar *literals,
+                 gsize         n_literals,
+                 gsize         offset,
+                 gsize         match)
+{
+  guchar *token;
+
+  if (dst >= end)
+    return NULL;
+
+  token = dst++;
+  *token = MIN (n_literals, 15) << 4;
+  if (n_literals >= 15 &&
+      !(dst = lz_put_length (dst, end, n_literals - 15)))
+    return NULL;
+
+  if ((gsize) (end - dst) < n_literals)
+    return NULL;
+  memcpy (dst, literals, n_literals);
+  dst += n_literals;
+
+  if (match)
+    {
+      match -= LZ_MIN_MATCH;
+      *token |= MIN (match, 15);
+
+      if (end - dst < 2)
+        return NULL;
+      *dst++ = offset & 0xff;
+      *dst++ = offset >> 8;
+
+      if (match >= 15 &&
+          !(dst = lz_put_length (dst, end, match - 15)))
+        return NULL;
+    }
+  return dst;
+}
+
+/* returns the compressed size, or 0 if it would exceed capacity */
+static gsize
+lz_compress (const guchar *src,
+             gsize         n,
+             guchar       *dst,
+             gsize         capacity)
+{
+  guint32       table[1 << LZ_HASH_BITS];
+  const guchar *ip     = src;
+  const guchar *anchor = src;
+  guchar       *op     = dst;
+  guchar       *end    = dst + capacity;
+
+  memset (table, 0, sizeof (table));
+
+  if (n > LZ_MIN_MATCH)
+    {
+      const guchar *limit = src + n - LZ_MIN_MATCH;
+
+      while (ip <= limit)
+        {
+          guint32       v   = lz_read32 (ip);
+          guint         h   = lz_hash (v);
+          const guchar *ref = src + table[h];
+
+          table[h] = ip - src;
+
+          if (ref < ip && ip - ref <= LZ_MAX_OFFSET && lz_read32 (ref) == v)
+            {
+              const guchar *mp = ip + LZ_MIN_MATCH;
+              const guchar *mr = ref + LZ_MIN_MATCH;
+
+              while (mp < src + n && *mp == *mr)
+                {
+                  mp++;
+                  mr++;
+                }
+
+              op = lz_put_sequence (op, end, anchor, ip - anchor,
+                                    ip - ref, mp - ip);
+              if (!op)
+                return 0;
+
+              ip = anchor = mp;
+            }
+          else
+            {
+              ip++;
+            }
+        }
+    }
+
+  op = lz_put_sequence (op, end, anchor, src + n - anchor, 0, 0);
+
+  return op ? op - dst : 0;
+}
+
+static gboolean
+lz_get_length (const guchar **ip,
+               const guchar  *end,
+               gsize         *length)
+{
+  guchar b;
+
+  do
+    {
+      if (*ip >= end)
+        return FALSE;
+      b = *(*ip)++;
+      *length += b;
+    }
+  while (b == 255);
+
+  return TRUE;
+}
+
+/* decompresses exactly size bytes, checking all reads and writes */
+static gboolean
+lz_decompress (const guchar *src,
+               gsize         n,
+               guchar       *dst,
+               gsize         size)
+{
+  const guchar *ip   = src;
+  const guchar *iend = src + n;
+  guchar       *op   = dst;
+  guchar       *oend = dst + size;
+
+  while (ip < iend)
+    {
+      guchar token  = *ip++;
+      gsize  length = token >> 4;
+      gsize  offset;
+
+      if (length == 15 && !lz_get_length (&ip, iend, &length))
+        return FALSE;
+      if ((gsize) (iend - ip) < length || (gsize) (oend - op) < length)
+        return FALSE;
+      memcpy (op, ip, length);
+      op += length;
+      ip += length;
+
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return FALSE;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+
+      length = token & 15;
+      if (length == 15 && !lz_get_length (&ip, iend, &length))
+        return FALSE;
+      length += LZ_MIN_MATCH;
+
+      if (offset == 0 || (gsize) (op - dst) < offset ||
+          (gsize) (oend - op) < length)
+        return FALSE;
+
+      /* byte by byte, matches may overlap what they produce */
+      {
+        const guchar *ref = op - offset;
+
+        while (length--)
+          *op++ = *ref++;
+      }
+    }
+
+  return op == oend;
+}
+
+static void
+shuffle (const guchar *src,
+         guchar       *dst,
+         gsize         size,
+         gint          bpp)
+{
+  gsize n = size / bpp;
+  gint  b;
+  gsize i;
+
+  for (b = 0; b < bpp; b++)
+    {
+      guchar prev = 0;
+
+      for (i = 0; i < n; i++)
+        {
+          guchar v = src[i * bpp + b];
+
+          *dst++ = v - prev;
+          prev = v;
+        }
+    }
+}
+
+static void
+unshuffle (const guchar *src,
+           guchar       *dst,
+           gsize         size,
+           gint          bpp)
+{
+  gsize n = size / bpp;
+  gint  b;
+  gsize i;
+
+  for (b = 0; b < bpp; b++)
+    {
+      guchar prev = 0;
+
+      for (i = 0; i < n; i++)
+        {
+          prev += *src++;
+          dst[i * bpp + b] = prev;
+        }
+    }
+}
+
+gsize
+gegl_buffer_compress_tile (const guchar *data,
+                           gsize         tile_size,
+                           gint          bpp,
+                           guchar       *dest,
+                           guint32      *codec)
+{
+  guchar *planes;
+  gsize   length;
+
+  if (bpp < 1 || tile_size % bpp)
+    bpp = 1;
+
+  planes = g_malloc (tile_size);
+  shuffle (data, planes, tile_size, bpp);
+
+  /* only keep the result if it saves anything */
+  length = lz_compress (planes, tile_size, dest, tile_size - 1);
+  g_free (planes);
+
+  if (length == 0)
+    {
+      memcpy (dest, data, tile_size);
+      *codec = GEGL_TILE_CODEC_NONE;
+      return tile_size;
+    }
+
+  *codec = GEGL_TILE_CODEC_SHUFFLE_LZ;
+  return length;
+}
+
+gboolean
+gegl_buffer_decompress_tile (const guchar *src,
+                             gsize         length,
+                             guint32       codec,
+                             gint          bpp,
+                             guchar       *dest,
+                             gsize         tile_size)
+{
+  switch (codec)
+    {
+      case GEGL_TILE_CODEC_NONE:
+        if (length != tile_size)
+          return FALSE;
+        memcpy (dest, src, tile_size);
+        return TRUE;
+
+      case GEGL_TILE_CODEC_SHUFFLE_LZ:
+        {
+          guchar   *planes = g_malloc (tile_size);
+          gboolean  ok;
+
+          if (bpp < 1 || tile_size % bpp)
+            bpp = 1;
+
+          ok = lz_decompress (src, length, planes, tile_size);
+          if (ok)
+            unshuffle (planes, dest, tile_size, bpp);
+
+          g_free (planes);
+          return ok;
+        }
+
+      default:
+        return FALSE;
+    }
+}
@@ -0,0 +1,47 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_BUFFER_COMPRESS_H__
+#define __GEGL_BUFFER_COMPRESS_H__
+
+#include <glib.h>
+
+/* Lossless compression of tile data for buffers saved to disk, the codecs
+ * are listed in gegl-buffer-index.h.
+ */
+
+/* Compresses the tile_size bytes of data, made up of pixels of bpp bytes,
+ * into dest which must be able to hold tile_size bytes. Returns the number
+ * of bytes stored in dest and sets codec to the codec used, tiles that
+ * don't compress are stored as they are.
+ */
+gsize    gegl_buffer_compress_tile   (const guchar *data,
+                                      gsize         tile_size,
+                                      gint          bpp,
+                                      guchar       *dest,
+                                      guint32      *codec);
+
+/* Decompresses length bytes of src stored with codec into the tile_size
+ * bytes of dest, returns FALSE if src is not valid data for codec.
+ */
+gboolean gegl_buffer_decompress_tile (const guchar *src,
+                                      gsize         length,
+                                      guint32       codec,
+                                      gint          bpp,
+                                      guchar       *dest,
+                                      gsize         tile_size);
+
+#endif
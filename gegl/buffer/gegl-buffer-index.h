@@ -8,13 +8,19 @@ GeglBuffer on disk representation
 */
 
 
-/* Increase this number when the structures change.*/
-#define GEGL_FILE_SPEC_REV     0
+/* Increase this number when the structures change.
+ *
+ * 1: the index can contain GeglBufferCompressedTile entries.
+ */
+#define GEGL_FILE_SPEC_REV     1
 #define GEGL_MAGIC             {'G','E','G','L'}
 
 #define GEGL_FLAG_TILE         1
 #define GEGL_FLAG_FREE_TILE    0xf+2
 
+/* a tile stored compressed, see GeglBufferCompressedTile */
+#define GEGL_FLAG_COMPRESSED_TILE 3
+
 /* a VOID message, indicating that the specified tile has been rewritten */
 #define GEGL_FLAG_INVALIDATED  2
 
@@ -99,12 +105,26 @@ typedef struct {
                             own state when revision differs. */
 } GeglBufferTile;
 
+/* the ways tile data can be stored, see gegl-buffer-compress.c */
+#define GEGL_TILE_CODEC_NONE        0 /* raw pixels */
+#define GEGL_TILE_CODEC_SHUFFLE_LZ  1 /* delta coded byte planes, LZ77 */
+
+/* gegl_buffer_save writes the index as one contiguous run of these
+ * entries following the header, with the compressed tile data after it.
+ */
+typedef struct {
+  GeglBufferTile tile;   /* tile.block.flags is GEGL_FLAG_COMPRESSED_TILE */
+  guint32        length; /* number of bytes stored at tile.offset */
+  guint32        codec;  /* the GEGL_TILE_CODEC the data is stored with */
+} GeglBufferCompressedTile;
+
 /* A convenience union to allow quick and simple casting */
 typedef union {
-  guint32          length;
-  GeglBufferBlock  block;
-  GeglBufferHeader header;
-  GeglBufferTile   tile;
+  guint32                  length;
+  GeglBufferBlock          block;
+  GeglBufferHeader         header;
+  GeglBufferTile           tile;
+  GeglBufferCompressedTile compressed_tile;
 } GeglBufferItem;
 
 /* functions to initialize data structures */
@@ -141,7 +161,8 @@ GList          *gegl_buffer_read_index (int i,
     }
 #define GEGL_BUFFER_STRUCT_CHECK_PADDING \
   {struct_check_padding (GeglBufferBlock, 16);\
-  struct_check_padding (GeglBufferHeader, 256);}
+  struct_check_padding (GeglBufferHeader, 256);\
+  struct_check_padding (GeglBufferCompressedTile, 48);}
 #define GEGL_BUFFER_SANITY {static gboolean done=FALSE;if(!done){GEGL_BUFFER_STRUCT_CHECK_PADDING;done=TRUE;}}
 
 #endif
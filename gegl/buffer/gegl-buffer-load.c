@@ -44,6 +44,8 @@
 #include "gegl-cache.h"
 #include "gegl-region.h"
 #include "gegl-buffer-index.h"
+#include "gegl-buffer-compress.h"
+#include "gegl-parallel.h"
 #include "gegl-debug.h"
 
 #include <glib/gprintf.h>
@@ -127,6 +129,11 @@ gegl_buffer_read_header (int i,
     {
       g_warning ("Magic is wrong! %s", ret->header.magic);
     }
+  else if (gegl_buffer_header_get_rev (ret) > GEGL_FILE_SPEC_REV)
+    {
+      g_warning ("buffer file revision %i is newer than the supported %i",
+                 gegl_buffer_header_get_rev (ret), GEGL_FILE_SPEC_REV);
+    }
 
   return ret;
 }
@@ -165,6 +172,9 @@ static GeglBufferItem *read_block (int           i,
         case GEGL_FLAG_FREE_TILE:
           own_size = sizeof (GeglBufferTile);
           break;
+        case GEGL_FLAG_COMPRESSED_TILE:
+          own_size = sizeof (GeglBufferCompressedTile);
+          break;
         default:
           g_warning ("skipping unknown type of entry flags=%i", block.flags);
           break;
@@ -240,6 +250,209 @@ gegl_buffer_read_index (int           i,
 
 static void sanity(void) { GEGL_BUFFER_SANITY; }
 
+/* the number of bytes stored for a tile entry and how they are coded */
+static gsize
+entry_length (GeglBufferItem *item,
+              gint            tile_size,
+              guint32        *codec)
+{
+  if (item->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+    {
+      *codec = item->compressed_tile.codec;
+      return item->compressed_tile.length;
+    }
+
+  *codec = GEGL_TILE_CODEC_NONE;
+  return tile_size;
+}
+
+static gint
+offset_compare (gconstpointer a,
+                gconstpointer b)
+{
+  const GeglBufferTile *entryA = a;
+  const GeglBufferTile *entryB = b;
+
+  if (entryA->offset == entryB->offset)
+    return 0;
+  return entryA->offset < entryB->offset ? -1 : 1;
+}
+
+/* A batch of tiles being loaded, the stored data is read and the tiles are
+ * locked by the loading thread, and decompressed on the threads of
+ * gegl_parallel_distribute.
+ */
+typedef struct
+{
+  LoadInfo        *info;
+  GeglBufferItem **entries;
+  GeglTile       **tiles;
+  guchar         **data;    /* the stored data of each tile */
+  gsize           *length;
+  guint32         *codec;
+  gint             n;
+} LoadBatch;
+
+static void
+decompress_tiles (gint     i,
+                  gint     n,
+                  gpointer user_data)
+{
+  LoadBatch *batch = user_data;
+  gint       t;
+
+  for (t = i; t < batch->n; t += n)
+    {
+      guchar *dest = gegl_tile_get_data (batch->tiles[t]);
+
+      if (!gegl_buffer_decompress_tile (batch->data[t],
+                                        batch->length[t],
+                                        batch->codec[t],
+                                        batch->info->header.bytes_per_pixel,
+                                        dest,
+                                        batch->info->tile_size))
+        {
+          GeglBufferTile *entry = &batch->entries[t]->tile;
+
+          g_warning ("%s: corrupt tile %i,%i,%i in '%s'", G_STRFUNC,
+                     entry->x, entry->y, entry->z, batch->info->path);
+          memset (dest, 0, batch->info->tile_size);
+        }
+    }
+}
+
+/* loads the tiles of a file with compressed tiles, reading them in file
+ * order and decompressing a batch of them at a time in parallel
+ */
+static void
+load_compressed_tiles (LoadInfo   *info,
+                       GeglBuffer *buffer)
+{
+  GList     *iter;
+  LoadBatch  batch;
+  gint       max_batch = gegl_parallel_get_n_threads () * 4;
+  gint       loaded = 0;
+  gint       t;
+
+  info->tiles = g_list_sort (info->tiles, offset_compare);
+
+  batch.info    = info;
+  batch.entries = g_new (GeglBufferItem *, max_batch);
+  batch.tiles   = g_new (GeglTile *, max_batch);
+  batch.data    = g_new (guchar *, max_batch);
+  batch.length  = g_new (gsize, max_batch);
+  batch.codec   = g_new (guint32, max_batch);
+  for (t = 0; t < max_batch; t++)
+    batch.data[t] = g_malloc (info->tile_size);
+
+  iter = info->tiles;
+  while (iter)
+    {
+      for (batch.n = 0; iter && batch.n < max_batch; iter = iter->next)
+        {
+          GeglBufferItem *entry = iter->data;
+          gsize           length;
+          guint32         codec;
+          ssize_t         sz_read;
+
+          length = entry_length (entry, info->tile_size, &codec);
+          if (length > (gsize) info->tile_size)
+            {
+              g_warning ("%s: corrupt tile %i,%i,%i in '%s'", G_STRFUNC,
+                         entry->tile.x, entry->tile.y, entry->tile.z,
+                         info->path);
+              continue;
+            }
+
+          if (info->offset != entry->tile.offset)
+            seekto (info, entry->tile.offset);
+
+          sz_read = read (info->i, batch.data[batch.n], length);
+          if (sz_read != -1)
+            info->offset += sz_read;
+          if (sz_read != (ssize_t) length)
+            codec = G_MAXUINT32; /* treated as corrupt */
+
+          batch.entries[batch.n] = entry;
+          batch.tiles[batch.n] = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                                            entry->tile.x,
+                                                            entry->tile.y,
+                                                            entry->tile.z);
+          g_assert (batch.tiles[batch.n]);
+          gegl_tile_lock (batch.tiles[batch.n]);
+
+          batch.length[batch.n] = length;
+          batch.codec[batch.n] = codec;
+          batch.n++;
+        }
+
+      gegl_parallel_distribute (batch.n, decompress_tiles, &batch);
+
+      for (t = 0; t < batch.n; t++)
+        {
+          gegl_tile_unlock (batch.tiles[t]);
+          gegl_tile_unref (batch.tiles[t]);
+        }
+      loaded += batch.n;
+    }
+
+  for (t = 0; t < max_batch; t++)
+    g_free (batch.data[t]);
+  g_free (batch.data);
+  g_free (batch.length);
+  g_free (batch.codec);
+  g_free (batch.tiles);
+  g_free (batch.entries);
+
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded", loaded);
+}
+
+
+/* loads the tiles of a file with uncompressed tiles */
+static void
+load_tiles (LoadInfo   *info,
+            GeglBuffer *buffer)
+{
+  GList *iter;
+  gint   i = 0;
+  for (iter = info->tiles; iter; iter = iter->next)
+    {
+      GeglBufferTile *entry = iter->data;
+      guchar         *data;
+      GeglTile       *tile;
+
+
+      tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                        entry->x,
+                                        entry->y,
+                                        entry->z);
+
+      if (info->offset != entry->offset)
+        {
+          seekto (info, entry->offset);
+        }
+      /*g_assert (info->offset == entry->offset);*/
+
+
+      g_assert (tile);
+      gegl_tile_lock (tile);
+
+      data = gegl_tile_get_data (tile);
+      g_assert (data);
+
+      {
+        ssize_t sz_read = read (info->i, data, info->tile_size);
+        if(sz_read != -1)
+          info->offset += sz_read;
+      }
+      /*g_assert (info->offset == entry->offset + info->tile_size);*/
+
+      gegl_tile_unlock (tile);
+      gegl_tile_unref (tile);
+      i++;
+    }
+  GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded",i);
+}
 
 GeglBuffer *
 gegl_buffer_open (const gchar *path)
@@ -253,6 +466,7 @@ GeglBuffer *
 gegl_buffer_load (const gchar *path)
 {
   GeglBuffer *ret;
+  gboolean    compressed = FALSE;
 
   LoadInfo *info = g_slice_new0 (LoadInfo);
 
@@ -281,63 +495,49 @@ gegl_buffer_load (const gchar *path)
                        info->header.bytes_per_pixel;
   info->format       = babl_format (info->header.description);
 
-  ret = g_object_new (GEGL_TYPE_BUFFER,
-                      "format", info->format,
-                      "tile-width", info->header.tile_width,
-                      "tile-height", info->header.tile_height,
-                      "height", info->header.height,
-                      "width", info->header.width,
-                      "path", path,
-                      NULL);
-
-  /* sanity check, should probably report error condition and return safely instead
-  */
-  g_assert (babl_format_get_bytes_per_pixel (info->format) == info->header.bytes_per_pixel);
-
   info->tiles = gegl_buffer_read_index (info->i, &info->offset);
 
-  /* load each tile */
   {
     GList *iter;
-    gint   i = 0;
     for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferTile *entry = iter->data;
-        guchar         *data;
-        GeglTile       *tile;
-
-
-        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (ret),
-                                          entry->x,
-                                          entry->y,
-                                          entry->z);
-
-        if (info->offset != entry->offset)
-          {
-            seekto (info, entry->offset);
-          }
-        /*g_assert (info->offset == entry->offset);*/
-
+      if (((GeglBufferItem *) iter->data)->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+        compressed = TRUE;
+  }
 
-        g_assert (tile);
-        gegl_tile_lock (tile);
+  if (compressed)
+    {
+      /* a file with compressed tiles is decompressed into a buffer of its
+       * own rather than used as the backing store
+       */
+      ret = g_object_new (GEGL_TYPE_BUFFER,
+                          "format", info->format,
+                          "tile-width", info->header.tile_width,
+                          "tile-height", info->header.tile_height,
+                          "height", info->header.height,
+                          "width", info->header.width,
+                          NULL);
+    }
+  else
+    {
+      ret = g_object_new (GEGL_TYPE_BUFFER,
+                          "format", info->format,
+                          "tile-width", info->header.tile_width,
+                          "tile-height", info->header.tile_height,
+                          "height", info->header.height,
+                          "width", info->header.width,
+                          "path", path,
+                          NULL);
+    }
 
-        data = gegl_tile_get_data (tile);
-        g_assert (data);
+  /* sanity check, should probably report error condition and return safely instead
+  */
+  g_assert (babl_format_get_bytes_per_pixel (info->format) == info->header.bytes_per_pixel);
 
-        {
-          ssize_t sz_read = read (info->i, data, info->tile_size);
-          if(sz_read != -1)
-            info->offset += sz_read;
-        }
-        /*g_assert (info->offset == entry->offset + info->tile_size);*/
+  if (compressed)
+    load_compressed_tiles (info, ret);
+  else
+    load_tiles (info, ret);
 
-        gegl_tile_unlock (tile);
-        gegl_tile_unref (tile);
-        i++;
-      }
-    GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded",i);
-  }
   GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "buffer loaded %s", info->path);
 
   load_info_destroy (info);
@@ -46,6 +46,8 @@
 #include "gegl-utils.h"
 #include "gegl-buffer-save.h"
 #include "gegl-buffer-index.h"
+#include "gegl-buffer-compress.h"
+#include "gegl-parallel.h"
 
 typedef struct
 {
@@ -55,7 +57,8 @@ typedef struct
   int             o;
 
   gint             tile_size;
-  gint             offset;
+  gint             bpp;
+  goffset          offset;
   gint             entry_count;
   GeglBufferBlock *in_holding; /* we need to write one block added behind
                                 * to be able to recompute the forward pointing
@@ -85,6 +88,21 @@ gegl_tile_entry_destroy (GeglBufferTile *entry)
   g_free (entry);
 }
 
+static GeglBufferTile *
+compressed_tile_entry_new (gint x,
+                           gint y,
+                           gint z)
+{
+  GeglBufferTile *entry = g_malloc0 (sizeof(GeglBufferCompressedTile));
+  entry->block.flags = GEGL_FLAG_COMPRESSED_TILE;
+  entry->block.length = sizeof (GeglBufferCompressedTile);
+
+  entry->x = x;
+  entry->y = y;
+  entry->z = z;
+  return entry;
+}
+
 static gsize write_block (SaveInfo        *info,
                           GeglBufferBlock *block)
 {
@@ -111,6 +129,39 @@ static gsize write_block (SaveInfo        *info,
    return ret;
 }
 
+/* A batch of tiles being compressed, the tiles are fetched and written by
+ * the saving thread, and compressed on the threads of
+ * gegl_parallel_distribute.
+ */
+typedef struct
+{
+  SaveInfo                  *info;
+  GeglTile                 **tiles;
+  GeglBufferCompressedTile **entries;
+  guchar                   **data;   /* compressed data of each tile */
+  gint                       n;
+} SaveBatch;
+
+static void
+compress_tiles (gint     i,
+                gint     n,
+                gpointer user_data)
+{
+  SaveBatch *batch = user_data;
+  gint       t;
+
+  for (t = i; t < batch->n; t += n)
+    {
+      GeglBufferCompressedTile *entry = batch->entries[t];
+
+      entry->length = gegl_buffer_compress_tile (gegl_tile_get_data (batch->tiles[t]),
+                                                 batch->info->tile_size,
+                                                 batch->info->bpp,
+                                                 batch->data[t],
+                                                 &entry->codec);
+    }
+}
+
 static void
 save_info_destroy (SaveInfo *info)
 {
@@ -250,6 +301,7 @@ gegl_buffer_save (GeglBuffer          *buffer,
                            );
   info->header.next = (prediction += sizeof (GeglBufferHeader));
   info->tile_size = tile_width * tile_height * bpp;
+  info->bpp       = bpp;
 
   g_assert (info->tile_size % 16 == 0);
 
@@ -285,7 +337,7 @@ gegl_buffer_save (GeglBuffer          *buffer,
                                "Found tile to save, tx, ty, z = %d, %d, %d",
                                tx, ty, z);
 
-                    entry = gegl_tile_entry_new (tx, ty, z);
+                    entry = compressed_tile_entry_new (tx, ty, z);
                     info->tiles = g_list_prepend (info->tiles, entry);
                     info->entry_count++;
                   }
@@ -303,18 +355,16 @@ gegl_buffer_save (GeglBuffer          *buffer,
   /* sort the list of tiles into zorder */
   info->tiles = g_list_sort (info->tiles, z_order_compare);
 
-  /* set the offset in the file each tile will be stored on */
+  /* link up the index, which is written between the header and the tile
+   * data once the compressed size of each tile is known
+   */
   {
     GList *iter;
-    gint   predicted_offset = sizeof (GeglBufferHeader) +
-                              sizeof (GeglBufferTile) * (info->entry_count);
     for (iter = info->tiles; iter; iter = iter->next)
       {
         GeglBufferTile *entry = iter->data;
         entry->block.next = iter->next?
-                            (prediction += sizeof (GeglBufferTile)):0;
-        entry->offset = predicted_offset;
-        predicted_offset += info->tile_size;
+                            (prediction += sizeof (GeglBufferCompressedTile)):0;
       }
   }
 
@@ -326,50 +376,82 @@ gegl_buffer_save (GeglBuffer          *buffer,
   }
   g_assert (info->offset == info->header.next);
 
-  /* save the index */
+  /* compress and save the tiles, a batch at a time */
   {
-    GList *iter;
-    for (iter = info->tiles; iter; iter = iter->next)
+    GList     *iter = info->tiles;
+    SaveBatch  batch;
+    gint       max_batch = gegl_parallel_get_n_threads () * 4;
+    gint       t;
+
+    batch.info    = info;
+    batch.tiles   = g_new (GeglTile *, max_batch);
+    batch.entries = g_new (GeglBufferCompressedTile *, max_batch);
+    batch.data    = g_new (guchar *, max_batch);
+    for (t = 0; t < max_batch; t++)
+      batch.data[t] = g_malloc (info->tile_size);
+
+    info->offset = sizeof (GeglBufferHeader) +
+                   sizeof (GeglBufferCompressedTile) * info->entry_count;
+    if (lseek (info->o, info->offset, SEEK_SET) == -1)
+      g_warning ("%s: failed seeking in '%s'", G_STRFUNC, info->path);
+
+    while (iter)
       {
-        GeglBufferItem *item = iter->data;
+        for (batch.n = 0; iter && batch.n < max_batch; iter = iter->next)
+          {
+            GeglBufferCompressedTile *entry = iter->data;
+            GeglTile                 *tile;
+
+            tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                              entry->tile.x,
+                                              entry->tile.y,
+                                              entry->tile.z);
+            g_assert (tile);
+            g_assert (gegl_tile_get_data (tile));
+
+            batch.tiles[batch.n] = tile;
+            batch.entries[batch.n] = entry;
+            batch.n++;
+          }
 
-        write_block (info, &item->block);
+        gegl_parallel_distribute (batch.n, compress_tiles, &batch);
 
+        for (t = 0; t < batch.n; t++)
+          {
+            GeglBufferCompressedTile *entry = batch.entries[t];
+            ssize_t                   ret;
+
+            entry->tile.offset = info->offset;
+            ret = write (info->o, batch.data[t], entry->length);
+            if (ret != -1)
+              info->offset += ret;
+
+            gegl_tile_unref (batch.tiles[t]);
+          }
       }
-  }
-  write_block (info, NULL); /* terminate the index */
 
-  /* update header to point to start of new index (already done for
-   * this serial saver, and the header is already written.
-   */
+    for (t = 0; t < max_batch; t++)
+      g_free (batch.data[t]);
+    g_free (batch.data);
+    g_free (batch.entries);
+    g_free (batch.tiles);
+  }
 
-  /* save each tile */
+  /* save the index */
+  info->offset = info->header.next;
+  if (lseek (info->o, info->offset, SEEK_SET) == -1)
+    g_warning ("%s: failed seeking in '%s'", G_STRFUNC, info->path);
   {
     GList *iter;
-    gint   i = 0;
     for (iter = info->tiles; iter; iter = iter->next)
       {
-        GeglBufferTile *entry = iter->data;
-        guchar          *data;
-        GeglTile        *tile;
-
-        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
-                                          entry->x,
-                                          entry->y,
-                                          entry->z);
-        g_assert (tile);
-        data = gegl_tile_get_data (tile);
-        g_assert (data);
-
-        g_assert (info->offset == entry->offset);
-        {
-          ssize_t ret = write (info->o, data, info->tile_size);
-	      if (ret != -1)
-            info->offset += ret;
-        }
-        gegl_tile_unref (tile);
-        i++;
+        GeglBufferItem *item = iter->data;
+
+        write_block (info, &item->block);
+
       }
   }
+  write_block (info, NULL); /* terminate the index */
+
   save_info_destroy (info);
 }
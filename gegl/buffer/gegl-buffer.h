@@ -95,7 +95,9 @@ GeglBuffer *    gegl_buffer_open              (const gchar         *path);
  * @roi: the region of interest to write, this is the tiles that will be collected and
  * written to disk.
  *
- * Write a GeglBuffer to a file.
+ * Write a GeglBuffer to a file. The tiles are compressed losslessly, split
+ * across the number of threads set by the "threads" property of
+ * #GeglConfig.
  */
 void            gegl_buffer_save              (GeglBuffer          *buffer,
                                                const gchar         *path,
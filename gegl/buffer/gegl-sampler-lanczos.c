@@ -15,8 +15,13 @@
  *
  */
 
-/* XXX WARNING: This code compiles, but is functionally broken, and
- * currently not used by the rest of GeglBuffer */
+/* The 1-D Lanczos kernels are precomputed and normalized for every
+ * sub-pixel phase a sample can fall on (lanczos_spp phases per pixel), the
+ * tables are shared between all samplers with the same width and phase
+ * count and kept until gegl_exit (). A sample then amounts to a separable
+ * 2-D convolution, first horizontally per row of the context_rect, then
+ * vertically.
+ */
 
 
 #include "config.h"
@@ -43,6 +48,8 @@ enum
 
 static inline gdouble sinc (gdouble x);
 static void           lanczos_lookup (GeglSamplerLanczos *sampler);
+static gfloat *       lanczos_kernels_new      (gint          lanczos_width,
+                                                gint          lanczos_spp);
 static void           gegl_sampler_lanczos_get (GeglSampler  *sampler,
                                                 gdouble       x,
                                                 gdouble       y,
@@ -103,7 +110,7 @@ gegl_sampler_lanczos_class_init (GeglSamplerLanczosClass *klass)
 static void
 gegl_sampler_lanczos_init (GeglSamplerLanczos *self)
 {
-
+  GEGL_SAMPLER (self)->interpolate_format = babl_format ("RaGaBaA float");
 }
 
 static GObject *
@@ -133,11 +140,8 @@ finalize (GObject *object)
 {
   GeglSamplerLanczos *self    = GEGL_SAMPLER_LANCZOS (object);
 
-  if ( self->lanczos_lookup != NULL )
-    {
-       g_free (self->lanczos_lookup);
-       self->lanczos_lookup = NULL;
-     }
+  /* the kernel tables are owned by the shared cache */
+  self->lanczos_kernels = NULL;
 
   G_OBJECT_CLASS (gegl_sampler_lanczos_parent_class)->finalize (object);
 }
@@ -151,55 +155,46 @@ gegl_sampler_lanczos_get (GeglSampler *self,
 {
   GeglSamplerLanczos      *lanczos      = GEGL_SAMPLER_LANCZOS (self);
   GeglRectangle            context_rect = self->context_rect[0];
-  gfloat                  *sampler_bptr;
-  gdouble                  x_sum, y_sum;
-  gfloat                   newval[4] = {0.0, 0.0, 0.0, 0.0};
-  gint                     i, j;
-  gint                     spp    = lanczos->lanczos_spp;
-  gint                     width  = lanczos->lanczos_width;
-  gint                     width2 = context_rect.width;
-  gint                     dx,dy;
-  gint                     u,v;
-
-  /* FIXME: move the initialization of these arrays into the _prepare function
-   * to speed up actual resampling
-   */
-  gfloat                  *x_kernel, /* 1-D kernels of Lanczos window coeffs */
+  const gint               channels     = 4;
+  const gint               row_skip     = 64 * channels; /* rowstride of the
+                                                            sampler buffer */
+  gint                     spp          = lanczos->lanczos_spp;
+  gint                     width2       = context_rect.width;
+  gfloat                   newval[4]    = {0.0, 0.0, 0.0, 0.0};
+  const gfloat            *x_kernel,
                           *y_kernel;
+  const gfloat            *sampler_bptr;
+  gint                     ix, iy;
+  gint                     i, j;
 
-  x_kernel = g_newa (gfloat, width2);
-  y_kernel = g_newa (gfloat, width2);
+  ix = (gint) floor (x);
+  iy = (gint) floor (y);
 
-  self->interpolate_format = babl_format ("RaGaBaA float");
+  x_kernel = lanczos->lanczos_kernels + (gint) ((x - ix) * spp + 0.5) * width2;
+  y_kernel = lanczos->lanczos_kernels + (gint) ((y - iy) * spp + 0.5) * width2;
 
-  dx = (gint) ((x - ((gint) x)) * spp + 0.5);
-  dy = (gint) ((y - ((gint) y)) * spp + 0.5);
-  /* fill 1D kernels */
-  for (x_sum = y_sum = 0.0, i = width; i >= -width; i--)
-    {
-      gint pos    = i * spp;
-      x_sum += x_kernel[width + i] = lanczos->lanczos_lookup[ABS (dx - pos)];
-      y_sum += y_kernel[width + i] = lanczos->lanczos_lookup[ABS (dy - pos)];
-    }
+  sampler_bptr = gegl_sampler_get_ptr (self, ix, iy) +
+                 context_rect.y * row_skip + context_rect.x * channels;
 
-  /* normalise the weighted arrays */
-  for (i = 0; i < width2; i++)
+  for (j = 0; j < width2; j++)
     {
-      x_kernel[i] /= x_sum;
-      y_kernel[i] /= y_sum;
-    }
+      const gfloat *row    = sampler_bptr + j * row_skip;
+      gfloat        rowval[4] = {0.0, 0.0, 0.0, 0.0};
 
-  dx = (gint) x;
-  dy = (gint) y;
-  for (v=dy+context_rect.y, j = 0; v < dy+context_rect.y+context_rect.height; j++, v++)
-    for (u=dx+context_rect.x, i = 0; u < dx+context_rect.x+context_rect.width; i++, u++)
-      {
-         sampler_bptr = gegl_sampler_get_from_buffer (self, u, v);
-         newval[0] += y_kernel[j] * x_kernel[i] * sampler_bptr[0];
-         newval[1] += y_kernel[j] * x_kernel[i] * sampler_bptr[1];
-         newval[2] += y_kernel[j] * x_kernel[i] * sampler_bptr[2];
-         newval[3] += y_kernel[j] * x_kernel[i] * sampler_bptr[3];
-      }
+      for (i = 0; i < width2; i++)
+        {
+          rowval[0] += x_kernel[i] * row[0];
+          rowval[1] += x_kernel[i] * row[1];
+          rowval[2] += x_kernel[i] * row[2];
+          rowval[3] += x_kernel[i] * row[3];
+          row += channels;
+        }
+
+      newval[0] += y_kernel[j] * rowval[0];
+      newval[1] += y_kernel[j] * rowval[1];
+      newval[2] += y_kernel[j] * rowval[2];
+      newval[3] += y_kernel[j] * rowval[3];
+    }
 
   babl_process (self->fish, newval, output, 1);
 }
@@ -269,26 +264,78 @@ sinc (gdouble x)
   return sin (y) / y;
 }
 
+/* Builds one normalized kernel of lanczos_width * 2 + 1 taps for each of
+ * the lanczos_spp + 1 phases in [0.0, 1.0], where tap k weights the pixel
+ * k - lanczos_width away from the pixel the sample position floors to.
+ */
+static gfloat *
+lanczos_kernels_new (gint lanczos_width,
+                     gint lanczos_spp)
+{
+  const gint  width2  = lanczos_width * 2 + 1;
+  gfloat     *kernels = g_new (gfloat, (lanczos_spp + 1) * width2);
+  gint        phase;
+
+  for (phase = 0; phase <= lanczos_spp; phase++)
+    {
+      gfloat  *kernel = kernels + phase * width2;
+      gdouble  offset = (gdouble) phase / lanczos_spp;
+      gdouble  sum    = 0.0;
+      gint     k;
+
+      for (k = 0; k < width2; k++)
+        {
+          gdouble d = offset - (k - lanczos_width);
+
+          kernel[k] = (ABS (d) < lanczos_width) ?
+                      sinc (d) * sinc (d / lanczos_width) : 0.0;
+          sum += kernel[k];
+        }
+
+      for (k = 0; k < width2; k++)
+        kernel[k] /= sum;
+    }
+
+  return kernels;
+}
+
+/* kernel tables by width and phase count, kept until gegl_exit () */
+static GHashTable *kernels_cache = NULL;
+
+G_LOCK_DEFINE_STATIC (lanczos_kernels);
+
 static void
 lanczos_lookup (GeglSamplerLanczos *sampler)
 {
   GeglSamplerLanczos *self = GEGL_SAMPLER_LANCZOS (sampler);
+  gpointer            key;
 
-  const gint    lanczos_width = self->lanczos_width;
-  const gint    samples       = (self->lanczos_spp * (lanczos_width + 1));
-  const gdouble dx            = (gdouble) lanczos_width / (gdouble) (samples - 1);
-  gdouble x = 0.0;
-  gint    i;
+  /* lanczos_spp is at most 10000 */
+  key = GINT_TO_POINTER (self->lanczos_width * 10001 + self->lanczos_spp);
 
-  if (self->lanczos_lookup != NULL)
-    g_free (self->lanczos_lookup);
+  G_LOCK (lanczos_kernels);
+  if (kernels_cache == NULL)
+    kernels_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, g_free);
 
-  self->lanczos_lookup = g_new (gfloat, samples);
+  self->lanczos_kernels = g_hash_table_lookup (kernels_cache, key);
+  if (self->lanczos_kernels == NULL)
+    {
+      self->lanczos_kernels = lanczos_kernels_new (self->lanczos_width,
+                                                   self->lanczos_spp);
+      g_hash_table_insert (kernels_cache, key, self->lanczos_kernels);
+    }
+  G_UNLOCK (lanczos_kernels);
+}
 
-  for (i = 0; i < samples; i++)
+void gegl_sampler_lanczos_cleanup (void);
+void gegl_sampler_lanczos_cleanup (void)
+{
+  G_LOCK (lanczos_kernels);
+  if (kernels_cache)
     {
-      self->lanczos_lookup[i] = ((ABS (x) < lanczos_width) ?
-                                 (sinc (x) * sinc (x / lanczos_width)) : 0.0);
-      x += dx;
+      g_hash_table_destroy (kernels_cache);
+      kernels_cache = NULL;
     }
+  G_UNLOCK (lanczos_kernels);
 }
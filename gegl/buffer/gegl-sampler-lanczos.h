@@ -37,7 +37,7 @@ struct _GeglSamplerLanczos
   GeglSampler  parent_instance;
 
   /*< private >*/
-  gfloat      *lanczos_lookup;
+  gfloat      *lanczos_kernels;
   gint         lanczos_width;
   gint         lanczos_spp;
 };
@@ -2119,35 +2119,6 @@ gegl_sampler_lohalo_get (      GeglSampler* restrict self,
            * small context_rect, this is a waste.
            */
 
-          /*
-           * Grab the pixel values located within the context_rect of
-           * "pure" LBB-Nohalo.  Farther ones will be accessed through
-           * higher mipmap levels.
-           */
-          {
-            gint i = -LOHALO_OFFSET;
-            do
-              {
-                gint j = -LOHALO_OFFSET;
-                do
-                  {
-                    ewa_update (j,
-                                i,
-                                c_major_x,
-                                c_major_y,
-                                c_minor_x,
-                                c_minor_y,
-                                x_0,
-                                y_0,
-                                channels,
-                                row_skip,
-                                input_bptr,
-                                &total_weight,
-                                ewa_newval);
-                  } while ( ++j <= LOHALO_OFFSET );
-              } while ( ++i <= LOHALO_OFFSET );
-          }
-
           {
             /*
              * In order to know whether we use higher mipmap level
@@ -2246,6 +2217,65 @@ gegl_sampler_lohalo_get (      GeglSampler* restrict self,
              */
             const gfloat theta = (gfloat) ( (gdouble) 1. / ellipse_f );
 
+            /*
+             * Grab the pixel values located within the context_rect of
+             * "pure" LBB-Nohalo.  Farther ones will be accessed through
+             * higher mipmap levels.
+             *
+             * Teepee weights vanish outside of the ellipse, so only the
+             * part of the context_rect covered by its bounding box is
+             * visited. For moderate downsampling ratios this is a small
+             * fraction of the LOHALO_SIZE x LOHALO_SIZE stencil.
+             */
+            {
+              const gint in_left_0 =
+                LOHALO_MAX
+                  (
+                    (gint) ceilf ( x_0 - bounding_box_half_width ),
+                    -LOHALO_OFFSET
+                  );
+              const gint in_rite_0 =
+                LOHALO_MIN
+                  (
+                    (gint) floorf ( x_0 + bounding_box_half_width ),
+                    LOHALO_OFFSET
+                  );
+              const gint in_top_0 =
+                LOHALO_MAX
+                  (
+                    (gint) ceilf ( y_0 - bounding_box_half_height ),
+                    -LOHALO_OFFSET
+                  );
+              const gint in_bot_0 =
+                LOHALO_MIN
+                  (
+                    (gint) floorf ( y_0 + bounding_box_half_height ),
+                    LOHALO_OFFSET
+                  );
+              gint i;
+
+              for ( i = in_top_0; i <= in_bot_0; i++ )
+                {
+                  gint j;
+                  for ( j = in_left_0; j <= in_rite_0; j++ )
+                    {
+                      ewa_update (j,
+                                  i,
+                                  c_major_x,
+                                  c_major_y,
+                                  c_minor_x,
+                                  c_minor_y,
+                                  x_0,
+                                  y_0,
+                                  channels,
+                                  row_skip,
+                                  input_bptr,
+                                  &total_weight,
+                                  ewa_newval);
+                    }
+                }
+            }
+
             if (
                 ( x_0 - fudged_bounding_box_half_width  < closest_left )
                 ||
@@ -538,6 +538,9 @@ gegl_sampler_type_from_string (const gchar *string)
       g_str_equal (string, "bicubic"))
     return GEGL_SAMPLER_CUBIC;
 
+  if (g_str_equal (string, "lanczos"))
+    return GEGL_SAMPLER_LANCZOS;
+
   if (g_str_equal (string, "lohalo"))
     return GEGL_SAMPLER_LOHALO;
 
@@ -33,6 +33,7 @@
 #include "gegl-tile-backend.h"
 #include "gegl-tile-backend-file.h"
 #include "gegl-buffer-index.h"
+#include "gegl-buffer-compress.h"
 #include "gegl-buffer-types.h"
 #include "gegl-debug.h"
 //#include "gegl-types-internal.h"
@@ -128,9 +129,25 @@ gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
   gint     tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self));
   goffset  offset = entry->offset;
   guchar  *tdest = dest;
+  GeglBufferCompressedTile *compressed = NULL;
 
   gegl_tile_backend_file_ensure_exist (self);
 
+  /* tiles saved by gegl_buffer_save are stored compressed, they are read
+   * whole and decompressed into dest
+   */
+  if (entry->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+    {
+      compressed = (GeglBufferCompressedTile *) entry;
+      if (compressed->length > (guint32) tile_size)
+        {
+          g_warning ("corrupt compressed tile in buffer: %s", self->path);
+          return;
+        }
+      tile_size = compressed->length;
+      tdest = g_malloc (tile_size);
+    }
+
   if (self->foffset != offset)
     {
       success = (lseek (self->i, offset, SEEK_SET) >= 0);
@@ -155,12 +172,24 @@ gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
           g_message ("unable to read tile data from self: "
                      "%s (%d/%d bytes read) %s",
                      g_strerror (errno), byte_read, to_be_read, error?error->message:"--");
+          if (compressed)
+            g_free (tdest);
           return;
         }
       to_be_read -= byte_read;
       self->foffset += byte_read;
     }
 
+  if (compressed)
+    {
+      if (!gegl_buffer_decompress_tile (tdest, tile_size, compressed->codec,
+                                        GEGL_TILE_BACKEND (self)->priv->px_size,
+                                        dest,
+                                        gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self))))
+        g_warning ("corrupt compressed tile in buffer: %s", self->path);
+      g_free (tdest);
+    }
+
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
 }
 
@@ -261,8 +290,11 @@ gegl_tile_backend_file_file_entry_destroy (GeglBufferTile      *entry,
 {
   /* XXX: EEEk, throwing away bits */
   guint offset = entry->offset;
-  self->free_list = g_slist_prepend (self->free_list,
-                                     GUINT_TO_POINTER (offset));
+
+  /* the space of compressed tiles is smaller than a tile, and not reused */
+  if (entry->block.flags != GEGL_FLAG_COMPRESSED_TILE)
+    self->free_list = g_slist_prepend (self->free_list,
+                                       GUINT_TO_POINTER (offset));
   g_hash_table_remove (self->index, entry);
 
   gegl_tile_backend_file_dbg_dealloc (gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (self)));
@@ -460,6 +492,13 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
+  if (entry != NULL && entry->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+    {
+      /* compressed tiles are rewritten uncompressed in a new place */
+      gegl_tile_backend_file_file_entry_destroy (entry, tile_backend_file);
+      entry = NULL;
+    }
+
   if (entry == NULL)
     {
       entry    = gegl_tile_backend_file_file_entry_new (tile_backend_file);
@@ -777,6 +816,9 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
 
       if (item->tile.offset > max)
         max = item->tile.offset + tile_size;
+      if (item->block.flags == GEGL_FLAG_COMPRESSED_TILE &&
+          item->tile.offset + item->compressed_tile.length > max)
+        max = item->tile.offset + item->compressed_tile.length;
 
       if (existing)
         {
@@ -236,6 +236,23 @@ GEGL_DEFINE_DYNAMIC_OPERATION(GEGL_TYPE_OPERATION_POINT_RENDER)
 #endif
 
 
+#ifdef GEGL_CHANT_TYPE_REDUCE_FILTER
+struct _GeglChant
+{
+  GeglOperationReduceFilter parent_instance;
+  gpointer                  properties;
+};
+
+typedef struct
+{
+  GeglOperationReduceFilterClass parent_class;
+} GeglChantClass;
+
+GEGL_DEFINE_DYNAMIC_OPERATION(GEGL_TYPE_OPERATION_REDUCE_FILTER)
+
+#endif
+
+
 #ifdef GEGL_CHANT_TYPE_TEMPORAL
 struct _GeglChant
 {
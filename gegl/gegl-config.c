@@ -41,7 +41,8 @@ enum
   PROP_TILE_WIDTH,
   PROP_TILE_HEIGHT,
   PROP_THREADS,
-  PROP_USE_OPENCL
+  PROP_USE_OPENCL,
+  PROP_IMAGE_CACHE_SIZE
 };
 
 static void
@@ -90,6 +91,10 @@ gegl_config_get_property (GObject    *gobject,
         g_value_set_boolean (value, config->use_opencl);
         break;
 
+      case PROP_IMAGE_CACHE_SIZE:
+        g_value_set_int (value, config->image_cache_size);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -160,6 +165,9 @@ gegl_config_set_property (GObject      *gobject,
         if (config->use_opencl)
           gegl_cl_init (NULL);
 
+        break;
+      case PROP_IMAGE_CACHE_SIZE:
+        config->image_cache_size = g_value_get_int (value);
         break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
@@ -237,6 +245,11 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                      TRUE,
                                                      G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_IMAGE_CACHE_SIZE,
+                                   g_param_spec_int ("image-cache-size", "Image cache size", "size in bytes of the decoded images file loaders keep for reuse, 0 disables the cache",
+                                                     0, G_MAXINT, 128*1024*1024,
+                                                     G_PARAM_READWRITE));
+
 }
 
 static void
@@ -250,4 +263,5 @@ gegl_config_init (GeglConfig *self)
   self->tile_height = 64;
   self->threads = 1;
   self->use_opencl = TRUE;
+  self->image_cache_size = 128 * 1024 * 1024;
 }
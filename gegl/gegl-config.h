@@ -46,6 +46,7 @@ struct _GeglConfig
   gint     tile_height;
   gint     threads;
   gboolean use_opencl;
+  gint     image_cache_size;
 };
 
 struct _GeglConfigClass
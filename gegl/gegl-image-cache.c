@@ -0,0 +1,223 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+#include <glib/gstdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-config.h"
+#include "gegl-image-cache.h"
+
+#ifdef G_OS_WIN32
+#define realpath(a, b)    _fullpath (b, a, _MAX_PATH)
+#endif
+
+typedef struct
+{
+  gchar      *key;
+  time_t      mtime;
+  goffset     size;
+  GeglBuffer *buffer;
+  gsize       bytes;
+  GList      *link;   /* in the recently used list */
+} GeglImageCacheEntry;
+
+static GHashTable   *entries = NULL;
+static GQueue        recent  = G_QUEUE_INIT; /* most recently used first */
+static gsize         total   = 0;
+static GStaticMutex  mutex   = G_STATIC_MUTEX_INIT;
+
+static void
+gegl_image_cache_entry_free (GeglImageCacheEntry *entry)
+{
+  g_queue_delete_link (&recent, entry->link);
+  total -= entry->bytes;
+
+  g_object_unref (entry->buffer);
+  g_free (entry->key);
+  g_slice_free (GeglImageCacheEntry, entry);
+}
+
+static void
+gegl_image_cache_remove (GeglImageCacheEntry *entry)
+{
+  g_hash_table_remove (entries, entry->key);
+  gegl_image_cache_entry_free (entry);
+}
+
+/* Builds the key for path and params, and looks up the modification time
+ * and size of the file. Returns NULL for files that can't be stat'ed.
+ */
+static gchar *
+gegl_image_cache_key (const gchar *path,
+                      const gchar *params,
+                      time_t      *mtime,
+                      goffset     *size)
+{
+  struct stat  st;
+  gchar       *canonical;
+  gchar       *key;
+
+  if (!path || !strcmp (path, "-"))
+    return NULL;
+
+  canonical = realpath (path, NULL);
+  if (!canonical)
+    return NULL;
+
+  if (g_stat (canonical, &st) != 0 || !S_ISREG (st.st_mode))
+    {
+      free (canonical);
+      return NULL;
+    }
+
+  *mtime = st.st_mtime;
+  *size  = st.st_size;
+
+  key = g_strconcat (canonical, "\n", params ? params : "", NULL);
+  free (canonical);
+
+  return key;
+}
+
+gboolean
+gegl_image_cache_can_store (gsize bytes)
+{
+  return bytes <= (gsize) MAX (gegl_config ()->image_cache_size, 0);
+}
+
+GeglBuffer *
+gegl_image_cache_lookup (const gchar *path,
+                         const gchar *params)
+{
+  GeglImageCacheEntry *entry;
+  GeglBuffer          *buffer = NULL;
+  gchar               *key;
+  time_t               mtime;
+  goffset              size;
+
+  key = gegl_image_cache_key (path, params, &mtime, &size);
+  if (!key)
+    return NULL;
+
+  g_static_mutex_lock (&mutex);
+
+  entry = entries ? g_hash_table_lookup (entries, key) : NULL;
+
+  if (entry && (entry->mtime != mtime || entry->size != size))
+    {
+      /* the file changed since it was decoded */
+      gegl_image_cache_remove (entry);
+      entry = NULL;
+    }
+
+  if (entry)
+    {
+      g_queue_unlink (&recent, entry->link);
+      g_queue_push_head_link (&recent, entry->link);
+
+      buffer = g_object_ref (entry->buffer);
+    }
+
+  g_static_mutex_unlock (&mutex);
+
+  g_free (key);
+
+  return buffer;
+}
+
+void
+gegl_image_cache_insert (const gchar         *path,
+                         const gchar         *params,
+                         GeglBuffer          *buffer,
+                         const GeglRectangle *rect)
+{
+  GeglImageCacheEntry *entry;
+  GeglImageCacheEntry *old;
+  gchar               *key;
+  time_t               mtime;
+  goffset              size;
+  gsize                bytes;
+
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (rect != NULL);
+
+  bytes = (gsize) rect->width * rect->height *
+          babl_format_get_bytes_per_pixel (gegl_buffer_get_format (buffer));
+
+  if (!gegl_image_cache_can_store (bytes))
+    return;
+
+  key = gegl_image_cache_key (path, params, &mtime, &size);
+  if (!key)
+    return;
+
+  entry = g_slice_new (GeglImageCacheEntry);
+  entry->key    = key;
+  entry->mtime  = mtime;
+  entry->size   = size;
+  entry->bytes  = bytes;
+  entry->buffer = gegl_buffer_new (rect, gegl_buffer_get_format (buffer));
+
+  /* the copy shares the tiles of buffer until either of them is written */
+  gegl_buffer_copy (buffer, rect, entry->buffer, rect);
+
+  g_static_mutex_lock (&mutex);
+
+  if (!entries)
+    entries = g_hash_table_new (g_str_hash, g_str_equal);
+
+  old = g_hash_table_lookup (entries, key);
+  if (old)
+    gegl_image_cache_remove (old);
+
+  while (total + bytes > (gsize) gegl_config ()->image_cache_size &&
+         recent.tail)
+    gegl_image_cache_remove (recent.tail->data);
+
+  g_queue_push_head (&recent, entry);
+  entry->link = recent.head;
+  total += bytes;
+
+  g_hash_table_insert (entries, entry->key, entry);
+
+  g_static_mutex_unlock (&mutex);
+}
+
+void
+gegl_image_cache_clear (void)
+{
+  g_static_mutex_lock (&mutex);
+
+  while (recent.head)
+    gegl_image_cache_remove (recent.head->data);
+
+  if (entries)
+    {
+      g_hash_table_destroy (entries);
+      entries = NULL;
+    }
+
+  g_static_mutex_unlock (&mutex);
+}
@@ -0,0 +1,74 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_IMAGE_CACHE_H__
+#define __GEGL_IMAGE_CACHE_H__
+
+G_BEGIN_DECLS
+
+/* A process wide cache of decoded images for file loaders, shared by all
+ * nodes loading the same file. Entries are keyed by the canonical path,
+ * modification time and size of the file and by the loader parameters
+ * that affect the decoded pixels, and are dropped least recently used
+ * first to stay within GeglConfig:image-cache-size.
+ */
+
+/**
+ * gegl_image_cache_can_store:
+ * @bytes: the size of a decoded image.
+ *
+ * Returns TRUE if an image of @bytes bytes can be kept in the cache, a
+ * loader can use this to decide whether to decode the image as a whole.
+ */
+gboolean     gegl_image_cache_can_store (gsize                bytes);
+
+/**
+ * gegl_image_cache_lookup:
+ * @path: the file the image was decoded from.
+ * @params: the loader parameters the image was decoded with, or NULL.
+ *
+ * Returns a new reference to the buffer stored for @path and @params, or
+ * NULL if there is none or the file changed since it was stored. Copying
+ * from it with gegl_buffer_copy() shares its tiles where they line up.
+ */
+GeglBuffer * gegl_image_cache_lookup    (const gchar         *path,
+                                         const gchar         *params);
+
+/**
+ * gegl_image_cache_insert:
+ * @path: the file the image was decoded from.
+ * @params: the loader parameters the image was decoded with, or NULL.
+ * @buffer: a buffer holding the decoded image.
+ * @rect: the extent of the image in @buffer.
+ *
+ * Stores @rect of @buffer for later lookups, sharing the tiles of
+ * @buffer copy-on-write.
+ */
+void         gegl_image_cache_insert    (const gchar         *path,
+                                         const gchar         *params,
+                                         GeglBuffer          *buffer,
+                                         const GeglRectangle *rect);
+
+/**
+ * gegl_image_cache_clear:
+ *
+ * Drops all stored images.
+ */
+void         gegl_image_cache_clear     (void);
+
+G_END_DECLS
+
+#endif
@@ -93,6 +93,7 @@ guint gegl_debug_flags = 0;
 #include "operation/gegl-extension-handler.h"
 #include "buffer/gegl-buffer-private.h"
 #include "gegl-config.h"
+#include "gegl-image-cache.h"
 #include "graph/gegl-node.h"
 
 
@@ -207,6 +208,7 @@ static gchar   *cmd_gegl_quality=NULL;
 static gchar   *cmd_gegl_tile_size=NULL;
 static gchar   *cmd_babl_tolerance =NULL;
 static gchar   *cmd_gegl_threads=NULL;
+static gchar   *cmd_gegl_image_cache_size=NULL;
 
 static const GOptionEntry cmd_entries[]=
 {
@@ -245,6 +247,11 @@ static const GOptionEntry cmd_entries[]=
      G_OPTION_ARG_STRING, &cmd_gegl_threads,
      N_("The number of concurrent processing threads to use."), "<threads>"
     },
+    {
+     "gegl-image-cache-size", 0, 0,
+     G_OPTION_ARG_STRING, &cmd_gegl_image_cache_size,
+     N_("How much memory to use for keeping decoded image files"), "<megabytes>"
+    },
     { NULL }
 };
 
@@ -283,6 +290,8 @@ GeglConfig *gegl_config (void)
         config->cache_size = atoi(g_getenv("GEGL_CACHE_SIZE"))* 1024*1024;
       if (g_getenv ("GEGL_CHUNK_SIZE"))
         config->chunk_size = atoi(g_getenv("GEGL_CHUNK_SIZE"));
+      if (g_getenv ("GEGL_IMAGE_CACHE_SIZE"))
+        config->image_cache_size = atoi(g_getenv("GEGL_IMAGE_CACHE_SIZE"))* 1024*1024;
       if (g_getenv ("GEGL_TILE_SIZE"))
         {
           const gchar *str = g_getenv ("GEGL_TILE_SIZE");
@@ -356,13 +365,16 @@ static void swap_clean (void)
 }
 
 void gegl_tile_storage_cache_cleanup (void);
+void gegl_sampler_lanczos_cleanup (void);
 
 void
 gegl_exit (void)
 {
   glong timing = gegl_ticks ();
 
+  gegl_image_cache_clear ();
   gegl_tile_storage_cache_cleanup ();
+  gegl_sampler_lanczos_cleanup ();
   gegl_tile_cache_destroy ();
   gegl_operation_gtype_cleanup ();
   gegl_extension_handler_cleanup ();
@@ -497,6 +509,8 @@ gegl_post_parse_hook (GOptionContext *context,
     }
   if (cmd_gegl_threads)
     config->threads = atoi (cmd_gegl_threads);
+  if (cmd_gegl_image_cache_size)
+    config->image_cache_size = atoi (cmd_gegl_image_cache_size)*1024*1024;
   if (cmd_babl_tolerance)
     g_object_set (config, "babl-tolerance", atof(cmd_babl_tolerance), NULL);
 
@@ -0,0 +1,129 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-config.h"
+#include "gegl-parallel.h"
+#include "graph/gegl-node.h"
+
+typedef struct
+{
+  GeglParallelDistributeFunc func;
+  gpointer                   user_data;
+  gint                       n;
+  gint                       remaining;
+  GMutex                    *mutex;
+  GCond                     *cond;
+} GeglParallelTask;
+
+typedef struct
+{
+  GeglParallelTask *task;
+  gint              i;
+} GeglParallelJob;
+
+static GThreadPool    *pool = NULL;
+static GStaticMutex    pool_mutex = G_STATIC_MUTEX_INIT;
+static GStaticPrivate  in_parallel = G_STATIC_PRIVATE_INIT;
+
+static void
+gegl_parallel_run_job (GeglParallelJob *job)
+{
+  GeglParallelTask *task = job->task;
+
+  g_static_private_set (&in_parallel, GINT_TO_POINTER (TRUE), NULL);
+  task->func (job->i, task->n, task->user_data);
+  g_static_private_set (&in_parallel, GINT_TO_POINTER (FALSE), NULL);
+
+  g_mutex_lock (task->mutex);
+  if (--task->remaining == 0)
+    g_cond_signal (task->cond);
+  g_mutex_unlock (task->mutex);
+}
+
+static void
+gegl_parallel_worker (gpointer data,
+                      gpointer user_data)
+{
+  gegl_parallel_run_job (data);
+}
+
+gint
+gegl_parallel_get_n_threads (void)
+{
+  gint threads = gegl_config ()->threads;
+
+  return CLAMP (threads, 1, GEGL_MAX_THREADS);
+}
+
+void
+gegl_parallel_distribute (gint                       max_n,
+                          GeglParallelDistributeFunc func,
+                          gpointer                   user_data)
+{
+  GeglParallelTask task;
+  GeglParallelJob  jobs[GEGL_MAX_THREADS];
+  gint             n;
+  gint             i;
+
+  g_return_if_fail (func != NULL);
+
+  n = MIN (max_n, gegl_parallel_get_n_threads ());
+
+  if (n <= 1 || g_static_private_get (&in_parallel))
+    {
+      n = MAX (n, 1);
+      for (i = 0; i < n; i++)
+        func (i, n, user_data);
+      return;
+    }
+
+  g_static_mutex_lock (&pool_mutex);
+  if (pool == NULL)
+    pool = g_thread_pool_new (gegl_parallel_worker, NULL,
+                              GEGL_MAX_THREADS - 1, FALSE, NULL);
+  g_static_mutex_unlock (&pool_mutex);
+
+  task.func      = func;
+  task.user_data = user_data;
+  task.n         = n;
+  task.remaining = n;
+  task.mutex     = g_mutex_new ();
+  task.cond      = g_cond_new ();
+
+  for (i = 0; i < n; i++)
+    {
+      jobs[i].task = &task;
+      jobs[i].i    = i;
+    }
+
+  for (i = 1; i < n; i++)
+    g_thread_pool_push (pool, &jobs[i], NULL);
+  gegl_parallel_run_job (&jobs[0]);
+
+  g_mutex_lock (task.mutex);
+  while (task.remaining != 0)
+    g_cond_wait (task.cond, task.mutex);
+  g_mutex_unlock (task.mutex);
+
+  g_mutex_free (task.mutex);
+  g_cond_free (task.cond);
+}
@@ -0,0 +1,54 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_PARALLEL_H__
+#define __GEGL_PARALLEL_H__
+
+G_BEGIN_DECLS
+
+typedef void (* GeglParallelDistributeFunc) (gint     i,
+                                             gint     n,
+                                             gpointer user_data);
+
+/**
+ * gegl_parallel_get_n_threads:
+ *
+ * Returns the number of threads gegl_parallel_distribute() splits work
+ * across, following the "threads" property of #GeglConfig.
+ */
+gint gegl_parallel_get_n_threads (void);
+
+/**
+ * gegl_parallel_distribute:
+ * @max_n: the largest number of parts the work can be split in.
+ * @func: function called for each part.
+ * @user_data: passed on to @func.
+ *
+ * Calls @func (i, n, user_data) for i from 0 to n - 1, where n is the
+ * smaller of @max_n and the number of threads, with the calls running
+ * concurrently. The calling thread runs one of the parts itself, and the
+ * function returns once all of them are done.
+ *
+ * Calls made from within a running part are executed serially in the
+ * calling thread, so nesting is safe.
+ */
+void gegl_parallel_distribute (gint                       max_n,
+                               GeglParallelDistributeFunc func,
+                               gpointer                   user_data);
+
+G_END_DECLS
+
+#endif
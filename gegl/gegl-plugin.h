@@ -39,6 +39,7 @@ typedef struct _GeglConnection       GeglConnection;
 #include <gegl-matrix.h>
 #include <gegl-utils.h>
 #include <gegl-buffer.h>
+#include <gegl-image-cache.h>
 #include <gegl-paramspecs.h>
 #include <gmodule.h>
 
@@ -145,6 +146,7 @@ typedef struct
 #include <operation/gegl-operation-point-composer.h>
 #include <operation/gegl-operation-point-composer3.h>
 #include <operation/gegl-operation-point-render.h>
+#include <operation/gegl-operation-reduce-filter.h>
 #include <operation/gegl-operation-temporal.h>
 #include <operation/gegl-operation-source.h>
 #include <operation/gegl-operation-sink.h>
@@ -0,0 +1,415 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-operation-reduce-filter.h"
+#include "gegl-parallel.h"
+#include "gegl-utils.h"
+#include "graph/gegl-node.h"
+
+#include "opencl/gegl-cl.h"
+#include "buffer/gegl-buffer-cl-iterator.h"
+
+/* rows of the input fetched at a time by the reduce phase */
+#define REDUCE_BAND_HEIGHT 128
+
+/* statistics are shared by the threads processing the map phase, which
+ * keep them alive while the node is invalidated underneath them
+ */
+typedef struct
+{
+  gint     ref_count;
+  gpointer data;
+} ReduceStatistics;
+
+struct _GeglOperationReduceFilterPrivate
+{
+  GMutex           *mutex;
+  ReduceStatistics *statistics;
+};
+
+typedef struct
+{
+  GeglOperation  *operation;
+  gint            pass;
+  gconstpointer   statistics;
+  gpointer       *partials;
+  guchar         *buf;
+  gint            width;
+  gint            height;
+  gint            bpp;
+} ReduceBand;
+
+static void     gegl_operation_reduce_filter_finalize (GObject       *object);
+static void     attach                                (GeglOperation *operation);
+static void     prepare                               (GeglOperation *operation);
+static GeglRectangle get_required_for_output          (GeglOperation       *operation,
+                                                       const gchar         *input_pad,
+                                                       const GeglRectangle *roi);
+static GeglRectangle get_invalidated_by_change        (GeglOperation       *operation,
+                                                       const gchar         *input_pad,
+                                                       const GeglRectangle *input_region);
+static gboolean gegl_operation_reduce_filter_process  (GeglOperation       *operation,
+                                                       GeglBuffer          *input,
+                                                       GeglBuffer          *output,
+                                                       const GeglRectangle *result);
+
+G_DEFINE_TYPE (GeglOperationReduceFilter, gegl_operation_reduce_filter, GEGL_TYPE_OPERATION_FILTER)
+
+#define GEGL_OPERATION_REDUCE_FILTER_GET_PRIVATE(obj) \
+  G_TYPE_INSTANCE_GET_PRIVATE (obj, GEGL_TYPE_OPERATION_REDUCE_FILTER, GeglOperationReduceFilterPrivate)
+
+static void
+gegl_operation_reduce_filter_class_init (GeglOperationReduceFilterClass *klass)
+{
+  GObjectClass             *object_class    = G_OBJECT_CLASS (klass);
+  GeglOperationClass       *operation_class = GEGL_OPERATION_CLASS (klass);
+  GeglOperationFilterClass *filter_class    = GEGL_OPERATION_FILTER_CLASS (klass);
+
+  object_class->finalize = gegl_operation_reduce_filter_finalize;
+
+  operation_class->attach                    = attach;
+  operation_class->prepare                   = prepare;
+  operation_class->get_required_for_output   = get_required_for_output;
+  operation_class->get_invalidated_by_change = get_invalidated_by_change;
+
+  filter_class->process = gegl_operation_reduce_filter_process;
+
+  klass->passes          = 1;
+  klass->statistics_free = g_free;
+
+  g_type_class_add_private (klass, sizeof (GeglOperationReduceFilterPrivate));
+}
+
+static void
+gegl_operation_reduce_filter_init (GeglOperationReduceFilter *self)
+{
+  self->priv = GEGL_OPERATION_REDUCE_FILTER_GET_PRIVATE (self);
+  self->priv->mutex      = g_mutex_new ();
+  self->priv->statistics = NULL;
+}
+
+static void
+reduce_statistics_unref (GeglOperationReduceFilter *self,
+                         ReduceStatistics          *statistics)
+{
+  GeglOperationReduceFilterClass *klass;
+
+  if (!g_atomic_int_dec_and_test (&statistics->ref_count))
+    return;
+
+  klass = GEGL_OPERATION_REDUCE_FILTER_GET_CLASS (self);
+  klass->statistics_free (statistics->data);
+  g_slice_free (ReduceStatistics, statistics);
+}
+
+static void
+gegl_operation_reduce_filter_invalidate (GeglOperationReduceFilter *self)
+{
+  ReduceStatistics *statistics;
+
+  g_mutex_lock (self->priv->mutex);
+  statistics             = self->priv->statistics;
+  self->priv->statistics = NULL;
+  g_mutex_unlock (self->priv->mutex);
+
+  if (statistics)
+    reduce_statistics_unref (self, statistics);
+}
+
+static void
+gegl_operation_reduce_filter_finalize (GObject *object)
+{
+  GeglOperationReduceFilter *self = GEGL_OPERATION_REDUCE_FILTER (object);
+
+  gegl_operation_reduce_filter_invalidate (self);
+  g_mutex_free (self->priv->mutex);
+
+  G_OBJECT_CLASS (gegl_operation_reduce_filter_parent_class)->finalize (object);
+}
+
+/* the node is invalidated both when the input changes and when one of the
+ * properties does, statistics may depend on either, like the normalization
+ * of a tone mapping operator does
+ */
+static void
+node_invalidated (GeglNode            *node,
+                  const GeglRectangle *rect,
+                  gpointer             user_data)
+{
+  gegl_operation_reduce_filter_invalidate (GEGL_OPERATION_REDUCE_FILTER (user_data));
+}
+
+static void
+attach (GeglOperation *operation)
+{
+  GEGL_OPERATION_CLASS (gegl_operation_reduce_filter_parent_class)->attach (operation);
+
+  g_signal_connect_object (operation->node, "invalidated",
+                           G_CALLBACK (node_invalidated), operation, 0);
+}
+
+static void
+prepare (GeglOperation *operation)
+{
+  gegl_operation_set_format (operation, "input", babl_format ("RGBA float"));
+  gegl_operation_set_format (operation, "output", babl_format ("RGBA float"));
+}
+
+static GeglRectangle
+get_required_for_output (GeglOperation       *operation,
+                         const gchar         *input_pad,
+                         const GeglRectangle *roi)
+{
+  GeglOperationReduceFilter *self = GEGL_OPERATION_REDUCE_FILTER (operation);
+  GeglRectangle             *in_rect;
+  gboolean                   reduced;
+
+  g_mutex_lock (self->priv->mutex);
+  reduced = self->priv->statistics != NULL;
+  g_mutex_unlock (self->priv->mutex);
+
+  in_rect = gegl_operation_source_get_bounding_box (operation, "input");
+
+  /* the reduce phase needs all of the input, once it has run the map phase
+   * only needs the pixels below the roi
+   */
+  if (reduced || !in_rect)
+    return *roi;
+  return *in_rect;
+}
+
+static GeglRectangle
+get_invalidated_by_change (GeglOperation       *operation,
+                           const gchar         *input_pad,
+                           const GeglRectangle *input_region)
+{
+  GeglRectangle *in_rect;
+
+  /* any input pixel can change the statistics, and with them all of the
+   * output
+   */
+  in_rect = gegl_operation_source_get_bounding_box (operation, "input");
+  if (in_rect)
+    return *in_rect;
+  return *input_region;
+}
+
+static void
+reduce_band_part (gint     i,
+                  gint     n,
+                  gpointer user_data)
+{
+  ReduceBand                     *band  = user_data;
+  GeglOperationReduceFilterClass *klass;
+  gint                            first = band->height * i / n;
+  gint                            last  = band->height * (i + 1) / n;
+
+  if (last <= first)
+    return;
+
+  klass = GEGL_OPERATION_REDUCE_FILTER_GET_CLASS (band->operation);
+  klass->reduce (band->operation, band->pass,
+                 band->statistics, band->partials[i],
+                 band->buf + (gsize) first * band->width * band->bpp,
+                 (glong) (last - first) * band->width);
+}
+
+static gpointer
+gegl_operation_reduce_filter_reduce (GeglOperation *operation,
+                                     GeglBuffer    *input)
+{
+  GeglOperationReduceFilterClass *klass;
+  const Babl                     *format;
+  GeglRectangle                  *in_rect;
+  GeglRectangle                   rect;
+  ReduceBand                      band;
+  gpointer                        statistics;
+  gpointer                       *partials;
+  gint                            n_partials;
+  gint                            pass;
+  gint                            i;
+
+  klass  = GEGL_OPERATION_REDUCE_FILTER_GET_CLASS (operation);
+  format = gegl_operation_get_format (operation, "input");
+
+  statistics = klass->statistics_new (operation);
+
+  in_rect = gegl_operation_source_get_bounding_box (operation, "input");
+  if (!in_rect || in_rect->width <= 0 || in_rect->height <= 0)
+    {
+      for (pass = 0; pass < klass->passes; pass++)
+        if (klass->finish)
+          klass->finish (operation, pass, statistics);
+      return statistics;
+    }
+  rect = *in_rect;
+
+  n_partials = MIN (gegl_parallel_get_n_threads (), REDUCE_BAND_HEIGHT);
+  partials   = g_new (gpointer, n_partials);
+
+  band.operation = operation;
+  band.statistics = statistics;
+  band.partials  = partials;
+  band.width     = rect.width;
+  band.bpp       = babl_format_get_bytes_per_pixel (format);
+  band.buf       = g_malloc ((gsize) rect.width * REDUCE_BAND_HEIGHT * band.bpp);
+
+  for (pass = 0; pass < klass->passes; pass++)
+    {
+      gint y;
+
+      band.pass = pass;
+
+      for (i = 0; i < n_partials; i++)
+        partials[i] = klass->statistics_new (operation);
+
+      for (y = rect.y; y < rect.y + rect.height; y += REDUCE_BAND_HEIGHT)
+        {
+          GeglRectangle band_rect = { rect.x, y, rect.width,
+                                      MIN (REDUCE_BAND_HEIGHT,
+                                           rect.y + rect.height - y) };
+
+          gegl_buffer_get (input, 1.0, &band_rect, format, band.buf,
+                           GEGL_AUTO_ROWSTRIDE);
+
+          band.height = band_rect.height;
+          gegl_parallel_distribute (n_partials, reduce_band_part, &band);
+        }
+
+      for (i = 0; i < n_partials; i++)
+        {
+          klass->merge (operation, pass, statistics, partials[i]);
+          klass->statistics_free (partials[i]);
+        }
+
+      if (klass->finish)
+        klass->finish (operation, pass, statistics);
+    }
+
+  g_free (band.buf);
+  g_free (partials);
+
+  return statistics;
+}
+
+static gboolean
+gegl_operation_reduce_filter_cl_process (GeglOperation       *operation,
+                                         gconstpointer        statistics,
+                                         GeglBuffer          *input,
+                                         GeglBuffer          *output,
+                                         const GeglRectangle *result)
+{
+  const Babl *in_format  = gegl_operation_get_format (operation, "input");
+  const Babl *out_format = gegl_operation_get_format (operation, "output");
+  GeglOperationReduceFilterClass *klass;
+  GeglBufferClIterator           *i;
+  gint                            read;
+  gint                            j;
+  cl_int                          cl_err = 0;
+  gboolean                        err;
+
+  klass = GEGL_OPERATION_REDUCE_FILTER_GET_CLASS (operation);
+
+  if (!gegl_cl_color_babl (in_format,  NULL) ||
+      !gegl_cl_color_babl (out_format, NULL))
+    return FALSE;
+
+  i    = gegl_buffer_cl_iterator_new (output, result, out_format, GEGL_CL_BUFFER_WRITE);
+  read = gegl_buffer_cl_iterator_add (i, input, result, in_format, GEGL_CL_BUFFER_READ);
+
+  while (gegl_buffer_cl_iterator_next (i, &err))
+    {
+      if (err) return FALSE;
+      for (j=0; j < i->n; j++)
+        {
+          cl_err = klass->cl_process (operation, statistics,
+                                      i->tex[read][j], i->tex[0][j],
+                                      i->size[0][j], &i->roi[0][j]);
+          if (cl_err != CL_SUCCESS)
+            {
+              g_warning ("[OpenCL] Error in %s [GeglOperationReduceFilter] Kernel\n",
+                         GEGL_OPERATION_CLASS (klass)->name);
+              return FALSE;
+            }
+        }
+    }
+  return TRUE;
+}
+
+static gboolean
+gegl_operation_reduce_filter_process (GeglOperation       *operation,
+                                      GeglBuffer          *input,
+                                      GeglBuffer          *output,
+                                      const GeglRectangle *result)
+{
+  GeglOperationReduceFilter      *self = GEGL_OPERATION_REDUCE_FILTER (operation);
+  GeglOperationReduceFilterClass *klass;
+  const Babl                     *in_format;
+  const Babl                     *out_format;
+  ReduceStatistics               *statistics;
+
+  klass      = GEGL_OPERATION_REDUCE_FILTER_GET_CLASS (operation);
+  in_format  = gegl_operation_get_format (operation, "input");
+  out_format = gegl_operation_get_format (operation, "output");
+
+  if (result->width <= 0 || result->height <= 0)
+    return TRUE;
+
+  /* when several threads render parts of the output before the statistics
+   * are known, the first one reduces while the others wait for it
+   */
+  g_mutex_lock (self->priv->mutex);
+  if (!self->priv->statistics)
+    {
+      statistics            = g_slice_new (ReduceStatistics);
+      statistics->ref_count = 1;
+      statistics->data      = gegl_operation_reduce_filter_reduce (operation, input);
+      self->priv->statistics = statistics;
+    }
+  statistics = self->priv->statistics;
+  g_atomic_int_inc (&statistics->ref_count);
+  g_mutex_unlock (self->priv->mutex);
+
+  if (cl_state.is_accelerated && klass->cl_process)
+    {
+      if (gegl_operation_reduce_filter_cl_process (operation, statistics->data,
+                                                   input, output, result))
+        {
+          reduce_statistics_unref (self, statistics);
+          return TRUE;
+        }
+    }
+
+  {
+    GeglBufferIterator *i = gegl_buffer_iterator_new (output, result, out_format, GEGL_BUFFER_WRITE);
+    gint read = gegl_buffer_iterator_add (i, input, result, in_format, GEGL_BUFFER_READ);
+
+    while (gegl_buffer_iterator_next (i))
+      klass->process (operation, statistics->data, i->data[read], i->data[0],
+                      i->length, &i->roi[0]);
+  }
+
+  reduce_statistics_unref (self, statistics);
+
+  return TRUE;
+}
@@ -0,0 +1,116 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* GeglOperationReduceFilter
+ * Base class for filters where an output pixel depends on the corresponding
+ * input pixel and on statistics of the whole input, like its minimum,
+ * maximum or average. Processing happens in two phases:
+ *
+ * The reduce phase walks the entire input bounding box in bands, splitting
+ * each band among threads that accumulate into their own partial
+ * statistics, which are merged once the band walk is done. This can be
+ * repeated for several passes, when statistics depend on earlier ones. The
+ * result is kept by the operation until its input or one of its properties
+ * changes.
+ *
+ * The map phase is a point filter with access to the statistics, once they
+ * are known only the requested region of the input is computed, so small
+ * regions of interest do not force rendering the whole image.
+ */
+
+#ifndef __GEGL_OPERATION_REDUCE_FILTER_H__
+#define __GEGL_OPERATION_REDUCE_FILTER_H__
+
+#include "gegl-operation-filter.h"
+
+#include "opencl/gegl-cl.h"
+
+G_BEGIN_DECLS
+
+#define GEGL_TYPE_OPERATION_REDUCE_FILTER            (gegl_operation_reduce_filter_get_type ())
+#define GEGL_OPERATION_REDUCE_FILTER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEGL_TYPE_OPERATION_REDUCE_FILTER, GeglOperationReduceFilter))
+#define GEGL_OPERATION_REDUCE_FILTER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GEGL_TYPE_OPERATION_REDUCE_FILTER, GeglOperationReduceFilterClass))
+#define GEGL_IS_OPERATION_REDUCE_FILTER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GEGL_TYPE_OPERATION_REDUCE_FILTER))
+#define GEGL_IS_OPERATION_REDUCE_FILTER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GEGL_TYPE_OPERATION_REDUCE_FILTER))
+#define GEGL_OPERATION_REDUCE_FILTER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GEGL_TYPE_OPERATION_REDUCE_FILTER, GeglOperationReduceFilterClass))
+
+typedef struct _GeglOperationReduceFilter         GeglOperationReduceFilter;
+typedef struct _GeglOperationReduceFilterPrivate  GeglOperationReduceFilterPrivate;
+struct _GeglOperationReduceFilter
+{
+  GeglOperationFilter               parent_instance;
+  GeglOperationReduceFilterPrivate *priv;
+};
+
+typedef struct _GeglOperationReduceFilterClass GeglOperationReduceFilterClass;
+struct _GeglOperationReduceFilterClass
+{
+  GeglOperationFilterClass parent_class;
+
+  /* number of reduce passes over the input, defaults to 1 */
+  gint       passes;
+
+  /* allocates empty statistics, used both for the final statistics and for
+   * the partial statistics of every thread in a pass
+   */
+  gpointer (* statistics_new)  (GeglOperation *self);
+  void     (* statistics_free) (gpointer       statistics);
+
+  /* accumulates samples pixels of in_buf, in the input format, into
+   * partial; statistics holds the results of the earlier passes
+   */
+  void     (* reduce)          (GeglOperation *self,
+                                gint           pass,
+                                gconstpointer  statistics,
+                                gpointer       partial,
+                                void          *in_buf,
+                                glong          samples);
+
+  /* adds partial to statistics */
+  void     (* merge)           (GeglOperation *self,
+                                gint           pass,
+                                gpointer       statistics,
+                                gconstpointer  partial);
+
+  /* optional, called on statistics once all partials of a pass are merged */
+  void     (* finish)          (GeglOperation *self,
+                                gint           pass,
+                                gpointer       statistics);
+
+  /* maps samples pixels of in_buf to out_buf, like
+   * GeglOperationPointFilterClass::process
+   */
+  gboolean (* process)         (GeglOperation       *self,
+                                gconstpointer        statistics,
+                                void                *in_buf,
+                                void                *out_buf,
+                                glong                samples,
+                                const GeglRectangle *roi);
+
+  /* optional */
+  cl_int   (* cl_process)      (GeglOperation       *self,
+                                gconstpointer        statistics,
+                                cl_mem               in_tex,
+                                cl_mem               out_tex,
+                                size_t               global_worksize,
+                                const GeglRectangle *roi);
+};
+
+GType gegl_operation_reduce_filter_get_type (void) G_GNUC_CONST;
+
+G_END_DECLS
+
+#endif
@@ -86,6 +86,9 @@ static GeglNode    * gegl_affine_detect                    (GeglOperation
 static gboolean      gegl_affine_matrix3_allow_fast_translate      (GeglMatrix3 *matrix);
 static gboolean      gegl_affine_matrix3_allow_fast_reflect_x      (GeglMatrix3 *matrix);
 static gboolean      gegl_affine_matrix3_allow_fast_reflect_y      (GeglMatrix3 *matrix);
+static gint          gegl_affine_matrix3_get_mipmap_level          (GeglMatrix3 *matrix);
+static gint          gegl_affine_get_mipmap_level          (OpAffine    *affine,
+                                                            GeglMatrix3 *matrix);
 
 static void          gegl_affine_fast_reflect_x            (GeglBuffer           *dest,
                                                             GeglBuffer           *src,
@@ -665,9 +668,9 @@ affine_generic (GeglBuffer  *dest,
 
   format = babl_format ("RaGaBaA float");
 
-  /* XXX: fast paths as existing in files in the same dir as affine.c
-   *      should probably be hooked in here, and bailing out before using
-   *      the generic code.
+  /* the fast paths (buffer shifting for integer translations, reflections
+   * and reading downscales from a mipmap level) are picked in
+   * gegl_affine_process before ending up here.
    */
   g_object_get (dest, "pixels", &dest_pixels, NULL);
   dest_extent = gegl_buffer_get_extent (dest);
@@ -714,15 +717,164 @@ affine_generic (GeglBuffer  *dest,
     }
 }
 
+/* The number of times a downscale can be halved before sampling, that is
+ * the mipmap level to resample from; 0 when the generic path should read
+ * the full resolution data.
+ */
+#define GEGL_AFFINE_MAX_MIPMAP_LEVEL 8
+
+static void
+affine_downscaled (GeglBuffer  *dest,
+                   GeglBuffer  *src,
+                   GeglMatrix3 *matrix,
+                   const gchar *filter,
+                   gint         level)
+{
+  const Babl          *format = babl_format ("RaGaBaA float");
+  const GeglRectangle *dest_extent = gegl_buffer_get_extent (dest);
+  const gint           factor = 1 << level;
+  GeglMatrix3          inverse;
+  GeglMatrix3          level_matrix;
+  GeglMatrix3          downscale;
+  GeglRectangle        need_rect;
+  GeglRectangle        level_rect;
+  GeglBuffer          *level_buffer;
+  GeglSampler         *sampler;
+  GeglRectangle        context_rect;
+  gfloat              *buf;
+  gdouble              need_points [8];
+  gint                 i;
+
+  gegl_matrix3_copy_into (&inverse, matrix);
+  gegl_matrix3_invert (&inverse);
+
+  need_points [0] = dest_extent->x;
+  need_points [1] = dest_extent->y;
+
+  need_points [2] = dest_extent->x + dest_extent->width;
+  need_points [3] = dest_extent->y;
+
+  need_points [4] = dest_extent->x + dest_extent->width;
+  need_points [5] = dest_extent->y + dest_extent->height;
+
+  need_points [6] = dest_extent->x;
+  need_points [7] = dest_extent->y + dest_extent->height;
+
+  for (i = 0; i < 8; i += 2)
+    gegl_matrix3_transform_point (&inverse,
+                                  need_points + i, need_points + i + 1);
+  gegl_affine_bounding_box (need_points, 4, &need_rect);
+
+  sampler = gegl_buffer_sampler_new (NULL, format,
+                                     gegl_sampler_type_from_string (filter));
+  context_rect = *gegl_sampler_get_context_rect (sampler);
+  g_object_unref (sampler);
+
+  /* the region of the mipmap level covering need_rect, grown by the
+   * sampler context (counted in level pixels) and a pixel of slack for
+   * rounding
+   */
+  level_rect.x      = floor ((gdouble) need_rect.x / factor) + context_rect.x - 1;
+  level_rect.y      = floor ((gdouble) need_rect.y / factor) + context_rect.y - 1;
+  level_rect.width  = ceil ((gdouble) (need_rect.x + need_rect.width) / factor)
+                      - level_rect.x + context_rect.width + 2;
+  level_rect.height = ceil ((gdouble) (need_rect.y + need_rect.height) / factor)
+                      - level_rect.y + context_rect.height + 2;
+
+  /* reading with a scale of 1/2^level copies the tiles the
+   * GeglTileHandlerZoom builds for that level, without fetching the full
+   * resolution data
+   */
+  buf = g_new (gfloat, level_rect.width * level_rect.height * 4);
+  gegl_buffer_get (src, 1.0 / factor, &level_rect, format,
+                   buf, GEGL_AUTO_ROWSTRIDE);
+  level_buffer = gegl_buffer_linear_new_from_data (buf, format, &level_rect,
+                                                   GEGL_AUTO_ROWSTRIDE,
+                                                   (GCallback) g_free, NULL);
+
+  /* pixel (i, j) of the level averages the factor x factor block of
+   * source pixels whose center is at (i * factor + (factor - 1) / 2, ...)
+   */
+  gegl_matrix3_identity (&downscale);
+  downscale.coeff [0][0] = factor;
+  downscale.coeff [1][1] = factor;
+  downscale.coeff [0][2] = (factor - 1) / 2.0;
+  downscale.coeff [1][2] = (factor - 1) / 2.0;
+  gegl_matrix3_multiply (matrix, &downscale, &level_matrix);
+
+  sampler = gegl_buffer_sampler_new (level_buffer, format,
+                                     gegl_sampler_type_from_string (filter));
+  affine_generic (dest, level_buffer, &level_matrix, sampler);
+  g_object_unref (sampler);
+  g_object_unref (level_buffer);
+}
+
 static gboolean
 gegl_affine_matrix3_allow_fast_translate (GeglMatrix3 *matrix)
 {
-  if (! GEGL_FLOAT_EQUAL (matrix->coeff[0][2], (gint) matrix->coeff[0][2]) ||
-      ! GEGL_FLOAT_EQUAL (matrix->coeff[1][2], (gint) matrix->coeff[1][2]))
+  if (! GEGL_FLOAT_EQUAL (matrix->coeff[0][2], floor (matrix->coeff[0][2] + 0.5)) ||
+      ! GEGL_FLOAT_EQUAL (matrix->coeff[1][2], floor (matrix->coeff[1][2] + 0.5)))
     return FALSE;
   return gegl_matrix3_is_translate (matrix);
 }
 
+static gint
+gegl_affine_matrix3_get_mipmap_level (GeglMatrix3 *matrix)
+{
+  gdouble a, b, c, d;
+  gdouble sum, det, max_scale;
+  gint    level = 0;
+
+  if (! GEGL_FLOAT_IS_ZERO (matrix->coeff[2][0]) ||
+      ! GEGL_FLOAT_IS_ZERO (matrix->coeff[2][1]) ||
+      ! GEGL_FLOAT_EQUAL (matrix->coeff[2][2], 1.0))
+    return 0;
+
+  a = matrix->coeff[0][0];
+  b = matrix->coeff[0][1];
+  c = matrix->coeff[1][0];
+  d = matrix->coeff[1][1];
+
+  /* the largest singular value of the forward jacobian is the strongest
+   * magnification; its reciprocal is how much the transform shrinks the
+   * source along its least reduced direction.
+   */
+  sum = a * a + b * b + c * c + d * d;
+  det = a * d - b * c;
+  max_scale = sqrt ((sum + sqrt (MAX (sum * sum - 4 * det * det, 0.0))) / 2.0);
+
+  if (max_scale <= 0.0)
+    return 0;
+
+  while (level < GEGL_AFFINE_MAX_MIPMAP_LEVEL &&
+         max_scale * (2 << level) <= 1.0 + 1e-6)
+    level++;
+
+  return level;
+}
+
+/* The mipmap level to resample from, 0 to keep reading the full
+ * resolution data. Averaging the source first changes the result, so this
+ * is only done when trading quality for speed; nearest should keep picking
+ * source pixels and lohalo does its own mipmapping.
+ */
+static gint
+gegl_affine_get_mipmap_level (OpAffine    *affine,
+                              GeglMatrix3 *matrix)
+{
+  gdouble quality;
+
+  if (!strcmp (affine->filter, "nearest") ||
+      !strcmp (affine->filter, "lohalo"))
+    return 0;
+
+  g_object_get (gegl_config (), "quality", &quality, NULL);
+  if (quality >= 1.0)
+    return 0;
+
+  return gegl_affine_matrix3_get_mipmap_level (matrix);
+}
+
 static gboolean
 gegl_affine_matrix3_allow_fast_reflect_x (GeglMatrix3 *matrix)
 {
@@ -838,6 +990,7 @@ gegl_affine_process (GeglOperation        *operation,
   GeglBuffer          *output;
   GeglMatrix3          matrix;
   OpAffine            *affine = (OpAffine *) operation;
+  gint                 mipmap_level;
 
   gegl_affine_create_composite_matrix (affine, &matrix);
 
@@ -863,8 +1016,8 @@ gegl_affine_process (GeglOperation        *operation,
 
       output = g_object_new (GEGL_TYPE_BUFFER,
                              "source",    input,
-                             "shift-x",   (int)-matrix.coeff[0][2],
-                             "shift-y",   (int)-matrix.coeff[1][2],
+                             "shift-x",   (int) -floor (matrix.coeff[0][2] + 0.5),
+                             "shift-y",   (int) -floor (matrix.coeff[1][2] + 0.5),
                              "abyss-width", -1,  /* turn of abyss
                                                     (relying on abyss
                                                     of source) */
@@ -937,6 +1090,19 @@ gegl_affine_process (GeglOperation        *operation,
       gegl_affine_fast_reflect_y (output, input, result, &src_rect);
       g_object_unref (sampler);
 
+      if (input != NULL)
+        g_object_unref (input);
+    }
+  else if ((mipmap_level = gegl_affine_get_mipmap_level (affine, &matrix)) > 0)
+    {
+      /* downscaling by 2x or more, resample from a mipmap level instead of
+       * the full resolution data.
+       */
+      input  = gegl_operation_context_get_source (context, "input");
+      output = gegl_operation_context_get_target (context, "output");
+
+      affine_downscaled (output, input, &matrix, affine->filter, mipmap_level);
+
       if (input != NULL)
         g_object_unref (input);
     }
@@ -0,0 +1,269 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Rectangle statistics in constant time, for area filters that look at
+ * the mean, variance or extremes of many overlapping rectangles.
+ *
+ * A SummedAreaTable is built once from the float buffer an operation
+ * processes, after which the sum (and optionally the sum of squares) of
+ * any rectangle of it is four lookups, independent of the size of the
+ * rectangle. Sums are kept in double precision so subtracting the large
+ * corner values does not eat the significant digits of small rectangles.
+ *
+ * box_extreme_map computes the minimum or maximum over every size x size
+ * square of one component in O(1) per pixel, with the van Herk/Gil-Werman
+ * running extreme applied separably, box_extreme_map_clipped the same
+ * counting only the pixels within a rectangle of the buffer.
+ */
+
+#ifndef __AREA_STATISTICS_H__
+#define __AREA_STATISTICS_H__
+
+typedef struct
+{
+  gint     width;
+  gint     height;
+  gint     components;
+  gdouble *sum;     /* (width + 1) * (height + 1) * components, with a
+                       leading row and column of zeros */
+  gdouble *sum_sq;  /* same layout, or NULL if not requested */
+} SummedAreaTable;
+
+static inline SummedAreaTable *
+summed_area_table_new (const gfloat *buf,
+                       gint          width,
+                       gint          height,
+                       gint          components,
+                       gboolean      squares)
+{
+  SummedAreaTable *table  = g_new0 (SummedAreaTable, 1);
+  gint             stride = (width + 1) * components;
+  gint             x, y, c;
+
+  table->width      = width;
+  table->height     = height;
+  table->components = components;
+  table->sum        = g_new0 (gdouble, stride * (height + 1));
+  if (squares)
+    table->sum_sq   = g_new0 (gdouble, stride * (height + 1));
+
+  for (y = 0; y < height; y++)
+    {
+      const gfloat *src    = buf + y * width * components;
+      gdouble      *row    = table->sum + (y + 1) * stride + components;
+      gdouble      *row_sq = squares ? table->sum_sq + (y + 1) * stride + components
+                                     : NULL;
+      for (x = 0; x < width; x++)
+        {
+          for (c = 0; c < components; c++)
+            {
+              row[c] = src[c] + row[c - components]
+                     + row[c - stride] - row[c - stride - components];
+              if (row_sq)
+                row_sq[c] = (gdouble) src[c] * src[c] + row_sq[c - components]
+                          + row_sq[c - stride] - row_sq[c - stride - components];
+            }
+          src += components;
+          row += components;
+          if (row_sq)
+            row_sq += components;
+        }
+    }
+
+  return table;
+}
+
+static inline void
+summed_area_table_free (SummedAreaTable *table)
+{
+  g_free (table->sum);
+  g_free (table->sum_sq);
+  g_free (table);
+}
+
+/* Computes the per component mean, and variance if the table has squares
+ * and variance is not NULL, of the width x height rectangle with its top
+ * left corner at (x, y). The rectangle is clipped to the table, returns
+ * the number of pixels it covered.
+ */
+static inline gint
+summed_area_table_get_stats (const SummedAreaTable *table,
+                             gint                   x,
+                             gint                   y,
+                             gint                   width,
+                             gint                   height,
+                             gfloat                *mean,
+                             gfloat                *variance)
+{
+  const gint stride = (table->width + 1) * table->components;
+  gint       x0 = CLAMP (x, 0, table->width);
+  gint       y0 = CLAMP (y, 0, table->height);
+  gint       x1 = CLAMP (x + width, 0, table->width);
+  gint       y1 = CLAMP (y + height, 0, table->height);
+  gint       count = (x1 - x0) * (y1 - y0);
+  gint       tl, tr, bl, br;
+  gint       c;
+
+  if (count <= 0)
+    {
+      for (c = 0; c < table->components; c++)
+        {
+          mean[c] = 0.0;
+          if (variance)
+            variance[c] = 0.0;
+        }
+      return 0;
+    }
+
+  tl = y0 * stride + x0 * table->components;
+  tr = y0 * stride + x1 * table->components;
+  bl = y1 * stride + x0 * table->components;
+  br = y1 * stride + x1 * table->components;
+
+  for (c = 0; c < table->components; c++)
+    {
+      gdouble sum = table->sum[br + c] - table->sum[bl + c]
+                  - table->sum[tr + c] + table->sum[tl + c];
+      gdouble m   = sum / count;
+
+      mean[c] = m;
+
+      if (variance && table->sum_sq)
+        {
+          gdouble sum_sq = table->sum_sq[br + c] - table->sum_sq[bl + c]
+                         - table->sum_sq[tr + c] + table->sum_sq[tl + c];
+          gdouble v      = sum_sq / count - m * m;
+
+          variance[c] = v > 0.0 ? v : 0.0;
+        }
+    }
+
+  return count;
+}
+
+#define AREA_EXTREME(a, b, maximum) ((maximum) ? MAX ((a), (b)) : MIN ((a), (b)))
+
+static inline void
+running_extreme (const gfloat *in,
+                 gint          in_stride,
+                 gint          n,
+                 gint          size,
+                 gboolean      maximum,
+                 gfloat       *out,
+                 gint          out_stride,
+                 gfloat       *prefix,
+                 gfloat       *suffix)
+{
+  gint i;
+
+  /* extremes from the start of each block of size values, and towards its
+   * end, every window of size values spans the end of one block and the
+   * start of the next
+   */
+  for (i = 0; i < n; i++)
+    prefix[i] = (i % size == 0) ? in[i * in_stride]
+                : AREA_EXTREME (prefix[i - 1], in[i * in_stride], maximum);
+
+  for (i = n - 1; i >= 0; i--)
+    suffix[i] = (i % size == size - 1 || i == n - 1) ? in[i * in_stride]
+                : AREA_EXTREME (suffix[i + 1], in[i * in_stride], maximum);
+
+  for (i = 0; i + size <= n; i++)
+    out[i * out_stride] = AREA_EXTREME (suffix[i], prefix[i + size - 1], maximum);
+}
+
+/* Fills out with the minimum (or maximum) of the given component over the
+ * size x size square with its top left corner at each position of the
+ * width x height buffer; out is (width - size + 1) x (height - size + 1).
+ */
+static inline void
+box_extreme_map (const gfloat *buf,
+                 gint          width,
+                 gint          height,
+                 gint          components,
+                 gint          component,
+                 gint          size,
+                 gboolean      maximum,
+                 gfloat       *out)
+{
+  gint    out_width  = width - size + 1;
+  gint    out_height = height - size + 1;
+  gfloat *tmp        = g_new (gfloat, out_width * height);
+  gfloat *prefix     = g_new (gfloat, MAX (width, height));
+  gfloat *suffix     = g_new (gfloat, MAX (width, height));
+  gint    x, y;
+
+  if (out_width <= 0 || out_height <= 0)
+    {
+      g_free (tmp);
+      g_free (prefix);
+      g_free (suffix);
+      return;
+    }
+
+  for (y = 0; y < height; y++)
+    running_extreme (buf + y * width * components + component, components,
+                     width, size, maximum,
+                     tmp + y * out_width, 1,
+                     prefix, suffix);
+
+  for (x = 0; x < out_width; x++)
+    running_extreme (tmp + x, out_width,
+                     height, size, maximum,
+                     out + x, out_width,
+                     prefix, suffix);
+
+  g_free (tmp);
+  g_free (prefix);
+  g_free (suffix);
+}
+
+/* Like box_extreme_map, but only the pixels within valid (in buffer
+ * coordinates) count towards the extremes. Squares without any such pixel
+ * get G_MAXFLOAT as their minimum and -G_MAXFLOAT as their maximum.
+ */
+static inline void
+box_extreme_map_clipped (const gfloat        *buf,
+                         gint                 width,
+                         gint                 height,
+                         gint                 components,
+                         gint                 component,
+                         const GeglRectangle *valid,
+                         gint                 size,
+                         gboolean             maximum,
+                         gfloat              *out)
+{
+  gfloat *plane = g_new (gfloat, width * height);
+  gfloat  fill  = maximum ? -G_MAXFLOAT : G_MAXFLOAT;
+  gint    x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gboolean inside = x >= valid->x && x < valid->x + valid->width &&
+                          y >= valid->y && y < valid->y + valid->height;
+
+        plane[y * width + x] =
+          inside ? buf[(y * width + x) * components + component] : fill;
+      }
+
+  box_extreme_map (plane, width, height, 1, 0, size, maximum, out);
+  g_free (plane);
+}
+
+#undef AREA_EXTREME
+
+#endif
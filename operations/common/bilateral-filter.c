@@ -35,6 +35,7 @@ gegl_chant_double (edge_preservation, _("Edge preservation"), 0.0, 70.0, 8.0,
 #define GEGL_CHANT_C_FILE       "bilateral-filter.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 #include <math.h>
 
 static void
@@ -209,6 +210,325 @@ process (GeglOperation       *operation,
   return  TRUE;
 }
 
+/* Bilateral grid, used for large radii: every channel is splatted into a
+ * grid over (x, y, value) downsampled by the spatial and range standard
+ * deviations, blurred with a unit gaussian along all three axes and sliced
+ * back with trilinear interpolation. The cost per pixel no longer depends
+ * on the radius. Unlike the direct filter, each channel is weighted by its
+ * own differences instead of the distance between colors.
+ */
+
+#define GRID_MIN_RADIUS 10.0  /* smaller radii use the direct filter */
+#define GRID_PADDING    2     /* half size of the [1 4 6 4 1] blur kernel */
+#define GRID_MAX_CELLS  16    /* grid cells per input pixel before giving up */
+
+typedef struct
+{
+  const gfloat        *src_buf;
+  const GeglRectangle *src_rect;
+  gfloat              *dst_buf;
+  const GeglRectangle *dst_rect;
+
+  gfloat               space_sample;
+  gfloat               range_sample;
+  gint                 origin_x;
+  gint                 origin_y;
+  gint                 origin_z[4];
+
+  gint                 width;
+  gint                 height;
+  gint                 depth[4];
+  /* per channel, (value, weight) pairs indexed by ((z * height) + y) * width + x */
+  gfloat              *grid[4];
+} BilateralGrid;
+
+static inline gint
+grid_index (const BilateralGrid *grid,
+            gint                 x,
+            gint                 y,
+            gint                 z)
+{
+  return ((z * grid->height) + y) * grid->width + x;
+}
+
+/* splats the pixels falling into the grid rows assigned to this thread */
+static void
+grid_splat (gint     thread,
+            gint     threads,
+            gpointer data)
+{
+  BilateralGrid       *grid     = data;
+  const GeglRectangle *src_rect = grid->src_rect;
+  gint                 first    = grid->height * thread / threads;
+  gint                 last     = grid->height * (thread + 1) / threads;
+  gint                 x, y, c;
+
+  for (y = 0; y < src_rect->height; y++)
+    {
+      const gfloat *src = grid->src_buf + y * src_rect->width * 4;
+      gint          gy  = floor ((src_rect->y + y) / grid->space_sample + 0.5) -
+                          grid->origin_y;
+
+      if (gy < first || gy >= last)
+        continue;
+
+      for (x = 0; x < src_rect->width; x++, src += 4)
+        {
+          gint gx = floor ((src_rect->x + x) / grid->space_sample + 0.5) -
+                    grid->origin_x;
+
+          for (c = 0; c < 4; c++)
+            {
+              gint    gz   = floor (src[c] / grid->range_sample + 0.5) -
+                             grid->origin_z[c];
+              gfloat *cell = grid->grid[c] + grid_index (grid, gx, gy, gz) * 2;
+
+              cell[0] += src[c];
+              cell[1] += 1.0;
+            }
+        }
+    }
+}
+
+static inline void
+grid_blur_line (gfloat *line,
+                gint    stride,
+                gint    length,
+                gfloat *temp)
+{
+  gint i;
+
+  for (i = 0; i < length; i++)
+    {
+      temp[(i + 2) * 2 + 0] = line[i * stride + 0];
+      temp[(i + 2) * 2 + 1] = line[i * stride + 1];
+    }
+  temp[0] = temp[1] = temp[2] = temp[3] = 0.0;
+  temp[(length + 2) * 2 + 0] = temp[(length + 2) * 2 + 1] = 0.0;
+  temp[(length + 3) * 2 + 0] = temp[(length + 3) * 2 + 1] = 0.0;
+
+  for (i = 0; i < length; i++)
+    {
+      const gfloat *t = temp + i * 2;
+
+      line[i * stride + 0] = (t[0] + 4.0f * t[2] + 6.0f * t[4] +
+                              4.0f * t[6] + t[8]) * (1.0f / 16.0f);
+      line[i * stride + 1] = (t[1] + 4.0f * t[3] + 6.0f * t[5] +
+                              4.0f * t[7] + t[9]) * (1.0f / 16.0f);
+    }
+}
+
+/* blurs along x and y in the z slices assigned to this thread, the slices
+ * of all channels are numbered one after the other
+ */
+static void
+grid_blur_xy (gint     thread,
+              gint     threads,
+              gpointer data)
+{
+  BilateralGrid *grid  = data;
+  gint           total = grid->depth[0] + grid->depth[1] +
+                         grid->depth[2] + grid->depth[3];
+  gfloat        *temp  = g_new (gfloat, (MAX (grid->width, grid->height) +
+                                         GRID_PADDING * 2) * 2);
+  gint           slice;
+
+  for (slice = total * thread / threads;
+       slice < total * (thread + 1) / threads;
+       slice++)
+    {
+      gint    c = 0;
+      gint    z = slice;
+      gfloat *plane;
+      gint    x, y;
+
+      while (z >= grid->depth[c])
+        z -= grid->depth[c++];
+
+      plane = grid->grid[c] + grid_index (grid, 0, 0, z) * 2;
+
+      for (y = 0; y < grid->height; y++)
+        grid_blur_line (plane + y * grid->width * 2, 2, grid->width, temp);
+      for (x = 0; x < grid->width; x++)
+        grid_blur_line (plane + x * 2, grid->width * 2, grid->height, temp);
+    }
+
+  g_free (temp);
+}
+
+/* blurs along z in the rows assigned to this thread */
+static void
+grid_blur_z (gint     thread,
+             gint     threads,
+             gpointer data)
+{
+  BilateralGrid *grid  = data;
+  gint           total = grid->height * 4;
+  gint           stride = grid->width * grid->height * 2;
+  gfloat        *temp  = g_new (gfloat, (MAX (MAX (grid->depth[0], grid->depth[1]),
+                                              MAX (grid->depth[2], grid->depth[3])) +
+                                         GRID_PADDING * 2) * 2);
+  gint           row;
+
+  for (row = total * thread / threads;
+       row < total * (thread + 1) / threads;
+       row++)
+    {
+      gint c = row / grid->height;
+      gint y = row % grid->height;
+      gint x;
+
+      for (x = 0; x < grid->width; x++)
+        grid_blur_line (grid->grid[c] + grid_index (grid, x, y, 0) * 2,
+                        stride, grid->depth[c], temp);
+    }
+
+  g_free (temp);
+}
+
+/* interpolates the output rows assigned to this thread from the grid */
+static void
+grid_slice (gint     thread,
+            gint     threads,
+            gpointer data)
+{
+  BilateralGrid       *grid     = data;
+  const GeglRectangle *src_rect = grid->src_rect;
+  const GeglRectangle *dst_rect = grid->dst_rect;
+  gint                 last     = dst_rect->height * (thread + 1) / threads;
+  gint                 x, y, c;
+
+  for (y = dst_rect->height * thread / threads; y < last; y++)
+    {
+      const gfloat *src = grid->src_buf +
+                          ((y + dst_rect->y - src_rect->y) * src_rect->width +
+                           dst_rect->x - src_rect->x) * 4;
+      gfloat       *dst = grid->dst_buf + y * dst_rect->width * 4;
+      gfloat        fy  = (dst_rect->y + y) / grid->space_sample -
+                          grid->origin_y;
+      gint          gy  = CLAMP ((gint) floor (fy), 0, grid->height - 2);
+      gfloat        ty  = fy - gy;
+
+      for (x = 0; x < dst_rect->width; x++, src += 4, dst += 4)
+        {
+          gfloat fx = (dst_rect->x + x) / grid->space_sample - grid->origin_x;
+          gint   gx = CLAMP ((gint) floor (fx), 0, grid->width - 2);
+          gfloat tx = fx - gx;
+
+          for (c = 0; c < 4; c++)
+            {
+              gfloat  fz = src[c] / grid->range_sample - grid->origin_z[c];
+              gint    gz = CLAMP ((gint) floor (fz), 0, grid->depth[c] - 2);
+              gfloat  tz = fz - gz;
+              gfloat  sum[2] = { 0.0, 0.0 };
+              gint    i;
+
+              for (i = 0; i < 8; i++)
+                {
+                  gint          dx   = i & 1;
+                  gint          dy   = (i >> 1) & 1;
+                  gint          dz   = i >> 2;
+                  gfloat        w    = (dx ? tx : 1.0f - tx) *
+                                       (dy ? ty : 1.0f - ty) *
+                                       (dz ? tz : 1.0f - tz);
+                  const gfloat *cell = grid->grid[c] +
+                                       grid_index (grid, gx + dx, gy + dy,
+                                                   gz + dz) * 2;
+
+                  sum[0] += w * cell[0];
+                  sum[1] += w * cell[1];
+                }
+
+              dst[c] = sum[1] > 0.0f ? sum[0] / sum[1] : src[c];
+            }
+        }
+    }
+}
+
+/* Returns FALSE, leaving dst_buf untouched, if the range of values in the
+ * input is too large for the grid to be smaller than the direct filter's
+ * work.
+ */
+static gboolean
+bilateral_grid (const gfloat        *src_buf,
+                const GeglRectangle *src_rect,
+                gfloat              *dst_buf,
+                const GeglRectangle *dst_rect,
+                gdouble              radius,
+                gdouble              preserve)
+{
+  BilateralGrid grid;
+  gfloat        min[4], max[4];
+  glong         cells = 0;
+  gint          n     = src_rect->width * src_rect->height;
+  gint          i, c;
+
+  /* the direct filter weights by exp (-0.5 d^2 / radius) and by
+   * exp (-preserve * dc^2), sample the grid at one standard deviation
+   */
+  grid.space_sample = sqrt (radius);
+  grid.range_sample = preserve > 0.0 ? 1.0 / sqrt (2.0 * preserve) : G_MAXFLOAT;
+
+  for (c = 0; c < 4; c++)
+    {
+      min[c] = G_MAXFLOAT;
+      max[c] = -G_MAXFLOAT;
+    }
+  for (i = 0; i < n; i++)
+    for (c = 0; c < 4; c++)
+      {
+        min[c] = MIN (min[c], src_buf[i * 4 + c]);
+        max[c] = MAX (max[c], src_buf[i * 4 + c]);
+      }
+
+  /* cells are aligned to absolute coordinates and values, so results do
+   * not depend on how the output is split
+   */
+  grid.origin_x = floor (src_rect->x / grid.space_sample + 0.5) - GRID_PADDING;
+  grid.origin_y = floor (src_rect->y / grid.space_sample + 0.5) - GRID_PADDING;
+  grid.width    = floor ((src_rect->x + src_rect->width - 1) /
+                         grid.space_sample + 0.5) - grid.origin_x +
+                  GRID_PADDING + 1;
+  grid.height   = floor ((src_rect->y + src_rect->height - 1) /
+                         grid.space_sample + 0.5) - grid.origin_y +
+                  GRID_PADDING + 1;
+
+  for (c = 0; c < 4; c++)
+    {
+      if (!(min[c] <= max[c]) ||
+          (max[c] - min[c]) / grid.range_sample > n)
+        return FALSE;
+
+      grid.origin_z[c] = floor (min[c] / grid.range_sample + 0.5) - GRID_PADDING;
+      grid.depth[c]    = floor (max[c] / grid.range_sample + 0.5) -
+                         grid.origin_z[c] + GRID_PADDING + 1;
+      cells += (glong) grid.width * grid.height * grid.depth[c];
+    }
+
+  if (cells > (glong) n * GRID_MAX_CELLS)
+    return FALSE;
+
+  grid.src_buf  = src_buf;
+  grid.src_rect = src_rect;
+  grid.dst_buf  = dst_buf;
+  grid.dst_rect = dst_rect;
+  for (c = 0; c < 4; c++)
+    grid.grid[c] = g_new0 (gfloat, (gsize) grid.width * grid.height *
+                                    grid.depth[c] * 2);
+
+  gegl_parallel_distribute (grid.height, grid_splat, &grid);
+  gegl_parallel_distribute (grid.depth[0] + grid.depth[1] +
+                            grid.depth[2] + grid.depth[3],
+                            grid_blur_xy, &grid);
+  gegl_parallel_distribute (grid.height * 4, grid_blur_z, &grid);
+  gegl_parallel_distribute (dst_rect->height, grid_slice, &grid);
+
+  for (c = 0; c < 4; c++)
+    g_free (grid.grid[c]);
+
+  return TRUE;
+}
+
 static void
 bilateral_filter (GeglBuffer          *src,
                   const GeglRectangle *src_rect,
@@ -233,6 +553,10 @@ bilateral_filter (GeglBuffer          *src,
 
   gegl_buffer_get (src, 1.0, src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
 
+  if (radius >= GRID_MIN_RADIUS &&
+      bilateral_grid (src_buf, src_rect, dst_buf, dst_rect, radius, preserve))
+    goto done;
+
   offset = 0;
 
 #define POW2(a) ((a)*(a))
@@ -286,6 +610,8 @@ bilateral_filter (GeglBuffer          *src,
           dst_buf[offset*4+u] = accumulated[u]/count;
         offset++;
       }
+
+done:
   gegl_buffer_set (dst, dst_rect, babl_format ("RGBA float"), dst_buf,
                    GEGL_AUTO_ROWSTRIDE);
   g_free (src_buf);
@@ -32,175 +32,52 @@ gegl_chant_double (radius, _("Radius"), 0.0, 200.0, 4.0,
 #include "gegl-chant.h"
 #include <stdio.h>
 #include <math.h>
+#include "area-statistics.h"
 
-#ifdef USE_DEAD_CODE
-static inline float
-get_mean_component (gfloat *buf,
-                    gint    buf_width,
-                    gint    buf_height,
-                    gint    x0,
-                    gint    y0,
-                    gint    width,
-                    gint    height,
-                    gint    component)
-{
-  gint    x, y;
-  gdouble acc=0;
-  gint    count=0;
-
-  gint offset = (y0 * buf_width + x0) * 4 + component;
-
-  for (y=y0; y<y0+height; y++)
-    {
-    for (x=x0; x<x0+width; x++)
-      {
-        if (x>=0 && x<buf_width &&
-            y>=0 && y<buf_height)
-          {
-            acc += buf [offset];
-            count++;
-          }
-        offset+=4;
-      }
-      offset+= (buf_width * 4) - 4 * width;
-    }
-   if (count)
-     return acc/count;
-   return 0.0;
-}
-#endif
-
-static inline void
-get_mean_components (gfloat *buf,
-                     gint    buf_width,
-                     gint    buf_height,
-                     gint    x0,
-                     gint    y0,
-                     gint    width,
-                     gint    height,
-                     gfloat *components)
-{
-  gint    y;
-  gdouble acc[4]={0,0,0,0};
-  gint    count[4]={0,0,0,0};
-
-  gint offset = (y0 * buf_width + x0) * 4;
-
-  for (y=y0; y<y0+height; y++)
-    {
-    gint x;
-    for (x=x0; x<x0+width; x++)
-      {
-        if (x>=0 && x<buf_width &&
-            y>=0 && y<buf_height)
-          {
-            gint c;
-            for (c=0;c<4;c++)
-              {
-                acc[c] += buf [offset+c];
-                count[c]++;
-              }
-          }
-        offset+=4;
-      }
-      offset+= (buf_width * 4) - 4 * width;
-    }
-    {
-      gint c;
-      for (c=0;c<4;c++)
-        {
-         if (count[c])
-           components[c] = acc[c]/count[c];
-         else
-           components[c] = 0.0;
-        }
-    }
-}
-
-/* expects src and dst buf to have the same extent */
+/* dst_rect has to lie within src_rect by at least radius on every side */
 static void
-hor_blur (GeglBuffer          *src,
+box_blur (GeglBuffer          *src,
           const GeglRectangle *src_rect,
           GeglBuffer          *dst,
           const GeglRectangle *dst_rect,
           gint                 radius)
 {
-  gint u,v;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
+  SummedAreaTable *table;
+  gint             u,v;
+  gint             offset;
+  gint             x0, y0;
+  gfloat          *src_buf;
+  gfloat          *dst_buf;
 
-  /* src == dst for hor blur */
   src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 4);
   dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
 
   gegl_buffer_get (src, 1.0, src_rect, babl_format ("RaGaBaA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
 
-  offset = 0;
-  for (v=0; v<dst_rect->height; v++)
-    for (u=0; u<dst_rect->width; u++)
-      {
-        gint i;
-        gfloat components[4];
-
-        get_mean_components (src_buf,
-                             src_rect->width,
-                             src_rect->height,
-                             u - radius,
-                             v,
-                             1 + radius*2,
-                             1,
-                             components);
-
-        for (i=0; i<4; i++)
-          dst_buf [offset++] = components[i];
-      }
-
-  gegl_buffer_set (dst, dst_rect, babl_format ("RaGaBaA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
-  g_free (src_buf);
-  g_free (dst_buf);
-}
-
-
-/* expects dst buf to be radius smaller than src buf */
-static void
-ver_blur (GeglBuffer          *src,
-          const GeglRectangle *src_rect,
-          GeglBuffer          *dst,
-          const GeglRectangle *dst_rect,
-          gint                 radius)
-{
-  gint u,v;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-
-  src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 4);
-  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
+  /* every output pixel is the mean of a (radius*2+1)^2 square, which the
+   * summed area table gives in constant time, whatever the radius
+   */
+  table = summed_area_table_new (src_buf, src_rect->width, src_rect->height, 4, FALSE);
 
-  gegl_buffer_get (src, 1.0, src_rect, babl_format ("RaGaBaA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
+  x0 = dst_rect->x - src_rect->x - radius;
+  y0 = dst_rect->y - src_rect->y - radius;
 
-  offset=0;
+  offset = 0;
   for (v=0; v<dst_rect->height; v++)
     for (u=0; u<dst_rect->width; u++)
       {
-        gfloat components[4];
-        gint c;
-
-        get_mean_components (src_buf,
-                             src_rect->width,
-                             src_rect->height,
-                             u + radius,  /* 1x radius is the offset between the bufs */
-                             v - radius + radius, /* 1x radius is the offset between the bufs */
-                             1,
-                             1 + radius * 2,
-                             components);
-
-        for (c=0; c<4; c++)
-          dst_buf [offset++] = components[c];
+        summed_area_table_get_stats (table,
+                                     x0 + u,
+                                     y0 + v,
+                                     1 + radius * 2,
+                                     1 + radius * 2,
+                                     dst_buf + offset,
+                                     NULL);
+        offset += 4;
       }
 
   gegl_buffer_set (dst, dst_rect, babl_format ("RaGaBaA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
+  summed_area_table_free (table);
   g_free (src_buf);
   g_free (dst_buf);
 }
@@ -365,7 +242,6 @@ process (GeglOperation       *operation,
 {
   GeglRectangle rect;
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
-  GeglBuffer *temp;
   GeglOperationAreaFilter *op_area;
   op_area = GEGL_OPERATION_AREA_FILTER (operation);
 
@@ -380,13 +256,7 @@ process (GeglOperation       *operation,
   rect.width+=op_area->left + op_area->right;
   rect.height+=op_area->top + op_area->bottom;
 
-  temp  = gegl_buffer_new (&rect,
-                           babl_format ("RaGaBaA float"));
-
-  hor_blur (input, &rect, temp, &rect, o->radius);
-  ver_blur (temp, &rect, output, result, o->radius);
-
-  g_object_unref (temp);
+  box_blur (input, &rect, output, result, o->radius);
   return  TRUE;
 }
 
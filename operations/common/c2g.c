@@ -47,6 +47,43 @@ gegl_chant_double (rgamma, _("Radial Gamma"), 0.0, 8.0, 2.0,
 
 #define RGAMMA 2.0
 
+static void
+c2g_pixel (const gfloat *pixel,
+           const gfloat *min,
+           const gfloat *max,
+           gfloat       *dst)
+{
+  /* this should be replaced with a better/faster projection of
+   * pixel onto the vector spanned by min -> max, currently
+   * computed by comparing the distance to min with the sum
+   * of the distance to min/max.
+   */
+  gfloat nominator   = 0;
+  gfloat denominator = 0;
+  gint   c;
+
+  for (c=0; c<3; c++)
+    {
+      nominator   += (pixel[c] - min[c]) * (pixel[c] - min[c]);
+      denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
+    }
+
+  nominator = sqrt (nominator);
+  denominator = sqrt (denominator);
+  denominator = nominator + denominator;
+
+  if (denominator>0.000)
+    {
+      dst[0] = nominator/denominator;
+    }
+  else
+    {
+      /* shouldn't happen */
+      dst[0] = 0.5;
+    }
+  dst[1] = pixel[3];
+}
+
 static void c2g (GeglBuffer          *src,
                  const GeglRectangle *src_rect,
                  GeglBuffer          *dst,
@@ -56,72 +93,19 @@ static void c2g (GeglBuffer          *src,
                  gint                 iterations,
                  gdouble              rgamma)
 {
-  gint x,y;
-  gint    dst_offset=0;
   gfloat *src_buf;
   gfloat *dst_buf;
-  gint    inw = src_rect->width;
-  gint    outw = dst_rect->width;
-  gint    inh = src_rect->height;
 
   src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 4);
   dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 2);
 
   gegl_buffer_get (src, 1.0, src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
 
-  for (y=radius; y<dst_rect->height+radius; y++)
-    {
-      gint src_offset = (inw*y+radius)*4;
-      for (x=radius; x<outw+radius; x++)
-        {
-          gfloat *pixel= src_buf + src_offset;
-          gfloat  min[4];
-          gfloat  max[4];
-
-          compute_envelopes (src_buf,
-                             inw, inh,
-                             x, y,
-                             radius, samples,
-                             iterations,
-                             FALSE, /* same spray */
-                             rgamma,
-                             min, max);
-          {
-            /* this should be replaced with a better/faster projection of
-             * pixel onto the vector spanned by min -> max, currently
-             * computed by comparing the distance to min with the sum
-             * of the distance to min/max.
-             */
-
-            gfloat nominator = 0;
-      gfloat denominator = 0;
-            gint c;
-      for (c=0; c<3; c++)
-        {
-                nominator   += (pixel[c] - min[c]) * (pixel[c] - min[c]);
-                denominator += (pixel[c] - max[c]) * (pixel[c] - max[c]);
-        }
-
-            nominator = sqrt (nominator);
-            denominator = sqrt (denominator);
-            denominator = nominator + denominator;
-  
-            if (denominator>0.000)
-              {
-                dst_buf[dst_offset+0] = nominator/denominator;
-              }
-            else
-              {
-                /* shouldn't happen */
-                dst_buf[dst_offset+0] = 0.5;
-              }
-            dst_buf[dst_offset+1] = src_buf[src_offset+3];
-
-            src_offset+=4;
-            dst_offset+=2;
-          }
-        }
-    }
+  spray_process (src_buf, src_rect, dst_buf, dst_rect, 2,
+                 radius, samples, iterations,
+                 FALSE, /* same spray */
+                 rgamma, c2g_pixel);
+
   gegl_buffer_set (dst, dst_rect, babl_format ("YA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
   g_free (src_buf);
   g_free (dst_buf);
@@ -14,15 +14,19 @@
  * Copyright 2007, 2009 Øyvind Kolås     <pippin@gimp.org>
  */
 
+#include "gegl-parallel.h"
+
 #define ANGLE_PRIME  95273 /* the lookuptables are sized as primes to ensure */
 #define RADIUS_PRIME 29537 /* as good as possible variation when using both */
 
+#define SPRAY_SEED        42
+#define SPRAY_TABLE_SIZE  16381 /* prime, offsets fit in 64kb */
+#define SPRAY_TILE        64
+
 static gfloat   lut_cos[ANGLE_PRIME];
 static gfloat   lut_sin[ANGLE_PRIME];
 static gfloat   radiuses[RADIUS_PRIME];
 static gdouble  luts_computed = 0.0;
-static gint     angle_no=0;
-static gint     radius_no=0;
 
 static void compute_luts(gdouble rgamma)
 {
@@ -34,7 +38,7 @@ static void compute_luts(gdouble rgamma)
   if (luts_computed==rgamma)
     return;
   luts_computed = rgamma;
-  rand = g_rand_new();
+  rand = g_rand_new_with_seed (SPRAY_SEED);
 
   for (i=0;i<ANGLE_PRIME;i++)
     {
@@ -51,168 +55,322 @@ static void compute_luts(gdouble rgamma)
 
 }
 
-static inline void
-sample (gfloat *buf,
-        gint    width,
-        gint    height,
-        gint    x,
-        gint    y,
-        gfloat *dst)
+/* The CPU path draws its probes from a table of precomputed (dx, dy)
+ * offsets for a given radius. Every pixel walks the table from a start
+ * position hashed from its absolute coordinates, so the result of a pixel
+ * does not depend on which region or thread computes it.
+ */
+typedef struct
 {
-  gfloat *pixel = (buf + ((width * y) + x) * 4);
-  gint c;
+  gint    ref_count;
+  gint    radius;
+  gdouble rgamma;
+  gshort  offsets[SPRAY_TABLE_SIZE * 2];
+} SprayTable;
 
-  for (c=0;c<4;c++)
-    {
-      dst[c] = pixel[c];
-    }
-}
+static GStaticMutex  spray_table_mutex  = G_STATIC_MUTEX_INIT;
+static SprayTable   *spray_table_cached = NULL;
 
-static inline void
-sample_min_max (gfloat *buf,
-                gint    width,
-                gint    height,
-                gint    x,
-                gint    y,
-                gint    radius,
-                gint    samples,
-                gfloat *min,
-                gfloat *max)
+static void
+spray_table_unref (SprayTable *table)
 {
-  gfloat best_min[3];
-  gfloat best_max[3];
-  gfloat *center_pix = (buf + (width * y + x) * 4);
+  gboolean last;
 
-  gint i, c;
+  g_static_mutex_lock (&spray_table_mutex);
+  last = --table->ref_count == 0;
+  g_static_mutex_unlock (&spray_table_mutex);
+
+  if (last)
+    g_free (table);
+}
 
-  for (c=0;c<3;c++)
+/* returns a reference to the table for radius and rgamma, the most recently
+ * used table is kept around for the next call
+ */
+static SprayTable *
+spray_table_ref (gint    radius,
+                 gdouble rgamma)
+{
+  SprayTable *table;
+  SprayTable *old = NULL;
+
+  g_static_mutex_lock (&spray_table_mutex);
+  table = spray_table_cached;
+  if (table && table->radius == radius && table->rgamma == rgamma)
     {
-      best_min[c]=center_pix[c];
-      best_max[c]=center_pix[c];
+      table->ref_count++;
+      g_static_mutex_unlock (&spray_table_mutex);
+      return table;
     }
+  g_static_mutex_unlock (&spray_table_mutex);
 
-  for (i=0; i<samples; i++)
-    {
-      gint u, v;
-      gint angle;
-      gfloat rmag;
-retry:                      /* if we've sampled outside the valid image
-                               area, we grab another sample instead, this
-                               should potentially work better than mirroring
-                               or extending the image
-                             */
-      angle = angle_no++;
-      rmag = radiuses[radius_no++] * radius;
-
-      if (angle_no>=ANGLE_PRIME)
-        angle_no=0;
-      if (radius_no>=RADIUS_PRIME)
-        radius_no=0;
-
-      u = x + rmag * lut_cos[angle];
-      v = y + rmag * lut_sin[angle];
-
-      if (u>=width ||
-          u<0 ||
-          v>=height ||
-          v<0)
-        goto retry;
+  {
+    GRand  *rand         = g_rand_new_with_seed (SPRAY_SEED);
+    gfloat  golden_angle = G_PI * (3 - sqrt (5.0));
+    gfloat  angle        = 0.0;
+    gint    i;
+
+    table = g_new (SprayTable, 1);
+    table->ref_count = 2; /* the caller and the cache */
+    table->radius    = radius;
+    table->rgamma    = rgamma;
 
+    for (i = 0; i < SPRAY_TABLE_SIZE; i++)
       {
-        gfloat *pixel = (buf + ((width * v) + u) * 4);
+        gfloat rmag = pow (g_rand_double_range (rand, 0.0, 1.0), rgamma) *
+                      radius;
 
-        if (pixel[3]>0.0) /* ignore fully transparent pixels */
-          {
-            for (c=0;c<3;c++)
-              {
-                if (pixel[c]<best_min[c])
-                  best_min[c]=pixel[c];
-
-                if (pixel[c]>best_max[c])
-                  best_max[c]=pixel[c];
-              }
-          }
-        else
-          {
-            goto retry;
-          }
+        angle += golden_angle;
+        table->offsets[i * 2 + 0] = rmag * cos (angle);
+        table->offsets[i * 2 + 1] = rmag * sin (angle);
       }
-    }
-  for (c=0;c<3;c++)
-    {
-      min[c]=best_min[c];
-      max[c]=best_max[c];
-    }
+
+    g_rand_free (rand);
+  }
+
+  g_static_mutex_lock (&spray_table_mutex);
+  old = spray_table_cached;
+  spray_table_cached = table;
+  g_static_mutex_unlock (&spray_table_mutex);
+
+  if (old)
+    spray_table_unref (old);
+
+  return table;
 }
 
-static inline void compute_envelopes (gfloat  *buf,
-                                      gint     width,
-                                      gint     height,
-                                      gint     x,
-                                      gint     y,
-                                      gint     radius,
-                                      gint     samples,
-                                      gint     iterations,
-                                      gboolean same_spray,
-                                      gdouble  rgamma,
-                                      gfloat  *min_envelope,
-                                      gfloat  *max_envelope)
+static inline guint
+spray_start (gint x,
+             gint y)
 {
-  gint    i;
-  gint    c;
-  gfloat  range_sum[4]               = {0,0,0,0};
-  gfloat  relative_brightness_sum[4] = {0,0,0,0};
-  gfloat *pixel = buf + (width*y+x)*4;
+  guint32 hash = ((guint32) x * 73856093u) ^ ((guint32) y * 19349663u);
 
-  /* compute lookuptables for the gamma, currently not used/exposed
-   * as a tweakable property */
-  compute_luts(rgamma);
+  hash ^= hash >> 13;
+  hash *= 0x5bd1e995u;
+  hash ^= hash >> 15;
 
-  if (same_spray)
+  return hash % SPRAY_TABLE_SIZE;
+}
+
+static inline void
+spray_min_max (const SprayTable *table,
+               const gfloat     *buf,
+               gint              width,
+               gint              height,
+               gint              x,
+               gint              y,
+               guint            *index,
+               gint              samples,
+               gfloat           *min,
+               gfloat           *max)
+{
+  const gfloat *center_pix = buf + (width * y + x) * 4;
+  guint         i          = *index;
+  gint          misses     = 0;
+  gint          c;
+
+  for (c = 0; c < 3; c++)
     {
-      angle_no = 0;
-      radius_no = 0;
+      min[c] = center_pix[c];
+      max[c] = center_pix[c];
     }
 
-  for (i=0;i<iterations;i++)
+  while (samples > 0)
     {
-      gfloat min[3], max[3];
+      const gfloat *pixel;
+      gint          u = x + table->offsets[i * 2 + 0];
+      gint          v = y + table->offsets[i * 2 + 1];
 
-      sample_min_max (buf,
-                      width,
-                      height,
-                      x, y,
-                      radius, samples,
-                      min, max);
+      if (++i == SPRAY_TABLE_SIZE)
+        i = 0;
 
-      for (c=0;c<3;c++)
+      /* if we've sampled outside the valid image area or hit a fully
+       * transparent pixel, we grab another sample instead, this should
+       * potentially work better than mirroring or extending the image
+       */
+      if (u < 0 || u >= width || v < 0 || v >= height)
+        pixel = NULL;
+      else
+        pixel = buf + (width * v + u) * 4;
+
+      if (!pixel || pixel[3] <= 0.0)
         {
-          gfloat range, relative_brightness;
+          /* give up on neighbourhoods without any usable pixels */
+          if (++misses == SPRAY_TABLE_SIZE)
+            break;
+          continue;
+        }
+
+      for (c = 0; c < 3; c++)
+        {
+          min[c] = MIN (min[c], pixel[c]);
+          max[c] = MAX (max[c], pixel[c]);
+        }
+      samples--;
+    }
 
-          range = max[c] - min[c];
+  *index = i;
+}
+
+/* computes the envelopes of pixel (x, y) of buf, which lies at (seed_x,
+ * seed_y) in the image, with same_spray every pixel uses the same probes
+ */
+static inline void
+spray_envelopes (const SprayTable *table,
+                 const gfloat     *buf,
+                 gint              width,
+                 gint              height,
+                 gint              x,
+                 gint              y,
+                 gint              seed_x,
+                 gint              seed_y,
+                 gint              samples,
+                 gint              iterations,
+                 gboolean          same_spray,
+                 gfloat           *min_envelope,
+                 gfloat           *max_envelope)
+{
+  const gfloat *pixel                      = buf + (width * y + x) * 4;
+  gfloat        range_sum[3]               = {0, 0, 0};
+  gfloat        relative_brightness_sum[3] = {0, 0, 0};
+  guint         index                      = 0;
+  gint          i, c;
+
+  if (!same_spray)
+    index = spray_start (seed_x, seed_y);
+
+  for (i = 0; i < iterations; i++)
+    {
+      gfloat min[3], max[3];
+
+      spray_min_max (table, buf, width, height, x, y, &index, samples,
+                     min, max);
 
-          if (range>0.0)
-            {
-              relative_brightness = (pixel[c] - min[c]) / range;
-            }
+      for (c = 0; c < 3; c++)
+        {
+          gfloat range = max[c] - min[c];
+
+          if (range > 0.0)
+            relative_brightness_sum[c] += (pixel[c] - min[c]) / range;
           else
-            {
-              relative_brightness = 0.5;
-            }
+            relative_brightness_sum[c] += 0.5;
 
-          relative_brightness_sum[c] += relative_brightness;
           range_sum[c] += range;
         }
     }
 
-    for (c=0;c<3;c++)
-      {
-        gfloat relative_brightness = relative_brightness_sum[c] / iterations;
-        gfloat range               = range_sum[c] / iterations;
-        
-        if (max_envelope)
-          max_envelope[c] = pixel[c] + (1.0 - relative_brightness) * range;
-        if (min_envelope)
-          min_envelope[c] = pixel[c] - relative_brightness * range;
-      }
+  for (c = 0; c < 3; c++)
+    {
+      gfloat relative_brightness = relative_brightness_sum[c] / iterations;
+      gfloat range               = range_sum[c] / iterations;
+
+      if (max_envelope)
+        max_envelope[c] = pixel[c] + (1.0 - relative_brightness) * range;
+      if (min_envelope)
+        min_envelope[c] = pixel[c] - relative_brightness * range;
+    }
+}
+
+/* maps a source pixel and its envelopes to components floats in dst */
+typedef void (* SprayPixelFunc) (const gfloat *pixel,
+                                 const gfloat *min_envelope,
+                                 const gfloat *max_envelope,
+                                 gfloat       *dst);
+
+typedef struct
+{
+  const SprayTable    *table;
+  const gfloat        *src_buf;
+  const GeglRectangle *src_rect;
+  gfloat              *dst_buf;
+  const GeglRectangle *dst_rect;
+  gint                 components;
+  gint                 samples;
+  gint                 iterations;
+  gboolean             same_spray;
+  SprayPixelFunc       func;
+  gint                 tiles_x;
+  gint                 tiles;
+} SprayTask;
+
+static void
+spray_process_tiles (gint     thread,
+                     gint     threads,
+                     gpointer data)
+{
+  SprayTask           *task     = data;
+  const GeglRectangle *src_rect = task->src_rect;
+  const GeglRectangle *dst_rect = task->dst_rect;
+  gint                 dx       = dst_rect->x - src_rect->x;
+  gint                 dy       = dst_rect->y - src_rect->y;
+  gint                 tile;
+
+  for (tile = thread; tile < task->tiles; tile += threads)
+    {
+      gint x0 = (tile % task->tiles_x) * SPRAY_TILE;
+      gint y0 = (tile / task->tiles_x) * SPRAY_TILE;
+      gint x1 = MIN (x0 + SPRAY_TILE, dst_rect->width);
+      gint y1 = MIN (y0 + SPRAY_TILE, dst_rect->height);
+      gint x, y;
+
+      for (y = y0; y < y1; y++)
+        for (x = x0; x < x1; x++)
+          {
+            gint   u = x + dx;
+            gint   v = y + dy;
+            gfloat min_envelope[3];
+            gfloat max_envelope[3];
+
+            spray_envelopes (task->table, task->src_buf,
+                             src_rect->width, src_rect->height,
+                             u, v,
+                             dst_rect->x + x, dst_rect->y + y,
+                             task->samples, task->iterations,
+                             task->same_spray,
+                             min_envelope, max_envelope);
+
+            task->func (task->src_buf + (src_rect->width * v + u) * 4,
+                        min_envelope, max_envelope,
+                        task->dst_buf + (dst_rect->width * y + x) *
+                                        task->components);
+          }
+    }
+}
+
+/* Computes the envelopes of every pixel of dst_rect, in tiles split across
+ * threads, src_buf holds RGBA float pixels of src_rect, which must contain
+ * dst_rect. func maps them to components floats per pixel of dst_buf.
+ */
+static void
+spray_process (const gfloat        *src_buf,
+               const GeglRectangle *src_rect,
+               gfloat              *dst_buf,
+               const GeglRectangle *dst_rect,
+               gint                 components,
+               gint                 radius,
+               gint                 samples,
+               gint                 iterations,
+               gboolean             same_spray,
+               gdouble              rgamma,
+               SprayPixelFunc       func)
+{
+  SprayTask task;
+
+  task.table      = spray_table_ref (radius, rgamma);
+  task.src_buf    = src_buf;
+  task.src_rect   = src_rect;
+  task.dst_buf    = dst_buf;
+  task.dst_rect   = dst_rect;
+  task.components = components;
+  task.samples    = samples;
+  task.iterations = MAX (iterations, 1);
+  task.same_spray = same_spray;
+  task.func       = func;
+  task.tiles_x    = (dst_rect->width  + SPRAY_TILE - 1) / SPRAY_TILE;
+  task.tiles      = (dst_rect->height + SPRAY_TILE - 1) / SPRAY_TILE *
+                    task.tiles_x;
+
+  gegl_parallel_distribute (task.tiles, spray_process_tiles, &task);
+
+  spray_table_unref ((SprayTable *) task.table);
 }
@@ -53,6 +53,8 @@ typedef struct
 #include "gegl-chant.h"
 GEGL_DEFINE_DYNAMIC_OPERATION(GEGL_TYPE_OPERATION_FILTER)
 
+#include "gegl-parallel.h"
+
 #include <errno.h>
 #include <math.h>
 #include <stdio.h>
@@ -83,6 +85,15 @@ static const gfloat MIN_WEIGHT = 1e-3f;
 /* number of pixels used if downscaling for curve estimation */
 static const guint  MAX_SCALED_PIXELS = 1000 * 1000;
 
+/* rows of every exposure held in memory while merging */
+#define BAND_HEIGHT 64
+
+/* the response estimation accumulates its sums over this many ranges of
+ * pixels, added up in order, so the result does not depend on the number
+ * of threads
+ */
+#define ROBERTSON_PARTS 16
+
 typedef enum
 {
   PIXELS_ACTIVE,    /* Must be lowest valid ID, zero */
@@ -99,6 +110,11 @@ typedef struct _exposure
   struct _exposure *hi;
   struct _exposure *lo;
 
+  /* Source of the full resolution pixels, which are only read one band of
+   * BAND_HEIGHT rows at a time into the PIXELS_FULL bucket.
+   */
+  GeglBuffer *buffer;
+
   gfloat *pixels[NUM_PIXEL_BUCKETS];
 
   /* 'Duration' of exposure. May only be relatively correct against the
@@ -145,6 +161,7 @@ gegl_expcombine_new_exposure (void)
   exposure *e = g_new (exposure, 1);
   e->hi = e->lo = e;
 
+  e->buffer = NULL;
   memset (e->pixels, 0, sizeof (e->pixels));
   e->ti = NAN;
 
@@ -179,6 +196,9 @@ gegl_expcombine_destroy_exposure (exposure *e)
         }
     }
 
+  if (e->buffer)
+    g_object_unref (e->buffer);
+
   g_free (e);
 }
 
@@ -295,50 +315,110 @@ gegl_expcombine_normalize (gfloat *response,
 }
 
 
-/* Apply debevec model for response curve application. Does not suffer from
- * apparent discolouration in some areas of image reconstruction when
- * compared with robertson.
+/* Find the trusted camera output range, the steps with non-zero weights.
+ * Returns FALSE if there are none.
  */
-static int
-gegl_expcombine_apply_debevec  (gfloat              *hdr,
-                                const guint          components,
-                                GSList              *imgs,
-                                gfloat             **response,
-                                const gfloat        *weighting,
-                                const guint          steps,
-                                const GeglRectangle *extent)
+static gboolean
+gegl_expcombine_trusted_range (const gfloat *weighting,
+                               guint         steps,
+                               guint        *step_min,
+                               guint        *step_max)
 {
-  guint  step_min, step_max;
-  guint  num_imgs    = g_slist_length (imgs);
-  guint  saturated   = 0;
-  guint  pixel_count = (guint)(extent->width * extent->height);
-  guint  i, j;
-
-  g_return_val_if_fail (hdr,                        G_MAXINT);
-  g_return_val_if_fail (g_slist_length (imgs) > 0,  G_MAXINT);
-  g_return_val_if_fail (response,                   G_MAXINT);
-  g_return_val_if_fail (weighting,                  G_MAXINT);
-  g_return_val_if_fail (steps > 0,                  G_MAXINT);
-  g_return_val_if_fail (extent,                     G_MAXINT);
-  g_return_val_if_fail (extent->width  > 0,         G_MAXINT);
-  g_return_val_if_fail (extent->height > 0,         G_MAXINT);
+  guint i;
 
-  /* anti saturation: calculate trusted camera output range */
-  for (step_min = 0, i = step_min; i <    steps; ++i)
+  for (*step_min = 0, i = *step_min; i < steps; ++i)
     if (weighting[i] > 0)
       {
-        step_min = i;
+        *step_min = i;
         break;
       }
-  for (step_max = steps - 1, i = step_max; i > step_min; --i)
+  for (*step_max = steps - 1, i = *step_max; i > *step_min; --i)
     if (weighting[i] > 0)
       {
-        step_max = i;
+        *step_max = i;
         break;
       }
-  g_return_val_if_fail (step_max >= step_min, G_MAXINT);
 
-  for (j = 0; j < pixel_count; ++j)
+  return *step_max >= *step_min;
+}
+
+
+/* Shared state of the threads applying response curves to a set of pixels.
+ * Every thread handles a contiguous range of the pixels and counts its
+ * saturated pixels separately.
+ */
+typedef struct
+{
+  gfloat        *hdr;
+  guint          offset;
+  guint          components;
+  exposure     **imgs;
+  guint          num_imgs;
+  gfloat       **response;
+  const gfloat  *weighting;
+  guint          steps;
+  guint          step_min;
+  guint          step_max;
+  guint          pixel_count;
+  guint         *saturated;
+} apply_task;
+
+
+static void
+gegl_expcombine_apply_task_range (const apply_task *task,
+                                  gint              part,
+                                  gint              parts,
+                                  guint            *first,
+                                  guint            *last)
+{
+  *first = (guint64) task->pixel_count *  part      / parts;
+  *last  = (guint64) task->pixel_count * (part + 1) / parts;
+}
+
+
+static guint
+gegl_expcombine_apply_task_run (apply_task                 *task,
+                                GeglParallelDistributeFunc  func)
+{
+  gint  parts     = gegl_parallel_get_n_threads ();
+  guint saturated = 0;
+  gint  i;
+
+  task->saturated = g_new0 (guint, parts);
+  gegl_parallel_distribute (parts, func, task);
+
+  for (i = 0; i < parts; ++i)
+    {
+      if (task->saturated[i] == G_MAXINT)
+        {
+          saturated = G_MAXINT;
+          break;
+        }
+      saturated += task->saturated[i];
+    }
+
+  g_free (task->saturated);
+
+  return saturated;
+}
+
+
+static guint
+gegl_expcombine_apply_debevec_range (const apply_task *task,
+                                     guint             first,
+                                     guint             last)
+{
+  const guint   components = task->components;
+  const guint   steps      = task->steps;
+  const guint   step_min   = task->step_min;
+  const guint   step_max   = task->step_max;
+  const gfloat *weighting  = task->weighting;
+  gfloat      **response   = task->response;
+  gfloat       *hdr        = task->hdr;
+  guint         saturated  = 0;
+  guint         i, j;
+
+  for (j = first; j < last; ++j)
     {
       gfloat  sum[3]  = { 0.0f, 0.0f, 0.0f },
               div     = 0.0f;
@@ -348,12 +428,12 @@ gegl_expcombine_apply_debevec  (gfloat              *hdr,
       guint   white_step[3], black_step[3];
 
       /* all exposures for each pixel */
-      for (i = 0; i < num_imgs; ++i)
+      for (i = 0; i < task->num_imgs; ++i)
         {
           exposure *exp_i;
           guint     step[3], step_hi[3], step_lo[3];
 
-          exp_i    = g_slist_nth_data (imgs, i);
+          exp_i    = task->imgs[i];
           step[0]  = exp_i->pixels[PIXELS_ACTIVE][0 + j * components];
           step[1]  = exp_i->pixels[PIXELS_ACTIVE][1 + j * components];
           step[2]  = exp_i->pixels[PIXELS_ACTIVE][2 + j * components];
@@ -489,63 +569,81 @@ gegl_expcombine_apply_debevec  (gfloat              *hdr,
 }
 
 
-/**
- * @brief Create HDR image by applying response curve to given images
- * taken with different exposures
- *
- * @param hdr [out] HDR image
- * @param imgs      list of scene exposures
- * @param response  camera response function (array size of `steps')
- * @param weighting weighting function for camera output values (array size of `steps')
- * @param steps     number of camera output levels
- * @return          number of saturated pixels in the HDR image (0: all OK)
+static void
+gegl_expcombine_apply_debevec_part (gint     part,
+                                    gint     parts,
+                                    gpointer data)
+{
+  apply_task *task = data;
+  guint       first, last;
+
+  gegl_expcombine_apply_task_range (task, part, parts, &first, &last);
+  task->saturated[part] = gegl_expcombine_apply_debevec_range (task, first,
+                                                               last);
+}
+
+
+/* Apply debevec model for response curve application. Does not suffer from
+ * apparent discolouration in some areas of image reconstruction when
+ * compared with robertson.
  */
 static int
-gegl_expcombine_apply_response (gfloat              *hdr,
-                                const guint          offset,
+gegl_expcombine_apply_debevec  (gfloat              *hdr,
                                 const guint          components,
-                                GSList              *imgs,
-                                const gfloat        *response,
+                                exposure           **imgs,
+                                const guint          num_imgs,
+                                gfloat             **response,
                                 const gfloat        *weighting,
                                 const guint          steps,
-                                const GeglRectangle *extent)
+                                const guint          pixel_count)
 {
-  guint  step_min, step_max;
-  guint  num_imgs  = g_slist_length (imgs);
-  guint  saturated = 0;
-  guint  pixel_count = (guint)(extent->width * extent->height);
-  guint  i, j;
-
-  g_return_val_if_fail (hdr,                        G_MAXINT);
-  g_return_val_if_fail (g_slist_length (imgs) > 0,  G_MAXINT);
-  g_return_val_if_fail (response,                   G_MAXINT);
-  g_return_val_if_fail (weighting,                  G_MAXINT);
-  g_return_val_if_fail (steps > 0,                  G_MAXINT);
-  g_return_val_if_fail (extent,                     G_MAXINT);
-  g_return_val_if_fail (extent->width  > 0,         G_MAXINT);
-  g_return_val_if_fail (extent->height > 0,         G_MAXINT);
+  apply_task task;
+  gboolean   trusted;
+
+  g_return_val_if_fail (hdr,             G_MAXINT);
+  g_return_val_if_fail (num_imgs > 0,    G_MAXINT);
+  g_return_val_if_fail (response,        G_MAXINT);
+  g_return_val_if_fail (weighting,       G_MAXINT);
+  g_return_val_if_fail (steps > 0,       G_MAXINT);
+  g_return_val_if_fail (pixel_count > 0, G_MAXINT);
 
   /* anti saturation: calculate trusted camera output range */
-  for (step_min = 0, i = step_min; i < steps; ++i)
-    {
-      if (weighting[i] > 0)
-        {
-          step_min = i;
-          break;
-        }
-    }
-  for (step_max = steps - 1, i = step_max; i > step_min; --i)
-    {
-      if (weighting[i] > 0)
-        {
-          step_max = i;
-          break;
-        }
-    }
+  trusted = gegl_expcombine_trusted_range (weighting, steps,
+                                           &task.step_min, &task.step_max);
+  g_return_val_if_fail (trusted, G_MAXINT);
+
+  task.hdr         = hdr;
+  task.offset      = 0;
+  task.components  = components;
+  task.imgs        = imgs;
+  task.num_imgs    = num_imgs;
+  task.response    = response;
+  task.weighting   = weighting;
+  task.steps       = steps;
+  task.pixel_count = pixel_count;
+
+  return gegl_expcombine_apply_task_run (&task,
+                                         gegl_expcombine_apply_debevec_part);
+}
 
-  g_return_val_if_fail (step_max >= step_min, G_MAXINT);
 
-  for (j = 0; j < pixel_count; ++j)
+static guint
+gegl_expcombine_apply_response_range (const apply_task *task,
+                                      guint             first,
+                                      guint             last)
+{
+  const guint   offset     = task->offset;
+  const guint   components = task->components;
+  const guint   steps      = task->steps;
+  const guint   step_min   = task->step_min;
+  const guint   step_max   = task->step_max;
+  const gfloat *weighting  = task->weighting;
+  const gfloat *response   = task->response[0];
+  gfloat       *hdr        = task->hdr;
+  guint         saturated  = 0;
+  guint         i, j;
+
+  for (j = first; j < last; ++j)
     {
       gfloat  sum    = 0.0f,
               div    = 0.0f;
@@ -553,12 +651,12 @@ gegl_expcombine_apply_response (gfloat              *hdr,
               ti_min = G_MAXFLOAT;
 
       /* all exposures for each pixel */
-      for (i = 0; i < num_imgs; ++i)
+      for (i = 0; i < task->num_imgs; ++i)
         {
           exposure *exp_i;
           guint     step, step_hi, step_lo;
 
-          exp_i = g_slist_nth_data (imgs, i);
+          exp_i = task->imgs[i];
           step  = exp_i->pixels[PIXELS_ACTIVE][offset + j * components];
           g_return_val_if_fail (step < steps, G_MAXINT);
 
@@ -617,11 +715,137 @@ gegl_expcombine_apply_response (gfloat              *hdr,
 }
 
 
+static void
+gegl_expcombine_apply_response_part (gint     part,
+                                     gint     parts,
+                                     gpointer data)
+{
+  apply_task *task = data;
+  guint       first, last;
+
+  gegl_expcombine_apply_task_range (task, part, parts, &first, &last);
+  task->saturated[part] = gegl_expcombine_apply_response_range (task, first,
+                                                                last);
+}
+
+
+/**
+ * @brief Create HDR image by applying response curve to given images
+ * taken with different exposures
+ *
+ * @param hdr [out] HDR image
+ * @param imgs      scene exposures, ordered by exposure time
+ * @param response  camera response function (array size of `steps')
+ * @param weighting weighting function for camera output values (array size of `steps')
+ * @param steps     number of camera output levels
+ * @return          number of saturated pixels in the HDR image (0: all OK)
+ */
+static int
+gegl_expcombine_apply_response (gfloat              *hdr,
+                                const guint          offset,
+                                const guint          components,
+                                exposure           **imgs,
+                                const guint          num_imgs,
+                                gfloat              *response,
+                                const gfloat        *weighting,
+                                const guint          steps,
+                                const guint          pixel_count)
+{
+  apply_task task;
+  gboolean   trusted;
+
+  g_return_val_if_fail (hdr,             G_MAXINT);
+  g_return_val_if_fail (num_imgs > 0,    G_MAXINT);
+  g_return_val_if_fail (response,        G_MAXINT);
+  g_return_val_if_fail (weighting,       G_MAXINT);
+  g_return_val_if_fail (steps > 0,       G_MAXINT);
+  g_return_val_if_fail (pixel_count > 0, G_MAXINT);
+
+  /* anti saturation: calculate trusted camera output range */
+  trusted = gegl_expcombine_trusted_range (weighting, steps,
+                                           &task.step_min, &task.step_max);
+  g_return_val_if_fail (trusted, G_MAXINT);
+
+  task.hdr         = hdr;
+  task.offset      = offset;
+  task.components  = components;
+  task.imgs        = imgs;
+  task.num_imgs    = num_imgs;
+  task.response    = &response;
+  task.weighting   = weighting;
+  task.steps       = steps;
+  task.pixel_count = pixel_count;
+
+  return gegl_expcombine_apply_task_run (&task,
+                                         gegl_expcombine_apply_response_part);
+}
+
+
+/* Shared state of the threads accumulating the response sums, see
+ * ROBERTSON_PARTS.
+ */
+typedef struct
+{
+  const gfloat  *hdr;
+  guint          offset;
+  guint          components;
+  exposure     **imgs;
+  guint          num_imgs;
+  guint          steps;
+  guint          pixel_count;
+  gdouble       *sum;
+  gulong        *card;
+} robertson_task;
+
+
+static void
+gegl_expcombine_robertson_part (gint     thread,
+                                gint     threads,
+                                gpointer data)
+{
+  robertson_task *task       = data;
+  const guint     offset     = task->offset;
+  const guint     components = task->components;
+  guint           part;
+
+  for (part  = ROBERTSON_PARTS *  thread      / threads;
+       part  < ROBERTSON_PARTS * (thread + 1) / threads;
+       part++)
+    {
+      gdouble *sum   = task->sum  + part * task->steps;
+      gulong  *card  = task->card + part * task->steps;
+      guint    first = (guint64) task->pixel_count *  part      / ROBERTSON_PARTS;
+      guint    last  = (guint64) task->pixel_count * (part + 1) / ROBERTSON_PARTS;
+      guint    i, j;
+
+      memset (sum,  0, task->steps * sizeof (gdouble));
+      memset (card, 0, task->steps * sizeof (gulong));
+
+      for (i = 0; i < task->num_imgs; ++i)
+        {
+          exposure *e = task->imgs[i];
+
+          for (j = first; j < last; ++j)
+            {
+              guint step = e->pixels[PIXELS_ACTIVE][offset + j * components];
+              if (step < task->steps)
+                {
+                  sum[step] += e->ti * task->hdr[offset + j * components];
+                  ++card[step];
+                }
+              else
+                g_warning ("robertson02: m out of range: %u", step);
+            }
+        }
+    }
+}
+
+
 /**
  * @brief Calculate camera response using Robertson02 algorithm
  *
  * @param luminance [out] estimated luminance values
- * @param imgs            list of scene exposures
+ * @param imgs            scene exposures, ordered by exposure time
  * @param response  [out] array to put response function
  * @param weighting       weights
  * @param steps           max camera output (no of discrete steps)
@@ -632,32 +856,29 @@ static int
 gegl_expcombine_get_response (gfloat              *hdr,
                               const guint          offset,
                               const guint          components,
-                              GSList              *imgs,
+                              exposure           **imgs,
+                              const guint          num_imgs,
                               gfloat              *response,
                               const gfloat        *weighting,
                               guint                steps,
-                              const GeglRectangle *extent)
+                              const guint          pixel_count)
 {
   gfloat  *response_old;
   gfloat   delta, delta_old;
 
-  gulong  *card;
-  gfloat  *sum;
+  robertson_task task;
 
   guint    i, j, hits;
   guint    iterations;
-  guint    pixel_count = (guint)(extent->height * extent->width);
   gulong   saturated  = 0;
   gboolean converged;
 
-  g_return_val_if_fail (hdr,                        G_MAXINT);
-  g_return_val_if_fail (g_slist_length (imgs) > 1,  G_MAXINT);
-  g_return_val_if_fail (response,                   G_MAXINT);
-  g_return_val_if_fail (weighting,                  G_MAXINT);
-  g_return_val_if_fail (steps > 0,                  G_MAXINT);
-  g_return_val_if_fail (extent,                     G_MAXINT);
-  g_return_val_if_fail (extent->width  > 0,         G_MAXINT);
-  g_return_val_if_fail (extent->height > 0,         G_MAXINT);
+  g_return_val_if_fail (hdr,             G_MAXINT);
+  g_return_val_if_fail (num_imgs > 1,    G_MAXINT);
+  g_return_val_if_fail (response,        G_MAXINT);
+  g_return_val_if_fail (weighting,       G_MAXINT);
+  g_return_val_if_fail (steps > 0,       G_MAXINT);
+  g_return_val_if_fail (pixel_count > 0, G_MAXINT);
 
   response_old = g_new (gfloat, steps);
 
@@ -666,57 +887,54 @@ gegl_expcombine_get_response (gfloat              *hdr,
   for (i = 0; i < steps; ++i)
       response_old[i] = response[i];
 
-  saturated = gegl_expcombine_apply_response (hdr, offset, components, imgs,
+  saturated = gegl_expcombine_apply_response (hdr, offset, components,
+                                              imgs, num_imgs,
                                               response, weighting, steps,
-                                              extent);
+                                              pixel_count);
 
   converged  = FALSE;
-  card       = g_new (gulong, steps);
-  sum        = g_new (gfloat, steps);
   iterations = 0;
   delta_old  = 0.0f;
 
+  task.hdr         = hdr;
+  task.offset      = offset;
+  task.components  = components;
+  task.imgs        = imgs;
+  task.num_imgs    = num_imgs;
+  task.steps       = steps;
+  task.pixel_count = pixel_count;
+  task.sum         = g_new (gdouble, ROBERTSON_PARTS * steps);
+  task.card        = g_new (gulong,  ROBERTSON_PARTS * steps);
+
   /* Optimization process */
   while (!converged)
   {
-    GSList *cursor = imgs;
     /* 1. Minimize with respect to response */
-    for (i = 0; i < steps; ++i)
-      {
-        card[i] = 0;
-        sum [i] = 0.0f;
-      }
-
-    for (cursor = imgs; cursor; cursor = cursor->next)
-      {
-        exposure *e = cursor->data;
+    gegl_parallel_distribute (ROBERTSON_PARTS,
+                              gegl_expcombine_robertson_part,
+                              &task);
 
-        for (j = 0; j < pixel_count; ++j)
-          {
-            guint step = e->pixels[PIXELS_ACTIVE][offset + j * components];
-            if (step < steps)
-              {
-                sum[step] += e->ti * hdr[offset + j * components];
-                ++card[step];
-              }
-            else
-              g_warning ("robertson02: m out of range: %u", step);
-          }
-      }
+    for (j = 1; j < ROBERTSON_PARTS; ++j)
+      for (i = 0; i < steps; ++i)
+        {
+          task.sum [i] += task.sum [j * steps + i];
+          task.card[i] += task.card[j * steps + i];
+        }
 
     for (i = 0; i < steps; ++i)
       {
-        if (card[i] != 0)
-          response[i] = sum[i] / card[i];
+        if (task.card[i] != 0)
+          response[i] = task.sum[i] / task.card[i];
         else
           response[i] = 0.0f;
       }
 
     /* 2. Apply new response */
     gegl_expcombine_normalize (response, steps);
-    saturated = gegl_expcombine_apply_response (hdr, offset, components, imgs,
+    saturated = gegl_expcombine_apply_response (hdr, offset, components,
+                                                imgs, num_imgs,
                                                 response, weighting, steps,
-                                                extent);
+                                                pixel_count);
 
     /* 3. Check stopping condition */
     delta = 0.0f;
@@ -755,8 +973,8 @@ gegl_expcombine_get_response (gfloat              *hdr,
   }
 
   g_free (response_old);
-  g_free (card);
-  g_free (sum);
+  g_free (task.card);
+  g_free (task.sum);
 
   return saturated;
 }
@@ -951,25 +1169,22 @@ gegl_expcombine_get_exposures (GeglOperation        *operation,
       if (!buffer)
           continue;
 
-      e                = gegl_expcombine_new_exposure ();
-      e->pixels[PIXELS_FULL]   = g_new (gfloat, full_roi->width  *
-                                                full_roi->height *
+      /* Only the pixels used for the curve estimation are read now, the
+       * full resolution pixels are streamed band by band when merging.
+       */
+      e                        = gegl_expcombine_new_exposure ();
+      e->buffer                = buffer;
+      e->pixels[PIXELS_FULL]   = g_new (gfloat, full_roi->width *
+                                                BAND_HEIGHT     *
                                                 components);
-      gegl_buffer_get (buffer, 1.0, full_roi, babl_format (PAD_FORMAT),
-                       e->pixels[PIXELS_FULL], GEGL_AUTO_ROWSTRIDE);
 
       g_return_val_if_fail (scale <= 1.0f, NULL);
-      if (scale == 1.0f)
-          e->pixels[PIXELS_SCALED] = e->pixels[PIXELS_FULL];
-      else
-        {
-          e->pixels[PIXELS_SCALED] = g_new (gfloat,
-                                            (scaled_roi->width  *
-                                             scaled_roi->height *
-                                             components));
-          gegl_buffer_get (buffer, scale, scaled_roi, babl_format (PAD_FORMAT),
-                           e->pixels[PIXELS_SCALED], GEGL_AUTO_ROWSTRIDE);
-        }
+      e->pixels[PIXELS_SCALED] = g_new (gfloat,
+                                        (scaled_roi->width  *
+                                         scaled_roi->height *
+                                         components));
+      gegl_buffer_get (buffer, scale, scaled_roi, babl_format (PAD_FORMAT),
+                       e->pixels[PIXELS_SCALED], GEGL_AUTO_ROWSTRIDE);
 
       e->pixels[PIXELS_ACTIVE] = e->pixels[PIXELS_FULL];
 
@@ -1054,6 +1269,148 @@ gegl_expcombine_save_curves (const gfloat *response,
 #endif
 
 
+/* Shared state of the threads remapping pixels to steps, every thread
+ * handles a range of the values and records its own statistics.
+ */
+typedef struct
+{
+  gfloat  *pixels;
+  guint    count;
+  guint    steps;
+  guint   *step_min;
+  guint   *step_max;
+  gfloat  *over;
+  gfloat  *under;
+} quantize_task;
+
+
+static void
+gegl_expcombine_quantize_part (gint     part,
+                               gint     parts,
+                               gpointer data)
+{
+  quantize_task *task     = data;
+  gfloat        *pixels   = task->pixels;
+  guint          first    = (guint64) task->count *  part      / parts;
+  guint          last     = (guint64) task->count * (part + 1) / parts;
+  guint          step_max = 0,
+                 step_min = task->steps - 1;
+  gfloat         over     = 0.0f,
+                 under    = 0.0f;
+  guint          i;
+
+  for (i = first; i < last; ++i)
+    {
+      /* Clamp the values we receive to [0.0, 1.0) and record the
+       * magnitude of this over/underflow.
+       */
+      if (pixels[i] <= 0.0f)
+        {
+          under += fabs (pixels[i]);
+          pixels[i] = 0.0f;
+        }
+      else if (pixels[i] > 1.0f)
+        {
+          over  += pixels[i] - 1.0f;
+          pixels[i] = 1.0f;
+        }
+
+      pixels[i] *= (task->steps - 1);
+      if (pixels[i] > 0.0f)
+        {
+          step_max = MAX (step_max, pixels[i]);
+          step_min = MIN (step_min, pixels[i]);
+        }
+    }
+
+  task->step_min[part] = step_min;
+  task->step_max[part] = step_max;
+  task->over    [part] = over;
+  task->under   [part] = under;
+}
+
+
+/* Remap from the 'normal' 0.0-1.0 floats to the range of integer steps, in
+ * place. Widens step_min and step_max to the lowest and highest non-zero
+ * steps found, and adds the magnitude of values outside of the range to
+ * over and under. The statistics are skipped if step_min is NULL.
+ */
+static void
+gegl_expcombine_quantize (gfloat *pixels,
+                          guint   count,
+                          guint   steps,
+                          guint  *step_min,
+                          guint  *step_max,
+                          gfloat *over,
+                          gfloat *under)
+{
+  quantize_task task;
+  gint          parts = gegl_parallel_get_n_threads ();
+  gint          i;
+
+  task.pixels   = pixels;
+  task.count    = count;
+  task.steps    = steps;
+  task.step_min = g_new (guint,  parts);
+  task.step_max = g_new (guint,  parts);
+  task.over     = g_new (gfloat, parts);
+  task.under    = g_new (gfloat, parts);
+
+  /* neutral statistics for parts that end up not running */
+  for (i = 0; i < parts; ++i)
+    {
+      task.step_min[i] = steps - 1;
+      task.step_max[i] = 0;
+      task.over    [i] = 0.0f;
+      task.under   [i] = 0.0f;
+    }
+
+  gegl_parallel_distribute (parts, gegl_expcombine_quantize_part, &task);
+
+  for (i = 0; step_min && i < parts; ++i)
+    {
+      *step_min  = MIN (*step_min, task.step_min[i]);
+      *step_max  = MAX (*step_max, task.step_max[i]);
+      *over     += task.over [i];
+      *under    += task.under[i];
+    }
+
+  g_free (task.step_min);
+  g_free (task.step_max);
+  g_free (task.over);
+  g_free (task.under);
+}
+
+
+/* Read the band of full resolution pixels of every exposure and remap them
+ * to steps, see gegl_expcombine_quantize for the statistics.
+ */
+static void
+gegl_expcombine_get_band (exposure           **imgs,
+                          guint                num_imgs,
+                          const GeglRectangle *band,
+                          guint                components,
+                          guint                steps,
+                          guint               *step_min,
+                          guint               *step_max,
+                          gfloat              *over,
+                          gfloat              *under)
+{
+  guint i;
+
+  for (i = 0; i < num_imgs; ++i)
+    {
+      exposure *e = imgs[i];
+
+      gegl_buffer_get (e->buffer, 1.0, band, babl_format (PAD_FORMAT),
+                       e->pixels[PIXELS_FULL], GEGL_AUTO_ROWSTRIDE);
+      gegl_expcombine_quantize (e->pixels[PIXELS_FULL],
+                                band->width * band->height * components,
+                                steps, step_min, step_max, over, under);
+    }
+}
+
+
 static gboolean
 gegl_expcombine_process (GeglOperation        *operation,
                          GeglOperationContext *context,
@@ -1065,11 +1422,14 @@ gegl_expcombine_process (GeglOperation        *operation,
                                                                output_pad);
 
   GeglRectangle   scaled_roi;
+  GeglRectangle   band;
   GSList         *cursor;
   GSList         *exposures   = gegl_expcombine_get_exposures (operation,
                                                                context,
                                                                full_roi,
                                                                &scaled_roi);
+  exposure      **imgs;
+  guint           num_imgs;
 
   guint   i;
   guint   steps      = 1 << o->steps,
@@ -1077,9 +1437,7 @@ gegl_expcombine_process (GeglOperation        *operation,
           step_min   = steps - 1;
 
   guint   components = babl_format_get_n_components (babl_format (PAD_FORMAT));
-  gfloat *hdr        = g_new (gfloat, full_roi->width  *
-                                      full_roi->height *
-                                      components);
+  gfloat *hdr;
   gfloat *weights     =   g_new (gfloat, steps);
   gfloat *response[3] = { g_new (gfloat, steps),
                           g_new (gfloat, steps),
@@ -1095,48 +1453,29 @@ gegl_expcombine_process (GeglOperation        *operation,
   g_return_val_if_fail (steps      > 0, FALSE);
   g_return_val_if_fail (components > 0, FALSE);
 
-  /* Find the highest and lowest valid steps in the output. Remap from the
-   * 'normal' 0.0-1.0 floats to the range of integer steps.
+  num_imgs = g_slist_length (exposures);
+  imgs     = g_new (exposure *, num_imgs);
+  for (cursor = exposures, i = 0; cursor; cursor = cursor->next, ++i)
+    imgs[i] = cursor->data;
+
+  /* Find the highest and lowest valid steps in the output, streaming the
+   * exposures one band at a time.
    */
-  for (cursor = exposures; cursor; cursor = cursor->next)
+  band = *full_roi;
+  for (band.y = full_roi->y;
+       band.y < full_roi->y + full_roi->height;
+       band.y += BAND_HEIGHT)
     {
-      exposure *e = cursor->data;
-
-      for (i = 0; i < full_roi->width * full_roi->height * components; ++i)
-        {
-          /* Clamp the values we receive to [0.0, 1.0) and record the
-           * magnitude of this over/underflow.
-           */
-          if (e->pixels[PIXELS_FULL][i] <= 0.0f)
-            {
-              under += fabs (e->pixels[PIXELS_FULL][i]);
-              e->pixels[PIXELS_FULL][i] = 0.0f;
-            }
-          else if (e->pixels[PIXELS_FULL][i] > 1.0f)
-            {
-              over  += e->pixels[PIXELS_FULL][i] - 1.0f;
-              e->pixels[PIXELS_FULL][i] = 1.0f;
-            }
-
-          e->pixels[PIXELS_FULL][i] *= (steps - 1);
-          if (e->pixels[PIXELS_FULL][i] > 0.0f)
-            {
-              step_max = MAX (step_max, e->pixels[PIXELS_FULL][i]);
-              step_min = MIN (step_min, e->pixels[PIXELS_FULL][i]);
-            }
-        }
-
-      if (e->pixels[PIXELS_SCALED] == e->pixels[PIXELS_FULL])
-          continue;
-
-      for (i = 0; i < scaled_roi.width * scaled_roi.height * components; ++i)
-        {
-          e->pixels[PIXELS_SCALED][i]  = CLAMP (e->pixels[PIXELS_SCALED][i], 0.0f, 1.0f);
-          e->pixels[PIXELS_SCALED][i] *= (steps - 1);
-        }
-
+      band.height = MIN (BAND_HEIGHT, full_roi->y + full_roi->height - band.y);
+      gegl_expcombine_get_band (imgs, num_imgs, &band, components, steps,
+                                &step_min, &step_max, &over, &under);
     }
 
+  for (i = 0; i < num_imgs; ++i)
+    gegl_expcombine_quantize (imgs[i]->pixels[PIXELS_SCALED],
+                              scaled_roi.width * scaled_roi.height * components,
+                              steps, NULL, NULL, NULL, NULL);
+
   g_return_val_if_fail (step_max >= step_min, FALSE);
   if (under || over)
       g_warning ("Unexpected pixel bounds. "
@@ -1151,13 +1490,17 @@ gegl_expcombine_process (GeglOperation        *operation,
   gegl_expcombine_weights_gauss (weights, steps, step_min, step_max, o->sigma);
   gegl_expcombine_exposures_set_active (exposures, PIXELS_SCALED);
 
+  hdr = g_new (gfloat, scaled_roi.width * scaled_roi.height * components);
   for (i = 0; i < components; ++i)
     {
       gegl_expcombine_response_linear (response[i], steps);
-      saturated += gegl_expcombine_get_response (hdr, i, components, exposures,
+      saturated += gegl_expcombine_get_response (hdr, i, components,
+                                                 imgs, num_imgs,
                                                  response[i], weights, steps,
-                                                 &scaled_roi);
+                                                 scaled_roi.width *
+                                                 scaled_roi.height);
     }
+  g_free (hdr);
 
 #ifdef DEBUG_SAVE_CURVES
   gegl_expcombine_save_curves (response[0], steps, "response_r");
@@ -1165,9 +1508,28 @@ gegl_expcombine_process (GeglOperation        *operation,
   gegl_expcombine_save_curves (response[2], steps, "response_b");
 #endif
 
+  /* Merge the full resolution exposures band by band, so only a band of
+   * every exposure is held in memory.
+   */
   gegl_expcombine_exposures_set_active (exposures, PIXELS_FULL);
-  gegl_expcombine_apply_debevec (hdr, components, exposures, response, weights,
-                            steps, full_roi);
+  hdr = g_new (gfloat, full_roi->width * BAND_HEIGHT * components);
+
+  for (band.y = full_roi->y;
+       band.y < full_roi->y + full_roi->height;
+       band.y += BAND_HEIGHT)
+    {
+      band.height = MIN (BAND_HEIGHT, full_roi->y + full_roi->height - band.y);
+      gegl_expcombine_get_band (imgs, num_imgs, &band, components, steps,
+                                NULL, NULL, NULL, NULL);
+
+      gegl_expcombine_apply_debevec (hdr, components, imgs, num_imgs,
+                                     response, weights, steps,
+                                     band.width * band.height);
+
+      /* Save the HDR components to the output buffer. */
+      gegl_buffer_set (output, &band, babl_format (PAD_FORMAT), hdr,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
 
   g_return_val_if_fail (G_N_ELEMENTS (response) == 3, FALSE);
   g_free (response[0]);
@@ -1190,21 +1552,38 @@ gegl_expcombine_process (GeglOperation        *operation,
   {
     gfloat max = G_MINFLOAT;
     guint  i;
-    for (i = 0; i < full_roi->width * full_roi->height * components; ++i)
-        max = MAX (max, hdr[i]);
 
-    for (i = 0; i < full_roi->width * full_roi->height * components; ++i)
-        hdr[i] /= max;
+    for (band.y = full_roi->y;
+         band.y < full_roi->y + full_roi->height;
+         band.y += BAND_HEIGHT)
+      {
+        band.height = MIN (BAND_HEIGHT, full_roi->y + full_roi->height - band.y);
+        gegl_buffer_get (output, 1.0, &band, babl_format (PAD_FORMAT), hdr,
+                         GEGL_AUTO_ROWSTRIDE);
+        for (i = 0; i < band.width * band.height * components; ++i)
+            max = MAX (max, hdr[i]);
+      }
+
+    for (band.y = full_roi->y;
+         band.y < full_roi->y + full_roi->height;
+         band.y += BAND_HEIGHT)
+      {
+        band.height = MIN (BAND_HEIGHT, full_roi->y + full_roi->height - band.y);
+        gegl_buffer_get (output, 1.0, &band, babl_format (PAD_FORMAT), hdr,
+                         GEGL_AUTO_ROWSTRIDE);
+        for (i = 0; i < band.width * band.height * components; ++i)
+            hdr[i] /= max;
+        gegl_buffer_set (output, &band, babl_format (PAD_FORMAT), hdr,
+                         GEGL_AUTO_ROWSTRIDE);
+      }
   }
 #endif
 
-  /* Save the HDR components to the output buffer. */
-  gegl_buffer_set (output, full_roi, babl_format (PAD_FORMAT), hdr,
-                   GEGL_AUTO_ROWSTRIDE);
   gegl_cache_computed (gegl_node_get_cache (operation->node), full_roi);
 
   /* Cleanup */
   g_free (hdr);
+  g_free (imgs);
 
   g_slist_foreach (exposures, (GFunc)gegl_expcombine_destroy_exposure, NULL);
   g_slist_free    (exposures);
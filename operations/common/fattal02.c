@@ -16,11 +16,6 @@
  * TMO:
  * Copyright 2010      Danny Robson      <danny@blubinc.net>
  * (pfstmo)  2003-2004 Grzegorz Krawczyk <krawczyk@mpi-sb.mpg.de>
- *
- * PDE:
- * 2003-2004 Grzegorz Krawczyk  <krawczyk@mpi-sb.mpg.de>
- *           Rafal Mantiuk      <mantiuk@mpi-sb.mpg.de>
- * Some code from Numerical Recipes in C
  */
 
 #include "config.h"
@@ -52,17 +47,13 @@ gegl_chant_double (noise, _("Noise"),
 #include "gegl-chant.h"
 #include "gegl-debug.h"
 #include <stdlib.h>
+#include <string.h>
+
+#include "poisson-solver.h"
 
 static const gchar *OUTPUT_FORMAT   = "RGB float";
 static const gint   MINIMUM_PYRAMID = 32;
 
-/* I: pixel buffer, luminance with stride of 1
- * R: rectangle, describes the buffer extent
- * X: width coordinate
- * Y: height coordinate
- */
-#define _P(I,R,X,Y) ((I)[(Y) * (R)->width + (X)])
-
 /* The width/height of the pyramid at a level */
 #define LEVEL_WIDTH(extent, level)  ((extent)->width  / (1 << (level)))
 #define LEVEL_HEIGHT(extent, level) ((extent)->height / (1 << (level)))
@@ -75,659 +66,9 @@ static const gint   MINIMUM_PYRAMID = 32;
 #define LEVEL_SIZE(extent, level) (LEVEL_EXTENT((extent), (level)).width * \
                                    LEVEL_EXTENT((extent), (level)).height)
 
-#define MODYF 0 /* 1 or 0 (1 is better) */
-#define MINS 16	/* minimum size 4 6 or 100 */
-
-/* #define MODYF_SQRT -1.0f *//* -1 or 0 */
-#define SMOOTH_IT 1 /* minimum 1  */
-#define BCG_STEPS 20
-#define V_CYCLE 2 /* number of v-cycles  */
-
-/* precision */
-#define EPS 1.0e-12
-
-static void
-linbcg (guint   rows,
-        guint   cols,
-        gfloat  b[],
-        gfloat  x[],
-        gint    itol,
-        gfloat  tol,
-        gint    itmax,
-        gint   *iter,
-        gfloat *err);
-
-
-/**
- * Set all elements of the array to a give value.
- *
- * @param array array to modify
- * @param value all elements of the array will be set to this value
- */
-static inline void
-fattal02_set_array (gfloat *array,
-                    guint   size,
-                    gfloat  value)
-{
-  guint i;
-  for (i = 0; i < size; ++i)
-    array[i] = value;
-}
-
-
-static inline void
-fattal02_add_array (gfloat       *accum,
-                    guint         size,
-                    const gfloat *input)
-{
-  guint i;
-  for (i = 0; i < size; ++i)
-    accum[i] += input[i];
-}
-
-
-static inline void
-fattal02_copy_array (const gfloat *input,
-                     gsize         size,
-                     gfloat       *output)
-{
-  memcpy (output, input, size * sizeof (input[0]));
-}
-
-
-/*
- * Full Multigrid Algorithm for solving partial differential equations
- */
-
-static void
-fattal02_restrict (const gfloat        *input,
-                   const GeglRectangle *extent_i,
-                   gfloat              *output,
-                   const GeglRectangle *extent_o)
-{
-  const guint inRows = extent_i->height,
-              inCols = extent_i->width;
-
-  const guint outRows = extent_o->height,
-              outCols = extent_o->width;
-
-  const gfloat dx = (gfloat)inCols / (gfloat)outCols,
-               dy = (gfloat)inRows / (gfloat)outRows;
-
-  const gfloat filterSize = 0.5;
-
-  gfloat sx, sy;
-  guint   x,  y;
-
-  for (y = 0, sy = dy / 2 - 0.5; y < outRows; ++y, sy += dy)
-    {
-      for (x = 0, sx = dx / 2 - 0.5; x < outCols; ++x, sx += dx )
-        {
-          gfloat pixVal = 0;
-          gfloat w      = 0;
-          gint   ix, iy;
-
-          for (ix  = MAX (0, ceilf (sx - dx * filterSize));
-               ix <= MIN (floorf (sx + dx * filterSize), inCols - 1);
-               ++ix)
-            {
-              for (iy  = MAX (0, ceilf (sy - dx * filterSize));
-                   iy <= MIN (floorf (sy + dx * filterSize), inRows - 1);
-                   ++iy)
-                {
-                  pixVal += input[ix + iy * inCols];
-                  w      += 1;
-                }
-            }
-
-          output[x + y * outCols] = pixVal / w;
-        }
-    }
-}
-
-
-static void
-fattal02_prolongate (const gfloat        *input,
-                     const GeglRectangle *extent_i,
-                     gfloat              *output,
-                     const GeglRectangle *extent_o)
-{
-  gfloat dx = (gfloat)extent_i->width  / (gfloat)extent_o->width,
-         dy = (gfloat)extent_i->height / (gfloat)extent_o->height;
-
-  const guint outRows = extent_o->height,
-              outCols = extent_o->width;
-
-  const gfloat inRows = extent_i->height,
-               inCols = extent_i->width;
-
-  const float filterSize = 1;
-
-  gfloat sx, sy;
-  guint   x,  y;
-
-  for (y = 0, sy = -dy / 2; y < outRows; ++y, sy += dy)
-    {
-      for (x = 0, sx = -dx / 2; x < outCols; ++x, sx += dx )
-        {
-          gfloat pixVal = 0;
-          gfloat weight = 0;
-          gfloat ix, iy;
-
-          for (ix  = MAX (0, ceilf (sx - filterSize));
-               ix <= MIN (floorf (sx + filterSize), inCols - 1);
-               ++ix)
-            {
-              for (iy  = MAX (0, ceilf (sy - filterSize));
-                   iy <= MIN (floorf (sy + filterSize), inRows - 1);
-                   ++iy)
-                {
-                  const gfloat fx   = fabs (sx - ix),
-                               fy   = fabs (sy - iy),
-                               fval = (1 - fx) * (1 - fy);
-
-                  pixVal += input[(guint)ix + (guint)iy * (guint)inCols] * fval;
-                  weight += fval;
-                }
-            }
-
-          g_return_if_fail (weight != 0);
-
-          output [x + y * outCols] = pixVal / weight;
-        }
-    }
-}
-
-
-static void
-fattal02_exact_solution (gfloat              *F,
-                         const GeglRectangle *extent_f,
-                         gfloat              *U,
-                         const GeglRectangle *extent_u)
-{
-  /* pfstmo suggests that successive over-relaxation should be used here,
-   * followed by scaling by the square of the inverse of the sqrt of the array
-   * length. However it was commented out due to 'incorrect results', and the
-   * array zeroing was used in its place.
-   */
-  fattal02_set_array (U, extent_u->width * extent_u->height, 0.0f);
-  return;
-}
-
-
-/* smooth u using f at level */
-static void
-fattal02_smooth (gfloat              *U,
-                 const GeglRectangle *extent_u,
-                 gfloat              *F,
-                 const GeglRectangle *extent_f)
-{
-  gint   iter;
-  gfloat err;
-
-  linbcg (extent_u->height,
-          extent_u->width,
-          F, U, 1, 0.001,
-          BCG_STEPS, &iter, &err);
-
-  /* pfstmo notes here that 'gauss relaxation is too slow'. */
-}
-
-
-static void
-fattal02_calculate_defect (gfloat              *D,
-                           const GeglRectangle *extent_d,
-                           gfloat              *U,
-                           const GeglRectangle *extent_u,
-                           gfloat              *F,
-                           const GeglRectangle *extent_f)
-{
-  guint sx = extent_f->width,
-        sy = extent_f->height;
-  guint x, y;
-
-  for (y = 0; y < sy; ++y)
-    {
-      for (x = 0; x < sx; ++x)
-        {
-          guint w = (x     ==  0 ? 0 : x - 1),
-                n = (y     ==  0 ? 0 : y - 1),
-                s = (y + 1 == sy ? y : y + 1),
-                e = (x + 1 == sx ? x : x + 1);
-
-          _P (D, extent_d, x, y) = _P (F, extent_f, x, y) - (
-                                      _P (U, extent_u, e, y) +
-                                      _P (U, extent_u, w, y) +
-                                      _P (U, extent_u, x, n) +
-                                      _P (U, extent_u, x, s) -
-                                      4.0 * _P (U, extent_u, x, y)
-                                  );
-        }
-    }
-}
-
-
-static void
-fattal02_solve_pde_multigrid (gfloat              *F,
-                              const GeglRectangle *extent_f,
-                              gfloat              *U,
-                              const GeglRectangle *extent_u)
-{
-  guint xmax = extent_f->width,
-        ymax = extent_f->height;
-
-  gint i,	/* index for simple loops */
-       k,	/* index for iterating through levels */
-       k2;	/* index for iterating through levels in V-cycles */
-
-  gint levels;
-
-  gfloat **RHS, /* given function f restricted on levels */
-         **IU,  /* approximate initial sollutions on levels */
-         **VF;  /* target functions in cycles (approximate sollution error (uh - ~uh) ) */
-
-  /* 1. restrict f to coarse-grid (by the way count the number of levels)
-   *	  k=0: fine-grid = f
-   *	  k=levels: coarsest-grid
-   */
-  {
-    guint mins = MIN (xmax, ymax);
-    levels = 0;
-
-    while (mins >= MINS)
-      {
-        levels++;
-        mins = mins / 2 + MODYF;
-      }
-  }
-
-  RHS = g_new (gfloat*, levels + 1);
-   IU = g_new (gfloat*, levels + 1);
-   VF = g_new (gfloat*, levels + 1);
-
-  RHS[0] = F;
-   VF[0] = g_new (gfloat, xmax * ymax);
-   IU[0] = g_new (gfloat, xmax * ymax);
-  fattal02_copy_array (U, xmax * ymax, IU[0]);
-
-  for (k = 0; k < levels; ++k)
-    {
-      RHS[k + 1] = g_new (gfloat, LEVEL_SIZE (extent_f, k + 1));
-       IU[k + 1] = g_new (gfloat, LEVEL_SIZE (extent_f, k + 1));
-       VF[k + 1] = g_new (gfloat, LEVEL_SIZE (extent_f, k + 1));
-
-      /* restrict from level k to level k+1 (coarser-grid) */
-      fattal02_restrict (RHS[k    ], &LEVEL_EXTENT (extent_f, k     ),
-                         RHS[k + 1], &LEVEL_EXTENT (extent_f, k + 1));
-    }
-
-  /* 2. find exact solution at the coarsest-grid (k=levels) */
-  fattal02_exact_solution (RHS[levels], &LEVEL_EXTENT (extent_f, levels),
-                            IU[levels], &LEVEL_EXTENT (extent_f, levels));
-
-  /* 3. nested iterations */
-  for (k = levels - 1; k >= 0; --k)
-    {
-      guint cycle;
-
-      /* 4. interpolate sollution from last coarse-grid to finer-grid
-       * interpolate from level k+1 to level k (finer-grid)
-       */
-      fattal02_prolongate (IU[k + 1], &LEVEL_EXTENT (extent_f, k + 1),
-                           IU[k    ], &LEVEL_EXTENT (extent_f, k    ));
-
-      /* 4.1. first target function is the equation target function
-       *      (following target functions are the defect)
-       */
-      fattal02_copy_array (RHS[k], LEVEL_SIZE (extent_f, k), VF[k]);
-
-      /* 5. V-cycle (twice repeated) */
-      for (cycle = 0; cycle < V_CYCLE; ++cycle)
-        {
-          /* 6. downward stroke of V */
-          for (k2 = k; k2 < levels; ++k2)
-            {
-              gfloat *D;
-
-              /* 7. pre-smoothing of initial sollution using target function
-               *    zero for initial guess at smoothing
-               *    (except for level k when iu contains prolongated result)
-               */
-              if (k2 != k)
-                {
-                  fattal02_set_array (IU[k2], LEVEL_SIZE (extent_f, k2), 0.0f);
-                }
-
-              for (i = 0; i < SMOOTH_IT; ++i)
-                {
-                  fattal02_smooth (IU[k2], &LEVEL_EXTENT (extent_f, k2),
-                                   VF[k2], &LEVEL_EXTENT (extent_f, k2));
-                }
-
-              /* 8. calculate defect at level
-               *    d[k2] = Lh * ~u[k2] - f[k2]
-               */
-              D = g_new (gfloat, LEVEL_SIZE (extent_f, k2));
-              fattal02_calculate_defect (     D, &LEVEL_EXTENT (extent_f, k2),
-                                         IU[k2], &LEVEL_EXTENT (extent_f, k2),
-                                         VF[k2], &LEVEL_EXTENT (extent_f, k2));
-
-              /* 9. restrict deffect as target function for next coarser-grid
-               *    def -> f[k2+1]
-               */
-              fattal02_restrict (         D, &LEVEL_EXTENT (extent_f, k2    ),
-                                 VF[k2 + 1], &LEVEL_EXTENT (extent_f, k2 + 1));
-              g_free (D);
-            }
-
-          /* 10. solve on coarsest-grid (target function is the deffect)
-           *     iu[levels] should contain sollution for
-           *     the f[levels] - last deffect, iu will now be the correction
-           */
-          fattal02_exact_solution (VF[levels], &LEVEL_EXTENT (extent_f, levels),
-                                   IU[levels], &LEVEL_EXTENT (extent_f, levels));
-
-          /* 11. upward stroke of V */
-          for (k2 = levels - 1; k2 >= k; --k2)
-            {
-              /* 12. interpolate correction from last coarser-grid to finer-grid
-               *     iu[k2+1] -> cor
-               */
-              gfloat *C = g_new (gfloat, LEVEL_SIZE (extent_f, k2));
-              fattal02_prolongate (IU[k2 + 1], &LEVEL_EXTENT (extent_f, k2 + 1),
-                                            C, &LEVEL_EXTENT (extent_f, k2    ));
-
-              /* 13. add interpolated correction to initial sollution at level k2 */
-              fattal02_add_array (IU[k2], LEVEL_SIZE (extent_f, k2), C);
-              g_free (C);
-
-              /* 14. post-smoothing of current sollution using target function */
-              for (i = 0; i < SMOOTH_IT; ++i)
-                  fattal02_smooth (IU[k2], &LEVEL_EXTENT (extent_f, k2),
-                                   VF[k2], &LEVEL_EXTENT (extent_f, k2));
-            }
-
-        } /*--- end of V-cycle */
-
-    } /*--- end of nested iteration */
-
-  /* 15. final sollution
-   *     IU[0] contains the final sollution
-   */
-
-  fattal02_copy_array (IU[0], extent_f->width * extent_f->height, U);
-
-  g_free (VF[0]);
-  g_free (IU[0]);
-
-  for (k = 1; k <= levels; ++k)
-    {
-      g_free (RHS[k]);
-      g_free ( IU[k]);
-      g_free ( VF[k]);
-    }
-
-  g_free (RHS);
-  g_free ( IU);
-  g_free ( VF);
-}
-
-
-static void
-asolve (gulong n,
-        gfloat b[],
-        gfloat x[],
-        gint   itrnsp)
-{
-  guint i;
-
-  for (i = 0; i < n; ++i)
-    x[i] = -4 * b[i];
-}
-
-static void
-atimes (guint  rows,
-        guint  cols,
-        gfloat x[],
-        gfloat res[],
-        gint   itrnsp)
-{
-  guint r, c;
-
-#define IDX(R,C) ((R) * cols + (C))
-
-  for (r = 1; r < rows - 1; ++r)
-    {
-      for (c = 1; c < cols - 1; ++c)
-        {
-          res[IDX (r,c)] = x[IDX (r-1,c)] + x[IDX (r+1,c)] +
-            x[IDX (r,c-1)] + x[IDX (r,c+1)] - 4*x[IDX (r,c)];
-        }
-    }
-
-  for (r = 1; r < rows - 1; ++r)
-    {
-      res[IDX (r, 0)] =     x[IDX (r - 1, 0)] +
-                            x[IDX (r + 1, 0)] +
-                            x[IDX (r    , 1)] -
-                        3 * x[IDX (r    , 0)];
-
-      res[IDX (r, cols - 1)] =     x[IDX (r - 1, cols - 1)] +
-                                   x[IDX (r + 1, cols - 1)] +
-                                   x[IDX (r    , cols - 2)] -
-                               3 * x[IDX (r    , cols - 1)];
-    }
-
-  for (c = 1; c < cols - 1; ++c)
-    {
-      res[IDX (0, c)] =     x[IDX (1, c    )] +
-                            x[IDX (0, c - 1)] +
-                            x[IDX (0, c + 1)] -
-                        3 * x[IDX (0, c     )];
-
-      res[IDX (rows - 1, c)] =     x[IDX (rows - 2, c    )] +
-                                   x[IDX (rows - 1, c - 1)] +
-                                   x[IDX (rows - 1, c + 1)] -
-                               3 * x[IDX (rows - 1, c    )];
-    }
-
-  res[IDX (0       ,        0)] =     x[IDX (1       ,        0)] +
-                                      x[IDX (0       ,        1)] -
-                                  2 * x[IDX (0       ,        0)];
-  res[IDX (rows - 1,        0)] =     x[IDX (rows - 2,        0)] +
-                                      x[IDX (rows - 1,        1)] -
-                                  2 * x[IDX (rows - 1,        0)];
-  res[IDX (0       , cols - 1)] =     x[IDX (1       , cols - 1)] +
-                                      x[IDX (0       , cols - 2)] -
-                                  2 * x[IDX (0       , cols - 1)];
-  res[IDX (rows - 1, cols - 1)] =     x[IDX (rows - 2, cols - 1)] +
-                                      x[IDX (rows - 1, cols - 2)] -
-                                  2 * x[IDX (rows - 1, cols - 1)];
-}
-
-static gfloat
-snrm (gulong n,
-      gfloat sx[],
-      gint   itol)
-{
-  gulong i;
-
-  if (itol <= 3)
-    {
-      gfloat ans = 0.0;
-      for (i = 0; i < n; ++i)
-          ans += sx[i] * sx[i];
-      return sqrtf (ans);
-    }
-  else
-    {
-      gulong isamax = 0;
-      for (i = 0; i < n; ++i)
-        if (fabs (sx[i]) > fabs (sx[isamax]))
-            isamax = i;
-      return fabs (sx[isamax]);
-    }
-}
-
-
-/**
- * Biconjugate Gradient Method
- * from Numerical Recipes in C
- */
-static void
-linbcg (guint   rows,
-        guint   cols,
-        gfloat  b[],
-        gfloat  x[],
-        gint    itol,
-        gfloat  tol,
-        gint    itmax,
-        gint   *iter,
-        gfloat *err)
-{
-  guint  n = rows * cols;
-
-  gulong j;
-  gfloat ak,akden,bk,bkden,bknum,bnrm,dxnrm,xnrm,zm1nrm,znrm;
-  gfloat *p,*pp,*r,*rr,*z,*zz;
-
-  /* To remove warning about potetial uninitialized use */
-  bkden = 1;
-
-  p  = g_new (gfloat, n);
-  pp = g_new (gfloat, n);
-  r  = g_new (gfloat, n);
-  rr = g_new (gfloat, n);
-  z  = g_new (gfloat, n);
-  zz = g_new (gfloat, n);
-
-  *iter=0;
-  atimes (rows, cols, x, r, 0);
-  for (j = 0; j < n; ++j)
-    {
-       r[j] = b[j] - r[j];
-      rr[j] = r[j];
-    }
-
-  atimes (rows, cols, r, rr, 0);       /* minimum residual */
-  znrm = 1.0;
-
-  if (itol == 1)
-    {
-      bnrm = snrm (n, b, itol);
-    }
-  else if (itol == 2)
-    {
-      asolve (n, b, z, 0);
-      bnrm = snrm (n, z, itol);
-    }
-  else if (itol == 3 || itol == 4)
-    {
-      asolve (n, b, z, 0);
-      bnrm = snrm (n, z, itol);
-      asolve (n, r, z, 0);
-      znrm = snrm (n, z, itol);
-    }
-  else
-    {
-      g_warning ("illegal itol in linbcg");
-    }
-
-  asolve (n, r, z, 0);
-
-  while (*iter <= itmax)
-    {
-      ++(*iter);
-
-      zm1nrm = znrm;
-      asolve (n, rr, zz, 1);
-      for (bknum = 0.0, j = 0; j < n; ++j)
-        {
-          bknum += z[j] * rr[j];
-        }
-
-      if (*iter == 1)
-        {
-          for (j = 0; j < n; ++j)
-            {
-               p[j] =  z[j];
-              pp[j] = zz[j];
-            }
-        }
-      else
-        {
-          bk = bknum / bkden;
-
-          for (j = 0; j < n; ++j)
-            {
-               p[j] = bk *  p[j] +  z[j];
-              pp[j] = bk * pp[j] + zz[j];
-            }
-        }
-
-      bkden = bknum;
-      atimes (rows, cols, p, z, 0);
-
-      for (akden = 0.0, j = 0; j < n; ++j)
-        {
-          akden += z[j] * pp[j];
-        }
-
-      ak = bknum / akden;
-      atimes (rows, cols, pp, zz, 1);
-
-      for (j = 0; j < n; ++j)
-        {
-           x[j] += ak *  p[j];
-           r[j] -= ak *  z[j];
-          rr[j] -= ak * zz[j];
-        }
-
-      asolve (n, r, z, 0);
-
-      if (itol == 1 || itol == 2)
-        {
-          znrm = 1.0;
-          *err = snrm (n, r, itol) / bnrm;
-        }
-      else if (itol == 3 || itol == 4)
-        {
-          znrm = snrm (n, z, itol);
-
-          if (fabs (zm1nrm - znrm) > EPS * znrm)
-            {
-              dxnrm = fabs (ak) * snrm (n, p, itol);
-              *err = znrm / fabs (zm1nrm - znrm) * dxnrm;
-            }
-          else
-            {
-              *err = znrm / bnrm;
-              continue;
-            }
-
-          xnrm = snrm (n, x, itol);
-          if (*err <= 0.5 * xnrm)
-            {
-              *err /= xnrm;
-            }
-          else
-            {
-              *err=znrm/bnrm;
-              continue;
-            }
-        }
-
-      if (*err <= tol)
-        break;
-    }
-
-  g_free (p);
-  g_free (pp);
-  g_free (r);
-  g_free (rr);
-  g_free (z);
-  g_free (zz);
-}
+/* the relative residual the gradient field is integrated to */
+#define PDE_TOLERANCE  1e-4
+#define PDE_MAX_CYCLES 50
 
 
 /* Downscale the input buffer by a factor of two. Extent describes the input
@@ -1170,8 +511,9 @@ fattal02_tonemap (const gfloat        *input,   /* Y */
   GEGL_NOTE (GEGL_DEBUG_PROCESS, "recovering image");
 
   /* solve pde and exponentiate (ie recover compressed image) */
-  U = g_new (gfloat, size);
-  fattal02_solve_pde_multigrid (divergence, extent, U, extent);
+  U = g_new0 (gfloat, size);
+  poisson_solve (divergence, U, width, height,
+                 PDE_TOLERANCE, PDE_MAX_CYCLES);
 
   for (i = 0; i < size; ++i)
     output[i] = expf (U[i]) - 1e-4f;
@@ -75,6 +75,7 @@ gegl_chant_boolean (useloglog, _("Loglog smoothing"), FALSE,
 #define GEGL_CHANT_C_FILE       "fractal-explorer.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 #include <math.h>
 #include <stdio.h>
 
@@ -107,6 +108,13 @@ typedef struct
 typedef gucharRGB  clrmap[MAXNCOLORS];
 
 
+/* Number of pixels iterated in lockstep. The lanes are plain arrays walked
+ * by fixed length loops the compiler can vectorize. Every lane keeps the
+ * state it had when it escaped, the loglog smoothing needs it, and the
+ * block stops as soon as all of its lanes escaped.
+ */
+#define EXPLORER_LANES 8
+
 static void
 explorer_render_row (GeglChantO *o,
                      gint        col_start,
@@ -119,21 +127,6 @@ explorer_render_row (GeglChantO *o,
   gint    col;
   gdouble xmin;
   gdouble ymin;
-  gdouble a;
-  gdouble b;
-  gdouble x;
-  gdouble y;
-  gdouble oldx;
-  gdouble oldy;
-  gdouble tempsqrx;
-  gdouble tempsqry;
-  gdouble tmpx = 0;
-  gdouble tmpy = 0;
-  gdouble foldxinitx;
-  gdouble foldxinity;
-  gdouble foldyinitx;
-  gdouble foldyinity;
-  gdouble xx = 0;
   gdouble adjust;
   gdouble cx;
   gdouble cy;
@@ -159,156 +152,210 @@ explorer_render_row (GeglChantO *o,
   xdiff = (o->xmax - xmin) / o->width;
   ydiff = (o->ymax - ymin) / o->height;
 
-  for (col = col_start; col < col_end; col++)
+  for (col = col_start; col < col_end; col += EXPLORER_LANES)
     {
-      a = xmin + (gdouble) col * xdiff;
-      b = ymin + (gdouble) row * ydiff;
-      if (fractaltype != 0)
-        {
-          tmpx = x = a;
-          tmpy = y = b;
-        }
-      else
+      gdouble  a[EXPLORER_LANES];
+      gdouble  b[EXPLORER_LANES];
+      gdouble  x[EXPLORER_LANES];
+      gdouble  y[EXPLORER_LANES];
+      gdouble  tmpx[EXPLORER_LANES];
+      gdouble  tmpy[EXPLORER_LANES];
+      gint     escaped[EXPLORER_LANES];
+      gboolean active[EXPLORER_LANES];
+      gint     n_active = 0;
+      gint     lane;
+
+      for (lane = 0; lane < EXPLORER_LANES; lane++)
         {
-          x = 0;
-          y = 0;
+          a[lane] = xmin + (gdouble) (col + lane) * xdiff;
+          b[lane] = ymin + (gdouble) row * ydiff;
+          if (fractaltype != 0)
+            {
+              tmpx[lane] = x[lane] = a[lane];
+              tmpy[lane] = y[lane] = b[lane];
+            }
+          else
+            {
+              tmpx[lane] = tmpy[lane] = 0;
+              x[lane] = 0;
+              y[lane] = 0;
+            }
+
+          escaped[lane] = iteration;
+          active[lane]  = col + lane < col_end;
+          n_active     += active[lane];
         }
 
-      for (counter = 0; counter < iteration; counter++)
+      for (counter = 0; counter < iteration && n_active; counter++)
         {
-          oldx=x;
-          oldy=y;
+          gdouble xx[EXPLORER_LANES];
+          gdouble yy[EXPLORER_LANES];
+          gdouble newtmpx[EXPLORER_LANES];
+          gdouble newtmpy[EXPLORER_LANES];
 
           switch (fractaltype)
             {
             case TYPE_MANDELBROT:
-              xx = x * x - y * y + a;
-              y = 2.0 * x * y + b;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane] * x[lane] - y[lane] * y[lane] + a[lane];
+                  yy[lane] = 2.0 * x[lane] * y[lane] + b[lane];
+                }
               break;
 
             case TYPE_JULIA:
-              xx = x * x - y * y + cx;
-              y = 2.0 * x * y + cy;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane] * x[lane] - y[lane] * y[lane] + cx;
+                  yy[lane] = 2.0 * x[lane] * y[lane] + cy;
+                }
               break;
 
             case TYPE_BARNSLEY_1:
-              foldxinitx = oldx * cx;
-              foldyinity = oldy * cy;
-              foldxinity = oldx * cy;
-              foldyinitx = oldy * cx;
-              /* orbit calculation */
-              if (oldx >= 0)
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
                 {
-                  xx = (foldxinitx - cx - foldyinity);
-                  y  = (foldyinitx - cy + foldxinity);
-                }
-              else
-                {
-                  xx = (foldxinitx + cx - foldyinity);
-                  y  = (foldyinitx + cy + foldxinity);
+                  gdouble foldxinitx = x[lane] * cx;
+                  gdouble foldyinity = y[lane] * cy;
+                  gdouble foldxinity = x[lane] * cy;
+                  gdouble foldyinitx = y[lane] * cx;
+                  gdouble sign       = x[lane] >= 0 ? 1.0 : -1.0;
+
+                  /* orbit calculation */
+                  xx[lane] = foldxinitx - sign * cx - foldyinity;
+                  yy[lane] = foldyinitx - sign * cy + foldxinity;
                 }
               break;
 
             case TYPE_BARNSLEY_2:
-              foldxinitx = oldx * cx;
-              foldyinity = oldy * cy;
-              foldxinity = oldx * cy;
-              foldyinitx = oldy * cx;
-              /* orbit calculation */
-              if (foldxinity + foldyinitx >= 0)
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
                 {
-                  xx = foldxinitx - cx - foldyinity;
-                  y  = foldyinitx - cy + foldxinity;
-                }
-              else
-                {
-                  xx = foldxinitx + cx - foldyinity;
-                  y  = foldyinitx + cy + foldxinity;
+                  gdouble foldxinitx = x[lane] * cx;
+                  gdouble foldyinity = y[lane] * cy;
+                  gdouble foldxinity = x[lane] * cy;
+                  gdouble foldyinitx = y[lane] * cx;
+                  gdouble sign       = foldxinity + foldyinitx >= 0 ? 1.0 : -1.0;
+
+                  /* orbit calculation */
+                  xx[lane] = foldxinitx - sign * cx - foldyinity;
+                  yy[lane] = foldyinitx - sign * cy + foldxinity;
                 }
               break;
 
             case TYPE_BARNSLEY_3:
-              foldxinitx  = oldx * oldx;
-              foldyinity  = oldy * oldy;
-              foldxinity  = oldx * oldy;
-              /* orbit calculation */
-              if (oldx > 0)
-                {
-                  xx = foldxinitx - foldyinity - 1.0;
-                  y  = foldxinity * 2;
-                }
-              else
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
                 {
-                  xx = foldxinitx - foldyinity -1.0 + cx * oldx;
-                  y  = foldxinity * 2;
-                  y += cy * oldx;
+                  gdouble foldxinitx = x[lane] * x[lane];
+                  gdouble foldyinity = y[lane] * y[lane];
+                  gdouble foldxinity = x[lane] * y[lane];
+                  gdouble fold       = x[lane] > 0 ? 0.0 : x[lane];
+
+                  /* orbit calculation */
+                  xx[lane] = foldxinitx - foldyinity - 1.0 + cx * fold;
+                  yy[lane] = foldxinity * 2 + cy * fold;
                 }
               break;
 
             case TYPE_SPIDER:
               /* { c=z=pixel: z=z*z+c; c=c/2+z, |z|<=4 } */
-              xx = x*x - y*y + tmpx + cx;
-              y = 2 * oldx * oldy + tmpy +cy;
-              tmpx = tmpx/2 + xx;
-              tmpy = tmpy/2 + y;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane] * x[lane] - y[lane] * y[lane] + tmpx[lane] + cx;
+                  yy[lane] = 2 * x[lane] * y[lane] + tmpy[lane] + cy;
+                  newtmpx[lane] = tmpx[lane] / 2 + xx[lane];
+                  newtmpy[lane] = tmpy[lane] / 2 + yy[lane];
+                }
               break;
 
             case TYPE_MAN_O_WAR:
-              xx = x*x - y*y + tmpx + cx;
-              y = 2.0 * x * y + tmpy + cy;
-              tmpx = oldx;
-              tmpy = oldy;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane] * x[lane] - y[lane] * y[lane] + tmpx[lane] + cx;
+                  yy[lane] = 2.0 * x[lane] * y[lane] + tmpy[lane] + cy;
+                  newtmpx[lane] = x[lane];
+                  newtmpy[lane] = y[lane];
+                }
               break;
 
             case TYPE_LAMBDA:
-              tempsqrx = x * x;
-              tempsqry = y * y;
-              tempsqrx = oldx - tempsqrx + tempsqry;
-              tempsqry = -(oldy * oldx);
-              tempsqry += tempsqry + oldy;
-              xx = cx * tempsqrx - cy * tempsqry;
-              y = cx * tempsqry + cy * tempsqrx;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  gdouble tempsqrx = x[lane] - x[lane] * x[lane] + y[lane] * y[lane];
+                  gdouble tempsqry = -(y[lane] * x[lane]);
+
+                  tempsqry += tempsqry + y[lane];
+                  xx[lane] = cx * tempsqrx - cy * tempsqry;
+                  yy[lane] = cx * tempsqry + cy * tempsqrx;
+                }
               break;
 
             case TYPE_SIERPINSKI:
-              xx = oldx + oldx;
-              y = oldy + oldy;
-              if (oldy > .5)
-                y = y - 1;
-              else if (oldx > .5)
-                xx = xx - 1;
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane] + x[lane];
+                  yy[lane] = y[lane] + y[lane];
+                  if (y[lane] > .5)
+                    yy[lane] = yy[lane] - 1;
+                  else if (x[lane] > .5)
+                    xx[lane] = xx[lane] - 1;
+                }
               break;
 
             default:
+              for (lane = 0; lane < EXPLORER_LANES; lane++)
+                {
+                  xx[lane] = x[lane];
+                  yy[lane] = y[lane];
+                }
               break;
             }
 
-          x = xx;
-
-          if (((x * x) + (y * y)) >= 4.0)
-            break;
+          if (fractaltype != TYPE_SPIDER && fractaltype != TYPE_MAN_O_WAR)
+            for (lane = 0; lane < EXPLORER_LANES; lane++)
+              {
+                newtmpx[lane] = tmpx[lane];
+                newtmpy[lane] = tmpy[lane];
+              }
+
+          for (lane = 0; lane < EXPLORER_LANES; lane++)
+            if (active[lane])
+              {
+                x[lane]    = xx[lane];
+                y[lane]    = yy[lane];
+                tmpx[lane] = newtmpx[lane];
+                tmpy[lane] = newtmpy[lane];
+
+                if (((x[lane] * x[lane]) + (y[lane] * y[lane])) >= 4.0)
+                  {
+                    active[lane]  = FALSE;
+                    escaped[lane] = counter;
+                    n_active--;
+                  }
+              }
         }
 
-      if (useloglog)
+      for (lane = 0; lane < EXPLORER_LANES && col + lane < col_end; lane++)
         {
-          gdouble modulus_square = (x * x) + (y * y);
+          if (useloglog)
+            {
+              gdouble modulus_square = (x[lane] * x[lane]) + (y[lane] * y[lane]);
 
-          if (modulus_square > (G_E * G_E))
-              adjust = log (log (modulus_square) / 2.0) / log2;
+              if (modulus_square > (G_E * G_E))
+                  adjust = log (log (modulus_square) / 2.0) / log2;
+              else
+                  adjust = 0.0;
+            }
           else
+            {
               adjust = 0.0;
-        }
-      else
-        {
-          adjust = 0.0;
-        }
+            }
 
-      color = (gint) (((counter - adjust) * (ncolors - 1)) / iteration);
+          color = (gint) (((escaped[lane] - adjust) * (ncolors - 1)) / iteration);
 
-      (*dest_row)[0] = colormap[color].r;
-      (*dest_row)[1] = colormap[color].g;
-      (*dest_row)[2] = colormap[color].b;
-      (*dest_row) += 3;
+          (*dest_row)[0] = colormap[color].r;
+          (*dest_row)[1] = colormap[color].g;
+          (*dest_row)[2] = colormap[color].b;
+          (*dest_row) += 3;
+        }
     }
 }
 
@@ -397,6 +444,35 @@ make_color_map (GeglChantO *o, clrmap colormap)
     }
 }
 
+typedef struct
+{
+  GeglChantO          *o;
+  const GeglRectangle *result;
+  gucharRGB           *colormap;
+  guchar              *buf;
+} ExplorerRows;
+
+static void
+explorer_render_rows (gint     thread,
+                      gint     threads,
+                      gpointer data)
+{
+  ExplorerRows        *rows   = data;
+  const GeglRectangle *result = rows->result;
+  gint                 first  = result->height * thread / threads;
+  gint                 last   = result->height * (thread + 1) / threads;
+  guchar              *dst    = rows->buf + first * result->width * 3;
+  gint                 y;
+
+  for (y = first; y < last; y++)
+    explorer_render_row (rows->o,
+                         result->x,
+                         result->x + result->width,
+                         result->y + y,
+                         rows->colormap,
+                         &dst);
+}
+
 static void
 prepare (GeglOperation *operation)
 {
@@ -421,6 +497,7 @@ process (GeglOperation       *operation,
          const GeglRectangle *result)
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
+  ExplorerRows rows;
   clrmap  colormap;
   guchar *buf;
   gint    pxsize;
@@ -430,19 +507,13 @@ process (GeglOperation       *operation,
   g_object_get (output, "px-size", &pxsize, NULL);
 
   buf  = g_new (guchar, result->width * result->height * pxsize);
-    {
-      guchar *dst=buf;
-      gint y;
-      for (y=0; y < result->height; y++)
-        {
-          explorer_render_row (o,
-                               result->x,
-                               result->x + result->width ,
-                               result->y + y,
-                               colormap,
-                               &dst);
-        }
-    }
+
+  rows.o        = o;
+  rows.result   = result;
+  rows.colormap = colormap;
+  rows.buf      = buf;
+
+  gegl_parallel_distribute (result->height, explorer_render_rows, &rows);
 
   gegl_buffer_set (output, NULL, babl_format ("R'G'B' u8"), buf,
                    GEGL_AUTO_ROWSTRIDE);
@@ -47,6 +47,9 @@ gegl_chant_double (detail, _("Detail"),
 #include "gegl-chant.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "poisson-solver.h"
 
 #ifdef HAVE_OPENMP
 #define _OMP(x) _Pragma(#x)
@@ -457,20 +460,34 @@ mantiuk06_matrix_zero (guint   n,
   memset(m, 0, n * sizeof (gfloat));
 }
 
+/* rows of a gradient or divergence calculation, split across threads */
+typedef struct
+{
+  gint          cols;
+  gint          rows;
+  const gfloat *lum;
+  gfloat       *Gx;
+  gfloat       *Gy;
+  gfloat       *divG;
+} mantiuk06_rows_t;
+
 /* calculate divergence of two gradient maps (Gx and Gy)
  * divG(x,y) = Gx(x,y) - Gx(x-1,y) + Gy(x,y) - Gy(x,y-1)
  */
-static inline void
-mantiuk06_calculate_and_add_divergence (const gint          cols,
-                                        const gint          rows,
-                                        const gfloat *const Gx,
-                                        const gfloat *const Gy,
-                                        gfloat       *const divG)
+static void
+mantiuk06_divergence_rows (gint     i,
+                           gint     n,
+                           gpointer data)
 {
-  gint ky, kx;
-
-  _OMP (omp parallel for schedule(static))
-  for (ky = 0; ky < rows; ky++)
+  const mantiuk06_rows_t *task = data;
+  const gint    cols = task->cols;
+  const gfloat *Gx   = task->Gx;
+  const gfloat *Gy   = task->Gy;
+  gfloat       *divG = task->divG;
+  gint          last = task->rows * (i + 1) / n;
+  gint          ky, kx;
+
+  for (ky = task->rows * i / n; ky < last; ky++)
     {
       for (kx = 0; kx<cols; kx++)
         {
@@ -492,6 +509,19 @@ mantiuk06_calculate_and_add_divergence (const gint          cols,
     }
 }
 
+static inline void
+mantiuk06_calculate_and_add_divergence (const gint          cols,
+                                        const gint          rows,
+                                        const gfloat *const Gx,
+                                        const gfloat *const Gy,
+                                        gfloat       *const divG)
+{
+  mantiuk06_rows_t task = { cols, rows, NULL,
+                            (gfloat *) Gx, (gfloat *) Gy, divG };
+
+  gegl_parallel_distribute (rows, mantiuk06_divergence_rows, &task);
+}
+
 /* calculate the sum of divergences for the all pyramid level. the smaller
  * divergence map is upsamled and added to the divergence map for the higher
  * level of pyramid.
@@ -616,10 +646,7 @@ mantiuk06_scale_gradient (const gint          n,
                           gfloat       *const G,
                           const gfloat *const C)
 {
-  gint i;
-  _OMP (omp parallel for schedule(static))
-  for (i = 0; i < n; i++)
-    G[i] *= C[i];
+  poisson_solver_multiply (n, C, G);
 }
 
 /* scale gradients for the whole one pyramid with the use of (Cx,Cy) from the
@@ -706,17 +733,21 @@ mantiuk06_pyramid_allocate (int cols,
 
 
 /* calculate gradients */
-static inline void
-mantiuk06_calculate_gradient (const gint          cols,
-                              const gint          rows,
-                              const gfloat *const lum,
-                              gfloat       *const Gx,
-                              gfloat       *const Gy)
+static void
+mantiuk06_gradient_rows (gint     i,
+                         gint     n,
+                         gpointer data)
 {
-  gint ky, kx;
-
-  _OMP (omp parallel for schedule(static))
-  for (ky = 0; ky < rows; ky++)
+  const mantiuk06_rows_t *task = data;
+  const gint    cols = task->cols;
+  const gint    rows = task->rows;
+  const gfloat *lum  = task->lum;
+  gfloat       *Gx   = task->Gx;
+  gfloat       *Gy   = task->Gy;
+  gint          last = rows * (i + 1) / n;
+  gint          ky, kx;
+
+  for (ky = rows * i / n; ky < last; ky++)
     {
       for (kx = 0; kx < cols; kx++)
         {
@@ -735,6 +766,18 @@ mantiuk06_calculate_gradient (const gint          cols,
     }
 }
 
+static inline void
+mantiuk06_calculate_gradient (const gint          cols,
+                              const gint          rows,
+                              const gfloat *const lum,
+                              gfloat       *const Gx,
+                              gfloat       *const Gy)
+{
+  mantiuk06_rows_t task = { cols, rows, lum, Gx, Gy, NULL };
+
+  gegl_parallel_distribute (rows, mantiuk06_gradient_rows, &task);
+}
+
 
 /* calculate gradients for the pyramid
  * lum_temp gets overwritten!
@@ -857,7 +900,6 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
 
   for (; iter < itmax; iter++)
     {
-      guint i;
       gfloat bknum, ak, old_err2;
 
       if (progress_cb != NULL)
@@ -878,12 +920,8 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
         {
           const gfloat bk = bknum / bkden; /* beta = ...  */
 
-          _OMP (omp parallel for schedule(static))
-          for (i = 0; i < n; i++)
-            {
-              p[i]  =  z[i] + bk *  p[i];
-              pp[i] = zz[i] + bk * pp[i];
-            }
+          poisson_solver_xpay (n,  z, bk,  p);
+          poisson_solver_xpay (n, zz, bk, pp);
         }
 
       bkden = bknum; /* numerator becomes the dominator for the next iteration */
@@ -893,12 +931,8 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
 
       ak = bknum / mantiuk06_matrix_dot_product (n, z, pp); /* alfa = ...   */
 
-      _OMP (omp parallel for schedule(static))
-      for (i = 0 ; i < n ; i++ )
-        {
-          r[i]  -= ak *  z[i];  /*  r =  r - alfa *  z  */
-          rr[i] -= ak * zz[i];  /* rr = rr - alfa * zz  */
-        }
+      poisson_solver_axpy (n, -ak,  z,  r); /*  r =  r - alfa *  z  */
+      poisson_solver_axpy (n, -ak, zz, rr); /* rr = rr - alfa * zz  */
 
       old_err2 = err2;
       err2 = mantiuk06_matrix_dot_product (n, r, r);
@@ -920,9 +954,7 @@ mantiuk06_linbcg (pyramid_t           *pyramid,
           num_backwards = 0;
         }
 
-      _OMP (omp parallel for schedule(static))
-      for (i = 0 ; i < n ; i++ )
-        x[i] += ak * p[i];      /* x =  x + alfa * p */
+      poisson_solver_axpy (n, ak, p, x); /* x =  x + alfa * p */
 
       if (num_backwards > num_backwards_ceiling)
         {
@@ -1030,7 +1062,6 @@ mantiuk06_lincg (pyramid_t           *pyramid,
   percent_sf = 100.0f / logf (tol2 * bnrm2 / irdotr);
   for (; iter < itmax; iter++)
     {
-      gint  i;
       gfloat alpha, old_rdotr;
 
       if (progress_cb != NULL) {
@@ -1046,9 +1077,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
       alpha = rdotr / mantiuk06_matrix_dot_product (n, p, Ap);
 
       /* r = r - alpha Ap */
-      _OMP (omp parallel for schedule(static))
-      for (i = 0; i < n; i++)
-        r[i] -= alpha * Ap[i];
+      poisson_solver_axpy (n, -alpha, Ap, r);
 
       /* rdotr = r.r */
       old_rdotr = rdotr;
@@ -1072,9 +1101,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
         }
 
       /* x = x + alpha p */
-      _OMP (omp parallel for schedule(static))
-      for (i = 0; i < n; i++)
-        x[i] += alpha * p[i];
+      poisson_solver_axpy (n, alpha, p, x);
 
 
       /* Exit if we're done */
@@ -1105,9 +1132,7 @@ mantiuk06_lincg (pyramid_t           *pyramid,
           /* p = r + beta p */
           const gfloat beta = rdotr/old_rdotr;
 
-          _OMP (omp parallel for schedule(static))
-          for (i = 0; i < n; i++)
-            p[i] = r[i] + beta*p[i];
+          poisson_solver_xpay (n, r, beta, p);
         }
     }
 
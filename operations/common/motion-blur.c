@@ -35,6 +35,7 @@ gegl_chant_double (angle,  _("Angle"),  -360, 360, 0,
 #define GEGL_CHANT_C_FILE       "motion-blur.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
 static void
 prepare (GeglOperation *operation)
@@ -223,18 +224,165 @@ cl_process (GeglOperation       *operation,
   return TRUE;
 }
 
-static inline gfloat*
-get_pixel_color(gfloat* in_buf,
-                const GeglRectangle* rect,
-                gint x,
-                gint y)
+/* The CPU path integrates the bilinearly interpolated input along the blur
+ * line instead of sampling it at ceil(length) + 1 points.
+ *
+ * The axis the line advances fastest along is the major axis a, the other
+ * one the minor axis b, and s = db/da is the slope, between -1 and 1. The
+ * input is sheared along b into rows r holding F(a, r + s * a), so every
+ * blur line runs within a single sheared row, or between two neighbouring
+ * ones when it does not hit a row exactly. The integral of a row between
+ * any two positions is read from its prefix sums, so the cost per pixel
+ * does not depend on the length. For axis aligned angles the shear is the
+ * identity and this is a plain running sum along the rows.
+ *
+ * The shear is anchored to absolute coordinates, so results do not depend
+ * on how the output is split into chunks. The sheared rows are split across
+ * threads, every output pixel belongs to the lower of its two rows, so
+ * threads never touch the same pixel.
+ */
+
+typedef struct
+{
+  const gfloat *in_buf;
+  gfloat       *out_buf;
+
+  /* major and minor axis extents of in_buf, strides in floats */
+  gint          in_na, in_nb;
+  gint          in_stride_a, in_stride_b;
+  /* position of the output in in_buf, extents and strides of out_buf */
+  gint          out_a, out_b;
+  gint          out_na, out_nb;
+  gint          out_stride_a, out_stride_b;
+
+  gdouble       half_length;  /* half of the blur length along a */
+
+  /* per input column a, the shear as integer offset into in_buf and
+   * weight along b, rows are numbered in absolute coordinates
+   */
+  gint         *shear_offset;
+  gfloat       *shear_weight;
+  /* per output column, the lowest sheared row and the weight of the row
+   * above it for the first output pixel of the column
+   */
+  gint         *row_offset;
+  gfloat       *row_weight;
+
+  gint          first_row;
+  gint          rows;
+} MotionBlurShear;
+
+/* fills g with the sheared row r and c with its prefix integrals */
+static void
+shear_row (const MotionBlurShear *shear,
+           gint                   r,
+           gfloat                *g,
+           gdouble               *c)
 {
-  gint ix = x - rect->x;
-  gint iy = y - rect->y;
-  ix = CLAMP(ix, 0, rect->width-1);
-  iy = CLAMP(iy, 0, rect->height-1);
+  gint a, i;
+
+  for (a = 0; a < shear->in_na; a++)
+    {
+      gint          b0  = CLAMP (r + shear->shear_offset[a],     0, shear->in_nb - 1);
+      gint          b1  = CLAMP (r + shear->shear_offset[a] + 1, 0, shear->in_nb - 1);
+      gfloat        w   = shear->shear_weight[a];
+      const gfloat *pix0 = shear->in_buf + a * shear->in_stride_a + b0 * shear->in_stride_b;
+      const gfloat *pix1 = shear->in_buf + a * shear->in_stride_a + b1 * shear->in_stride_b;
+
+      for (i = 0; i < 4; i++)
+        g[a * 4 + i] = pix0[i] + w * (pix1[i] - pix0[i]);
+    }
+
+  for (i = 0; i < 4; i++)
+    c[i] = 0.0;
+  for (a = 1; a < shear->in_na; a++)
+    for (i = 0; i < 4; i++)
+      c[a * 4 + i] = c[(a - 1) * 4 + i] +
+                     0.5 * (g[(a - 1) * 4 + i] + g[a * 4 + i]);
+}
+
+/* integral of the piecewise linear row from 0 to x */
+static inline void
+row_integral (const MotionBlurShear *shear,
+              const gfloat          *g,
+              const gdouble         *c,
+              gdouble                x,
+              gdouble               *result)
+{
+  gint    k  = (gint) floor (x);
+  gint    k1 = MIN (k + 1, shear->in_na - 1);
+  gdouble f  = x - k;
+  gint    i;
+
+  for (i = 0; i < 4; i++)
+    result[i] = c[k * 4 + i] +
+                f * g[k * 4 + i] +
+                0.5 * f * f * (g[k1 * 4 + i] - g[k * 4 + i]);
+}
+
+static void
+motion_blur_rows (gint     thread,
+                  gint     threads,
+                  gpointer data)
+{
+  MotionBlurShear *shear = data;
+  gint             first = shear->first_row + shear->rows * thread / threads;
+  gint             last  = shear->first_row + shear->rows * (thread + 1) / threads;
+  gfloat          *g[2];
+  gdouble         *c[2];
+  gdouble          scale = 1.0 / (2.0 * shear->half_length);
+  gint             r;
+
+  g[0] = g_new (gfloat,  shear->in_na * 4);
+  g[1] = g_new (gfloat,  shear->in_na * 4);
+  c[0] = g_new (gdouble, shear->in_na * 4);
+  c[1] = g_new (gdouble, shear->in_na * 4);
+
+  if (first < last)
+    shear_row (shear, first, g[1], c[1]);
+
+  for (r = first; r < last; r++)
+    {
+      gfloat  *g_swap = g[0];
+      gdouble *c_swap = c[0];
+      gint     pa;
+
+      g[0] = g[1]; g[1] = g_swap;
+      c[0] = c[1]; c[1] = c_swap;
+      shear_row (shear, r + 1, g[1], c[1]);
+
+      for (pa = 0; pa < shear->out_na; pa++)
+        {
+          gint     pb = r - shear->row_offset[pa];
+          gdouble  a  = shear->out_a + pa;
+          gdouble  lo[4], hi[4];
+          gdouble  sum[4];
+          gfloat  *out_pixel;
+          gint     i;
+
+          if (pb < 0 || pb >= shear->out_nb)
+            continue;
+
+          row_integral (shear, g[0], c[0], a + shear->half_length, hi);
+          row_integral (shear, g[0], c[0], a - shear->half_length, lo);
+          for (i = 0; i < 4; i++)
+            sum[i] = (hi[i] - lo[i]) * (1.0 - shear->row_weight[pa]);
+
+          row_integral (shear, g[1], c[1], a + shear->half_length, hi);
+          row_integral (shear, g[1], c[1], a - shear->half_length, lo);
+          for (i = 0; i < 4; i++)
+            sum[i] += (hi[i] - lo[i]) * shear->row_weight[pa];
+
+          out_pixel = shear->out_buf + pa * shear->out_stride_a + pb * shear->out_stride_b;
+          for (i = 0; i < 4; i++)
+            out_pixel[i] = sum[i] * scale;
+        }
+    }
 
-  return &in_buf[(iy*rect->width + ix) * 4];
+  g_free (g[0]);
+  g_free (g[1]);
+  g_free (c[0]);
+  g_free (c[1]);
 }
 
 static gboolean
@@ -246,16 +394,17 @@ process (GeglOperation       *operation,
   GeglRectangle src_rect;
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
   GeglOperationAreaFilter *op_area;
+  MotionBlurShear shear;
   gfloat* in_buf;
   gfloat* out_buf;
-  gfloat* out_pixel;
-  gint x,y;
+  gint a;
 
   gdouble theta = o->angle * G_PI / 180.0;
   gdouble offset_x = o->length * cos(theta);
   gdouble offset_y = o->length * sin(theta);
-  gint num_steps = (gint)ceil(o->length) + 1;
-  gfloat inv_num_steps = 1.0f / num_steps;
+  gdouble slope;
+  gint src_a, src_b, roi_b;
+  gint min_row, max_row;
 
   op_area = GEGL_OPERATION_AREA_FILTER (operation);
 
@@ -269,61 +418,103 @@ process (GeglOperation       *operation,
     if (cl_process (operation, input, output, roi, &src_rect))
       return TRUE;
 
+  /* too short to integrate over, this samples the pixel itself */
+  if (o->length < 1e-3)
+    {
+      gegl_buffer_copy (input, roi, output, roi);
+      return TRUE;
+    }
+
   in_buf = g_new (gfloat, src_rect.width * src_rect.height * 4);
-  out_buf = g_new0 (gfloat, roi->width * roi->height * 4);
-  out_pixel = out_buf;
+  out_buf = g_new (gfloat, roi->width * roi->height * 4);
 
   gegl_buffer_get (input, 1.0, &src_rect, babl_format ("RaGaBaA float"), in_buf, GEGL_AUTO_ROWSTRIDE);
 
-  for (y=0; y<roi->height; ++y)
+  shear.in_buf  = in_buf;
+  shear.out_buf = out_buf;
+
+  if (fabs (offset_x) >= fabs (offset_y))
     {
-      for (x=0; x<roi->width; ++x)
-        {
-          gint step;
-          gint c;
-          gint px = x+roi->x;
-          gint py = y+roi->y;
-          gfloat sum[4] = {0,0,0,0};
-          for (step=0; step<num_steps; ++step)
-            {
-              gdouble t = num_steps == 1 ? 0.0 : step / (gdouble)(num_steps-1) - 0.5;
-
-              /* get the interpolated pixel position for this step */
-              gdouble xx = px + t*offset_x;
-              gdouble yy = py + t*offset_y;
-              gint ix = (gint)floor(xx);
-              gint iy = (gint)floor(yy);
-              gdouble dx = xx - floor(xx);
-              gdouble dy = yy - floor(yy);
-
-              /* do bilinear interpolation to get a nice smooth result */
-              gfloat *pix0, *pix1, *pix2, *pix3;
-              gfloat mixy0[4];
-              gfloat mixy1[4];
-
-              pix0 = get_pixel_color(in_buf, &src_rect, ix, iy);
-              pix1 = get_pixel_color(in_buf, &src_rect, ix+1, iy);
-              pix2 = get_pixel_color(in_buf, &src_rect, ix, iy+1);
-              pix3 = get_pixel_color(in_buf, &src_rect, ix+1, iy+1);
-              for (c=0; c<4; ++c)
-                {
-                  mixy0[c] = dy*(pix2[c] - pix0[c]) + pix0[c];
-                  mixy1[c] = dy*(pix3[c] - pix1[c]) + pix1[c];
-                  sum[c] += dx*(mixy1[c] - mixy0[c]) + mixy0[c];
-                }
-            }
-
-          for (c=0; c<4; ++c)
-            *out_pixel++ = sum[c] * inv_num_steps;
-        }
+      shear.in_na        = src_rect.width;
+      shear.in_nb        = src_rect.height;
+      shear.in_stride_a  = 4;
+      shear.in_stride_b  = src_rect.width * 4;
+      shear.out_a        = roi->x - src_rect.x;
+      shear.out_b        = roi->y - src_rect.y;
+      shear.out_na       = roi->width;
+      shear.out_nb       = roi->height;
+      shear.out_stride_a = 4;
+      shear.out_stride_b = roi->width * 4;
+      shear.half_length  = 0.5 * fabs (offset_x);
+      slope              = offset_y / offset_x;
+      src_a              = src_rect.x;
+      src_b              = src_rect.y;
+      roi_b              = roi->y;
+    }
+  else
+    {
+      shear.in_na        = src_rect.height;
+      shear.in_nb        = src_rect.width;
+      shear.in_stride_a  = src_rect.width * 4;
+      shear.in_stride_b  = 4;
+      shear.out_a        = roi->y - src_rect.y;
+      shear.out_b        = roi->x - src_rect.x;
+      shear.out_na       = roi->height;
+      shear.out_nb       = roi->width;
+      shear.out_stride_a = roi->width * 4;
+      shear.out_stride_b = 4;
+      shear.half_length  = 0.5 * fabs (offset_y);
+      slope              = offset_x / offset_y;
+      src_a              = src_rect.y;
+      src_b              = src_rect.x;
+      roi_b              = roi->x;
     }
 
+  /* keep axis aligned angles exact, cos (90°) is not quite zero */
+  if (fabs (slope) < 1e-6)
+    slope = 0.0;
+
+  shear.shear_offset = g_new (gint,   shear.in_na);
+  shear.shear_weight = g_new (gfloat, shear.in_na);
+  shear.row_offset   = g_new (gint,   shear.out_na);
+  shear.row_weight   = g_new (gfloat, shear.out_na);
+
+  for (a = 0; a < shear.in_na; a++)
+    {
+      gdouble b = slope * (src_a + a);
+
+      shear.shear_offset[a] = (gint) floor (b) - src_b;
+      shear.shear_weight[a] = b - floor (b);
+    }
+
+  /* the output pixel (a, b) lies on the sheared row b - slope * a */
+  min_row = G_MAXINT;
+  max_row = G_MININT;
+  for (a = 0; a < shear.out_na; a++)
+    {
+      gdouble r   = roi_b - slope * (src_a + shear.out_a + a);
+      gint    row = (gint) floor (r);
+
+      shear.row_offset[a] = row;
+      shear.row_weight[a] = r - row;
+      min_row = MIN (min_row, row);
+      max_row = MAX (max_row, row + shear.out_nb - 1);
+    }
+
+  shear.first_row = min_row;
+  shear.rows      = max_row - min_row + 1;
+
+  gegl_parallel_distribute (shear.rows, motion_blur_rows, &shear);
+
   gegl_buffer_set (output, roi, babl_format ("RaGaBaA float"), out_buf, GEGL_AUTO_ROWSTRIDE);
 
+  g_free (shear.shear_offset);
+  g_free (shear.shear_weight);
+  g_free (shear.row_offset);
+  g_free (shear.row_weight);
   g_free (in_buf);
   g_free (out_buf);
 
-
   return  TRUE;
 }
 
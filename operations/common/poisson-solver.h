@@ -0,0 +1,543 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Solvers for the gradient domain tone mapping operators.
+ *
+ * poisson_solve solves the discrete Poisson equation L u = f on a
+ * width x height grid with Neumann boundaries, where
+ *
+ *   L u (x, y) = sum of u (n) - u (x, y) over the 4-neighbours n of (x, y)
+ *                inside the grid,
+ *
+ * which is the divergence of the forward difference gradient with zero
+ * gradients across the border. It runs multigrid V-cycles, with red-black
+ * Gauss-Seidel smoothing, until the relative residual drops below the
+ * requested tolerance. The solution is only defined up to a constant, the
+ * mean of f is ignored.
+ *
+ * The poisson_solver_dot/axpy/xpay/multiply vector helpers are there for
+ * solvers of other systems, like conjugate gradients. Everything is split
+ * across threads with gegl_parallel_distribute, reductions are summed in a
+ * fixed order so results do not depend on the number of threads.
+ */
+
+#ifndef __POISSON_SOLVER_H__
+#define __POISSON_SOLVER_H__
+
+#include "gegl-parallel.h"
+
+/* vector elements handled by one work item */
+#define POISSON_SOLVER_BLOCK    16384
+/* grids at or below this size in both dimensions are solved by relaxation */
+#define POISSON_SOLVER_COARSEST 4
+#define POISSON_SOLVER_PRE_SMOOTH    2
+#define POISSON_SOLVER_POST_SMOOTH   2
+#define POISSON_SOLVER_COARSE_SMOOTH 64
+
+typedef struct
+{
+  gint     n;
+  gint     blocks;
+  gfloat   a;
+  const gfloat *x;
+  const gfloat *y;
+  gfloat  *out;
+  gdouble *sums;
+} PoissonVector;
+
+static inline void
+poisson_vector_range (const PoissonVector *v,
+                      gint                 block,
+                      gint                *first,
+                      gint                *last)
+{
+  *first = block * POISSON_SOLVER_BLOCK;
+  *last  = MIN (*first + POISSON_SOLVER_BLOCK, v->n);
+}
+
+static void
+poisson_vector_dot_part (gint     i,
+                         gint     n,
+                         gpointer data)
+{
+  PoissonVector *v = data;
+  gint           block;
+
+  for (block = i; block < v->blocks; block += n)
+    {
+      gdouble sum = 0.0;
+      gint    first, last, j;
+
+      poisson_vector_range (v, block, &first, &last);
+      for (j = first; j < last; j++)
+        sum += v->x[j] * v->y[j];
+      v->sums[block] = sum;
+    }
+}
+
+/* returns x . y */
+static inline gdouble
+poisson_solver_dot (gint          n,
+                    const gfloat *x,
+                    const gfloat *y)
+{
+  PoissonVector v;
+  gdouble       sum = 0.0;
+  gint          block;
+
+  v.n      = n;
+  v.blocks = (n + POISSON_SOLVER_BLOCK - 1) / POISSON_SOLVER_BLOCK;
+  v.x      = x;
+  v.y      = y;
+  v.sums   = g_new (gdouble, MAX (v.blocks, 1));
+
+  gegl_parallel_distribute (v.blocks, poisson_vector_dot_part, &v);
+
+  for (block = 0; block < v.blocks; block++)
+    sum += v.sums[block];
+
+  g_free (v.sums);
+  return sum;
+}
+
+static void
+poisson_vector_axpy_part (gint     i,
+                          gint     n,
+                          gpointer data)
+{
+  PoissonVector *v = data;
+  gint           block;
+
+  for (block = i; block < v->blocks; block += n)
+    {
+      gint first, last, j;
+
+      poisson_vector_range (v, block, &first, &last);
+      for (j = first; j < last; j++)
+        v->out[j] += v->a * v->x[j];
+    }
+}
+
+/* y = y + a * x */
+static inline void
+poisson_solver_axpy (gint          n,
+                     gfloat        a,
+                     const gfloat *x,
+                     gfloat       *y)
+{
+  PoissonVector v;
+
+  v.n      = n;
+  v.blocks = (n + POISSON_SOLVER_BLOCK - 1) / POISSON_SOLVER_BLOCK;
+  v.a      = a;
+  v.x      = x;
+  v.out    = y;
+
+  gegl_parallel_distribute (v.blocks, poisson_vector_axpy_part, &v);
+}
+
+static void
+poisson_vector_xpay_part (gint     i,
+                          gint     n,
+                          gpointer data)
+{
+  PoissonVector *v = data;
+  gint           block;
+
+  for (block = i; block < v->blocks; block += n)
+    {
+      gint first, last, j;
+
+      poisson_vector_range (v, block, &first, &last);
+      for (j = first; j < last; j++)
+        v->out[j] = v->x[j] + v->a * v->out[j];
+    }
+}
+
+/* y = x + a * y */
+static inline void
+poisson_solver_xpay (gint          n,
+                     const gfloat *x,
+                     gfloat        a,
+                     gfloat       *y)
+{
+  PoissonVector v;
+
+  v.n      = n;
+  v.blocks = (n + POISSON_SOLVER_BLOCK - 1) / POISSON_SOLVER_BLOCK;
+  v.a      = a;
+  v.x      = x;
+  v.out    = y;
+
+  gegl_parallel_distribute (v.blocks, poisson_vector_xpay_part, &v);
+}
+
+static void
+poisson_vector_multiply_part (gint     i,
+                              gint     n,
+                              gpointer data)
+{
+  PoissonVector *v = data;
+  gint           block;
+
+  for (block = i; block < v->blocks; block += n)
+    {
+      gint first, last, j;
+
+      poisson_vector_range (v, block, &first, &last);
+      for (j = first; j < last; j++)
+        v->out[j] *= v->x[j];
+    }
+}
+
+/* y = y * x, element by element */
+static inline void
+poisson_solver_multiply (gint          n,
+                         const gfloat *x,
+                         gfloat       *y)
+{
+  PoissonVector v;
+
+  v.n      = n;
+  v.blocks = (n + POISSON_SOLVER_BLOCK - 1) / POISSON_SOLVER_BLOCK;
+  v.x      = x;
+  v.out    = y;
+
+  gegl_parallel_distribute (v.blocks, poisson_vector_multiply_part, &v);
+}
+
+
+/* Multigrid */
+
+typedef struct
+{
+  gint    width;
+  gint    height;
+  gfloat *u;      /* solution, or correction on coarser levels */
+  gfloat *f;      /* right hand side */
+  gfloat *r;      /* residual */
+} PoissonLevel;
+
+typedef struct
+{
+  PoissonLevel *level;
+  PoissonLevel *coarse;
+  gint          color;
+} PoissonTask;
+
+static inline gint
+poisson_rows_first (gint height,
+                    gint i,
+                    gint n)
+{
+  return height * i / n;
+}
+
+static void
+poisson_smooth_part (gint     i,
+                     gint     n,
+                     gpointer data)
+{
+  PoissonTask  *task  = data;
+  PoissonLevel *l     = task->level;
+  const gint    w     = l->width;
+  const gint    h     = l->height;
+  gint          first = poisson_rows_first (h, i, n);
+  gint          last  = poisson_rows_first (h, i + 1, n);
+  gint          x, y;
+
+  for (y = first; y < last; y++)
+    {
+      gfloat       *u  = l->u + y * w;
+      const gfloat *f  = l->f + y * w;
+      const gfloat *un = y > 0     ? u - w : NULL;
+      const gfloat *us = y < h - 1 ? u + w : NULL;
+
+      for (x = (y + task->color) & 1; x < w; x += 2)
+        {
+          gfloat sum   = 0.0f;
+          gint   count = 0;
+
+          if (x > 0)     { sum += u[x - 1]; count++; }
+          if (x < w - 1) { sum += u[x + 1]; count++; }
+          if (un)        { sum += un[x];    count++; }
+          if (us)        { sum += us[x];    count++; }
+
+          if (count)
+            u[x] = (sum - f[x]) / count;
+        }
+    }
+}
+
+/* red-black Gauss-Seidel, the points of one color only depend on points
+ * of the other, so every half sweep can be split across threads
+ */
+static inline void
+poisson_smooth (PoissonLevel *level,
+                gint          iterations)
+{
+  PoissonTask task;
+  gint        i;
+
+  task.level = level;
+
+  for (i = 0; i < iterations; i++)
+    {
+      for (task.color = 0; task.color < 2; task.color++)
+        gegl_parallel_distribute (level->height, poisson_smooth_part, &task);
+    }
+}
+
+static void
+poisson_residual_part (gint     i,
+                       gint     n,
+                       gpointer data)
+{
+  PoissonTask  *task  = data;
+  PoissonLevel *l     = task->level;
+  const gint    w     = l->width;
+  const gint    h     = l->height;
+  gint          first = poisson_rows_first (h, i, n);
+  gint          last  = poisson_rows_first (h, i + 1, n);
+  gint          x, y;
+
+  for (y = first; y < last; y++)
+    {
+      const gfloat *u  = l->u + y * w;
+      const gfloat *f  = l->f + y * w;
+      gfloat       *r  = l->r + y * w;
+      const gfloat *un = y > 0     ? u - w : u;
+      const gfloat *us = y < h - 1 ? u + w : u;
+
+      /* with replicated borders the missing neighbours cancel out */
+      for (x = 0; x < w; x++)
+        {
+          gint   west = x > 0     ? x - 1 : x;
+          gint   east = x < w - 1 ? x + 1 : x;
+          gfloat lu   = u[west] + u[east] + un[x] + us[x] - 4.0f * u[x];
+
+          r[x] = f[x] - lu;
+        }
+    }
+}
+
+/* sums 2x2 blocks of the fine residual into the coarse right hand side,
+ * the coarse Laplacian spans twice the distance, so its values are four
+ * times those of the fine one
+ */
+static void
+poisson_restrict_part (gint     i,
+                       gint     n,
+                       gpointer data)
+{
+  PoissonTask  *task   = data;
+  PoissonLevel *fine   = task->level;
+  PoissonLevel *coarse = task->coarse;
+  const gint    fw     = fine->width;
+  const gint    fh     = fine->height;
+  const gint    cw     = coarse->width;
+  gint          first  = poisson_rows_first (coarse->height, i, n);
+  gint          last   = poisson_rows_first (coarse->height, i + 1, n);
+  gint          x, y;
+
+  for (y = first; y < last; y++)
+    {
+      const gfloat *r0 = fine->r + 2 * y * fw;
+      const gfloat *r1 = 2 * y + 1 < fh ? r0 + fw : NULL;
+      gfloat       *f  = coarse->f + y * cw;
+
+      for (x = 0; x < fw / 2; x++)
+        f[x] = r0[2 * x] + r0[2 * x + 1];
+      if (fw & 1)
+        f[x] = r0[2 * x];
+
+      if (r1)
+        {
+          for (x = 0; x < fw / 2; x++)
+            f[x] += r1[2 * x] + r1[2 * x + 1];
+          if (fw & 1)
+            f[x] += r1[2 * x];
+        }
+    }
+}
+
+/* adds the coarse correction to the fine solution with cell centered
+ * bilinear interpolation, fine pixel 2X sits a quarter coarse pixel before
+ * coarse pixel X and 2X + 1 a quarter after it
+ */
+static void
+poisson_prolongate_part (gint     i,
+                         gint     n,
+                         gpointer data)
+{
+  PoissonTask  *task   = data;
+  PoissonLevel *fine   = task->level;
+  PoissonLevel *coarse = task->coarse;
+  const gint    fw     = fine->width;
+  const gint    cw     = coarse->width;
+  const gint    ch     = coarse->height;
+  gint          first  = poisson_rows_first (fine->height, i, n);
+  gint          last   = poisson_rows_first (fine->height, i + 1, n);
+  gfloat       *row    = g_new (gfloat, cw + 2);
+  gint          x, y;
+
+  for (y = first; y < last; y++)
+    {
+      gint          cy    = y / 2;
+      gint          ny    = (y & 1) ? MIN (cy + 1, ch - 1) : MAX (cy - 1, 0);
+      const gfloat *near  = coarse->u + cy * cw;
+      const gfloat *far   = coarse->u + ny * cw;
+      gfloat       *u     = fine->u + y * fw;
+
+      /* vertical pass into a row padded with replicated borders */
+      for (x = 0; x < cw; x++)
+        row[x + 1] = 0.75f * near[x] + 0.25f * far[x];
+      row[0]      = row[1];
+      row[cw + 1] = row[cw];
+
+      for (x = 0; x + 1 < fw; x += 2)
+        {
+          gint cx = x / 2 + 1;
+
+          u[x]     += 0.75f * row[cx] + 0.25f * row[cx - 1];
+          u[x + 1] += 0.75f * row[cx] + 0.25f * row[cx + 1];
+        }
+      if (fw & 1)
+        {
+          gint cx = x / 2 + 1;
+
+          u[x] += 0.75f * row[cx] + 0.25f * row[cx - 1];
+        }
+    }
+
+  g_free (row);
+}
+
+static void
+poisson_v_cycle (PoissonLevel *levels,
+                 gint          level,
+                 gint          n_levels)
+{
+  PoissonLevel *l = levels + level;
+  PoissonTask   task;
+
+  task.level  = l;
+  task.coarse = level + 1 < n_levels ? l + 1 : NULL;
+
+  if (!task.coarse)
+    {
+      poisson_smooth (l, POISSON_SOLVER_COARSE_SMOOTH);
+      return;
+    }
+
+  poisson_smooth (l, POISSON_SOLVER_PRE_SMOOTH);
+
+  gegl_parallel_distribute (l->height, poisson_residual_part, &task);
+  gegl_parallel_distribute (task.coarse->height, poisson_restrict_part, &task);
+
+  memset (task.coarse->u, 0,
+          sizeof (gfloat) * task.coarse->width * task.coarse->height);
+  poisson_v_cycle (levels, level + 1, n_levels);
+
+  gegl_parallel_distribute (l->height, poisson_prolongate_part, &task);
+
+  poisson_smooth (l, POISSON_SOLVER_POST_SMOOTH);
+}
+
+/* Solves L u = f, using the contents of u as the initial guess. Stops once
+ * the norm of the residual is below tolerance times the norm of f, or after
+ * max_cycles V-cycles. Returns the number of V-cycles run.
+ */
+static inline gint
+poisson_solve (const gfloat *f,
+               gfloat       *u,
+               gint          width,
+               gint          height,
+               gfloat        tolerance,
+               gint          max_cycles)
+{
+  PoissonLevel *levels;
+  gint          n_levels;
+  gint          size  = width * height;
+  gdouble       mean;
+  gdouble       f_norm;
+  gint          cycle = 0;
+  gint          w, h, i;
+
+  if (size <= 0)
+    return 0;
+
+  for (n_levels = 1, w = width, h = height;
+       w > POISSON_SOLVER_COARSEST || h > POISSON_SOLVER_COARSEST;
+       n_levels++)
+    {
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+    }
+
+  levels = g_new0 (PoissonLevel, n_levels);
+  for (i = 0, w = width, h = height; i < n_levels; i++)
+    {
+      levels[i].width  = w;
+      levels[i].height = h;
+      levels[i].u      = i ? g_new (gfloat, w * h) : u;
+      levels[i].f      = g_new (gfloat, w * h);
+      levels[i].r      = g_new (gfloat, w * h);
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+    }
+
+  /* the Neumann problem only has a solution for f summing to zero */
+  memcpy (levels[0].f, f, sizeof (gfloat) * size);
+  for (i = 0, mean = 0.0; i < size; i++)
+    mean += f[i];
+  mean /= size;
+  for (i = 0; i < size; i++)
+    levels[0].f[i] -= mean;
+
+  f_norm = sqrt (poisson_solver_dot (size, levels[0].f, levels[0].f));
+
+  if (f_norm > 0.0)
+    {
+      PoissonTask task = { levels, NULL, 0 };
+
+      while (cycle < max_cycles)
+        {
+          gdouble r_norm;
+
+          poisson_v_cycle (levels, 0, n_levels);
+          cycle++;
+
+          gegl_parallel_distribute (height, poisson_residual_part, &task);
+          r_norm = sqrt (poisson_solver_dot (size, levels[0].r, levels[0].r));
+          if (r_norm <= tolerance * f_norm)
+            break;
+        }
+    }
+
+  for (i = 0; i < n_levels; i++)
+    {
+      if (i)
+        g_free (levels[i].u);
+      g_free (levels[i].f);
+      g_free (levels[i].r);
+    }
+  g_free (levels);
+
+  return cycle;
+}
+
+#endif
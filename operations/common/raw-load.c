@@ -49,6 +49,9 @@ gegl_chant_file_path (path, _("File"), "/tmp/test.raw", _("Path of file to load.
 #define MAX_SAMPLE 65535
 #define ERROR -1
 
+/* Number of rows read from dcraw at a time. */
+#define BAND_HEIGHT 64
+
 static void
 load_buffer (GeglChantO *op_raw_load)
 {
@@ -84,25 +87,37 @@ load_buffer (GeglChantO *op_raw_load)
                                                      babl_component ("R"),
                                                      NULL));
         }
-         {
-
-           guint16 *buf = g_new (guint16, width * height * 3);
-           fread (buf, 1, width * height * 3 * 2, pfp);
-           gegl_buffer_set (GEGL_BUFFER (op_raw_load->chant_data),
-                            NULL,
-                            babl_format_new (
-                                        babl_model ("RGB"),
-                                        babl_type ("u16"),
-                                        babl_component ("G"),
-                                        babl_component ("B"),
-                                        babl_component ("R"),
-                                        NULL),
-                            buf,
-                            GEGL_AUTO_ROWSTRIDE
-                           );
-           g_free (buf);
-         }
-       fclose (pfp);
+      {
+        const Babl    *format = babl_format_new (babl_model ("RGB"),
+                                                 babl_type ("u16"),
+                                                 babl_component ("G"),
+                                                 babl_component ("B"),
+                                                 babl_component ("R"),
+                                                 NULL);
+        gsize          stride = width * 3 * 2;
+        guint16       *buf    = g_malloc (stride * MIN (BAND_HEIGHT, height));
+        GeglRectangle  band   = { 0, 0, width, 0 };
+
+        /* copy the rows into the buffer a band at a time as they arrive
+         * from dcraw, rather than staging the whole image
+         */
+        for (band.y = 0; band.y < height; band.y += BAND_HEIGHT)
+          {
+            band.height = MIN (BAND_HEIGHT, height - band.y);
+
+            if (fread (buf, stride, band.height, pfp) != (gsize) band.height)
+              {
+                g_warning ("short read of raw data");
+                break;
+              }
+
+            gegl_buffer_set (GEGL_BUFFER (op_raw_load->chant_data), &band,
+                             format, buf, GEGL_AUTO_ROWSTRIDE);
+          }
+
+        g_free (buf);
+      }
+      pclose (pfp);
     }
 }
 
@@ -37,7 +37,7 @@ gegl_chant_double (light, _("Light Adaptation"),
 
 #else
 
-#define GEGL_CHANT_TYPE_FILTER
+#define GEGL_CHANT_TYPE_REDUCE_FILTER
 #define GEGL_CHANT_C_FILE       "reinhard05.c"
 
 #include "gegl-chant.h"
@@ -48,6 +48,25 @@ typedef struct {
   guint  num;
 } stats;
 
+/* The operator needs two passes over the image: the first gathers the
+ * luminance and channel averages the adaptation is based on, the second
+ * the range of the adapted values, used to normalise them.
+ */
+enum
+{
+  PASS_ADAPTATION,
+  PASS_NORMALISE
+};
+
+typedef struct {
+  stats  world_lin,
+         world_log,
+         channel[3],
+         normalise;
+  gfloat contrast,
+         intensity;
+} reinhard05_stats;
+
 
 static const gchar *OUTPUT_FORMAT = "RGBA float";
 
@@ -59,24 +78,6 @@ reinhard05_prepare (GeglOperation *operation)
   gegl_operation_set_format (operation, "output", babl_format (OUTPUT_FORMAT));
 }
 
-static GeglRectangle
-reinhard05_get_required_for_output (GeglOperation       *operation,
-                                    const gchar         *input_pad,
-                                    const GeglRectangle *roi)
-{
-  GeglRectangle result = *gegl_operation_source_get_bounding_box (operation,
-                                                                  "input");
-  return result;
-}
-
-
-static GeglRectangle
-reinhard05_get_cached_region (GeglOperation       *operation,
-                              const GeglRectangle *roi)
-{
-  return *gegl_operation_source_get_bounding_box (operation, "input");
-}
-
 static void
 reinhard05_stats_start (stats *s)
 {
@@ -105,6 +106,17 @@ reinhard05_stats_update (stats *s,
 }
 
 
+static void
+reinhard05_stats_merge (stats       *s,
+                        const stats *other)
+{
+  s->min  = MIN (s->min, other->min);
+  s->max  = MAX (s->max, other->max);
+  s->avg += other->avg;
+  s->num += other->num;
+}
+
+
 static void
 reinhard05_stats_finish (stats *s)
 {
@@ -115,13 +127,221 @@ reinhard05_stats_finish (stats *s)
   s->range  = s->max - s->min;
 }
 
+
+/* Returns the luminance of the n_pixels pixels of pix, to be freed */
+static gfloat *
+reinhard05_luminance (const gfloat *pix,
+                      glong         n_pixels)
+{
+  gfloat *lum = g_new (gfloat, n_pixels);
+
+  babl_process (babl_fish (babl_format (OUTPUT_FORMAT),
+                           babl_format ("Y float")),
+                (void *) pix, lum, n_pixels);
+
+  return lum;
+}
+
+
+/* Adapts the color channels of pix in place, pixels with zero luminance
+ * are left as they are.
+ */
+static inline gboolean
+reinhard05_adapt (const GeglChantO       *o,
+                  const reinhard05_stats *s,
+                  gfloat                 *pix,
+                  gfloat                  lum)
+{
+  const gint RGB        = 3;
+  gfloat     chrom      =       o->chromatic,
+             chrom_comp = 1.0 - o->chromatic,
+             light      =       o->light,
+             light_comp = 1.0 - o->light;
+  gint       c;
+
+  if (lum == 0.0)
+    return FALSE;
+
+  for (c = 0; c < RGB; ++c)
+    {
+      gfloat local, global, adapt;
+      gfloat p = pix[c];
+
+      local  = chrom      * p +
+               chrom_comp * lum;
+      global = chrom      * s->channel[c].avg +
+               chrom_comp * s->world_lin.avg;
+      adapt  = light      * local +
+               light_comp * global;
+
+      pix[c] = p / (p + powf (s->intensity * adapt, s->contrast));
+    }
+
+  return TRUE;
+}
+
+
+static gpointer
+reinhard05_stats_new (GeglOperation *operation)
+{
+  reinhard05_stats *s = g_new (reinhard05_stats, 1);
+  gint              i;
+
+  reinhard05_stats_start (&s->world_lin);
+  reinhard05_stats_start (&s->world_log);
+  reinhard05_stats_start (&s->normalise);
+  for (i = 0; i < 3; ++i)
+    reinhard05_stats_start (s->channel + i);
+  s->contrast  = 0.0;
+  s->intensity = 0.0;
+
+  return s;
+}
+
+
+static void
+reinhard05_reduce (GeglOperation *operation,
+                   gint           pass,
+                   gconstpointer  statistics,
+                   gpointer       partial,
+                   void          *in_buf,
+                   glong          n_pixels)
+{
+  const GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
+  reinhard05_stats *part = partial;
+  gfloat           *pix  = in_buf;
+  gfloat           *lum  = reinhard05_luminance (pix, n_pixels);
+  const gint        pix_stride = 4, /* RGBA */
+                    RGB        = 3;
+  glong             i;
+  gint              c;
+
+  for (i = 0; i < n_pixels; ++i, pix += pix_stride)
+    {
+      if (pass == PASS_ADAPTATION)
+        {
+          reinhard05_stats_update (&part->world_lin,                 lum[i] );
+          reinhard05_stats_update (&part->world_log, logf (2.3e-5f + lum[i]));
+
+          for (c = 0; c < RGB; ++c)
+            reinhard05_stats_update (part->channel + c, pix[c]);
+        }
+      else
+        {
+          gfloat adapted[4] = { pix[0], pix[1], pix[2], pix[3] };
+
+          if (!reinhard05_adapt (o, statistics, adapted, lum[i]))
+            continue;
+
+          for (c = 0; c < RGB; ++c)
+            reinhard05_stats_update (&part->normalise, adapted[c]);
+        }
+    }
+
+  g_free (lum);
+}
+
+
+static void
+reinhard05_merge (GeglOperation *operation,
+                  gint           pass,
+                  gpointer       statistics,
+                  gconstpointer  partial)
+{
+  reinhard05_stats       *s    = statistics;
+  const reinhard05_stats *part = partial;
+  gint                    i;
+
+  if (pass == PASS_ADAPTATION)
+    {
+      reinhard05_stats_merge (&s->world_lin, &part->world_lin);
+      reinhard05_stats_merge (&s->world_log, &part->world_log);
+      for (i = 0; i < 3; ++i)
+        reinhard05_stats_merge (s->channel + i, part->channel + i);
+    }
+  else
+    {
+      reinhard05_stats_merge (&s->normalise, &part->normalise);
+    }
+}
+
+
+static void
+reinhard05_finish (GeglOperation *operation,
+                   gint           pass,
+                   gpointer       statistics)
+{
+  const GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
+  reinhard05_stats *s = statistics;
+  gfloat            key;
+  gint              i;
+
+  if (pass == PASS_NORMALISE)
+    {
+      reinhard05_stats_finish (&s->normalise);
+      return;
+    }
+
+  g_warn_if_fail (s->world_lin.min >= 0.0);
+
+  reinhard05_stats_finish (&s->world_lin);
+  reinhard05_stats_finish (&s->world_log);
+  for (i = 0; i < 3; ++i)
+    reinhard05_stats_finish (s->channel + i);
+
+  /* Calculate key parameters */
+  key          = (logf (s->world_lin.max) -                 s->world_log.avg) /
+                 (logf (s->world_lin.max) - logf (2.3e-5f + s->world_lin.min));
+  s->contrast  = 0.3 + 0.7 * powf (key, 1.4);
+  s->intensity = expf (-o->brightness);
+
+  g_warn_if_fail (s->contrast >= 0.3 && s->contrast <= 1.0);
+}
+
+
+static gboolean
+reinhard05_process (GeglOperation       *operation,
+                    gconstpointer        statistics,
+                    void                *in_buf,
+                    void                *out_buf,
+                    glong                n_pixels,
+                    const GeglRectangle *roi)
+{
+  const GeglChantO       *o   = GEGL_CHANT_PROPERTIES (operation);
+  const reinhard05_stats *s   = statistics;
+  const gint              pix_stride = 4; /* RGBA */
+  gfloat                 *in  = in_buf;
+  gfloat                 *out = out_buf;
+  gfloat                 *lum = reinhard05_luminance (in, n_pixels);
+  glong                   i;
+  gint                    c;
+
+  for (i = 0; i < n_pixels; ++i)
+    {
+      for (c = 0; c < pix_stride; ++c)
+        out[c] = in[c];
+
+      reinhard05_adapt (o, s, out, lum[i]);
+
+      /* Normalise the pixel values */
+      for (c = 0; c < pix_stride; ++c)
+        out[c] = (out[c] - s->normalise.min) / s->normalise.range;
+
+      in  += pix_stride;
+      out += pix_stride;
+    }
+
+  g_free (lum);
+
+  return TRUE;
+}
+
 #include "opencl/gegl-cl.h"
-#include "buffer/gegl-buffer-cl-iterator.h"
 
+/* the luminance weights are the ones of the OpenCL "Y float" conversion */
 static const char* kernel_source =
 "__kernel void reinhard05_1 (__global const float4 * pix,        \n"
 "                            __global       float4 * pix_out,    \n"
-"                            __global const float  * lum,        \n"
 "                            float chrom,                        \n"
 "                            float light,                        \n"
 "                            float intensity,                    \n"
@@ -131,17 +351,19 @@ static const char* kernel_source =
 "{                                                               \n"
 " int gid = get_global_id(0);                                    \n"
 " float4 pix_v = pix[gid];                                       \n"
-" float  lum_v = lum[gid];                                       \n"
+" float  lum_v = dot (pix_v.xyz,                                 \n"
+"                    (float3)(0.212671f, 0.715160f, 0.072169f)); \n"
 " float3 local_;                                                 \n"
 " float3 global_;                                                \n"
 " float3 adapt;                                                  \n"
 "                                                                \n"
-" if (lum_v == 0.0f) return;                                     \n"
-"                                                                \n"
-" local_  = chrom * pix_v.xyz       + (1.0f - chrom) * lum_v;         \n"
-" global_ = chrom * channel_avg.xyz + (1.0f - chrom) * world_lin_avg; \n"
-" adapt   = light * local_ + (1.0f - light) * global_;                \n"
-" pix_v.xyz /= pix_v.xyz + pow (intensity * adapt, contrast);    \n"
+" if (lum_v != 0.0f)                                             \n"
+"   {                                                            \n"
+"     local_  = chrom * pix_v.xyz       + (1.0f - chrom) * lum_v;         \n"
+"     global_ = chrom * channel_avg.xyz + (1.0f - chrom) * world_lin_avg; \n"
+"     adapt   = light * local_ + (1.0f - light) * global_;                \n"
+"     pix_v.xyz /= pix_v.xyz + pow (intensity * adapt, contrast);         \n"
+"   }                                                            \n"
 "                                                                \n"
 " pix_out[gid] = pix_v;                                          \n"
 "}                                                               \n"
@@ -158,20 +380,20 @@ static const char* kernel_source =
 static gegl_cl_run_data * cl_data = NULL;
 
 static cl_int
-cl_reinhard05_1 (cl_mem               in_tex,
-                 cl_mem               lum_tex,
-                 cl_mem               out_tex,
-                 size_t               global_worksize,
-                 const GeglRectangle *roi,
-                 gfloat               chrom,
-                 gfloat               light,
-                 gfloat               intensity,
-                 gfloat               contrast,
-                 stats                world_lin,
-                 stats                channel[])
+reinhard05_cl_process (GeglOperation       *operation,
+                       gconstpointer        statistics,
+                       cl_mem               in_tex,
+                       cl_mem               out_tex,
+                       size_t               global_worksize,
+                       const GeglRectangle *roi)
 {
-  cl_int cl_err = 0;
-  cl_float4 channel_avg = {channel[0].avg, channel[1].avg, channel[2].avg, 1.0f};
+  const GeglChantO       *o = GEGL_CHANT_PROPERTIES (operation);
+  const reinhard05_stats *s = statistics;
+
+  cl_int    cl_err = 0;
+  cl_float  chrom  = o->chromatic,
+            light  = o->light;
+  cl_float4 channel_avg = {s->channel[0].avg, s->channel[1].avg, s->channel[2].avg, 1.0f};
 
   if (!cl_data)
     {
@@ -183,15 +405,14 @@ cl_reinhard05_1 (cl_mem               in_tex,
 
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 0, sizeof(cl_mem),    (void*)&in_tex);
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 1, sizeof(cl_mem),    (void*)&out_tex);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 2, sizeof(cl_mem),    (void*)&lum_tex);
 
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 3, sizeof(cl_float),  (void*)&chrom);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 4, sizeof(cl_float),  (void*)&light);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 5, sizeof(cl_float),  (void*)&intensity);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 6, sizeof(cl_float),  (void*)&contrast);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 2, sizeof(cl_float),  (void*)&chrom);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 3, sizeof(cl_float),  (void*)&light);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 4, sizeof(cl_float),  (void*)&s->intensity);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 5, sizeof(cl_float),  (void*)&s->contrast);
 
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 7, sizeof(cl_float4), (void*)&channel_avg);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 8, sizeof(cl_float),  (void*)&world_lin.avg);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 6, sizeof(cl_float4), (void*)&channel_avg);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 7, sizeof(cl_float),  (void*)&s->world_lin.avg);
   if (cl_err != CL_SUCCESS) return cl_err;
 
   cl_err = gegl_clEnqueueNDRangeKernel(gegl_cl_get_command_queue (),
@@ -199,275 +420,44 @@ cl_reinhard05_1 (cl_mem               in_tex,
                                         NULL, &global_worksize, NULL,
                                         0, NULL, NULL);
   if (cl_err != CL_SUCCESS) return cl_err;
-  return cl_err;
-}
-
-static cl_int
-cl_reinhard05_2 (cl_mem               in_tex,
-                 cl_mem               out_tex,
-                 size_t               global_worksize,
-                 const GeglRectangle *roi,
-                 gfloat               min,
-                 gfloat               range)
-{
-  cl_int cl_err = 0;
-
-  if (!cl_data)
-    {
-      const char *kernel_name[] = {"reinhard05_1", "reinhard05_2", NULL};
-      cl_data = gegl_cl_compile_and_build (kernel_source, kernel_name);
-    }
 
-  if (!cl_data) return 1;
+  gegl_clEnqueueBarrier (gegl_cl_get_command_queue ());
 
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 0, sizeof(cl_mem),    (void*)&in_tex);
+  /* Normalise the pixel values */
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 0, sizeof(cl_mem),    (void*)&out_tex);
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 1, sizeof(cl_mem),    (void*)&out_tex);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 2, sizeof(cl_float),  (void*)&min);
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 3, sizeof(cl_float),  (void*)&range);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 2, sizeof(cl_float),  (void*)&s->normalise.min);
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[1], 3, sizeof(cl_float),  (void*)&s->normalise.range);
   if (cl_err != CL_SUCCESS) return cl_err;
 
   cl_err = gegl_clEnqueueNDRangeKernel(gegl_cl_get_command_queue (),
                                         cl_data->kernel[1], 1,
                                         NULL, &global_worksize, NULL,
                                         0, NULL, NULL);
-  if (cl_err != CL_SUCCESS) return cl_err;
   return cl_err;
 }
 
 
-
-static gboolean
-reinhard05_process (GeglOperation       *operation,
-                    GeglBuffer          *input,
-                    GeglBuffer          *output,
-                    const GeglRectangle *result)
-{
-  const GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
-
-  const gint  pix_stride = 4, /* RGBA */
-              RGB        = 3;
-
-  gfloat *lum,
-         *pix;
-  gfloat  key, contrast, intensity,
-          chrom      =       o->chromatic,
-          chrom_comp = 1.0 - o->chromatic,
-          light      =       o->light,
-          light_comp = 1.0 - o->light;
-
-  stats   world_lin,
-          world_log,
-          channel [RGB],
-          normalise;
-
-  gint    i, c;
-
-  g_return_val_if_fail (operation, FALSE);
-  g_return_val_if_fail (input, FALSE);
-  g_return_val_if_fail (output, FALSE);
-  g_return_val_if_fail (result, FALSE);
-
-  g_return_val_if_fail (babl_format_get_n_components (babl_format (OUTPUT_FORMAT)) == pix_stride, FALSE);
-
-  g_return_val_if_fail (chrom      >= 0.0 && chrom      <= 1.0, FALSE);
-  g_return_val_if_fail (chrom_comp >= 0.0 && chrom_comp <= 1.0, FALSE);
-  g_return_val_if_fail (light      >= 0.0 && light      <= 1.0, FALSE);
-  g_return_val_if_fail (light_comp >= 0.0 && light_comp <= 1.0, FALSE);
-
-
-  /* Obtain the pixel data */
-  lum = g_new (gfloat, result->width * result->height),
-  gegl_buffer_get (input, 1.0, result, babl_format ("Y float"),
-                   lum, GEGL_AUTO_ROWSTRIDE);
-
-  pix = g_new (gfloat, result->width * result->height * pix_stride);
-  gegl_buffer_get (input, 1.0, result, babl_format (OUTPUT_FORMAT),
-                   pix, GEGL_AUTO_ROWSTRIDE);
-
-  /* Collect the image stats, averages, etc */
-  reinhard05_stats_start (&world_lin);
-  reinhard05_stats_start (&world_log);
-  reinhard05_stats_start (&normalise);
-  for (i = 0; i < RGB; ++i)
-    {
-      reinhard05_stats_start (channel + i);
-    }
-
-  for (i = 0; i < result->width * result->height; ++i)
-    {
-      reinhard05_stats_update (&world_lin,                 lum[i] );
-      reinhard05_stats_update (&world_log, logf (2.3e-5f + lum[i]));
-
-      for (c = 0; c < RGB; ++c)
-        {
-          reinhard05_stats_update (channel + c, pix[i * pix_stride + c]);
-        }
-    }
-
-  g_return_val_if_fail (world_lin.min >= 0.0, FALSE);
-
-  reinhard05_stats_finish (&world_lin);
-  reinhard05_stats_finish (&world_log);
-  for (i = 0; i < RGB; ++i)
-    {
-      reinhard05_stats_finish (channel + i);
-    }
-
-  /* Calculate key parameters */
-  key       = (logf (world_lin.max) -                 world_log.avg) /
-              (logf (world_lin.max) - logf (2.3e-5f + world_lin.min));
-  contrast  = 0.3 + 0.7 * powf (key, 1.4);
-  intensity = expf (-o->brightness);
-
-  g_return_val_if_fail (contrast >= 0.3 && contrast <= 1.0, FALSE);
-
-  if (cl_state.is_accelerated)
-    {
-      const Babl *in_format  = gegl_operation_get_format (operation, "input");
-      const Babl *out_format = gegl_operation_get_format (operation, "output");
-      const Babl *lum_format = babl_format("Y float");
-
-      GeglBuffer *pix_out = gegl_buffer_new (result, in_format);
-      gint j, k;
-      cl_int err, cl_err;
-
-      {
-      gfloat *pix_map;
-
-      GeglBufferClIterator *i = gegl_buffer_cl_iterator_new (pix_out, result, in_format, GEGL_CL_BUFFER_WRITE);
-      gint read = gegl_buffer_cl_iterator_add (i, input, result, in_format,  GEGL_CL_BUFFER_READ);
-      gint lum_ = gegl_buffer_cl_iterator_add (i, input, result, lum_format, GEGL_CL_BUFFER_READ);
-
-      while (gegl_buffer_cl_iterator_next (i, &err))
-        {
-          if (err) return FALSE;
-          for (j=0; j < i->n; j++)
-            {
-
-              cl_err = cl_reinhard05_1(i->tex[read][j], i->tex[lum_][j], i->tex[0][j], i->size[0][j], &i->roi[0][j],
-                                       chrom, light, intensity, contrast,
-                                       world_lin, channel);
-              if (cl_err != CL_SUCCESS)
-                {
-                  g_warning("[OpenCL] Error in gegl:reinhard05: %s\n", gegl_cl_errstring(cl_err));
-                  return FALSE;
-                }
-
-              pix_map = gegl_clEnqueueMapBuffer(gegl_cl_get_command_queue(), i->tex[0][j], CL_TRUE, CL_MAP_READ, 0, i->size[0][j] * babl_format_get_bytes_per_pixel (in_format),
-                                                0, NULL, NULL, &cl_err);
-              if (CL_SUCCESS != cl_err) return cl_err;
-
-              for (k = 0; k < i->size[0][j]; ++k)
-                {
-                  if(lum[k] == 0.0f)
-                    continue;
-                  for(c=0; c < RGB; c++)
-                    reinhard05_stats_update (&normalise, pix_map[k*pix_stride + c]);
-                }
-
-              cl_err = gegl_clEnqueueUnmapMemObject(gegl_cl_get_command_queue(), i->tex[0][j], pix_map,
-                                                    0, NULL, NULL);
-              if (CL_SUCCESS != cl_err) return cl_err;
-
-            }
-        }
-      }
-
-      /* Normalise the pixel values */
-      reinhard05_stats_finish (&normalise);
-      {
-      GeglBufferClIterator *i = gegl_buffer_cl_iterator_new (output, result, out_format, GEGL_CL_BUFFER_WRITE);
-      gint read = gegl_buffer_cl_iterator_add (i, pix_out, result, in_format,  GEGL_CL_BUFFER_READ);
-      while (gegl_buffer_cl_iterator_next (i, &err))
-        {
-          if (err) return FALSE;
-          for (j=0; j < i->n; j++)
-            {
-
-              cl_err = cl_reinhard05_2(i->tex[read][j], i->tex[0][j], i->size[0][j], &i->roi[0][j],
-                                       normalise.min, normalise.range);
-              if (cl_err != CL_SUCCESS)
-                {
-                  g_warning("[OpenCL] Error in gegl:reinhard05: %s\n", gegl_cl_errstring(cl_err));
-                  return FALSE;
-
-                }
-
-            }
-        }
-      }
-
-      gegl_buffer_destroy (pix_out);
-    }
-  else
-    {
-
-      /* Apply the operator */
-      for (i = 0; i < result->width * result->height; ++i)
-        {
-          gfloat local, global, adapt;
-
-          if (lum[i] == 0.0)
-            continue;
-
-          for (c = 0; c < RGB; ++c)
-            {
-              gfloat *_p = pix + i * pix_stride + c,
-                       p = *_p;
-
-              local  = chrom      * p +
-                       chrom_comp * lum[i];
-              global = chrom      * channel[c].avg +
-                       chrom_comp * world_lin.avg;
-              adapt  = light      * local +
-                       light_comp * global;
-
-              p  /= p + powf (intensity * adapt, contrast);
-              *_p = p;
-              reinhard05_stats_update (&normalise, p);
-            }
-        }
-
-      /* Normalise the pixel values */
-      reinhard05_stats_finish (&normalise);
-
-      for (i = 0; i < result->width * result->height; ++i)
-        {
-           for (c = 0; c < pix_stride; ++c)
-            {
-              gfloat *p = pix + i * pix_stride + c;
-              *p        = (*p - normalise.min) / normalise.range;
-            }
-        }
-
-      /* Cleanup and set the output */
-      gegl_buffer_set (output, result, babl_format (OUTPUT_FORMAT), pix,
-                       GEGL_AUTO_ROWSTRIDE);
-    }
-
-  g_free (pix);
-  g_free (lum);
-
-  return TRUE;
-}
-
-
 /**/
 static void
 gegl_chant_class_init (GeglChantClass *klass)
 {
-  GeglOperationClass       *operation_class;
-  GeglOperationFilterClass *filter_class;
+  GeglOperationClass             *operation_class;
+  GeglOperationReduceFilterClass *reduce_class;
 
   operation_class = GEGL_OPERATION_CLASS (klass);
-  filter_class    = GEGL_OPERATION_FILTER_CLASS (klass);
-
-  filter_class->process = reinhard05_process;
+  reduce_class    = GEGL_OPERATION_REDUCE_FILTER_CLASS (klass);
+
+  reduce_class->passes         = 2;
+  reduce_class->statistics_new = reinhard05_stats_new;
+  reduce_class->reduce         = reinhard05_reduce;
+  reduce_class->merge          = reinhard05_merge;
+  reduce_class->finish         = reinhard05_finish;
+  reduce_class->process        = reinhard05_process;
+  reduce_class->cl_process     = reinhard05_cl_process;
   operation_class->opencl_support = TRUE;
 
-  operation_class->prepare                 = reinhard05_prepare;
-  operation_class->get_required_for_output = reinhard05_get_required_for_output;
-  operation_class->get_cached_region       = reinhard05_get_cached_region;
+  operation_class->prepare = reinhard05_prepare;
 
   operation_class->name        = "gegl:reinhard05";
   operation_class->categories  = "tonemapping";
@@ -479,5 +469,3 @@ gegl_chant_class_init (GeglChantClass *klass)
 }
 
 #endif
-
-
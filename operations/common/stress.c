@@ -55,6 +55,29 @@ gegl_chant_double (rgamma, _("Radial Gamma"), 0.0, 8.0, 2.0,
 #include <stdlib.h>
 #include "envelopes.h"
 
+static void
+stress_pixel (const gfloat *center_pix,
+              const gfloat *min_envelope,
+              const gfloat *max_envelope,
+              gfloat       *dst)
+{
+  gint c;
+
+  for (c=0;c<3;c++)
+    {
+      gfloat delta = max_envelope[c]-min_envelope[c];
+      if (delta != 0)
+        {
+          dst[c] = (center_pix[c]-min_envelope[c])/delta;
+        }
+      else
+        {
+          dst[c] = 0.5;
+        }
+    }
+  dst[3] = center_pix[3];
+}
+
 static void stress (GeglBuffer          *src,
                     const GeglRectangle *src_rect,
                     GeglBuffer          *dst,
@@ -64,13 +87,8 @@ static void stress (GeglBuffer          *src,
                     gint                 iterations,
                     gdouble              rgamma)
 {
-  gint x,y;
-  gint    dst_offset=0;
   gfloat *src_buf;
   gfloat *dst_buf;
-  gint    inw = src_rect->width;
-  gint    inh = src_rect->height;
-  gint   outw = dst_rect->width;
 
   /* this use of huge linear buffers should be avoided and
    * most probably would lead to great speed ups
@@ -81,44 +99,11 @@ static void stress (GeglBuffer          *src,
 
   gegl_buffer_get (src, 1.0, src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
 
-  for (y=radius; y<dst_rect->height+radius; y++)
-    {
-      gint src_offset = (inw*y+radius)*4;
-      for (x=radius; x<outw+radius; x++)
-        {
-          gfloat *center_pix= src_buf + src_offset;
-          gfloat  min_envelope[4];
-          gfloat  max_envelope[4];
-
-          compute_envelopes (src_buf,
-                             inw, inh,
-                             x, y,
-                             radius, samples,
-                             iterations,
-                             FALSE, /* same-spray */
-                             rgamma,
-                             min_envelope, max_envelope);
-           {
-              gint c;
-              for (c=0;c<3;c++)
-                {
-                  gfloat delta = max_envelope[c]-min_envelope[c];
-                  if (delta != 0)
-                    {
-                      dst_buf[dst_offset+c] =
-                         (center_pix[c]-min_envelope[c])/delta;
-                    }
-                  else
-                    {
-                      dst_buf[dst_offset+c] = 0.5;
-                    }
-                }
-           }
-          dst_buf[dst_offset+3] = src_buf[src_offset+3];
-          src_offset+=4;
-          dst_offset+=4;
-        }
-    }
+  spray_process (src_buf, src_rect, dst_buf, dst_rect, 4,
+                 radius, samples, iterations,
+                 FALSE, /* same-spray */
+                 rgamma, stress_pixel);
+
   gegl_buffer_set (dst, dst_rect, babl_format ("RGBA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
   g_free (src_buf);
   g_free (dst_buf);
@@ -24,44 +24,42 @@
 
 #else
 
-#define GEGL_CHANT_TYPE_FILTER
+#define GEGL_CHANT_TYPE_REDUCE_FILTER
 #define GEGL_CHANT_C_FILE       "stretch-contrast.c"
 
 #include "gegl-chant.h"
 
-static gboolean
-inner_process (gdouble  min,
-               gdouble  max,
-               gfloat  *buf,
-               gint     n_pixels)
+typedef struct
 {
-  gint o;
+  gfloat min;
+  gfloat max;
+} MinMax;
 
-  for (o=0; o<n_pixels; o++)
-    {
-      buf[0] = (buf[0] - min) / (max-min);
-      buf[1] = (buf[1] - min) / (max-min);
-      buf[2] = (buf[2] - min) / (max-min);
-      /* FIXME: really stretch the alpha channel?? */
-      buf[3] = (buf[3] - min) / (max-min);
+static gpointer
+statistics_new (GeglOperation *operation)
+{
+  MinMax *min_max = g_new (MinMax, 1);
 
-      buf += 4;
-    }
-  return TRUE;
+  min_max->min =  9000000.0;
+  min_max->max = -9000000.0;
+  return min_max;
 }
 
 static void
-buffer_get_min_max (GeglBuffer *buffer,
-                    gdouble    *min,
-                    gdouble    *max)
+reduce (GeglOperation *operation,
+        gint           pass,
+        gconstpointer  statistics,
+        gpointer       partial,
+        void          *in_buf,
+        glong          n_pixels)
 {
-  gfloat tmin = 9000000.0;
-  gfloat tmax =-9000000.0;
+  MinMax *min_max = partial;
+  gfloat *buf     = in_buf;
+  gfloat  tmin    = min_max->min;
+  gfloat  tmax    = min_max->max;
+  glong   i;
 
-  gfloat *buf = g_new0 (gfloat, 4 * gegl_buffer_get_pixel_count (buffer));
-  gint i;
-  gegl_buffer_get (buffer, 1.0, NULL, babl_format ("RGBA float"), buf, GEGL_AUTO_ROWSTRIDE);
-  for (i=0;i< gegl_buffer_get_pixel_count (buffer);i++)
+  for (i=0; i<n_pixels; i++)
     {
       gint component;
       for (component=0; component<3; component++)
@@ -74,36 +72,60 @@ buffer_get_min_max (GeglBuffer *buffer,
             tmax=val;
         }
     }
-  g_free (buf);
-  if (min)
-    *min = tmin;
-  if (max)
-    *max = tmax;
+
+  min_max->min = tmin;
+  min_max->max = tmax;
 }
 
-static void prepare (GeglOperation *operation)
+static void
+merge (GeglOperation *operation,
+       gint           pass,
+       gpointer       statistics,
+       gconstpointer  partial)
 {
-  gegl_operation_set_format (operation, "input", babl_format ("RGBA float"));
-  gegl_operation_set_format (operation, "output", babl_format ("RGBA float"));
+  MinMax       *min_max = statistics;
+  const MinMax *other   = partial;
+
+  min_max->min = MIN (min_max->min, other->min);
+  min_max->max = MAX (min_max->max, other->max);
 }
 
-static GeglRectangle
-get_required_for_output (GeglOperation        *operation,
-                         const gchar         *input_pad,
-                         const GeglRectangle *roi)
+static gboolean
+process (GeglOperation       *operation,
+         gconstpointer        statistics,
+         void                *in_buf,
+         void                *out_buf,
+         glong                n_pixels,
+         const GeglRectangle *roi)
 {
-  GeglRectangle result = *gegl_operation_source_get_bounding_box (operation, "input");
-  return result;
+  const MinMax *min_max = statistics;
+  gfloat       *in      = in_buf;
+  gfloat       *out     = out_buf;
+  gfloat        min     = min_max->min;
+  gfloat        max     = min_max->max;
+  glong         o;
+
+  for (o=0; o<n_pixels; o++)
+    {
+      out[0] = (in[0] - min) / (max-min);
+      out[1] = (in[1] - min) / (max-min);
+      out[2] = (in[2] - min) / (max-min);
+      /* FIXME: really stretch the alpha channel?? */
+      out[3] = (in[3] - min) / (max-min);
+
+      in  += 4;
+      out += 4;
+    }
+  return TRUE;
 }
 
 #include "opencl/gegl-cl.h"
-#include "buffer/gegl-buffer-cl-iterator.h"
 
 static const char* kernel_source =
 "__kernel void kernel_StretchContrast(__global float4 * in,     \n"
 "                                     __global float4 * out,    \n"
 "                                     float           min,      \n"
-"                                     float           max)      \n"     
+"                                     float           max)      \n"
 "{                                                              \n"
 "  int gid = get_global_id(0);                                  \n"
 "  float4 in_v = in[gid];                                       \n"
@@ -113,28 +135,26 @@ static const char* kernel_source =
 static gegl_cl_run_data * cl_data = NULL;
 
 static cl_int
-cl_stretch_contrast (cl_mem                in_tex,
-                     cl_mem                out_tex,
-                     size_t                global_worksize,
-                     const GeglRectangle  *roi,
-                     gdouble               min,
-                     gdouble               max)
-{  
-  int i = 0 , stride = 16;/*RGBA float*/
-  size_t size = roi->width * roi->height * stride;
-  cl_int cl_err = 0;   
+cl_process (GeglOperation       *operation,
+            gconstpointer        statistics,
+            cl_mem               in_tex,
+            cl_mem               out_tex,
+            size_t               global_worksize,
+            const GeglRectangle *roi)
+{
+  const MinMax *min_max = statistics;
+  cl_int        cl_err  = 0;
+  cl_float      cl_min  = min_max->min;
+  cl_float      cl_max  = min_max->max;
 
   if (!cl_data)
   {
     const char *kernel_name[] ={"kernel_StretchContrast", NULL};
     cl_data = gegl_cl_compile_and_build(kernel_source, kernel_name);
   }
-  if (!cl_data)  return 0;
+  if (!cl_data)  return 1;
 
-  cl_float cl_min = (cl_float)min;
-  cl_float cl_max = (cl_float)max;
-
-  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 0, sizeof(cl_mem), (void*)&in_tex);  
+  cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 0, sizeof(cl_mem), (void*)&in_tex);
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 1, sizeof(cl_mem), (void*)&out_tex);
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 2, sizeof(cl_float), (void*)&cl_min);
   cl_err |= gegl_clSetKernelArg(cl_data->kernel[0], 3, sizeof(cl_float), (void*)&cl_max);
@@ -145,111 +165,32 @@ cl_stretch_contrast (cl_mem                in_tex,
     1, NULL,
     &global_worksize, NULL,
     0, NULL, NULL);
-
-  cl_err = gegl_clEnqueueBarrier(gegl_cl_get_command_queue());
   if (CL_SUCCESS != cl_err) return cl_err;
 
+  cl_err = gegl_clEnqueueBarrier(gegl_cl_get_command_queue());
   return cl_err;
 }
 
-
-static gboolean
-cl_process (GeglOperation       *operation,
-      GeglBuffer          *input,
-      GeglBuffer          *output,
-      const GeglRectangle *result,
-      gdouble              min,
-      gdouble              max)
-{
-  const Babl *in_format  = gegl_operation_get_format (operation, "input");
-  const Babl *out_format = gegl_operation_get_format (operation, "output");
-  gint err;
-  gint j;
-  cl_int cl_err;
-
-  GeglBufferClIterator *i = gegl_buffer_cl_iterator_new (output,result, out_format, GEGL_CL_BUFFER_WRITE);
-  gint read = gegl_buffer_cl_iterator_add (i, input, result, in_format,  GEGL_CL_BUFFER_READ);
-
-  while (gegl_buffer_cl_iterator_next (i, &err))
-  {
-    if (err) return FALSE;
-    for (j=0; j < i->n; j++)
-
-    {
-      cl_err=cl_stretch_contrast(i->tex[read][j],i->tex[0][j],i->size[0][j],&i->roi[0][j],min,max);
-      if (cl_err != CL_SUCCESS)
-      {
-        g_warning("[OpenCL] Error in %s [GeglOperationFilter:Edge-sobel] Kernel\n");
-        return FALSE;
-      }
-    }
-  }  
-  return TRUE;
-}
-
-
-static gboolean
-process (GeglOperation       *operation,
-         GeglBuffer          *input,
-         GeglBuffer          *output,
-         const GeglRectangle *result)
-{
-  gdouble  min, max;
-
-  buffer_get_min_max (input, &min, &max);
-
-  if (cl_state.is_accelerated)
-    if(cl_process(operation, input, output, result, min, max))
-      return TRUE;
-
-  {
-    gint row;
-    gfloat *buf;
-    gint chunk_size=128;
-    gint consumed=0;
-
-    buf = g_new0 (gfloat, 4 * result->width  * chunk_size);
-
-    for (row = 0; row < result->height; row = consumed)
-      {
-        gint chunk = consumed+chunk_size<result->height?chunk_size:result->height-consumed;
-        GeglRectangle line;
-
-        line.x = result->x;
-        line.y = result->y + row;
-        line.width = result->width;
-        line.height = chunk;
-
-        gegl_buffer_get (input, 1.0, &line, babl_format ("RGBA float"), buf, GEGL_AUTO_ROWSTRIDE);
-        inner_process (min, max, buf, result->width  * chunk);
-        gegl_buffer_set (output, &line, babl_format ("RGBA float"), buf,
-                         GEGL_AUTO_ROWSTRIDE);
-        consumed+=chunk;
-      }
-    g_free (buf);
-  }
-
-  return TRUE;
-}
-
 /* This is called at the end of the gobject class_init function.
  *
- * Here we override the standard passthrough options for the rect
- * computations.
+ * The minimum and maximum are gathered by the reduce filter base class,
+ * which keeps them until the input changes.
  */
 static void
 gegl_chant_class_init (GeglChantClass *klass)
 {
-  GeglOperationClass       *operation_class;
-  GeglOperationFilterClass *filter_class;
+  GeglOperationClass             *operation_class;
+  GeglOperationReduceFilterClass *reduce_class;
 
   operation_class = GEGL_OPERATION_CLASS (klass);
-  filter_class    = GEGL_OPERATION_FILTER_CLASS (klass);
+  reduce_class    = GEGL_OPERATION_REDUCE_FILTER_CLASS (klass);
 
-  filter_class->process = process;
-  operation_class->prepare = prepare;
+  reduce_class->statistics_new = statistics_new;
+  reduce_class->reduce         = reduce;
+  reduce_class->merge          = merge;
+  reduce_class->process        = process;
+  reduce_class->cl_process     = cl_process;
   operation_class->opencl_support = TRUE;
-  operation_class->get_required_for_output = get_required_for_output;
 
   operation_class->name        = "gegl:stretch-contrast";
   operation_class->categories  = "color:enhance";
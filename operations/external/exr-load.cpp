@@ -32,6 +32,8 @@ extern "C" {
 }
 
 #include <ImfInputFile.h>
+#include <ImfTiledInputFile.h>
+#include <ImfThreading.h>
 #include <ImfChannelList.h>
 #include <ImfRgbaFile.h>
 #include <ImfRgbaYca.h>
@@ -75,9 +77,26 @@ query_exr              (const gchar *path,
                         gpointer    *format);
 
 static gboolean
-import_exr             (GeglBuffer  *gegl_buffer,
-                        const gchar *path,
-                        gint         format_flags);
+query_exr_tiles        (const gchar *path,
+                        gint        *tile_width,
+                        gint        *tile_height);
+
+static void
+exr_set_thread_count   (void);
+
+static gboolean
+import_exr             (GeglBuffer          *gegl_buffer,
+                        const GeglRectangle *result,
+                        const gchar         *path,
+                        gint                 format_flags);
+
+static gboolean
+import_exr_tiles       (GeglBuffer          *gegl_buffer,
+                        const GeglRectangle *result,
+                        const gchar         *path,
+                        gint                 format_flags,
+                        gint                 tile_width,
+                        gint                 tile_height);
 
 static void
 convert_yca_to_rgba    (GeglBuffer *buf,
@@ -123,7 +142,8 @@ insert_channels        (FrameBuffer  &fb,
                         char         *base,
                         gint          width,
                         gint          format_flags,
-                        gint          bpp);
+                        gint          bpp,
+                        gsize         ystride);
 
 
 
@@ -401,7 +421,8 @@ insert_channels (FrameBuffer  &fb,
                  char         *base,
                  gint          width,
                  gint          format_flags,
-                 gint          bpp)
+                 gint          bpp,
+                 gsize         ystride)
 {
   gint alpha_offset = 12;
   PixelType tp;
@@ -413,9 +434,9 @@ insert_channels (FrameBuffer  &fb,
 
   if (format_flags & COLOR_RGB)
     {
-      fb.insert ("R", Slice (tp, base,    bpp, 0, 1,1, 0.0));
-      fb.insert ("G", Slice (tp, base+4,  bpp, 0, 1,1, 0.0));
-      fb.insert ("B", Slice (tp, base+8,  bpp, 0, 1,1, 0.0));
+      fb.insert ("R", Slice (tp, base,    bpp, ystride, 1,1, 0.0));
+      fb.insert ("G", Slice (tp, base+4,  bpp, ystride, 1,1, 0.0));
+      fb.insert ("B", Slice (tp, base+8,  bpp, ystride, 1,1, 0.0));
     }
   else if (format_flags & COLOR_C)
     {
@@ -425,19 +446,20 @@ insert_channels (FrameBuffer  &fb,
     }
   else if (format_flags & COLOR_Y)
     {
-      fb.insert ("Y",  Slice (tp, base, bpp, 0, 1,1, 0.5));
+      fb.insert ("Y",  Slice (tp, base, bpp, ystride, 1,1, 0.5));
       alpha_offset = 4;
     }
 
   if (format_flags & COLOR_ALPHA)
-    fb.insert ("A", Slice (tp, base+alpha_offset, bpp, 0, 1,1, 1.0));
+    fb.insert ("A", Slice (tp, base+alpha_offset, bpp, ystride, 1,1, 1.0));
 }
 
 
 static gboolean
-import_exr (GeglBuffer  *gegl_buffer,
-            const gchar *path,
-            gint         format_flags)
+import_exr (GeglBuffer          *gegl_buffer,
+            const GeglRectangle *result,
+            const gchar         *path,
+            gint                 format_flags)
 {
   try
     {
@@ -448,44 +470,49 @@ import_exr (GeglBuffer  *gegl_buffer,
 
       g_object_get (gegl_buffer, "px-size", &pxsize, NULL);
 
+      if (format_flags & COLOR_C)
+        {
+          /*
+           * Chroma subsampled images are reconstructed over the whole
+           * image, they are read a row at a time into the same row of
+           * pixels, all rows sharing one slice with a y stride of 0.
+           */
+          char *pixels = (char*) g_malloc0 (gegl_buffer_get_width (gegl_buffer) * pxsize);
+
+          char *base = pixels;
+
+          /*
+           * The pointer we pass to insert_channels needs to be adjusted, since
+           * our buffer always starts at the position where the first pixels
+           * occurs, which may be a position not equal to (0 0). OpenEXR expects
+           * the pointer to point to (0 0), which may be outside our buffer, but
+           * that is needed so that OpenEXR writes all pixels to the correct
+           * position in our buffer.
+           */
+          base -= pxsize * dw.min.x;
+
+          insert_channels (frameBuffer,
+                           file.header(),
+                           base,
+                           gegl_buffer_get_width (gegl_buffer),
+                           format_flags,
+                           pxsize,
+                           0);
+
+          file.setFrameBuffer (frameBuffer);
 
-      char *pixels = (char*) g_malloc0 (gegl_buffer_get_width (gegl_buffer) * pxsize);
-
-      char *base = pixels;
-
-      /*
-       * The pointer we pass to insert_channels needs to be adjusted, since
-       * our buffer always starts at the position where the first pixels
-       * occurs, which may be a position not equal to (0 0). OpenEXR expects
-       * the pointer to point to (0 0), which may be outside our buffer, but
-       * that is needed so that OpenEXR writes all pixels to the correct
-       * position in our buffer.
-       */
-      base -= pxsize * dw.min.x;
-
-      insert_channels (frameBuffer,
-                       file.header(),
-                       base,
-                       gegl_buffer_get_width (gegl_buffer),
-                       format_flags,
-                       pxsize);
-
-      file.setFrameBuffer (frameBuffer);
-
-      {
-        gint i;
-        GeglRectangle rect;
-
-        for (i=dw.min.y; i<=dw.max.y; i++)
           {
-            gegl_rectangle_set (&rect, 0, i-dw.min.y,gegl_buffer_get_width (gegl_buffer), 1);
-            file.readPixels (i);
-            gegl_buffer_set (gegl_buffer, &rect, NULL, pixels, GEGL_AUTO_ROWSTRIDE);
+            gint i;
+            GeglRectangle rect;
+
+            for (i=dw.min.y; i<=dw.max.y; i++)
+              {
+                gegl_rectangle_set (&rect, 0, i-dw.min.y,gegl_buffer_get_width (gegl_buffer), 1);
+                file.readPixels (i);
+                gegl_buffer_set (gegl_buffer, &rect, NULL, pixels, GEGL_AUTO_ROWSTRIDE);
+              }
           }
-      }
 
-      if (format_flags & COLOR_C)
-        {
           Chromaticities cr;
           V3f yw;
 
@@ -500,6 +527,123 @@ import_exr (GeglBuffer  *gegl_buffer,
                                yw);
 
           fix_saturation (gegl_buffer, yw, format_flags & COLOR_ALPHA);
+
+          g_free (pixels);
+        }
+      else
+        {
+          /*
+           * Other images are read for the rows of result only, a band of
+           * rows at a time, which OpenEXR decodes from the line blocks or
+           * tiles covering them.
+           */
+          gint   width  = dw.max.x - dw.min.x + 1;
+          gsize  stride = (gsize) width * pxsize;
+          gint   band_height;
+          gint   y;
+          char  *pixels;
+
+          g_object_get (gegl_buffer, "tile-height", &band_height, NULL);
+          band_height = CLAMP (band_height, 1, MAX (result->height, 1));
+
+          pixels = (char*) g_malloc0 (stride * band_height);
+
+          for (y = result->y; y < result->y + result->height; y += band_height)
+            {
+              GeglRectangle band;
+              FrameBuffer   bandBuffer;
+              gint          first = dw.min.y + y;
+
+              gegl_rectangle_set (&band, 0, y, width,
+                                  MIN (band_height, result->y + result->height - y));
+
+              /* the same adjustment as above, for the first row of the band */
+              insert_channels (bandBuffer,
+                               file.header(),
+                               pixels - pxsize * dw.min.x - stride * first,
+                               width,
+                               format_flags,
+                               pxsize,
+                               stride);
+
+              file.setFrameBuffer (bandBuffer);
+              file.readPixels (first, first + band.height - 1);
+              gegl_buffer_set (gegl_buffer, &band, NULL, pixels, GEGL_AUTO_ROWSTRIDE);
+            }
+
+          g_free (pixels);
+        }
+    }
+  catch (...)
+    {
+      g_warning ("failed to load `%s'", path);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+
+/*
+ * Tiled images are read through the tile API, for the tiles of the base
+ * level covering result, a row of tiles at a time. The regions requested
+ * are aligned to the tile grid, so every tile is decoded once, and when
+ * the tiles of the file and the buffer have the same size every band maps
+ * to whole buffer tiles.
+ */
+static gboolean
+import_exr_tiles (GeglBuffer          *gegl_buffer,
+                  const GeglRectangle *result,
+                  const gchar         *path,
+                  gint                 format_flags,
+                  gint                 tile_width,
+                  gint                 tile_height)
+{
+  if (result->width <= 0 || result->height <= 0)
+    return TRUE;
+
+  try
+    {
+      TiledInputFile file (path);
+      Box2i dw = file.header().dataWindow();
+      gint  pxsize;
+      gint  tx0 = result->x / tile_width;
+      gint  tx1 = (result->x + result->width - 1) / tile_width;
+      gint  ty0 = result->y / tile_height;
+      gint  ty1 = (result->y + result->height - 1) / tile_height;
+      gint  x   = tx0 * tile_width;
+      gint  width;
+      gint  height;
+      gsize stride;
+      gint  ty;
+
+      g_object_get (gegl_buffer, "px-size", &pxsize, NULL);
+
+      width  = MIN ((tx1 + 1) * tile_width, dw.max.x - dw.min.x + 1) - x;
+      height = dw.max.y - dw.min.y + 1;
+      stride = (gsize) width * pxsize;
+
+      char *pixels = (char*) g_malloc0 (stride * tile_height);
+
+      for (ty = ty0; ty <= ty1; ty++)
+        {
+          GeglRectangle band;
+          FrameBuffer   frameBuffer;
+          gint          y = ty * tile_height;
+
+          gegl_rectangle_set (&band, x, y, width, MIN (tile_height, height - y));
+
+          /* see import_exr for the adjustment of the base pointer */
+          insert_channels (frameBuffer,
+                           file.header(),
+                           pixels - pxsize * (dw.min.x + x) - stride * (dw.min.y + y),
+                           width,
+                           format_flags,
+                           pxsize,
+                           stride);
+
+          file.setFrameBuffer (frameBuffer);
+          file.readTiles (tx0, tx1, ty, ty);
+          gegl_buffer_set (gegl_buffer, &band, NULL, pixels, GEGL_AUTO_ROWSTRIDE);
         }
 
       g_free (pixels);
@@ -513,6 +657,45 @@ import_exr (GeglBuffer  *gegl_buffer,
 }
 
 
+/* Returns TRUE, and the size of the tiles, for tiled files. */
+static gboolean
+query_exr_tiles (const gchar *path,
+                 gint        *tile_width,
+                 gint        *tile_height)
+{
+  try
+    {
+      InputFile file (path);
+
+      if (!file.header().hasTileDescription ())
+        return FALSE;
+
+      *tile_width  = file.header().tileDescription ().xSize;
+      *tile_height = file.header().tileDescription ().ySize;
+    }
+  catch (...)
+    {
+      return FALSE;
+    }
+  return TRUE;
+}
+
+
+/*
+ * Lets OpenEXR decompress line blocks and tiles in parallel, with as many
+ * threads as GEGL splits its own work across.
+ */
+static void
+exr_set_thread_count (void)
+{
+  gint threads = gegl_parallel_get_n_threads ();
+  gint count   = threads > 1 ? threads : 0;
+
+  if (globalThreadCount () != count)
+    setGlobalThreadCount (count);
+}
+
+
 static gboolean
 query_exr (const gchar *path,
            gint        *width,
@@ -629,7 +812,15 @@ process (GeglOperation       *operation,
 
   if (ok)
     {
-      import_exr (output, o->path, ff);
+      gint tile_width, tile_height;
+
+      exr_set_thread_count ();
+
+      if (!(ff & COLOR_C) &&
+          query_exr_tiles (o->path, &tile_width, &tile_height))
+        import_exr_tiles (output, result, o->path, ff, tile_width, tile_height);
+      else
+        import_exr (output, result, o->path, ff);
     }
   else
     {
@@ -639,11 +830,46 @@ process (GeglOperation       *operation,
   return TRUE;
 }
 
+/* Tiled images are read in regions aligned to their tiles, scanline
+ * images in full width row ranges, apart from chroma subsampled ones,
+ * which are reconstructed as a whole.
+ */
 static GeglRectangle
 get_cached_region (GeglOperation       *operation,
                    const GeglRectangle *roi)
 {
-  return get_bounding_box (operation);
+  GeglChantO   *o = GEGL_CHANT_PROPERTIES (operation);
+  GeglRectangle result = get_bounding_box (operation);
+  gint          w, h, ff;
+  gint          tile_width, tile_height;
+  gpointer      format;
+
+  if (!query_exr (o->path, &w, &h, &ff, &format) || (ff & COLOR_C))
+    return result;
+
+  if (query_exr_tiles (o->path, &tile_width, &tile_height))
+    {
+      GeglRectangle tiles;
+      gint          x0 = MAX (roi->x, 0) / tile_width * tile_width;
+      gint          y0 = MAX (roi->y, 0) / tile_height * tile_height;
+      gint          x1 = roi->x + roi->width;
+      gint          y1 = roi->y + roi->height;
+
+      x1 = (x1 + tile_width - 1) / tile_width * tile_width;
+      y1 = (y1 + tile_height - 1) / tile_height * tile_height;
+
+      gegl_rectangle_set (&tiles, x0, y0, MAX (x1 - x0, 0), MAX (y1 - y0, 0));
+      gegl_rectangle_intersect (&result, &result, &tiles);
+    }
+  else
+    {
+      gint bottom = MIN (roi->y + roi->height, result.y + result.height);
+
+      result.y      = MAX (roi->y, result.y);
+      result.height = MAX (bottom - result.y, 0);
+    }
+
+  return result;
 }
 
 static void
@@ -32,9 +32,14 @@ extern "C" {
 
 #include "config.h"
 #include <exception>
+#include <vector>
 #include <OpenEXR/ImfTiledOutputFile.h>
 #include <OpenEXR/ImfOutputFile.h>
 #include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfThreading.h>
+
+/* number of rows of a scanline image fetched and written at a time */
+#define BAND_HEIGHT 64
 
 /**
  * create an Imf::Header for writing up to 4 channels (given in d).
@@ -66,16 +71,20 @@ create_header (int w,
 }
 
 /**
- * create an Imf::FrameBuffer object for w*h*d floats and return it.
+ * create an Imf::FrameBuffer object for rows of w*d floats in data, the
+ * first of them being row y of the image, and return it.
  */
 static Imf::FrameBuffer
 create_frame_buffer (int          w,
-                     int          h,
+                     int          y,
                      int          d,
                      const float *data)
 {
   Imf::FrameBuffer fbuf;
 
+  /* OpenEXR addresses the slices from the origin of the image */
+  data -= (size_t) y * w * d;
+
   if (d <= 2)
     {
       fbuf.insert ("Y", Imf::Slice (Imf::FLOAT, (char *) (&data[0] + 0),
@@ -99,8 +108,8 @@ create_frame_buffer (int          w,
 }
 
 /**
- * write the float buffer to an exr file with tile-size tw x th.
- * The buffer must contain w*h*d floats.
+ * write rect of input to an exr file with tile-size tw x th, a row of tiles
+ * at a time, fetching the pixels of each row in format.
  * Currently supported are only values 1-4 for d:
  * d=1: write a single Y-channel.
  * d=2: write Y and A.
@@ -108,63 +117,91 @@ create_frame_buffer (int          w,
  * d=4: write RGB and A.
  */
 static void
-write_tiled_exr (const float       *pixels,
-                 int                w,
-                 int                h,
-                 int                d,
-                 int                tw,
-                 int                th,
-                 const std::string &filename)
+write_tiled_exr (GeglBuffer          *input,
+                 const GeglRectangle *rect,
+                 const Babl          *format,
+                 int                  d,
+                 int                  tw,
+                 int                  th,
+                 const std::string   &filename)
 {
+  int w = rect->width;
+  int h = rect->height;
   Imf::Header header (create_header (w, h, d));
   header.setTileDescription (Imf::TileDescription (tw, th, Imf::ONE_LEVEL));
   Imf::TiledOutputFile out (filename.c_str (), header);
-  Imf::FrameBuffer fbuf (create_frame_buffer (w, h, d, pixels));
-  out.setFrameBuffer (fbuf);
-  out.writeTiles (0, out.numXTiles () - 1, 0, out.numYTiles () - 1);
+  std::vector<float> pixels ((size_t) w * th * d);
+
+  for (int ty = 0; ty < out.numYTiles (); ty++)
+    {
+      GeglRectangle band = { rect->x, rect->y + ty * th, w, MIN (th, h - ty * th) };
+
+      gegl_buffer_get (input, 1.0, &band, format, &pixels[0],
+                       GEGL_AUTO_ROWSTRIDE);
+      out.setFrameBuffer (create_frame_buffer (w, ty * th, d, &pixels[0]));
+      out.writeTiles (0, out.numXTiles () - 1, ty, ty);
+    }
 }
 
 /**
- * write an openexr file in scanline mode.
- * pixels contains the image data as an array of w*h*d floats.
+ * write rect of input to an openexr file in scanline mode, BAND_HEIGHT
+ * rows at a time, fetching the pixels of each band in format.
  * The data is written to the file named filename.
  */
 static void
-write_scanline_exr (const float       *pixels,
-                    int                w,
-                    int                h,
-                    int                d,
-                    const std::string &filename)
+write_scanline_exr (GeglBuffer          *input,
+                    const GeglRectangle *rect,
+                    const Babl          *format,
+                    int                  d,
+                    const std::string   &filename)
 {
+  int w = rect->width;
+  int h = rect->height;
   Imf::Header header (create_header (w, h, d));
   Imf::OutputFile out (filename.c_str (), header);
-  Imf::FrameBuffer fbuf (create_frame_buffer (w, h, d, pixels));
-  out.setFrameBuffer (fbuf);
-  out.writePixels (h);
+  std::vector<float> pixels ((size_t) w * MIN (BAND_HEIGHT, h) * d);
+
+  for (int y = 0; y < h; y += BAND_HEIGHT)
+    {
+      GeglRectangle band = { rect->x, rect->y + y, w, MIN (BAND_HEIGHT, h - y) };
+
+      gegl_buffer_get (input, 1.0, &band, format, &pixels[0],
+                       GEGL_AUTO_ROWSTRIDE);
+      out.setFrameBuffer (create_frame_buffer (w, y, d, &pixels[0]));
+      out.writePixels (band.height);
+    }
 }
 
 /**
- * write the given pixel buffer, which is w * h * d to filename using the
+ * write rect of input, fetched in format, to filename using the
  * tilesize as tile width and height. This is the only function calling
  * the openexr lib and therefore should be exception save.
+ *
+ * OpenEXR compresses the line blocks or tiles of each band in parallel,
+ * with as many threads as GEGL splits its own work across.
  */
 static void
-exr_save_process (const float       *pixels,
-                  int                w,
-                  int                h,
-                  int                d,
-                  int                tile_size,
-                  const std::string &filename)
+exr_save_process (GeglBuffer          *input,
+                  const GeglRectangle *rect,
+                  const Babl          *format,
+                  int                  d,
+                  int                  tile_size,
+                  const std::string   &filename)
 {
+  int threads = gegl_parallel_get_n_threads ();
+
+  if (Imf::globalThreadCount () != (threads > 1 ? threads : 0))
+    Imf::setGlobalThreadCount (threads > 1 ? threads : 0);
+
   if (tile_size == 0)
     {
       /* write a scanline exr image. */
-      write_scanline_exr (pixels, w, h, d, filename);
+      write_scanline_exr (input, rect, format, d, filename);
     }
   else
     {
       /* write a tiled exr image. */
-      write_tiled_exr (pixels, w, h, d, tile_size, tile_size, filename);
+      write_tiled_exr (input, rect, format, d, tile_size, tile_size, filename);
     }
 }
 
@@ -199,24 +236,14 @@ gegl_exr_save_process (GeglOperation       *operation,
         break;
     }
   /*
-   * get the pixel data. The position of the rectangle is effectively
-   * ignored. Always write a file width x height; @todo: check if exr
-   * can set the origin.
+   * the pixel data is fetched and written a band at a time. The position
+   * of the rectangle is effectively ignored. Always write a file
+   * width x height; @todo: check if exr can set the origin.
    */
-  float *pixels
-    = (float *) g_malloc (rect->width * rect->height * depth * sizeof *pixels);
-  if (pixels == 0)
-    {
-      g_warning ("exr-save: could allocate %d*%d*%d pixels.",
-        rect->width, rect->height, depth);
-      return FALSE;
-    }
-  gegl_buffer_get (input, 1.0, rect, babl_format (output_format.c_str ()),
-                   pixels, GEGL_AUTO_ROWSTRIDE);
   bool status;
   try
     {
-      exr_save_process (pixels, rect->width, rect->height,
+      exr_save_process (input, rect, babl_format (output_format.c_str ()),
                         depth, tile_size, filename);
       status = TRUE;
     }
@@ -226,7 +253,6 @@ gegl_exr_save_process (GeglOperation       *operation,
          filename.c_str (), e.what ());
       status = FALSE;
     }
-  g_free (pixels);
   return status;
 }
 
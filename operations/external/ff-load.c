@@ -31,6 +31,7 @@ gegl_chant_int (frame, _("Frame"), 0, 1000000, 0, _("frame number"))
 #define GEGL_CHANT_C_FILE       "ff-load.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 #include <errno.h>
 
 #ifdef HAVE_LIBAVFORMAT_AVFORMAT_H
@@ -61,8 +62,30 @@ typedef struct
 
   gchar           *loadedfilename; /* to remember which file is "cached"     */
   glong            prevframe;      /* previously decoded frame in loadedfile */
+
+  GThread         *decoder;        /* decode-ahead thread, or NULL            */
+  GMutex          *mutex;          /* protects the fields below               */
+  GCond           *cond;           /* signalled on new requests and frames    */
+  gboolean         quit;
+  glong            wanted;         /* frame last asked for by process         */
+  gboolean         sequential;     /* wanted follows the frame asked before   */
+  glong            last_frame;     /* last frame in the file, once known      */
+  GQueue           decoded;        /* FfFrames, most recently used first      */
 } Priv;
 
+/* decoded frames are kept in R'G'B'A u8, FF_LOAD_AHEAD of them are decoded
+ * ahead of sequential access, and up to FF_LOAD_FRAMES recently used ones
+ * are kept for scrubbing back and for temporal ops asking for nearby frames.
+ */
+#define FF_LOAD_AHEAD   4
+#define FF_LOAD_FRAMES 12
+
+typedef struct
+{
+  glong   frame;
+  guchar *pixels;
+} FfFrame;
+
 
 static void
 print_error (const char *filename, int err)
@@ -106,6 +129,11 @@ init (GeglChantO *o)
     {
       p = g_new0 (Priv, 1);
       o->chant_data = (void*) p;
+
+      p->mutex = g_mutex_new ();
+      p->cond = g_cond_new ();
+      p->wanted = -1;
+      p->last_frame = G_MAXLONG;
     }
 
   p->width = 320;
@@ -122,6 +150,21 @@ init (GeglChantO *o)
   p->codec_name = g_strdup ("");
 }
 
+static void
+ff_close (Priv *p)
+{
+  if (p->enc)
+    avcodec_close (p->enc);
+  if (p->ic)
+    av_close_input_file (p->ic);
+  if (p->lavc_frame)
+    av_free (p->lavc_frame);
+
+  p->enc = NULL;
+  p->ic = NULL;
+  p->lavc_frame = NULL;
+}
+
 /* FIXME: probably some more stuff to free here */
 static void
 ff_cleanup (GeglChantO *o)
@@ -134,21 +177,85 @@ ff_cleanup (GeglChantO *o)
       if (p->loadedfilename)
         g_free (p->loadedfilename);
 
-      if (p->enc)
-        avcodec_close (p->enc);
-      if (p->ic)
-        av_close_input_file (p->ic);
-      if (p->lavc_frame)
-        av_free (p->lavc_frame);
+      ff_close (p);
 
-      p->enc = NULL;
-      p->ic = NULL;
-      p->lavc_frame = NULL;
       p->codec_name = NULL;
       p->loadedfilename = NULL;
     }
 }
 
+/* opens the video stream of path for decoding from its first frame, this
+ * is also used to rewind when seeking backwards.
+ */
+static gboolean
+ff_open (Priv        *p,
+         const gchar *path)
+{
+  gint i;
+  gint err;
+
+  ff_close (p);
+
+  err = av_open_input_file (&p->ic, path, NULL, 0, NULL);
+  if (err < 0)
+    {
+      print_error (path, err);
+      return FALSE;
+    }
+  err = av_find_stream_info (p->ic);
+  if (err < 0)
+    {
+      g_warning ("ff-load: error finding stream info for %s", path);
+
+      return FALSE;
+    }
+  for (i = 0; i< p->ic->nb_streams; i++)
+    {
+      AVCodecContext *c = p->ic->streams[i]->codec;
+#if LIBAVFORMAT_VERSION_MAJOR >= 53
+      if (c->codec_type == AVMEDIA_TYPE_VIDEO)
+#else
+      if (c->codec_type == CODEC_TYPE_VIDEO)
+#endif
+        {
+          p->video_st = p->ic->streams[i];
+          p->video_stream = i;
+        }
+    }
+
+  p->enc = p->video_st->codec;
+  p->codec = avcodec_find_decoder (p->enc->codec_id);
+
+  /* p->enc->error_resilience = 2; */
+  p->enc->error_concealment = 3;
+  p->enc->workaround_bugs = FF_BUG_AUTODETECT;
+
+  if (p->codec == NULL)
+    {
+      g_warning ("codec not found");
+    }
+
+  if (p->codec->capabilities & CODEC_CAP_TRUNCATED)
+    p->enc->flags |= CODEC_FLAG_TRUNCATED;
+
+  if (avcodec_open (p->enc, p->codec) < 0)
+    {
+      g_warning ("error opening codec %s", p->enc->codec->name);
+      return FALSE;
+    }
+
+  p->width = p->enc->width;
+  p->height = p->enc->height;
+  p->frames = 10000000;
+  p->lavc_frame = avcodec_alloc_frame ();
+
+  p->prevframe = -1;
+  p->coded_bytes = 0;
+  p->coded_buf = NULL;
+
+  return TRUE;
+}
+
 static glong
 prev_keyframe (Priv *priv, glong frame)
 {
@@ -159,12 +266,13 @@ prev_keyframe (Priv *priv, glong frame)
   return 0;
 }
 
+/* only called from one thread at a time, the decode-ahead thread when
+ * there is one, since it owns the decoder state.
+ */
 static int
-decode_frame (GeglOperation *operation,
-              glong          frame)
+decode_frame (Priv  *p,
+              glong  frame)
 {
-  GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
-  Priv       *p = (Priv*)o->chant_data;
   glong       prevframe = p->prevframe;
   glong       decodeframe;        /*< frame to be requested decoded */
 
@@ -199,9 +307,9 @@ decode_frame (GeglOperation *operation,
   if (decodeframe < prevframe)
     {
       /* seeking backwards, since it ffmpeg doesn't allow us,. we'll reload the file */
-      g_free (p->loadedfilename);
-      p->loadedfilename = NULL;
-      init (o);
+      if (!ff_open (p, p->loadedfilename))
+        return -1;
+      decodeframe = 0;
     }
 
   while (decodeframe <= frame)
@@ -219,7 +327,7 @@ decode_frame (GeglOperation *operation,
                   if (av_read_packet (p->ic, &p->pkt) < 0)
                     {
                       fprintf (stderr, "av_read_packet failed for %s\n",
-                               o->path);
+                               p->loadedfilename);
                       return -1;
                     }
                 }
@@ -234,7 +342,7 @@ decode_frame (GeglOperation *operation,
           if (decoded_bytes < 0)
             {
               fprintf (stderr, "avcodec_decode_video failed for %s\n",
-                       o->path);
+                       p->loadedfilename);
               return -1;
             }
 
@@ -249,6 +357,200 @@ decode_frame (GeglOperation *operation,
   return 0;
 }
 
+/* converts the last decoded frame to R'G'B'A u8 */
+static guchar *
+convert_frame (Priv *p)
+{
+  guchar *buf;
+  gint    x,y;
+
+  buf = g_new (guchar, p->width * p->height * 4);
+
+  for (y=0; y < p->height; y++)
+    {
+      guchar       *dst  = buf + y * p->width * 4;
+      const guchar *ysrc = p->lavc_frame->data[0] + y * p->lavc_frame->linesize[0];
+      const guchar *usrc = p->lavc_frame->data[1] + y/2 * p->lavc_frame->linesize[1];
+      const guchar *vsrc = p->lavc_frame->data[2] + y/2 * p->lavc_frame->linesize[2];
+
+      for (x=0;x < p->width; x++)
+        {
+          gint R,G,B;
+#ifndef byteclamp
+#define byteclamp(j) do{if(j<0)j=0; else if(j>255)j=255;}while(0)
+#endif
+#define YUV82RGB8(Y,U,V,R,G,B)do{\
+          R= ((Y<<15)                 + 37355*(V-128))>>15;\
+          G= ((Y<<15) -12911* (U-128) - 19038*(V-128))>>15;\
+          B= ((Y<<15) +66454* (U-128)                )>>15;\
+          byteclamp(R);\
+          byteclamp(G);\
+          byteclamp(B);\
+        } while(0)
+
+        YUV82RGB8 (*ysrc, *usrc, *vsrc, R, G, B);
+
+        *(unsigned int *) dst = R + G * 256 + B * 256 * 256 + 0xff000000;
+        dst += 4;
+        ysrc ++;
+        if (x % 2)
+          {
+            usrc++;
+            vsrc++;
+          }
+        }
+    }
+  return buf;
+}
+
+/* The decoded frames, the helpers below are called with p->mutex held. */
+
+static GList *
+find_decoded (Priv  *p,
+              glong  frame)
+{
+  GList *iter;
+
+  for (iter = p->decoded.head; iter; iter = iter->next)
+    if (((FfFrame *) iter->data)->frame == frame)
+      return iter;
+
+  return NULL;
+}
+
+static FfFrame *
+lookup_decoded (Priv  *p,
+                glong  frame)
+{
+  GList *link = find_decoded (p, frame);
+
+  if (!link)
+    return NULL;
+
+  g_queue_unlink (&p->decoded, link);
+  g_queue_push_head_link (&p->decoded, link);
+
+  return link->data;
+}
+
+/* stores the pixels decoded for frame, NULL pixels mark the end of the file */
+static void
+store_decoded (Priv   *p,
+               glong   frame,
+               guchar *pixels)
+{
+  FfFrame *f;
+
+  if (!pixels)
+    {
+      p->last_frame = MIN (p->last_frame, frame - 1);
+      return;
+    }
+
+  while (p->decoded.length >= FF_LOAD_FRAMES)
+    {
+      f = g_queue_pop_tail (&p->decoded);
+      g_free (f->pixels);
+      g_slice_free (FfFrame, f);
+    }
+
+  f = g_slice_new (FfFrame);
+  f->frame = frame;
+  f->pixels = pixels;
+  g_queue_push_head (&p->decoded, f);
+}
+
+/* returns the next frame the decode-ahead thread should decode, or -1 */
+static glong
+next_to_decode (Priv *p)
+{
+  glong frame;
+
+  if (p->wanted < 0 || p->wanted > p->last_frame)
+    return -1;
+
+  if (!find_decoded (p, p->wanted))
+    return p->wanted;
+
+  if (!p->sequential)
+    return -1;
+
+  for (frame = p->wanted + 1;
+       frame <= p->wanted + FF_LOAD_AHEAD && frame <= p->last_frame;
+       frame++)
+    if (!find_decoded (p, frame))
+      return frame;
+
+  return -1;
+}
+
+static guchar *
+decode_pixels (Priv  *p,
+               glong  frame)
+{
+  if (decode_frame (p, frame))
+    return NULL;
+  return convert_frame (p);
+}
+
+static gpointer
+decoder_thread (gpointer data)
+{
+  Priv *p = data;
+
+  g_mutex_lock (p->mutex);
+  while (!p->quit)
+    {
+      glong   frame = next_to_decode (p);
+      guchar *pixels;
+
+      if (frame < 0)
+        {
+          g_cond_wait (p->cond, p->mutex);
+          continue;
+        }
+
+      g_mutex_unlock (p->mutex);
+      pixels = decode_pixels (p, frame);
+      g_mutex_lock (p->mutex);
+
+      store_decoded (p, frame, pixels);
+      g_cond_broadcast (p->cond);
+    }
+  g_mutex_unlock (p->mutex);
+
+  return NULL;
+}
+
+/* stops the decode-ahead thread and drops the decoded frames */
+static void
+stop_decoder (Priv *p)
+{
+  FfFrame *f;
+
+  if (p->decoder)
+    {
+      g_mutex_lock (p->mutex);
+      p->quit = TRUE;
+      g_cond_broadcast (p->cond);
+      g_mutex_unlock (p->mutex);
+
+      g_thread_join (p->decoder);
+      p->decoder = NULL;
+      p->quit = FALSE;
+    }
+
+  while ((f = g_queue_pop_head (&p->decoded)))
+    {
+      g_free (f->pixels);
+      g_slice_free (FfFrame, f);
+    }
+
+  p->wanted = -1;
+  p->sequential = FALSE;
+  p->last_frame = G_MAXLONG;
+}
+
 static void
 prepare (GeglOperation *operation)
 {
@@ -267,62 +569,15 @@ prepare (GeglOperation *operation)
   if (!p->loadedfilename ||
       strcmp (p->loadedfilename, o->path))
     {
-      gint i;
-      gint err;
-
+      stop_decoder (p);
       ff_cleanup (o);
-      err = av_open_input_file (&p->ic, o->path, NULL, 0, NULL);
-      if (err < 0)
-        {
-          print_error (o->path, err);
-        }
-      err = av_find_stream_info (p->ic);
-      if (err < 0)
-        {
-          g_warning ("ff-load: error finding stream info for %s", o->path);
 
-          return;
-        }
-      for (i = 0; i< p->ic->nb_streams; i++)
+      if (!ff_open (p, o->path))
         {
-          AVCodecContext *c = p->ic->streams[i]->codec;
-#if LIBAVFORMAT_VERSION_MAJOR >= 53
-          if (c->codec_type == AVMEDIA_TYPE_VIDEO)
-#else
-          if (c->codec_type == CODEC_TYPE_VIDEO)
-#endif
-            {
-              p->video_st = p->ic->streams[i];
-              p->video_stream = i;
-            }
-        }
-
-      p->enc = p->video_st->codec;
-      p->codec = avcodec_find_decoder (p->enc->codec_id);
-
-      /* p->enc->error_resilience = 2; */
-      p->enc->error_concealment = 3;
-      p->enc->workaround_bugs = FF_BUG_AUTODETECT;
-
-      if (p->codec == NULL)
-        {
-          g_warning ("codec not found");
-        }
-
-      if (p->codec->capabilities & CODEC_CAP_TRUNCATED)
-        p->enc->flags |= CODEC_FLAG_TRUNCATED;
-
-      if (avcodec_open (p->enc, p->codec) < 0)
-        {
-          g_warning ("error opening codec %s", p->enc->codec->name);
+          ff_close (p);
           return;
         }
 
-      p->width = p->enc->width;
-      p->height = p->enc->height;
-      p->frames = 10000000;
-      p->lavc_frame = avcodec_alloc_frame ();
-
       if (p->fourcc)
         g_free (p->fourcc);
       p->fourcc = g_strdup ("none");
@@ -345,9 +600,6 @@ prepare (GeglOperation *operation)
       if (p->loadedfilename)
         g_free (p->loadedfilename);
       p->loadedfilename = g_strdup (o->path);
-      p->prevframe = -1;
-      p->coded_bytes = 0;
-      p->coded_buf = NULL;
     }
 }
 
@@ -368,56 +620,49 @@ process (GeglOperation       *operation,
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
   Priv       *p = (Priv*)o->chant_data;
+  glong       frame = o->frame;
+  FfFrame    *f;
 
-  {
-    if (p->ic && !decode_frame (operation, o->frame))
-      {
-        guchar *buf;
-        gint    pxsize;
-        gint    x,y;
+  if (!p->ic)
+    return TRUE;
 
+  /* with more than one thread, frames are decoded by a thread of their
+   * own, which keeps decoding ahead while the frames get processed.
+   */
+  if (!p->decoder && g_thread_supported () &&
+      gegl_parallel_get_n_threads () > 1)
+    p->decoder = g_thread_create (decoder_thread, p, TRUE, NULL);
 
-        g_object_get (output, "px-size", &pxsize, NULL);
-        buf = g_new (guchar, p->width * p->height * pxsize);
+  g_mutex_lock (p->mutex);
+
+  if (frame != p->wanted)
+    p->sequential = (frame == p->wanted + 1);
+  p->wanted = frame;
+
+  f = lookup_decoded (p, frame);
+
+  if (!f && p->decoder)
+    {
+      g_cond_broadcast (p->cond);
+      while (!(f = lookup_decoded (p, frame)) && frame <= p->last_frame)
+        g_cond_wait (p->cond, p->mutex);
+    }
+  else if (!f && frame <= p->last_frame)
+    {
+      store_decoded (p, frame, decode_pixels (p, frame));
+      f = lookup_decoded (p, frame);
+    }
+  else
+    {
+      /* let the decoder go on ahead */
+      g_cond_broadcast (p->cond);
+    }
+
+  if (f)
+    gegl_buffer_set (output, NULL, NULL, f->pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_mutex_unlock (p->mutex);
 
-        for (y=0; y < p->height; y++)
-          {
-            guchar       *dst  = buf + y * p->width * 4;
-            const guchar *ysrc = p->lavc_frame->data[0] + y * p->lavc_frame->linesize[0];
-            const guchar *usrc = p->lavc_frame->data[1] + y/2 * p->lavc_frame->linesize[1];
-            const guchar *vsrc = p->lavc_frame->data[2] + y/2 * p->lavc_frame->linesize[2];
-
-            for (x=0;x < p->width; x++)
-              {
-                gint R,G,B;
-#ifndef byteclamp
-#define byteclamp(j) do{if(j<0)j=0; else if(j>255)j=255;}while(0)
-#endif
-#define YUV82RGB8(Y,U,V,R,G,B)do{\
-                R= ((Y<<15)                 + 37355*(V-128))>>15;\
-                G= ((Y<<15) -12911* (U-128) - 19038*(V-128))>>15;\
-                B= ((Y<<15) +66454* (U-128)                )>>15;\
-                byteclamp(R);\
-                byteclamp(G);\
-                byteclamp(B);\
-              } while(0)
-
-              YUV82RGB8 (*ysrc, *usrc, *vsrc, R, G, B);
-
-              *(unsigned int *) dst = R + G * 256 + B * 256 * 256 + 0xff000000;
-              dst += 4;
-              ysrc ++;
-              if (x % 2)
-                {
-                  usrc++;
-                  vsrc++;
-                }
-              }
-          }
-        gegl_buffer_set (output, NULL, NULL, buf, GEGL_AUTO_ROWSTRIDE);
-        g_free (buf);
-      }
-  }
   return  TRUE;
 }
 
@@ -430,10 +675,15 @@ finalize (GObject *object)
     {
       Priv *p = (Priv*)o->chant_data;
 
+      stop_decoder (p);
+
       g_free (p->loadedfilename);
       g_free (p->fourcc);
       g_free (p->codec_name);
 
+      g_mutex_free (p->mutex);
+      g_cond_free (p->cond);
+
       g_free (o->chant_data);
       o->chant_data = NULL;
     }
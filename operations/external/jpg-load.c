@@ -23,6 +23,10 @@
 #ifdef GEGL_CHANT_PROPERTIES
 
 gegl_chant_file_path (path, _("File"), "", _("Path of file to load."))
+gegl_chant_double (scale, _("Scale"), 0.0, 1.0, 1.0,
+                   _("Scale the image is needed at, it is decoded at the "
+                     "smallest of 1/8, 1/4, 1/2 or full size that is not "
+                     "smaller, and provided at that size"))
 
 #else
 
@@ -31,10 +35,36 @@ gegl_chant_file_path (path, _("File"), "", _("Path of file to load."))
 
 #include "gegl-chant.h"
 #include <stdio.h>
+#include <string.h>
 #include <jpeglib.h>
 
+/* Returns the denominator libjpeg should scale the image by, to decode it
+ * directly in the DCT domain at a size no smaller than scale times the
+ * full size.
+ */
+static guint
+gegl_jpg_load_scale_denom (gdouble scale)
+{
+  guint denom = 1;
+
+  while (denom < 8 && scale * denom * 2 <= 1.0)
+    denom *= 2;
+
+  return denom;
+}
+
+/* The loader parameters images decoded at scale_denom are cached with. */
+static void
+gegl_jpg_load_cache_params (guint  scale_denom,
+                            gchar *params,
+                            gsize  size)
+{
+  g_snprintf (params, size, "scale-denom=%u", scale_denom);
+}
+
 static gint
 gegl_jpg_load_query_jpg (const gchar *path,
+                         guint        scale_denom,
                          gint        *width,
                          gint        *height)
 {
@@ -54,10 +84,14 @@ gegl_jpg_load_query_jpg (const gchar *path,
 
   (void) jpeg_read_header (&cinfo, TRUE);
 
+  cinfo.scale_num   = 1;
+  cinfo.scale_denom = scale_denom;
+  jpeg_calc_output_dimensions (&cinfo);
+
   if (width)
-    *width = cinfo.image_width;
+    *width = cinfo.output_width;
   if (height)
-    *height = cinfo.image_height;
+    *height = cinfo.output_height;
 
   jpeg_destroy_decompress (&cinfo);
 
@@ -65,18 +99,41 @@ gegl_jpg_load_query_jpg (const gchar *path,
   return 0;
 }
 
-static gint
-gegl_jpg_load_buffer_import_jpg (GeglBuffer  *gegl_buffer,
-                                 const gchar *path,
-                                 gint         dest_x,
-                                 gint         dest_y)
+/* A decompressor kept open between calls to process. Regions are decoded
+ * in full width row ranges, so a crop near the top of the image stops
+ * decoding below it, and regions requested from top to bottom are decoded
+ * in a single pass over the file.
+ */
+typedef struct
 {
-  gint row_stride;
+  gchar                         *path;
+  guint                          scale_denom;
+  FILE                          *infile;
   struct jpeg_decompress_struct  cinfo;
   struct jpeg_error_mgr          jerr;
+} JpgDecoder;
+
+static void
+gegl_jpg_load_decoder_close (JpgDecoder *decoder)
+{
+  if (!decoder->infile)
+    return;
+
+  jpeg_destroy_decompress (&decoder->cinfo);
+  fclose (decoder->infile);
+  g_free (decoder->path);
+
+  decoder->infile = NULL;
+  decoder->path   = NULL;
+}
+
+static gint
+gegl_jpg_load_decoder_open (JpgDecoder  *decoder,
+                            const gchar *path,
+                            guint        scale_denom)
+{
+  struct jpeg_decompress_struct *cinfo = &decoder->cinfo;
   FILE                          *infile;
-  JSAMPARRAY                     buffer;
-  int row=0;
 
   if ((infile = fopen (path, "rb")) == NULL)
     {
@@ -84,59 +141,110 @@ gegl_jpg_load_buffer_import_jpg (GeglBuffer  *gegl_buffer,
       return -1;
     }
 
-  jpeg_create_decompress (&cinfo);
-  cinfo.err = jpeg_std_error (&jerr);
-  jpeg_stdio_src (&cinfo, infile);
+  jpeg_create_decompress (cinfo);
+  cinfo->err = jpeg_std_error (&decoder->jerr);
+  jpeg_stdio_src (cinfo, infile);
 
-  (void) jpeg_read_header (&cinfo, TRUE);
-  (void) jpeg_start_decompress (&cinfo);
+  (void) jpeg_read_header (cinfo, TRUE);
 
-  if ((cinfo.output_components != 1) &&
-      (cinfo.output_components != 3))
+  cinfo->scale_num   = 1;
+  cinfo->scale_denom = scale_denom;
+  (void) jpeg_start_decompress (cinfo);
+
+  if ((cinfo->output_components != 1) &&
+      (cinfo->output_components != 3))
     {
       g_warning ("attempted to load unsupported JPEG (components=%d)",
-                 cinfo.output_components);
-      jpeg_destroy_decompress (&cinfo);
+                 cinfo->output_components);
+      jpeg_destroy_decompress (cinfo);
+      fclose (infile);
       return -1;
     }
 
-  row_stride = cinfo.output_width * cinfo.output_components;
+  decoder->path        = g_strdup (path);
+  decoder->scale_denom = scale_denom;
+  decoder->infile      = infile;
 
-  if ((row_stride) % 2)
-    (row_stride)++;
+  return 0;
+}
 
-  /* allocated with the jpeg library, and freed with the decompress context */
-  buffer = (*cinfo.mem->alloc_sarray)
-    ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
+/* Decodes the rows of result into gegl_buffer. Rows above result that the
+ * decoder has not passed yet are skipped, the caller reopens the decoder
+ * for regions above its position.
+ */
+static void
+gegl_jpg_load_decoder_read (JpgDecoder          *decoder,
+                            GeglBuffer          *gegl_buffer,
+                            const GeglRectangle *result)
+{
+  struct jpeg_decompress_struct *cinfo = &decoder->cinfo;
+  gint                           last  = MIN (result->y + result->height,
+                                              (gint) cinfo->output_height);
+  gint                           row_stride;
+  const Babl                    *format;
+  JSAMPLE                       *pixels;
+  JSAMPARRAY                     rows;
+  GeglRectangle                  band;
+  gint                           band_height;
+  gint                           i;
+
+  switch (cinfo->output_components)
+    {
+    case 1:
+      format = babl_format ("Y' u8");
+      break;
+    case 3:
+    default:
+      format = babl_format ("R'G'B' u8");
+    }
+
+  /* Scanlines are decoded a tile row at a time into a staging band, which
+   * is converted and stored with a single gegl_buffer_set.
+   */
+  g_object_get (gegl_buffer, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, (gint) cinfo->output_height);
+
+  row_stride = cinfo->output_width * cinfo->output_components;
 
-  while (cinfo.output_scanline < cinfo.output_height)
+  pixels = g_new (JSAMPLE, row_stride * band_height);
+  rows   = g_new (JSAMPROW, band_height);
+
+  for (i = 0; i < band_height; i++)
+    rows[i] = pixels + i * row_stride;
+
+  while ((gint) cinfo->output_scanline < result->y)
     {
-      GeglRectangle rect;
-
-      rect.x = dest_x;
-      rect.y = dest_y + row++;
-      rect.width = cinfo.output_width;
-      rect.height = 1;
-
-      jpeg_read_scanlines (&cinfo, buffer, 1);
-
-      switch (cinfo.output_components)
-        {
-        case 1:
-          gegl_buffer_set (gegl_buffer, &rect,
-                           babl_format ("Y' u8"), buffer[0],
-                           GEGL_AUTO_ROWSTRIDE);
-          break;
-        case 3:
-        default:
-          gegl_buffer_set (gegl_buffer, &rect,
-                           babl_format ("R'G'B' u8"), buffer[0],
-                           GEGL_AUTO_ROWSTRIDE);
-	}
+#if defined (LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+      jpeg_skip_scanlines (cinfo, result->y - cinfo->output_scanline);
+#else
+      jpeg_read_scanlines (cinfo, rows, 1);
+#endif
+    }
+
+  gegl_rectangle_set (&band, 0, 0, cinfo->output_width, 0);
+
+  while ((gint) cinfo->output_scanline < last)
+    {
+      gint first = cinfo->output_scanline;
+      gint count = MIN (band_height, last - first);
+
+      while ((gint) cinfo->output_scanline < first + count)
+        jpeg_read_scanlines (cinfo, rows + (cinfo->output_scanline - first),
+                             first + count - cinfo->output_scanline);
+
+      band.y      = first;
+      band.height = count;
+      gegl_buffer_set (gegl_buffer, &band, format, pixels, row_stride);
+    }
+
+  g_free (rows);
+  g_free (pixels);
+
+  if (cinfo->output_scanline >= cinfo->output_height)
+    {
+      jpeg_finish_decompress (cinfo);
+      gegl_jpg_load_decoder_close (decoder);
     }
-  jpeg_destroy_decompress (&cinfo);
-  fclose (infile);
-  return 0;
 }
 
 static GeglRectangle
@@ -146,8 +254,23 @@ gegl_jpg_load_get_bounding_box (GeglOperation *operation)
   GeglRectangle result = {0,0,0,0};
   gint width, height;
   gint status;
+  gchar params[32];
+  GeglBuffer *cached;
   gegl_operation_set_format (operation, "output", babl_format ("R'G'B' u8"));
-  status = gegl_jpg_load_query_jpg (o->path, &width, &height);
+
+  gegl_jpg_load_cache_params (gegl_jpg_load_scale_denom (o->scale),
+                              params, sizeof (params));
+  cached = gegl_image_cache_lookup (o->path, params);
+  if (cached)
+    {
+      result = *gegl_buffer_get_extent (cached);
+      g_object_unref (cached);
+      return result;
+    }
+
+  status = gegl_jpg_load_query_jpg (o->path,
+                                    gegl_jpg_load_scale_denom (o->scale),
+                                    &width, &height);
 
   if (status)
     {
@@ -170,37 +293,87 @@ gegl_jpg_load_process (GeglOperation       *operation,
                        const GeglRectangle *result)
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
-  GeglRectangle        rect={0,0};
-  gint                 problem;
-
-  problem = gegl_jpg_load_query_jpg (o->path, &rect.width, &rect.height);
-
-  if (problem)
+  JpgDecoder *decoder = o->chant_data;
+  guint       scale_denom = gegl_jpg_load_scale_denom (o->scale);
+  gchar       params[32];
+  GeglBuffer *cached;
+  gboolean    whole;
+
+  gegl_jpg_load_cache_params (scale_denom, params, sizeof (params));
+  cached = gegl_image_cache_lookup (o->path, params);
+  if (cached)
     {
-      g_warning ("%s failed to open file %s for reading.",
-        G_OBJECT_TYPE_NAME (operation), o->path);
-      return FALSE;
+      gegl_buffer_copy (cached, result, output, result);
+      g_object_unref (cached);
+      return TRUE;
     }
 
+  if (!decoder)
+    {
+      decoder = g_new0 (JpgDecoder, 1);
+      o->chant_data = decoder;
+    }
 
-  problem = gegl_jpg_load_buffer_import_jpg (output, o->path, 0, 0);
+  /* rows above the position of the decoder need a new pass over the file */
+  if (decoder->infile &&
+      (strcmp (decoder->path, o->path) ||
+       decoder->scale_denom != scale_denom ||
+       (gint) decoder->cinfo.output_scanline > result->y))
+    gegl_jpg_load_decoder_close (decoder);
 
-  if (problem)
+  if (!decoder->infile &&
+      gegl_jpg_load_decoder_open (decoder, o->path, scale_denom))
     {
       g_warning ("%s failed to open file %s for reading.",
         G_OBJECT_TYPE_NAME (operation), o->path);
-
       return FALSE;
     }
 
+  /* the decoder is closed once it reaches the end of the image */
+  whole = result->x == 0 && result->y == 0 &&
+          result->width  == (gint) decoder->cinfo.output_width &&
+          result->height == (gint) decoder->cinfo.output_height;
+
+  gegl_jpg_load_decoder_read (decoder, output, result);
+
+  if (whole)
+    gegl_image_cache_insert (o->path, params, output, result);
+
   return  TRUE;
 }
 
+/* Images are decoded in full width row ranges, or as a whole when they
+ * are small enough to be kept in the image cache.
+ */
 static GeglRectangle
 gegl_jpg_load_get_cached_region (GeglOperation       *operation,
                                  const GeglRectangle *roi)
 {
-  return gegl_jpg_load_get_bounding_box (operation);
+  GeglRectangle result = gegl_jpg_load_get_bounding_box (operation);
+  gint          bottom = MIN (roi->y + roi->height, result.y + result.height);
+
+  if (gegl_image_cache_can_store ((gsize) result.width * result.height * 3))
+    return result;
+
+  result.y      = MAX (roi->y, result.y);
+  result.height = MAX (bottom - result.y, 0);
+
+  return result;
+}
+
+static void
+finalize (GObject *object)
+{
+  GeglChantO *o = GEGL_CHANT_PROPERTIES (object);
+
+  if (o->chant_data)
+    {
+      gegl_jpg_load_decoder_close (o->chant_data);
+      g_free (o->chant_data);
+      o->chant_data = NULL;
+    }
+
+  G_OBJECT_CLASS (gegl_chant_parent_class)->finalize (object);
 }
 
 static void
@@ -212,6 +385,8 @@ gegl_chant_class_init (GeglChantClass *klass)
   operation_class = GEGL_OPERATION_CLASS (klass);
   source_class    = GEGL_OPERATION_SOURCE_CLASS (klass);
 
+  G_OBJECT_CLASS (klass)->finalize = finalize;
+
   source_class->process = gegl_jpg_load_process;
   operation_class->get_bounding_box = gegl_jpg_load_get_bounding_box;
   operation_class->get_cached_region = gegl_jpg_load_get_cached_region;
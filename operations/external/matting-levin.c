@@ -39,12 +39,17 @@ gegl_chant_int    (levels, _("Levels"),
 gegl_chant_int    (active_levels, _("Active Levels"),
                    0, 8, 2,
                    _("Number of levels to perform solving"))
+gegl_chant_boolean (exact, _("Exact"), FALSE,
+                  _("Solve with a direct sparse factorization instead of "
+                    "conjugate gradients, memory use grows quickly with "
+                    "the image size (needs GEGL built with UMFPACK)"))
 #else
 
 #define GEGL_CHANT_TYPE_COMPOSER
 #define GEGL_CHANT_C_FILE       "matting-levin.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 #include "gegl-debug.h"
 
 #include <stdlib.h>
@@ -55,11 +60,13 @@ gegl_chant_int    (active_levels, _("Active Levels"),
  * UMFPACK. Ideally this would be sorted out purely in autoconf; see
  * configure.ac for the issues.
  */
+#ifdef HAVE_UMFPACK
 #if defined(HAVE_UMFPACK_H)
 #include <umfpack.h>
 #elif defined (HAVE_SUITESPARSE_UMFPACK_H)
 #include <suitesparse/umfpack.h>
 #endif
+#endif
 
 #include "matting-levin-cblas.h"
 
@@ -77,6 +84,7 @@ gegl_chant_int    (active_levels, _("Active Levels"),
 #define CONVOLVE_LEN     ((CONVOLVE_RADIUS * 2) + 1)
 
 
+#ifdef HAVE_UMFPACK
 /* A simple structure holding a compressed column sparse matrix. Data fields
  * correspond directly to the expected format used by UMFPACK. This restricts
  * us to using square matrices.
@@ -90,6 +98,7 @@ typedef struct
           *row_idx;
   gdouble *values;
 } sparse_t;
+#endif
 
 
 /* All channels use double precision. Despite it being overly precise, slower,
@@ -130,6 +139,7 @@ ceil_div (gint x, gint y)
   return (x + y - 1) / y;
 }
 
+#ifdef HAVE_UMFPACK
 /* Perform a floating point comparison, returning true if the values are
  * within the percentage tolerance specified in FLOAT_TOLERANCE. Note: this
  * is different to GEGL_FLOAT_EQUAL which specifies an absolute delta. This
@@ -143,6 +153,7 @@ float_cmp (gfloat a, gfloat b)
   return (a - b) <= FLOAT_TOLERANCE * fabsf (a) ||
          (a - b) <= FLOAT_TOLERANCE * fabsf (b);
 }
+#endif
 
 /* Return the offset for the integer coordinates (X, Y), in surface of
  * dimensions R, which has C channels. Does not take into account the channel
@@ -173,6 +184,7 @@ trimap_masked (const gdouble       *restrict trimap,
 }
 
 
+#ifdef HAVE_UMFPACK
 static const char*
 matting_umf_error_to_string (guint err)
 {
@@ -214,6 +226,7 @@ matting_umf_error_to_string (guint err)
           g_return_val_if_reached ("Unknown UMFPACK error");
     }
 }
+#endif
 
 
 static void
@@ -842,6 +855,7 @@ cleanup:
 }
 
 
+#ifdef HAVE_UMFPACK
 static sparse_t *
 matting_sparse_new (guint cols, guint rows, guint elems)
 {
@@ -1246,12 +1260,586 @@ cleanup:
 
   return success;
 }
+#endif /* HAVE_UMFPACK */
+
+
+/* Matrix free conjugate gradient solver for the matting laplacian.
+ *
+ * With W_k the set of pixels in the window centered on pixel k, mu_k its
+ * mean colour and S_k the inverse of its regularised covariance, the
+ * laplacian is L = D - W, where
+ *
+ *   W_ij = sum over masked k with i, j in W_k of
+ *            (1 + (I_i - mu_k)' S_k (I_j - mu_k)) / |W_k|
+ *
+ * and D holds the row sums of W, plus lambda for pixels defined in the
+ * trimap. For a vector p, (W p)_i only needs, for each window k,
+ *
+ *   b_k = S_k sum_j (I_j - mu_k) p_j / |W_k|
+ *   a_k = sum_j p_j / |W_k| - mu_k . b_k
+ *
+ * after which (W p)_i = sum over windows k containing i of a_k + I_i . b_k.
+ * Memory use is linear in the image size, the window statistics and a few
+ * vectors, instead of the super-linear fill-in of a sparse factorisation.
+ *
+ * Each level is solved with jacobi preconditioned conjugate gradients,
+ * starting from the solution upsampled from the coarser level, so most of
+ * the error left for the fine level is of high frequency. The coarser
+ * levels only provide that starting point, they are not used as a
+ * multilevel preconditioner: coarse versions of the laplacian, with its
+ * wide and image dependent stencil, would take back much of the memory
+ * that the matrix free product saves.
+ */
+
+#define STATS_MEAN     0
+#define STATS_INVERSE  3
+#define STATS_ELEMS    9
+
+#define CG_BLOCK          16384
+#define CG_TOLERANCE      1e-6
+#define CG_MAX_ITERATIONS 1000
+
+typedef struct
+{
+  const gdouble       *image;
+  const gdouble       *trimap;
+  const GeglRectangle *roi;
+  gint                 radius;
+  gdouble              epsilon;
+  gdouble              lambda;
+
+  /* per window center: mean colour and the upper triangle of the inverse
+   * covariance, windows with an unmasked center are inactive
+   */
+  gboolean            *active;
+  gdouble             *stats;
+  /* diagonal of L, for the preconditioner */
+  gdouble             *diagonal;
+  /* row sums of W plus the trimap term */
+  gdouble             *degree;
+  /* per window center: b_k and a_k of the current product */
+  gdouble             *coeffs;
+
+  const gdouble       *p;
+  gdouble             *Ap;
+} matting_laplacian_t;
+
+
+static inline gdouble
+matting_window_product (const gdouble *restrict stats,
+                        const gdouble           u[3],
+                        const gdouble           v[3])
+{
+  const gdouble *s = stats + STATS_INVERSE;
+
+  return u[0] * (s[0] * v[0] + s[1] * v[1] + s[2] * v[2]) +
+         u[1] * (s[1] * v[0] + s[3] * v[1] + s[4] * v[2]) +
+         u[2] * (s[2] * v[0] + s[4] * v[1] + s[5] * v[2]);
+}
+
+
+/* Compute the mean and inverse covariance of the windows centered on the
+ * rows assigned to this thread.
+ */
+static void
+matting_laplacian_stats_rows (gint     thread,
+                              gint     threads,
+                              gpointer data)
+{
+  matting_laplacian_t *L   = data;
+  const GeglRectangle *roi = L->roi;
+  gint     radius       = L->radius,
+           window_elems = (radius * 2 + 1) * (radius * 2 + 1),
+           first        = roi->height * thread / threads,
+           last         = roi->height * (thread + 1) / threads,
+           i, j, k, x, y;
+  gdouble  mean[COMPONENTS_INPUT],
+           mean_matrix[COMPONENTS_INPUT][COMPONENTS_INPUT],
+           covariance[COMPONENTS_INPUT][COMPONENTS_INPUT],
+           inverse[COMPONENTS_INPUT][COMPONENTS_INPUT],
+           window[COMPONENTS_INPUT][window_elems];
+
+  for (j = MAX (first, radius); j < MIN (last, roi->height - radius); ++j)
+    {
+      for (i = radius; i < roi->width - radius; ++i)
+        {
+          gdouble *stats = L->stats + offset (i, j, roi, STATS_ELEMS);
+
+          if (!trimap_masked (L->trimap, i, j, roi))
+            continue;
+
+          mean[0] = mean[1] = mean[2] = 0.0;
+          k = 0;
+          for (y = j - radius; y <= j + radius; ++y)
+            for (x = i - radius; x <= i + radius; ++x)
+              {
+                const gdouble *pixel = L->image + offset (x, y, roi,
+                                                          COMPONENTS_INPUT);
+
+                mean[0] += window[0][k] = pixel[0];
+                mean[1] += window[1][k] = pixel[1];
+                mean[2] += window[2][k] = pixel[2];
+                ++k;
+              }
+
+          mean[0] /= window_elems;
+          mean[1] /= window_elems;
+          mean[2] /= window_elems;
+
+          matting_vector3_self_product (mean, mean_matrix);
+
+          /* Same covariance as matting_get_laplacian */
+          cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasTrans,
+                       COMPONENTS_INPUT, COMPONENTS_INPUT, window_elems,
+                       1.0 / window_elems,
+                       (gdouble *)window, window_elems,
+                       (gdouble *)window, window_elems,
+                       0.0,  (gdouble *)covariance, COMPONENTS_INPUT);
+
+          matting_matrix3_matrix3_sub (covariance, mean_matrix, covariance);
+          covariance[0][0] += L->epsilon / window_elems;
+          covariance[1][1] += L->epsilon / window_elems;
+          covariance[2][2] += L->epsilon / window_elems;
+          if (!matting_matrix3_inverse (covariance, inverse))
+            continue;
+
+          stats[STATS_MEAN + 0]    = mean[0];
+          stats[STATS_MEAN + 1]    = mean[1];
+          stats[STATS_MEAN + 2]    = mean[2];
+          stats[STATS_INVERSE + 0] = inverse[0][0];
+          stats[STATS_INVERSE + 1] = inverse[0][1];
+          stats[STATS_INVERSE + 2] = inverse[0][2];
+          stats[STATS_INVERSE + 3] = inverse[1][1];
+          stats[STATS_INVERSE + 4] = inverse[1][2];
+          stats[STATS_INVERSE + 5] = inverse[2][2];
+
+          L->active[offset (i, j, roi, 1)] = TRUE;
+        }
+    }
+}
+
+
+/* Compute the row sums of W and the diagonal of L for pixels in the rows
+ * assigned to this thread.
+ */
+static void
+matting_laplacian_diagonal_rows (gint     thread,
+                                 gint     threads,
+                                 gpointer data)
+{
+  matting_laplacian_t *L   = data;
+  const GeglRectangle *roi = L->roi;
+  gint    radius       = L->radius,
+          window_elems = (radius * 2 + 1) * (radius * 2 + 1),
+          first        = roi->height * thread / threads,
+          last         = roi->height * (thread + 1) / threads,
+          i, j, x, y;
+
+  for (j = first; j < last; ++j)
+    {
+      for (i = 0; i < roi->width; ++i)
+        {
+          const gdouble *pixel  = L->image + offset (i, j, roi,
+                                                     COMPONENTS_INPUT);
+          gdouble        degree = 0.0,
+                         self   = 0.0;
+
+          for (y = MAX (j - radius, radius);
+               y <= MIN (j + radius, roi->height - radius - 1); ++y)
+            for (x = MAX (i - radius, radius);
+                 x <= MIN (i + radius, roi->width - radius - 1); ++x)
+              {
+                const gdouble *stats = L->stats + offset (x, y, roi,
+                                                          STATS_ELEMS);
+                gdouble        delta[3];
+
+                if (!L->active[offset (x, y, roi, 1)])
+                  continue;
+
+                delta[0] = pixel[0] - stats[STATS_MEAN + 0];
+                delta[1] = pixel[1] - stats[STATS_MEAN + 1];
+                delta[2] = pixel[2] - stats[STATS_MEAN + 2];
+
+                /* every window contributes exactly 1 to the row sum */
+                degree += 1.0;
+                self   += (1.0 + matting_window_product (stats, delta, delta)) /
+                          window_elems;
+              }
+
+          if (!trimap_masked (L->trimap, i, j, roi))
+            degree += L->lambda;
+
+          L->degree  [offset (i, j, roi, 1)] = degree;
+          L->diagonal[offset (i, j, roi, 1)] = degree - self;
+        }
+    }
+}
+
+
+/* First half of a product: a_k and b_k of the windows centered in the rows
+ * assigned to this thread.
+ */
+static void
+matting_laplacian_coeffs_rows (gint     thread,
+                               gint     threads,
+                               gpointer data)
+{
+  matting_laplacian_t *L   = data;
+  const GeglRectangle *roi = L->roi;
+  gint    radius       = L->radius,
+          window_elems = (radius * 2 + 1) * (radius * 2 + 1),
+          first        = roi->height * thread / threads,
+          last         = roi->height * (thread + 1) / threads,
+          i, j, x, y;
+
+  for (j = MAX (first, radius); j < MIN (last, roi->height - radius); ++j)
+    {
+      for (i = radius; i < roi->width - radius; ++i)
+        {
+          const gdouble *stats  = L->stats  + offset (i, j, roi, STATS_ELEMS);
+          gdouble       *coeffs = L->coeffs + offset (i, j, roi,
+                                                      COMPONENTS_COEFF);
+          gdouble        sum = 0.0,
+                         weighted[3] = { 0.0, 0.0, 0.0 },
+                         unit[3][3]  = { { 1.0, 0.0, 0.0 },
+                                         { 0.0, 1.0, 0.0 },
+                                         { 0.0, 0.0, 1.0 } };
+
+          if (!L->active[offset (i, j, roi, 1)])
+            continue;
+
+          for (y = j - radius; y <= j + radius; ++y)
+            for (x = i - radius; x <= i + radius; ++x)
+              {
+                const gdouble *pixel = L->image + offset (x, y, roi,
+                                                          COMPONENTS_INPUT);
+                gdouble        p     = L->p[offset (x, y, roi, 1)];
+
+                sum         += p;
+                weighted[0] += pixel[0] * p;
+                weighted[1] += pixel[1] * p;
+                weighted[2] += pixel[2] * p;
+              }
+
+          weighted[0] = (weighted[0] - stats[STATS_MEAN + 0] * sum) / window_elems;
+          weighted[1] = (weighted[1] - stats[STATS_MEAN + 1] * sum) / window_elems;
+          weighted[2] = (weighted[2] - stats[STATS_MEAN + 2] * sum) / window_elems;
+
+          coeffs[0] = matting_window_product (stats, unit[0], weighted);
+          coeffs[1] = matting_window_product (stats, unit[1], weighted);
+          coeffs[2] = matting_window_product (stats, unit[2], weighted);
+          coeffs[3] = sum / window_elems -
+                      stats[STATS_MEAN + 0] * coeffs[0] -
+                      stats[STATS_MEAN + 1] * coeffs[1] -
+                      stats[STATS_MEAN + 2] * coeffs[2];
+        }
+    }
+}
+
+
+/* Second half of a product: Ap = D p - W p for the rows assigned to this
+ * thread.
+ */
+static void
+matting_laplacian_multiply_rows (gint     thread,
+                                 gint     threads,
+                                 gpointer data)
+{
+  matting_laplacian_t *L   = data;
+  const GeglRectangle *roi = L->roi;
+  gint    radius = L->radius,
+          first  = roi->height * thread / threads,
+          last   = roi->height * (thread + 1) / threads,
+          i, j, x, y;
+
+  for (j = first; j < last; ++j)
+    {
+      for (i = 0; i < roi->width; ++i)
+        {
+          const gdouble *pixel = L->image + offset (i, j, roi,
+                                                    COMPONENTS_INPUT);
+          gdouble        sum[COMPONENTS_COEFF] = { 0.0, 0.0, 0.0, 0.0 };
+          off_t          idx = offset (i, j, roi, 1);
+
+          for (y = MAX (j - radius, radius);
+               y <= MIN (j + radius, roi->height - radius - 1); ++y)
+            for (x = MAX (i - radius, radius);
+                 x <= MIN (i + radius, roi->width - radius - 1); ++x)
+              {
+                const gdouble *coeffs = L->coeffs + offset (x, y, roi,
+                                                            COMPONENTS_COEFF);
+
+                if (!L->active[offset (x, y, roi, 1)])
+                  continue;
+
+                sum[0] += coeffs[0];
+                sum[1] += coeffs[1];
+                sum[2] += coeffs[2];
+                sum[3] += coeffs[3];
+              }
+
+          L->Ap[idx] = L->degree[idx] * L->p[idx] -
+                       (pixel[0] * sum[0] +
+                        pixel[1] * sum[1] +
+                        pixel[2] * sum[2] + sum[3]);
+        }
+    }
+}
+
+
+static void
+matting_laplacian_multiply (matting_laplacian_t *L,
+                            const gdouble       *p,
+                            gdouble             *Ap)
+{
+  L->p  = p;
+  L->Ap = Ap;
+
+  gegl_parallel_distribute (L->roi->height, matting_laplacian_coeffs_rows,   L);
+  gegl_parallel_distribute (L->roi->height, matting_laplacian_multiply_rows, L);
+}
+
+
+static void
+matting_laplacian_init (matting_laplacian_t *L,
+                        const gdouble       *image,
+                        const gdouble       *trimap,
+                        const GeglRectangle *roi,
+                        gint                 radius,
+                        gdouble              epsilon,
+                        gdouble              lambda)
+{
+  gint image_elems = roi->width * roi->height;
+
+  L->image    = image;
+  L->trimap   = trimap;
+  L->roi      = roi;
+  L->radius   = radius;
+  L->epsilon  = epsilon;
+  L->lambda   = lambda;
+
+  L->active   = g_new0 (gboolean, image_elems);
+  L->stats    = g_new  (gdouble,  image_elems * STATS_ELEMS);
+  L->diagonal = g_new  (gdouble,  image_elems);
+  L->degree   = g_new  (gdouble,  image_elems);
+  L->coeffs   = g_new  (gdouble,  image_elems * COMPONENTS_COEFF);
+
+  gegl_parallel_distribute (roi->height, matting_laplacian_stats_rows,    L);
+  gegl_parallel_distribute (roi->height, matting_laplacian_diagonal_rows, L);
+}
+
+
+static void
+matting_laplacian_clear (matting_laplacian_t *L)
+{
+  g_free (L->active);
+  g_free (L->stats);
+  g_free (L->diagonal);
+  g_free (L->degree);
+  g_free (L->coeffs);
+}
+
+
+/* The vector operations of the conjugate gradient iteration. Partial sums
+ * are kept per fixed size block and added up in order, so the result does
+ * not depend on the number of threads.
+ */
+typedef enum
+{
+  CG_DOT_P_AP,  /* sums[0] = p . Ap */
+  CG_STEP,      /* x += alpha p, r -= alpha Ap, z = r / diagonal,
+                 * sums[0] = r . r, sums[1] = r . z */
+  CG_DIRECTION  /* p = z + beta p */
+} matting_cg_op_t;
+
+typedef struct
+{
+  matting_cg_op_t  op;
+  gint             n;
+  gint             blocks;
+  gdouble          alpha,
+                   beta;
+  const gdouble   *diagonal;
+  gdouble         *x,
+                  *r,
+                  *z,
+                  *p,
+                  *Ap;
+  gdouble         *sums;
+} matting_cg_t;
+
+
+static void
+matting_cg_blocks (gint     thread,
+                   gint     threads,
+                   gpointer data)
+{
+  matting_cg_t *cg = data;
+  gint          block;
+
+  for (block = thread; block < cg->blocks; block += threads)
+    {
+      gint    first = block * CG_BLOCK,
+              last  = MIN (first + CG_BLOCK, cg->n),
+              i;
+      gdouble sum0  = 0.0,
+              sum1  = 0.0;
+
+      switch (cg->op)
+        {
+          case CG_DOT_P_AP:
+            for (i = first; i < last; ++i)
+              sum0 += cg->p[i] * cg->Ap[i];
+            break;
+
+          case CG_STEP:
+            for (i = first; i < last; ++i)
+              {
+                cg->x[i] += cg->alpha * cg->p[i];
+                cg->r[i] -= cg->alpha * cg->Ap[i];
+                cg->z[i]  = cg->diagonal[i] > 0.0 ?
+                            cg->r[i] / cg->diagonal[i] : cg->r[i];
+                sum0 += cg->r[i] * cg->r[i];
+                sum1 += cg->r[i] * cg->z[i];
+              }
+            break;
+
+          case CG_DIRECTION:
+            for (i = first; i < last; ++i)
+              cg->p[i] = cg->z[i] + cg->beta * cg->p[i];
+            break;
+        }
+
+      cg->sums[block * 2 + 0] = sum0;
+      cg->sums[block * 2 + 1] = sum1;
+    }
+}
+
+
+static void
+matting_cg_run (matting_cg_t    *cg,
+                matting_cg_op_t  op,
+                gdouble          result[2])
+{
+  gint block;
+
+  cg->op = op;
+  gegl_parallel_distribute (cg->blocks, matting_cg_blocks, cg);
+
+  result[0] = result[1] = 0.0;
+  for (block = 0; block < cg->blocks; ++block)
+    {
+      result[0] += cg->sums[block * 2 + 0];
+      result[1] += cg->sums[block * 2 + 1];
+    }
+}
+
+
+/* Solve the matting laplacian with preconditioned conjugate gradients,
+ * using the contents of solution as the initial guess.
+ */
+static gboolean
+matting_solve_laplacian_iterative (const gdouble       *restrict image,
+                                   const gdouble       *restrict trimap,
+                                   gdouble             *restrict solution,
+                                   const GeglRectangle *restrict roi,
+                                   gint                 radius,
+                                   gdouble              epsilon,
+                                   gdouble              lambda)
+{
+  matting_laplacian_t L;
+  matting_cg_t        cg;
+  gdouble             sums[2],
+                      rhs_norm2 = 0.0,
+                      rr, rz;
+  gint                image_elems, i, iter;
+
+  g_return_val_if_fail (image,    FALSE);
+  g_return_val_if_fail (trimap,   FALSE);
+  g_return_val_if_fail (solution, FALSE);
+  g_return_val_if_fail (roi,      FALSE);
+  g_return_val_if_fail (!gegl_rectangle_is_empty (roi), FALSE);
+  g_return_val_if_fail (radius > 0, FALSE);
+
+  image_elems = roi->width * roi->height;
+  matting_laplacian_init (&L, image, trimap, roi, radius, epsilon, lambda);
+
+  cg.n        = image_elems;
+  cg.blocks   = ceil_div (image_elems, CG_BLOCK);
+  cg.diagonal = L.diagonal;
+  cg.x        = solution;
+  cg.r        = g_new (gdouble, image_elems);
+  cg.z        = g_new (gdouble, image_elems);
+  cg.p        = g_new (gdouble, image_elems);
+  cg.Ap       = g_new (gdouble, image_elems);
+  cg.sums     = g_new (gdouble, cg.blocks * 2);
+
+  /* r = b - A x, where b is lambda times the defined trimap values */
+  matting_laplacian_multiply (&L, solution, cg.Ap);
+  for (i = 0; i < image_elems; ++i)
+    {
+      gdouble rhs = 0.0;
+
+      if (!trimap_masked (trimap, i, 0, roi))
+        rhs = lambda * trimap[i * COMPONENTS_AUX + AUX_VALUE];
+
+      rhs_norm2 += rhs * rhs;
+      cg.r[i]    = rhs - cg.Ap[i];
+    }
+
+  /* A zero step only computes the preconditioned residual */
+  cg.alpha = 0.0;
+  matting_cg_run (&cg, CG_STEP, sums);
+  memcpy (cg.p, cg.z, image_elems * sizeof (gdouble));
+  rr = sums[0];
+  rz = sums[1];
+
+  for (iter = 0;
+       iter < CG_MAX_ITERATIONS &&
+       rr > CG_TOLERANCE * CG_TOLERANCE * rhs_norm2;
+       ++iter)
+    {
+      gdouble pAp;
+
+      matting_laplacian_multiply (&L, cg.p, cg.Ap);
+      matting_cg_run (&cg, CG_DOT_P_AP, sums);
+      pAp = sums[0];
+      if (pAp <= 0.0)
+        break;
+
+      cg.alpha = rz / pAp;
+      matting_cg_run (&cg, CG_STEP, sums);
+      rr = sums[0];
+
+      cg.beta = sums[1] / rz;
+      rz      = sums[1];
+      matting_cg_run (&cg, CG_DIRECTION, sums);
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_PROCESS,
+             "matting conjugate gradients: %d iterations", iter);
+
+  /* Courtesy clamping of the solution to normal alpha range */
+  for (i = 0; i < image_elems; ++i)
+    solution[i] = CLAMP (solution[i], 0.0, 1.0);
+
+  g_free (cg.r);
+  g_free (cg.z);
+  g_free (cg.p);
+  g_free (cg.Ap);
+  g_free (cg.sums);
+  matting_laplacian_clear (&L);
+
+  return TRUE;
+}
 
 
 /* Recursively downsample, solve, then upsample the matting laplacian.
  * Perform up to `levels' recursions (provided the image remains large
  * enough), with up to `active_levels' number of full laplacian solves (not
- * just extrapolation).
+ * just extrapolation). Full solves are exact factorizations if `exact' is
+ * set and UMFPACK is available, otherwise they iterate from the
+ * extrapolated solution.
  */
 static gdouble *
 matting_solve_level (gdouble             *restrict pixels,
@@ -1262,7 +1850,8 @@ matting_solve_level (gdouble             *restrict pixels,
                      guint                radius,
                      gdouble              epsilon,
                      gdouble              lambda,
-                     gdouble              threshold)
+                     gdouble              threshold,
+                     gboolean             exact)
 {
   gint     i;
   gdouble *new_alpha    = NULL,
@@ -1299,7 +1888,7 @@ matting_solve_level (gdouble             *restrict pixels,
       small_alpha = matting_solve_level (small_pixels, small_trimap,
                                          &small_region, active_levels,
                                          levels - 1, radius, epsilon,
-                                         lambda, threshold);
+                                         lambda, threshold, exact);
 
       new_alpha = matting_upsample_alpha (small_pixels, pixels, small_alpha,
                                           &small_region, region, epsilon,
@@ -1333,8 +1922,21 @@ matting_solve_level (gdouble             *restrict pixels,
       g_free (eroded_alpha);
     }
 
+#ifndef HAVE_UMFPACK
+  exact = FALSE;
+#endif
+
   /* Ordinary solution of the matting laplacian */
-  if (active_levels >= levels || levels == 0)
+  if ((active_levels >= levels || levels == 0) && !exact)
+    {
+      if (!new_alpha)
+        new_alpha = g_new0 (gdouble, region->width * region->height);
+
+      matting_solve_laplacian_iterative (pixels, trimap, new_alpha, region,
+                                         radius, epsilon, lambda);
+    }
+#ifdef HAVE_UMFPACK
+  else if (active_levels >= levels || levels == 0)
     {
       sparse_t *laplacian;
       g_free (new_alpha);
@@ -1350,6 +1952,7 @@ matting_solve_level (gdouble             *restrict pixels,
       matting_solve_laplacian (trimap, laplacian, new_alpha, region, lambda);
       matting_sparse_free (laplacian);
     }
+#endif
 
   g_return_val_if_fail (new_alpha != NULL, NULL);
   return new_alpha;
@@ -1391,7 +1994,7 @@ matting_process (GeglOperation       *operation,
   output = matting_solve_level (input, trimap, result,
                                 MIN (o->active_levels, o->levels), o->levels,
                                 o->radius, powf (10, o->epsilon), o->lambda,
-                                o->threshold);
+                                o->threshold, o->exact);
   gegl_buffer_set (output_buf, result, babl_format (FORMAT_OUTPUT), output,
                    GEGL_AUTO_ROWSTRIDE);
 
@@ -71,16 +71,46 @@ static FILE * open_png(const gchar *path)
   return infile;
 }
 
-static gint
-gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
-                        const gchar *path,
-                        gint         dest_x,
-                        gint         dest_y,
-                        gint        *ret_width,
-                        gint        *ret_height,
-                        gpointer     format)
+/* A decoder kept open between calls to process. Regions are decoded in
+ * full width row ranges, so a crop near the top of the image only inflates
+ * the rows above it, and regions requested from top to bottom are decoded
+ * in a single pass over the file.
+ */
+typedef struct
+{
+  gchar       *path;
+  FILE        *infile;
+  png_structp  load_png_ptr;
+  png_infop    load_info_ptr;
+  gint         width;
+  gint         height;
+  gint         bpp;
+  gint         number_of_passes;
+  gint         row;               /* next row png_read_rows returns */
+} PngDecoder;
+
+static void
+png_decoder_close (PngDecoder *decoder)
+{
+  if (decoder->load_png_ptr)
+    png_destroy_read_struct (&decoder->load_png_ptr,
+                             &decoder->load_info_ptr, NULL);
+
+  if (decoder->infile && decoder->infile != stdin)
+    fclose (decoder->infile);
+
+  g_free (decoder->path);
+
+  decoder->path          = NULL;
+  decoder->infile        = NULL;
+  decoder->load_png_ptr  = NULL;
+  decoder->load_info_ptr = NULL;
+}
+
+static gboolean
+png_decoder_open (PngDecoder  *decoder,
+                  const gchar *path)
 {
-  gint           width;
   gint           bit_depth;
   gint           bpp;
   gint           number_of_passes=1;
@@ -89,18 +119,12 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
   FILE          *infile;
   png_structp    load_png_ptr;
   png_infop      load_info_ptr;
-  guchar        *pixels;
-  /*png_bytep     *rows;*/
-
-
-  unsigned   int i;
-  png_bytep  *row_p = NULL;
 
   infile = open_png (path);
 
   if (!infile)
     {
-      return -1;
+      return FALSE;
     }
 
   load_png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -108,7 +132,7 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
   if (!load_png_ptr)
     {
       fclose (infile);
-      return -1;
+      return FALSE;
     }
 
   load_info_ptr = png_create_info_struct (load_png_ptr);
@@ -116,16 +140,14 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
     {
       png_destroy_read_struct (&load_png_ptr, &load_info_ptr, NULL);
       fclose (infile);
-      return -1;
+      return FALSE;
     }
 
   if (setjmp (png_jmpbuf (load_png_ptr)))
     {
       png_destroy_read_struct (&load_png_ptr, &load_info_ptr, NULL);
-     if (row_p)
-        g_free (row_p);
       fclose (infile);
-      return -1;
+      return FALSE;
     }
 
   png_init_io (load_png_ptr, infile);
@@ -142,11 +164,6 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
                   &color_type,
                   &interlace_type,
                   NULL, NULL);
-    width = w;
-    if (ret_width)
-      *ret_width = w;
-    if (ret_height)
-      *ret_height = h;
 
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
       {
@@ -184,7 +201,7 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
           g_warning ("color type mismatch");
           png_destroy_read_struct (&load_png_ptr, &load_info_ptr, NULL);
           fclose (infile);
-          return -1;
+          return FALSE;
       }
 
     if (color_type == PNG_COLOR_TYPE_PALETTE)
@@ -215,43 +232,127 @@ gegl_buffer_import_png (GeglBuffer  *gegl_buffer,
     png_read_update_info (load_png_ptr, load_info_ptr);
   }
 
-  pixels = g_malloc0 (width*bpp);
+  decoder->path             = g_strdup (path);
+  decoder->infile           = infile;
+  decoder->load_png_ptr     = load_png_ptr;
+  decoder->load_info_ptr    = load_info_ptr;
+  decoder->width            = w;
+  decoder->height           = h;
+  decoder->bpp              = bpp;
+  decoder->number_of_passes = number_of_passes;
+  decoder->row              = 0;
+
+  return TRUE;
+}
 
-  {
-    gint           pass;
-    GeglRectangle  rect;
+/* Decodes the rows of result into gegl_buffer. Rows above result that the
+ * decoder has not passed yet are inflated and dropped, the caller reopens
+ * the decoder for regions above its position. Interlaced images can only
+ * be decoded as a whole, and are expected to be requested as such.
+ */
+static gboolean
+png_decoder_read (PngDecoder          *decoder,
+                  GeglBuffer          *gegl_buffer,
+                  const GeglRectangle *result,
+                  gpointer             format)
+{
+  png_structp    load_png_ptr = decoder->load_png_ptr;
+  gint           width        = decoder->width;
+  gint           bpp          = decoder->bpp;
+  gint           first        = decoder->number_of_passes > 1 ? 0 : result->y;
+  gint           last         = decoder->number_of_passes > 1 ?
+                                decoder->height : result->y + result->height;
+  gint           band_height;
+  guchar        *pixels;
+  png_bytep     *row_p;
+  gint           i;
 
-    for (pass=0; pass<number_of_passes; pass++)
-      {
-        for(i=0; i<h; i++)
-          {
-            gegl_rectangle_set (&rect, 0, i, width, 1);
+  /* Rows are decoded a tile row at a time into a staging band, which is
+   * converted and stored with a single gegl_buffer_set.
+   */
+  g_object_get (gegl_buffer, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, MAX (last - first, 1));
 
-            if (pass != 0)
-              gegl_buffer_get (gegl_buffer, 1.0, &rect, format, pixels, GEGL_AUTO_ROWSTRIDE);
+  pixels = g_malloc0 (width * bpp * band_height);
+  row_p  = g_new (png_bytep, band_height);
 
-            png_read_rows (load_png_ptr, &pixels, NULL, 1);
-            gegl_buffer_set (gegl_buffer, &rect, format, pixels,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-      }
-  }
+  for (i = 0; i < band_height; i++)
+    row_p[i] = pixels + i * width * bpp;
 
+  if (setjmp (png_jmpbuf (load_png_ptr)))
+    {
+      png_decoder_close (decoder);
+      g_free (row_p);
+      g_free (pixels);
+      return FALSE;
+    }
 
-  png_read_end (load_png_ptr, NULL);
-  png_destroy_read_struct (&load_png_ptr, &load_info_ptr, NULL);
+  if (decoder->number_of_passes > 1)
+    {
+      gint           pass;
+      GeglRectangle  band;
+
+      /* The later passes fill in a band that was already stored, so it is
+       * fetched back first.
+       */
+      for (pass=0; pass<decoder->number_of_passes; pass++)
+        {
+          for (i = 0; i < decoder->height; i += band_height)
+            {
+              gegl_rectangle_set (&band, 0, i, width,
+                                  MIN (band_height, decoder->height - i));
+
+              if (pass != 0)
+                gegl_buffer_get (gegl_buffer, 1.0, &band, format, pixels,
+                                 GEGL_AUTO_ROWSTRIDE);
+
+              png_read_rows (load_png_ptr, row_p, NULL, band.height);
+              gegl_buffer_set (gegl_buffer, &band, format, pixels,
+                               GEGL_AUTO_ROWSTRIDE);
+            }
+        }
+
+      decoder->row = decoder->height;
+    }
+  else
+    {
+      GeglRectangle  band;
 
-  g_free (pixels);
+      while (decoder->row < first)
+        {
+          png_read_rows (load_png_ptr, row_p, NULL, 1);
+          decoder->row++;
+        }
 
-  if (infile!=stdin)
-    fclose (infile);
+      while (decoder->row < last)
+        {
+          gegl_rectangle_set (&band, 0, decoder->row, width,
+                              MIN (band_height, last - decoder->row));
 
-  return 0;
+          png_read_rows (load_png_ptr, row_p, NULL, band.height);
+          gegl_buffer_set (gegl_buffer, &band, format, pixels,
+                           GEGL_AUTO_ROWSTRIDE);
+
+          decoder->row += band.height;
+        }
+    }
+
+  if (decoder->row >= decoder->height)
+    {
+      png_read_end (load_png_ptr, NULL);
+      png_decoder_close (decoder);
+    }
+
+  g_free (row_p);
+  g_free (pixels);
+
+  return TRUE;
 }
 
 static gint query_png (const gchar *path,
                        gint        *width,
                        gint        *height,
+                       gboolean    *interlaced,
                        gpointer    *format)
 {
   png_uint_32   w;
@@ -299,6 +400,7 @@ static gint query_png (const gchar *path,
   {
     int bit_depth;
     int color_type;
+    int interlace_type;
     gchar format_string[32];
 
     png_get_IHDR (load_png_ptr,
@@ -306,9 +408,12 @@ static gint query_png (const gchar *path,
                   &w, &h,
                   &bit_depth,
                   &color_type,
-                  NULL, NULL, NULL);
+                  &interlace_type,
+                  NULL, NULL);
     *width = w;
     *height = h;
+    if (interlaced)
+      *interlaced = interlace_type == PNG_INTERLACE_ADAM7;
 
     if (png_get_valid (load_png_ptr, load_info_ptr, PNG_INFO_tRNS))
       color_type |= PNG_COLOR_MASK_ALPHA;
@@ -373,8 +478,19 @@ get_bounding_box (GeglOperation *operation)
   gint          width, height;
   gint          status;
   gpointer      format;
+  GeglBuffer   *cached;
 
-  status = query_png (o->path, &width, &height, &format);
+  cached = gegl_image_cache_lookup (o->path, NULL);
+  if (cached)
+    {
+      gegl_operation_set_format (operation, "output",
+                                 gegl_buffer_get_format (cached));
+      result = *gegl_buffer_get_extent (cached);
+      g_object_unref (cached);
+      return result;
+    }
+
+  status = query_png (o->path, &width, &height, NULL, &format);
 
   if (status)
     {
@@ -394,11 +510,21 @@ process (GeglOperation       *operation,
          const GeglRectangle *result)
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
+  PngDecoder *decoder = o->chant_data;
   gint        problem;
   gpointer    format;
   gint        width, height;
+  GeglBuffer *cached;
+
+  cached = gegl_image_cache_lookup (o->path, NULL);
+  if (cached)
+    {
+      gegl_buffer_copy (cached, result, output, result);
+      g_object_unref (cached);
+      return TRUE;
+    }
 
-  problem = query_png (o->path, &width, &height, &format);
+  problem = query_png (o->path, &width, &height, NULL, &format);
   if (problem)
     {
       g_warning ("%s is %s really a PNG file?",
@@ -406,24 +532,81 @@ process (GeglOperation       *operation,
       return FALSE;
     }
 
-  problem = gegl_buffer_import_png (output, o->path, 0, 0,
-                                    &width, &height, format);
+  if (!decoder)
+    {
+      decoder = g_new0 (PngDecoder, 1);
+      o->chant_data = decoder;
+    }
 
-  if (problem)
+  /* rows above the position of the decoder need a new pass over the file */
+  if (decoder->load_png_ptr &&
+      (strcmp (decoder->path, o->path) || decoder->row > result->y))
+    png_decoder_close (decoder);
+
+  if (!decoder->load_png_ptr && !png_decoder_open (decoder, o->path))
     {
       g_warning ("%s failed to open file %s for reading.",
                  G_OBJECT_TYPE_NAME (operation), o->path);
       return FALSE;
     }
 
+  if (!png_decoder_read (decoder, output, result, format))
+    {
+      g_warning ("%s failed to decode file %s.",
+                 G_OBJECT_TYPE_NAME (operation), o->path);
+      return FALSE;
+    }
+
+  if (result->x == 0 && result->y == 0 &&
+      result->width == width && result->height == height)
+    gegl_image_cache_insert (o->path, NULL, output, result);
+
   return  TRUE;
 }
 
+/* Non interlaced files are decoded in full width row ranges. Interlaced
+ * ones, images coming from stdin and images small enough to be kept in
+ * the image cache are decoded as a whole.
+ */
 static GeglRectangle
 get_cached_region (GeglOperation       *operation,
                    const GeglRectangle *roi)
 {
-  return get_bounding_box (operation);
+  GeglChantO   *o = GEGL_CHANT_PROPERTIES (operation);
+  GeglRectangle result = get_bounding_box (operation);
+  gboolean      interlaced;
+  gint          width, height;
+  gpointer      format;
+
+  if (!strcmp (o->path, "-") ||
+      query_png (o->path, &width, &height, &interlaced, &format) ||
+      interlaced ||
+      gegl_image_cache_can_store ((gsize) width * height *
+                                  babl_format_get_bytes_per_pixel (format)))
+    return result;
+
+  result.y      = MAX (roi->y, 0);
+  result.height = MIN (roi->y + roi->height, height) - result.y;
+
+  if (result.height <= 0)
+    result.height = 0;
+
+  return result;
+}
+
+static void
+finalize (GObject *object)
+{
+  GeglChantO *o = GEGL_CHANT_PROPERTIES (object);
+
+  if (o->chant_data)
+    {
+      png_decoder_close (o->chant_data);
+      g_free (o->chant_data);
+      o->chant_data = NULL;
+    }
+
+  G_OBJECT_CLASS (gegl_chant_parent_class)->finalize (object);
 }
 
 static void
@@ -435,6 +618,8 @@ gegl_chant_class_init (GeglChantClass *klass)
   operation_class = GEGL_OPERATION_CLASS (klass);
   source_class    = GEGL_OPERATION_SOURCE_CLASS (klass);
 
+  G_OBJECT_CLASS (klass)->finalize = finalize;
+
   source_class->process = process;
   operation_class->get_bounding_box = get_bounding_box;
   operation_class->get_cached_region = get_cached_region;
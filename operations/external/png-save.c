@@ -36,8 +36,430 @@ gegl_chant_int    (bitdepth, _("Bitdepth"),
 #define GEGL_CHANT_C_FILE       "png-save.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 #include <png.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+
+/* With more than one thread the image data is not handed to libpng but
+ * filtered and deflated here, in the way pigz does it: the rows are split
+ * in bands that are compressed concurrently as independent raw deflate
+ * streams, each primed with the last 32KB of filtered data before it and
+ * ended with a sync flush, so that their concatenation is a single valid
+ * zlib stream. While the bands of one batch are compressed the next batch
+ * is fetched from the buffer.
+ */
+#define PNG_BAND_BYTES  (256 * 1024)
+#define PNG_WINDOW_SIZE 32768
+
+typedef struct
+{
+  guchar  *filtered;
+  guchar  *scratch;
+  guchar  *out;
+  gsize    out_size;
+  gsize    out_len;
+  gsize    in_len;
+  uLong    adler;
+  gboolean failed;
+} PngBand;
+
+typedef struct
+{
+  GeglBuffer *buffer;
+  const Babl *format;
+  gint        src_x;
+  gint        src_y;
+  gint        width;
+  gint        height;
+  gint        bit_depth;
+  gint        level;
+
+  gint        bpp;
+  gint        rowbytes;
+  gint        band_rows;
+  gint        history_rows;
+  gint        n_bands;
+  PngBand    *bands;
+  guchar     *zero_row;
+
+  /* two batches of rows, each preceded by history_rows rows of the batch
+   * before it, the bands of one are compressed while the other is fetched
+   */
+  guchar     *rows[2];
+  gint        cur;
+  gint        batch_y;
+  gint        batch_height;
+  gint        next_y;
+  gint        next_height;
+} PngDeflate;
+
+static guchar *
+png_deflate_batch_row (PngDeflate *d,
+                       gint        batch,
+                       gint        batch_y,
+                       gint        y)
+{
+  return d->rows[batch] + (gsize) (d->history_rows + y - batch_y) * d->rowbytes;
+}
+
+static void
+png_deflate_fetch (PngDeflate *d,
+                   gint        batch,
+                   gint        y,
+                   gint        height)
+{
+  GeglRectangle rect = { d->src_x, d->src_y + y, d->width, height };
+  guchar       *dst  = png_deflate_batch_row (d, batch, y, y);
+
+  gegl_buffer_get (d->buffer, 1.0, &rect, d->format, dst, GEGL_AUTO_ROWSTRIDE);
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+  if (d->bit_depth > 8)
+    {
+      guint16 *p = (guint16 *) dst;
+      gsize    i;
+
+      for (i = 0; i < (gsize) height * d->rowbytes / 2; i++)
+        p[i] = GUINT16_TO_BE (p[i]);
+    }
+#endif
+}
+
+/* picks the filter with the smallest sum of absolute differences, the
+ * heuristic libpng uses, and writes the filter type and filtered row to out
+ */
+static void
+png_filter_row (const guchar *row,
+                const guchar *prior,
+                gint          rowbytes,
+                gint          bpp,
+                guchar       *scratch,
+                guchar       *out)
+{
+  guchar *sub   = scratch;
+  guchar *up    = scratch + rowbytes;
+  guchar *avg   = scratch + rowbytes * 2;
+  guchar *paeth = scratch + rowbytes * 3;
+  guint   sums[5] = { 0, 0, 0, 0, 0 };
+  const guchar *best;
+  gint    type;
+  gint    i;
+
+  for (i = 0; i < rowbytes; i++)
+    {
+      gint a = i >= bpp ? row[i - bpp] : 0;
+      gint b = prior[i];
+      gint c = i >= bpp ? prior[i - bpp] : 0;
+      gint p  = a + b - c;
+      gint pa = ABS (p - a);
+      gint pb = ABS (p - b);
+      gint pc = ABS (p - c);
+      gint predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+
+      sub[i]   = row[i] - a;
+      up[i]    = row[i] - b;
+      avg[i]   = row[i] - ((a + b) >> 1);
+      paeth[i] = row[i] - predictor;
+
+      sums[0] += ABS ((gint8) row[i]);
+      sums[1] += ABS ((gint8) sub[i]);
+      sums[2] += ABS ((gint8) up[i]);
+      sums[3] += ABS ((gint8) avg[i]);
+      sums[4] += ABS ((gint8) paeth[i]);
+    }
+
+  type = 0;
+  for (i = 1; i < 5; i++)
+    if (sums[i] < sums[type])
+      type = i;
+
+  best = type == 0 ? row : scratch + (gsize) (type - 1) * rowbytes;
+
+  out[0] = type;
+  memcpy (out + 1, best, rowbytes);
+}
+
+static void
+png_deflate_band (PngDeflate *d,
+                  gint        index)
+{
+  PngBand  *band   = &d->bands[index];
+  gint      y0     = d->batch_y + index * d->band_rows;
+  gint      n      = MIN (d->band_rows, d->batch_y + d->batch_height - y0);
+  gint      h0     = MAX (0, y0 - (d->history_rows - 1));
+  gsize     stride = d->rowbytes + 1;
+  gsize     dict_len;
+  gsize     dict_start;
+  guchar   *data;
+  gint      flush;
+  gint      ret;
+  gint      y;
+  z_stream  z;
+
+  band->out_len = 0;
+  band->in_len  = 0;
+  band->failed  = FALSE;
+
+  if (n <= 0)
+    return;
+
+  /* the rows in front of the band are filtered again to recreate the
+   * deflate window the previous band ended with
+   */
+  for (y = h0; y < y0 + n; y++)
+    {
+      const guchar *row   = png_deflate_batch_row (d, d->cur, d->batch_y, y);
+      const guchar *prior = y > 0 ? row - d->rowbytes : d->zero_row;
+
+      png_filter_row (row, prior, d->rowbytes, d->bpp, band->scratch,
+                      band->filtered + (gsize) (y - h0) * stride);
+    }
+
+  dict_len   = MIN ((gsize) (y0 - h0) * stride, PNG_WINDOW_SIZE);
+  dict_start = (gsize) (y0 - h0) * stride - dict_len;
+  data       = band->filtered + (gsize) (y0 - h0) * stride;
+
+  band->in_len = (gsize) n * stride;
+  band->adler  = adler32 (adler32 (0L, Z_NULL, 0), data, band->in_len);
+
+  memset (&z, 0, sizeof (z));
+  if (deflateInit2 (&z, d->level, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK)
+    {
+      band->failed = TRUE;
+      return;
+    }
+
+  if (dict_len)
+    deflateSetDictionary (&z, band->filtered + dict_start, dict_len);
+
+  flush = (y0 + n == d->height) ? Z_FINISH : Z_SYNC_FLUSH;
+
+  z.next_in  = data;
+  z.avail_in = band->in_len;
+
+  do
+    {
+      if (band->out_len == band->out_size)
+        {
+          band->out_size = MAX (band->out_size * 2,
+                                deflateBound (&z, band->in_len) + 64);
+          band->out = g_realloc (band->out, band->out_size);
+        }
+
+      z.next_out  = band->out + band->out_len;
+      z.avail_out = band->out_size - band->out_len;
+
+      ret = deflate (&z, flush);
+
+      band->out_len = band->out_size - z.avail_out;
+    }
+  while (ret == Z_OK && z.avail_out == 0);
+
+  if (ret != (flush == Z_FINISH ? Z_STREAM_END : Z_OK))
+    band->failed = TRUE;
+
+  deflateEnd (&z);
+}
+
+static void
+png_deflate_parts (gint     thread,
+                   gint     threads,
+                   gpointer data)
+{
+  PngDeflate *d = data;
+  gint        part;
+
+  /* part 0 runs in the calling thread and fetches the next batch, the
+   * others compress a band of the current one each
+   */
+  for (part = thread; part <= d->n_bands; part += threads)
+    {
+      if (part == 0)
+        {
+          if (d->next_height > 0)
+            {
+              gint next = 1 - d->cur;
+
+              memcpy (d->rows[next],
+                      png_deflate_batch_row (d, d->cur, d->batch_y,
+                                             d->next_y - d->history_rows),
+                      (gsize) d->history_rows * d->rowbytes);
+              png_deflate_fetch (d, next, d->next_y, d->next_height);
+            }
+        }
+      else
+        {
+          png_deflate_band (d, part - 1);
+        }
+    }
+}
+
+static gboolean
+png_write_raw_chunk (FILE         *fp,
+                     const gchar  *name,
+                     const guchar *head,
+                     gsize         head_len,
+                     const guchar *data,
+                     gsize         data_len,
+                     const guchar *tail,
+                     gsize         tail_len)
+{
+  gsize  len = head_len + data_len + tail_len;
+  guchar header[8];
+  guchar footer[4];
+  uLong  crc;
+
+  header[0] = len >> 24;
+  header[1] = len >> 16;
+  header[2] = len >> 8;
+  header[3] = len;
+  memcpy (header + 4, name, 4);
+
+  crc = crc32 (0L, Z_NULL, 0);
+  crc = crc32 (crc, header + 4, 4);
+  if (head_len)
+    crc = crc32 (crc, head, head_len);
+  if (data_len)
+    crc = crc32 (crc, data, data_len);
+  if (tail_len)
+    crc = crc32 (crc, tail, tail_len);
+
+  footer[0] = crc >> 24;
+  footer[1] = crc >> 16;
+  footer[2] = crc >> 8;
+  footer[3] = crc;
+
+  return fwrite (header, 8, 1, fp) == 1 &&
+         (!head_len || fwrite (head, head_len, 1, fp) == 1) &&
+         (!data_len || fwrite (data, data_len, 1, fp) == 1) &&
+         (!tail_len || fwrite (tail, tail_len, 1, fp) == 1) &&
+         fwrite (footer, 4, 1, fp) == 1;
+}
+
+/* writes the IDAT chunks and IEND for the image, following the header
+ * chunks libpng has already written to fp
+ */
+static gboolean
+png_write_image_parallel (FILE       *fp,
+                          GeglBuffer *buffer,
+                          const Babl *format,
+                          gint        src_x,
+                          gint        src_y,
+                          gint        width,
+                          gint        height,
+                          gint        bit_depth,
+                          gint        level,
+                          gint        n_threads)
+{
+  PngDeflate d;
+  guchar     zlib_header[2];
+  gint       flevel;
+  uLong      adler  = adler32 (0L, Z_NULL, 0);
+  gboolean   first  = TRUE;
+  gboolean   result = TRUE;
+  gint       i;
+
+  d.buffer    = buffer;
+  d.format    = format;
+  d.src_x     = src_x;
+  d.src_y     = src_y;
+  d.width     = width;
+  d.height    = height;
+  d.bit_depth = bit_depth;
+  d.level     = level;
+
+  d.bpp          = babl_format_get_bytes_per_pixel (format);
+  d.rowbytes     = width * d.bpp;
+  d.band_rows    = MAX (1, PNG_BAND_BYTES / d.rowbytes);
+  d.history_rows = (PNG_WINDOW_SIZE + d.rowbytes) / (d.rowbytes + 1) + 1;
+  d.n_bands      = MAX (1, n_threads - 1);
+  d.zero_row     = g_malloc0 (d.rowbytes);
+
+  d.bands = g_new0 (PngBand, d.n_bands);
+  for (i = 0; i < d.n_bands; i++)
+    {
+      d.bands[i].filtered = g_malloc ((gsize) (d.history_rows + d.band_rows) *
+                                      (d.rowbytes + 1));
+      d.bands[i].scratch  = g_malloc ((gsize) d.rowbytes * 4);
+    }
+
+  for (i = 0; i < 2; i++)
+    d.rows[i] = g_malloc0 ((gsize) (d.history_rows +
+                                    d.n_bands * d.band_rows) * d.rowbytes);
+
+  /* zlib stream header, a 32KB window and the level hint zlib would use */
+  flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  zlib_header[0] = 0x78;
+  zlib_header[1] = flevel << 6;
+  zlib_header[1] += 31 - (zlib_header[0] * 256 + zlib_header[1]) % 31;
+
+  d.cur          = 0;
+  d.batch_y      = 0;
+  d.batch_height = MIN (height, d.n_bands * d.band_rows);
+  png_deflate_fetch (&d, d.cur, d.batch_y, d.batch_height);
+
+  while (d.batch_height > 0 && result)
+    {
+      d.next_y      = d.batch_y + d.batch_height;
+      d.next_height = MIN (height - d.next_y, d.n_bands * d.band_rows);
+
+      gegl_parallel_distribute (d.n_bands + 1, png_deflate_parts, &d);
+
+      for (i = 0; i < d.n_bands && result; i++)
+        {
+          PngBand *band = &d.bands[i];
+          guchar   trailer[4];
+          gboolean last;
+
+          if (band->failed)
+            {
+              result = FALSE;
+              break;
+            }
+          if (band->in_len == 0)
+            continue;
+
+          adler = adler32_combine (adler, band->adler, band->in_len);
+          last  = d.batch_y + (i + 1) * d.band_rows >= height;
+
+          trailer[0] = adler >> 24;
+          trailer[1] = adler >> 16;
+          trailer[2] = adler >> 8;
+          trailer[3] = adler;
+
+          result = png_write_raw_chunk (fp, "IDAT",
+                                        zlib_header, first ? 2 : 0,
+                                        band->out, band->out_len,
+                                        trailer, last ? 4 : 0);
+          first = FALSE;
+        }
+
+      d.cur          = 1 - d.cur;
+      d.batch_y      = d.next_y;
+      d.batch_height = d.next_height;
+    }
+
+  if (result)
+    result = png_write_raw_chunk (fp, "IEND", NULL, 0, NULL, 0, NULL, 0);
+
+  for (i = 0; i < d.n_bands; i++)
+    {
+      g_free (d.bands[i].filtered);
+      g_free (d.bands[i].scratch);
+      g_free (d.bands[i].out);
+    }
+  g_free (d.bands);
+  g_free (d.rows[0]);
+  g_free (d.rows[1]);
+  g_free (d.zero_row);
+
+  return result;
+}
+#endif
 
 /* this call is available when the png-save plug-in is loaded,
  * it might have to be dlsymed to be used?
@@ -166,12 +588,32 @@ gegl_buffer_export_png (GeglBuffer  *gegl_buffer,
 
   png_write_info (png, info);
 
+  format = babl_format (format_string);
+
+#ifdef HAVE_ZLIB_H
+  if (gegl_parallel_get_n_threads () > 1)
+    {
+      gboolean written;
+
+      written = png_write_image_parallel (fp, gegl_buffer, format,
+                                          src_x, src_y, width, height,
+                                          bit_depth, compression,
+                                          gegl_parallel_get_n_threads ());
+
+      png_destroy_write_struct (&png, &info);
+
+      if (stdout != fp)
+        fclose (fp);
+
+      return written ? 0 : -1;
+    }
+#endif
+
 #if BYTE_ORDER == LITTLE_ENDIAN
   if (bit_depth > 8)
     png_set_swap (png);
 #endif
 
-  format = babl_format (format_string);
   pixels = g_malloc0 (width * babl_format_get_bytes_per_pixel (format));
 
   for (i=0; i< height; i++)
@@ -34,6 +34,7 @@ gegl_chant_file_path (path, _("File"), "", _("Path of file to load."))
 #define ASCII_P                 80
 
 #include "gegl-chant.h"
+#include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -84,7 +85,7 @@ ppm_load_read_header(FILE       *fp,
     /* Get Width and Height */
     img->width  = strtol (header,&ptr,0);
     img->height = atoi (ptr);
-    img->numsamples = img->width * img->height * CHANNEL_COUNT;
+    img->numsamples = (gsize) img->width * img->height * CHANNEL_COUNT;
 
     retval = fgets (header,MAX_CHARS_IN_ROW,fp);
     maxval = strtol (header,&ptr,0);
@@ -112,23 +113,26 @@ ppm_load_read_header(FILE       *fp,
     return TRUE;
 }
 
-static void
-ppm_load_read_image(FILE       *fp,
-                    pnm_struct *img)
+/* Reads the next n_rows full rows of the raster into img->data. */
+static gboolean
+ppm_load_read_rows (FILE       *fp,
+                    pnm_struct *img,
+                    gint        n_rows)
 {
-    guint   i;
-    gint    retval;
+    gsize numsamples = (gsize) n_rows * img->width * CHANNEL_COUNT;
+    gsize i;
 
     if (img->type == PIXMAP_RAW)
       {
-        retval = fread (img->data, img->bpc, img->numsamples, fp);
+        if (fread (img->data, img->bpc, numsamples, fp) != numsamples)
+          return FALSE;
 
         /* Fix endianness if necessary */
         if (img->bpc > 1)
           {
             gushort *ptr = (gushort *) img->data;
 
-            for (i=0; i < img->numsamples; i++)
+            for (i=0; i < numsamples; i++)
               {
                 *ptr = GUINT16_FROM_BE (*ptr);
                 ptr++;
@@ -143,10 +147,11 @@ ppm_load_read_image(FILE       *fp,
           {
             guchar *ptr = img->data;
 
-            for (i = 0; i < img->numsamples; i++)
+            for (i = 0; i < numsamples; i++)
               {
                 guint sample;
-                retval = fscanf (fp, " %u", &sample);
+                if (fscanf (fp, " %u", &sample) != 1)
+                  return FALSE;
                 *ptr++ = sample;
               }
           }
@@ -154,10 +159,11 @@ ppm_load_read_image(FILE       *fp,
           {
             gushort *ptr = (gushort *) img->data;
 
-            for (i = 0; i < img->numsamples; i++)
+            for (i = 0; i < numsamples; i++)
               {
                 guint sample;
-                retval = fscanf (fp, " %u", &sample);
+                if (fscanf (fp, " %u", &sample) != 1)
+                  return FALSE;
                 *ptr++ = sample;
               }
           }
@@ -166,6 +172,45 @@ ppm_load_read_image(FILE       *fp,
             g_warning ("%s: Programmer stupidity error", G_STRLOC);
           }
       }
+
+    return TRUE;
+}
+
+/* Parses the whole raster from the current position of fp, a band of rows
+ * at a time, for plain pixmaps and standard input.
+ */
+static gboolean
+ppm_load_read_image (FILE       *fp,
+                     pnm_struct *img,
+                     GeglBuffer *output,
+                     const Babl *format)
+{
+  GeglRectangle band = { 0, 0, img->width, 0 };
+  gint          band_height;
+  gboolean      ret = TRUE;
+
+  g_object_get (output, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, MAX (img->height, 1));
+
+  img->data = g_malloc ((gsize) img->width * CHANNEL_COUNT * img->bpc *
+                        band_height);
+
+  for (band.y = 0; band.y < img->height; band.y += band_height)
+    {
+      band.height = MIN (band_height, img->height - band.y);
+
+      if (!ppm_load_read_rows (fp, img, band.height))
+        {
+          g_warning ("%s: unexpected end of file", G_STRLOC);
+          ret = FALSE;
+          break;
+        }
+
+      gegl_buffer_set (output, &band, format, img->data, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (img->data);
+  return ret;
 }
 
 static GeglRectangle
@@ -210,6 +255,131 @@ get_bounding_box (GeglOperation *operation)
   return result;
 }
 
+/* Reads the pixels of rect straight from the raster of a binary pixmap,
+ * which starts at offset in fp, a band of rows at a time.
+ */
+static gboolean
+ppm_load_read_region (FILE                *fp,
+                      pnm_struct          *img,
+                      off_t                offset,
+                      GeglBuffer          *output,
+                      const GeglRectangle *rect,
+                      const Babl          *format)
+{
+  gsize         row_size = rect->width * CHANNEL_COUNT * img->bpc;
+  gint          band_height;
+  GeglRectangle band;
+  gint          y;
+
+  g_object_get (output, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, MAX (rect->height, 1));
+
+  img->data = g_malloc (row_size * band_height);
+
+  band = *rect;
+  for (band.y = rect->y; band.y < rect->y + rect->height; band.y += band_height)
+    {
+      band.height = MIN (band_height, rect->y + rect->height - band.y);
+
+      for (y = 0; y < band.height; y++)
+        {
+          guchar *row = img->data + y * row_size;
+
+          if (fseeko (fp, offset + ((off_t) (band.y + y) * img->width + rect->x) *
+                                   CHANNEL_COUNT * img->bpc, SEEK_SET) ||
+              fread (row, 1, row_size, fp) != row_size)
+            {
+              g_warning ("%s: unexpected end of file", G_STRLOC);
+              g_free (img->data);
+              return FALSE;
+            }
+        }
+
+      /* Fix endianness if necessary */
+      if (img->bpc > 1)
+        {
+          gushort *ptr = (gushort *) img->data;
+          gsize    i;
+
+          for (i = 0; i < band.height * row_size / 2; i++)
+            {
+              *ptr = GUINT16_FROM_BE (*ptr);
+              ptr++;
+            }
+        }
+
+      gegl_buffer_set (output, &band, format, img->data, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (img->data);
+  return TRUE;
+}
+
+/* Hands rect to the buffer straight from the mapped file. 8 bit samples
+ * are copied from the mapping into the tiles, 16 bit ones go through a
+ * band of rows to be swapped to host order.
+ */
+static gboolean
+ppm_load_map_region (GMappedFile         *map,
+                     pnm_struct          *img,
+                     gsize                offset,
+                     GeglBuffer          *output,
+                     const GeglRectangle *rect,
+                     const Babl          *format)
+{
+  const guchar *raster   = (const guchar *) g_mapped_file_get_contents (map) + offset;
+  gsize         stride   = (gsize) img->width * CHANNEL_COUNT * img->bpc;
+  gsize         row_size = rect->width * CHANNEL_COUNT * img->bpc;
+  gint          band_height;
+  GeglRectangle band;
+  gint          y;
+
+  if (g_mapped_file_get_length (map) < offset ||
+      g_mapped_file_get_length (map) - offset < stride * img->height)
+    {
+      g_warning ("%s: unexpected end of file", G_STRLOC);
+      return FALSE;
+    }
+
+  raster += rect->y * stride + rect->x * CHANNEL_COUNT * img->bpc;
+
+  if (img->bpc == 1)
+    {
+      gegl_buffer_set (output, rect, format, (gpointer) raster, stride);
+      return TRUE;
+    }
+
+  g_object_get (output, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, MAX (rect->height, 1));
+
+  img->data = g_malloc (row_size * band_height);
+
+  band = *rect;
+  for (band.y = rect->y; band.y < rect->y + rect->height; band.y += band_height)
+    {
+      band.height = MIN (band_height, rect->y + rect->height - band.y);
+
+      for (y = 0; y < band.height; y++)
+        {
+          /* the header makes the offset of the mapped data arbitrary, so
+           * the samples are assembled from bytes rather than read as
+           * possibly unaligned gushorts
+           */
+          const guchar *src = raster + (band.y - rect->y + y) * stride;
+          gushort      *dst = (gushort *) (img->data + y * row_size);
+          gsize         i;
+
+          for (i = 0; i < row_size / 2; i++)
+            dst[i] = (src[2 * i] << 8) | src[2 * i + 1];
+        }
+
+      gegl_buffer_set (output, &band, format, img->data, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (img->data);
+  return TRUE;
+}
+
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *output,
@@ -218,7 +388,7 @@ process (GeglOperation       *operation,
   GeglChantO   *o = GEGL_CHANT_PROPERTIES (operation);
   FILE         *fp;
   pnm_struct    img;
-  GeglRectangle rect = {0,0,0,0};
+  const Babl   *format;
   gboolean      ret = FALSE;
 
   fp = (!strcmp (o->path, "-") ? stdin : fopen (o->path,"rb"));
@@ -229,49 +399,29 @@ process (GeglOperation       *operation,
   if (!ppm_load_read_header (fp, &img))
     goto out;
 
-  rect.height = img.height;
-  rect.width = img.width;
-
-  /* Allocating Array Size */
-  img.data = (guchar*) g_malloc (img.numsamples * img.bpc);
-
-  switch (img.bpc)
-    {
-    case 1:
-      gegl_buffer_get (output, 1.0, &rect, babl_format ("R'G'B' u8"), img.data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    case 2:
-      gegl_buffer_get (output, 1.0, &rect, babl_format ("R'G'B' u16"), img.data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    default:
-      g_warning ("%s: Programmer stupidity error", G_STRLOC);
-    }
-
-  ppm_load_read_image (fp, &img);
+  format = babl_format (img.bpc == 1 ? "R'G'B' u8" : "R'G'B' u16");
 
-  switch (img.bpc)
+  /* binary pixmaps in files are read for the requested region only,
+   * through a mapping of the file where possible
+   */
+  if (img.type == PIXMAP_RAW && fp != stdin)
     {
-    case 1:
-      gegl_buffer_set (output, &rect, babl_format ("R'G'B' u8"), img.data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    case 2:
-      gegl_buffer_set (output, &rect, babl_format ("R'G'B' u16"), img.data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    default:
-      g_warning ("%s: Programmer stupidity error", G_STRLOC);
+      GMappedFile *map    = g_mapped_file_new (o->path, FALSE, NULL);
+      off_t        offset = ftello (fp);
+
+      if (map)
+        {
+          ret = ppm_load_map_region (map, &img, offset, output, result, format);
+          g_mapped_file_unref (map);
+        }
+      else
+        {
+          ret = ppm_load_read_region (fp, &img, offset, output, result, format);
+        }
+      goto out;
     }
 
-  g_free (img.data);
-
-  ret = TRUE;
+  ret = ppm_load_read_image (fp, &img, output, format);
 
  out:
   if (stdin != fp)
@@ -280,11 +430,27 @@ process (GeglOperation       *operation,
   return ret;
 }
 
+/* Binary pixmaps in files can be read in any region, everything else is
+ * parsed as a whole.
+ */
 static GeglRectangle
 get_cached_region (GeglOperation       *operation,
                    const GeglRectangle *roi)
 {
-  return get_bounding_box (operation);
+  GeglChantO   *o = GEGL_CHANT_PROPERTIES (operation);
+  GeglRectangle result = get_bounding_box (operation);
+  pnm_struct    img;
+  FILE         *fp;
+
+  if (!strcmp (o->path, "-") || !(fp = fopen (o->path, "rb")))
+    return result;
+
+  if (ppm_load_read_header (fp, &img) && img.type == PIXMAP_RAW)
+    gegl_rectangle_intersect (&result, &result, roi);
+
+  fclose (fp);
+
+  return result;
 }
 
 static void
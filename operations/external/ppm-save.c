@@ -45,20 +45,28 @@ typedef enum {
 } map_type;
 
 static void
-ppm_save_write(FILE    *fp,
-               gint     width,
-               gint     height,
-               gsize    numsamples,
-               gsize    bpc,
-               guchar  *data,
-               map_type type)
+ppm_save_write_header (FILE    *fp,
+                       gint     width,
+                       gint     height,
+                       gsize    bpc,
+                       map_type type)
 {
-  guint i;
-  gint retval;
-
-  /* Write the header */
   fprintf (fp, "P%c\n%d %d\n", type, width, height );
   fprintf (fp, "%d\n", (bpc == sizeof (guchar)) ? 255 : 65535);
+}
+
+/* Writes a band of numsamples samples, made of whole rows, after the
+ * header and the bands before it.
+ */
+static gboolean
+ppm_save_write_rows (FILE    *fp,
+                     gint     width,
+                     gsize    numsamples,
+                     gsize    bpc,
+                     guchar  *data,
+                     map_type type)
+{
+  gsize i;
 
   /* Raw images writes the data in binary form */
   if (type == PIXMAP_RAW)
@@ -75,7 +83,7 @@ ppm_save_write(FILE    *fp,
             }
         }
 
-      retval = fwrite (data, bpc, numsamples, fp);
+      return fwrite (data, bpc, numsamples, fp) == numsamples;
     }
   else
     {
@@ -107,6 +115,8 @@ ppm_save_write(FILE    *fp,
         {
           g_warning ("%s: Programmer stupidity error", G_STRLOC);
         }
+
+      return !ferror (fp);
     }
 }
 
@@ -117,12 +127,14 @@ process (GeglOperation       *operation,
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
 
-  FILE     *fp;
-  guchar   *data;
-  map_type  type;
-  gsize     bpc;
-  gsize     numsamples;
-  gboolean  ret = FALSE;
+  FILE          *fp;
+  guchar        *data;
+  map_type       type;
+  gsize          bpc;
+  const Babl    *format;
+  GeglRectangle  band;
+  gint           band_height;
+  gboolean       ret = FALSE;
 
   fp = (!strcmp (o->path, "-") ? stdout : fopen(o->path, "wb") );
 
@@ -137,32 +149,36 @@ process (GeglOperation       *operation,
 
   type = (o->rawformat ? PIXMAP_RAW : PIXMAP_ASCII);
   bpc = (o->bitdepth == 8) ? (sizeof (guchar)) : (sizeof (gushort));
-  numsamples = rect->width * rect->height * CHANNEL_COUNT;
+  format = babl_format (bpc == 1 ? "R'G'B' u8" : "R'G'B' u16");
+
+  ppm_save_write_header (fp, rect->width, rect->height, bpc, type);
 
-  data = g_malloc (numsamples * bpc);
+  /* the image is fetched and written a band of rows at a time */
+  g_object_get (input, "tile-height", &band_height, NULL);
+  band_height = CLAMP (band_height, 1, MAX (rect->height, 1));
 
-  switch (bpc)
+  data = g_malloc ((gsize) rect->width * CHANNEL_COUNT * bpc * band_height);
+
+  ret = TRUE;
+
+  band = *rect;
+  for (band.y = rect->y; band.y < rect->y + rect->height && ret;
+       band.y += band_height)
     {
-    case 1:
-      gegl_buffer_get (input, 1.0, rect, babl_format ("R'G'B' u8"), data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    case 2:
-      gegl_buffer_get (input, 1.0, rect, babl_format ("R'G'B' u16"), data,
-                       GEGL_AUTO_ROWSTRIDE);
-      break;
-
-    default:
-      g_warning ("%s: Programmer stupidity error", G_STRLOC);
+      band.height = MIN (band_height, rect->y + rect->height - band.y);
+
+      gegl_buffer_get (input, 1.0, &band, format, data, GEGL_AUTO_ROWSTRIDE);
+
+      ret = ppm_save_write_rows (fp, rect->width,
+                                 (gsize) band.width * band.height * CHANNEL_COUNT,
+                                 bpc, data, type);
     }
 
-  ppm_save_write (fp, rect->width, rect->height, numsamples, bpc, data, type);
+  if (!ret)
+    g_warning ("%s: failed to write %s", G_STRLOC, o->path);
 
   g_free (data);
 
-  ret = TRUE;
-
  out:
   if (fp != stdout)
     fclose( fp );
@@ -31,8 +31,6 @@ gegl_chant_double (percentile, _("Percentile"), 0.0, 100.0, 50,
 
 #else
 
-#define MAX_SAMPLES 20000 /* adapted to max level of radius */
-
 #define GEGL_CHANT_TYPE_AREA_FILTER
 #define GEGL_CHANT_C_FILE       "box-percentile.c"
 
@@ -40,10 +38,14 @@ gegl_chant_double (percentile, _("Percentile"), 0.0, 100.0, 50,
 #include <stdio.h>
 #include <math.h>
 
-static void median (GeglBuffer *src,
-                    GeglBuffer *dst,
-                    gint        radius,
-                    gdouble     rank);
+#include "percentile-histogram.h"
+
+static void median (GeglBuffer          *src,
+                    GeglBuffer          *dst,
+                    const GeglRectangle *dst_rect,
+                    const GeglRectangle *valid,
+                    gint                 radius,
+                    gdouble              rank);
 
 
 static void prepare (GeglOperation *operation)
@@ -73,7 +75,9 @@ process (GeglOperation       *operation,
     {
       temp_in = gegl_buffer_create_sub_buffer (input, &compute);
 
-      median (temp_in, output, o->radius, o->percentile / 100.0);
+      median (temp_in, output, result,
+              gegl_operation_source_get_bounding_box (operation, "input"),
+              o->radius, o->percentile / 100.0);
       g_object_unref (temp_in);
     }
 
@@ -81,129 +85,50 @@ process (GeglOperation       *operation,
 }
 
 
-typedef struct
-{
-  int       head;
-  int       next[MAX_SAMPLES];
-  float     luma[MAX_SAMPLES];
-  float    *pixel[MAX_SAMPLES];
-  int       items;
-} RankList;
-
-static void
-list_clear (RankList * p)
-{
-  p->items = 0;
-  p->next[0] = -1;
-}
-
-static inline void
-list_add (RankList *p,
-          gfloat    lumniosity,
-          gfloat   *pixel)
-{
-  gint location;
-
-  location = p->items;
-
-  p->items++;
-  p->luma[location] = lumniosity;
-  p->pixel[location] = pixel;
-  p->next[location] = -1;
-
-  if (p->items == 1)
-    {
-      p->head = location;
-      return;
-    }
-  if (lumniosity <= p->luma[p->head])
-    {
-      p->next[location] = p->head;
-      p->head = location;
-    }
-  else
-    {
-      gint   prev, i;
-      prev = p->head;
-      i = prev;
-      while (i >= 0 && p->luma[i] < lumniosity)
-        {
-          prev = i;
-          i = p->next[i];
-        }
-      p->next[location] = p->next[prev];
-      p->next[prev] = location;
-    }
-}
-
-static inline gfloat *
-list_percentile (RankList *p,
-                 gdouble   percentile)
-{
-  gint       i = p->head;
-  gint       pos = 0;
-  if (!p->items)
-    return NULL;
-  if (percentile >= 1.0)
-    percentile = 1.0;
-  while (pos < p->items * percentile &&
-         p->pixel[p->next[i]])
-    {
-      i = p->next[i];
-      pos++;
-    }
-  return p->pixel[i];
-}
-
 static void
-median (GeglBuffer *src,
-        GeglBuffer *dst,
-        gint        radius,
-        gdouble     rank)
+median (GeglBuffer          *src,
+        GeglBuffer          *dst,
+        const GeglRectangle *dst_rect,
+        const GeglRectangle *valid,
+        gint                 radius,
+        gdouble              rank)
 {
-  RankList list={0};
-
-  gint x,y;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-
-
-  src_buf = g_malloc0 (gegl_buffer_get_pixel_count (src) * 4 * 4);
-  dst_buf = g_malloc0 (gegl_buffer_get_pixel_count (dst) * 4 * 4);
-
-  gegl_buffer_get (src, 1.0, NULL, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
-
-  offset = 0;
-  for (y=0; y<gegl_buffer_get_height (dst); y++)
-    for (x=0; x<gegl_buffer_get_width (dst); x++)
-      {
-        gint u,v;
-        gfloat *median_pix;
-
-        list_clear (&list);
-
-        for (v=y-radius;v<=y+radius;v++)
-          for (u=x-radius;u<=x+radius;u++)
-            {
-              if (u >= 0 && u < gegl_buffer_get_width (dst) &&
-                  v >= 0 && v < gegl_buffer_get_height (dst))
-                {
-                  gfloat *src_pix = src_buf + (u+(v * gegl_buffer_get_width (src))) * 4;
-                  gfloat luma = (src_pix[0] * 0.212671 +
-                                 src_pix[1] * 0.715160 +
-                                 src_pix[2] * 0.072169);
-                  list_add (&list, luma, src_pix);
-                }
-            }
-
-        median_pix = list_percentile (&list, rank);
-        for (u=0; u<4;u++)
-          dst_buf[offset*4+u] = median_pix[u];
-        offset++;
-      }
-  gegl_buffer_set (dst, NULL, babl_format ("RGBA float"), dst_buf,
+  GeglRectangle  src_rect = *dst_rect;
+  GeglRectangle  src_valid;
+  gint          *half_widths;
+  gint           v;
+  gfloat        *src_buf;
+  gfloat        *dst_buf;
+
+  src_rect.x      -= radius;
+  src_rect.y      -= radius;
+  src_rect.width  += radius * 2;
+  src_rect.height += radius * 2;
+
+  src_buf = g_new0 (gfloat, src_rect.width * src_rect.height * 4);
+  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
+
+  gegl_buffer_get (src, 1.0, &src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
+
+  half_widths = g_new (gint, radius * 2 + 1);
+  for (v = -radius; v <= radius; v++)
+    half_widths[v + radius] = radius;
+
+  /* only pixels within the input count towards the percentile */
+  src_valid = src_rect;
+  if (valid)
+    gegl_rectangle_intersect (&src_valid, &src_rect, valid);
+  src_valid.x -= src_rect.x;
+  src_valid.y -= src_rect.y;
+
+  percentile_histogram_filter (src_buf, src_rect.width, src_rect.height,
+                               &src_valid,
+                               dst_buf, dst_rect->width, dst_rect->height,
+                               radius, half_widths, rank);
+
+  gegl_buffer_set (dst, dst_rect, babl_format ("RGBA float"), dst_buf,
                    GEGL_AUTO_ROWSTRIDE);
+  g_free (half_widths);
   g_free (src_buf);
   g_free (dst_buf);
 }
@@ -27,7 +27,7 @@ gegl_chant_int (green_bits, _("Green bits"), 1, 16, 16, _("Number of bits for gr
 gegl_chant_int (blue_bits,  _("Blue bits"),  1, 16, 16, _("Number of bits for blue channel"))
 gegl_chant_int (alpha_bits, _("Alpha bits"), 1, 16, 16, _("Number of bits for alpha channel"))
 gegl_chant_string (dither_type, _("Dither"), "none",
-              _("Dithering strategy (none, random, random-covariant, bayer, floyd-steinberg)"))
+              _("Dithering strategy (none, random, random-covariant, bayer, blue-noise, floyd-steinberg)"))
 
 #else
 
@@ -35,6 +35,7 @@ gegl_chant_string (dither_type, _("Dither"), "none",
 #define GEGL_CHANT_C_FILE       "color-reduction.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
 static void
 prepare (GeglOperation *operation)
@@ -65,113 +66,407 @@ quantize_value (guint value, guint n_bits, guint mask)
   return value;
 }
 
+/* Floyd-Steinberg scans serpentine, so every row depends on the last pixel
+ * of the row above and rows cannot be processed as a wavefront without
+ * changing the result. The error of a channel never spills into another
+ * channel though, so the channels are diffused in parallel, each thread
+ * keeping its own error rows. The input is streamed in bands of rows.
+ */
+
+#define DITHER_BAND_HEIGHT 64
+
+typedef struct
+{
+  const guint16 *band_buf;
+  guint16       *planes [4];
+  gdouble       *error_buf [4][2];
+  guint         *channel_bits;
+  guint          channel_mask [4];
+  gint           width;
+  gint           first_row;
+  gint           rows;
+} FloydSteinbergBand;
+
+static void
+floyd_steinberg_channels (gint     thread,
+                          gint     threads,
+                          gpointer data)
+{
+  FloydSteinbergBand *band  = data;
+  gint                width = band->width;
+  guint               ch;
+
+  for (ch = 4 * thread / threads; ch < 4 * (thread + 1) / threads; ch++)
+  {
+    gdouble **error_buf = band->error_buf [ch];
+    gint      row;
+
+    for (row = 0; row < band->rows; row++)
+    {
+      const guint16 *line  = band->band_buf + row * width * 4;
+      guint16       *plane = band->planes [ch] + row * width;
+      gdouble       *error_buf_swap;
+      gint           step;
+      gint           start_x;
+      gint           end_x;
+      gint           x;
+
+      /* Serpentine scanning; reverse direction every row */
+
+      if ((band->first_row + row) & 1)
+      {
+        start_x = width - 1;
+        end_x   = -1;
+        step    = -1;
+      }
+      else
+      {
+        start_x = 0;
+        end_x   = width;
+        step    = 1;
+      }
+
+      for (x = start_x; x != end_x; x += step)
+      {
+        gdouble value;
+        gdouble value_clamped;
+        gdouble quantized;
+        gdouble qerror;
+
+        value         = line [x * 4 + ch] + error_buf [0] [x];
+        value_clamped = CLAMP (value, 0.0, 65535.0);
+        quantized     = quantize_value ((guint) (value_clamped + 0.5), band->channel_bits [ch], band->channel_mask [ch]);
+        qerror        = value - quantized;
+
+        plane [x] = (guint16) quantized;
+
+        /* Distribute the error */
+
+        error_buf [1] [x] += qerror * 5.0 / 16.0;  /* Down */
+
+        if (x + step >= 0 && x + step < width)
+        {
+          error_buf [0] [x + step] += qerror * 6.0 / 16.0;  /* Ahead */
+          error_buf [1] [x + step] += qerror * 1.0 / 16.0;  /* Down, ahead */
+        }
+
+        if (x - step >= 0 && x - step < width)
+        {
+          error_buf [1] [x - step] += qerror * 3.0 / 16.0;  /* Down, behind */
+        }
+      }
+
+      /* Swap error accumulation rows */
+
+      error_buf_swap = error_buf [0];
+      error_buf [0]  = error_buf [1];
+      error_buf [1]  = error_buf_swap;
+
+      /* Clear error buffer for next-plus-one line */
+
+      memset (error_buf [1], 0, width * sizeof (gdouble));
+    }
+  }
+}
+
 static void
 process_floyd_steinberg (GeglBuffer *input,
                          GeglBuffer *output,
                          const GeglRectangle *result,
                          guint *channel_bits)
 {
-  GeglRectangle        line_rect;
-  guint16             *line_buf;
-  gdouble             *error_buf [2];
-  guint                channel_mask [4];
-  gint                 y;
+  FloydSteinbergBand   band;
+  GeglRectangle        band_rect;
+  guint16             *band_buf;
+  guint                ch;
+  gint                 i;
 
-  line_rect.x      = result->x;
-  line_rect.y      = result->y;
-  line_rect.width  = result->width;
-  line_rect.height = 1;
+  band_rect.x     = result->x;
+  band_rect.width = result->width;
 
-  line_buf      = g_new  (guint16, line_rect.width * 4);
-  error_buf [0] = g_new0 (gdouble, line_rect.width * 4);
-  error_buf [1] = g_new0 (gdouble, line_rect.width * 4);
+  band_buf = g_new (guint16, result->width * DITHER_BAND_HEIGHT * 4);
 
-  generate_channel_masks (channel_bits, channel_mask);
+  band.band_buf     = band_buf;
+  band.channel_bits = channel_bits;
+  band.width        = result->width;
 
-  for (y = 0; y < result->height; y++)
+  generate_channel_masks (channel_bits, band.channel_mask);
+
+  for (ch = 0; ch < 4; ch++)
   {
-    gdouble  *error_buf_swap;
-    gint      step;
-    gint      start_x;
-    gint      end_x;
-    gint      x;
+    band.planes [ch]        = g_new  (guint16, result->width * DITHER_BAND_HEIGHT);
+    band.error_buf [ch] [0] = g_new0 (gdouble, result->width);
+    band.error_buf [ch] [1] = g_new0 (gdouble, result->width);
+  }
+
+  for (band.first_row = 0; band.first_row < result->height; band.first_row += DITHER_BAND_HEIGHT)
+  {
+    band.rows = MIN (DITHER_BAND_HEIGHT, result->height - band.first_row);
+
+    band_rect.y      = result->y + band.first_row;
+    band_rect.height = band.rows;
+
+    gegl_buffer_get (input, 1.0, &band_rect, babl_format ("RGBA u16"), band_buf, GEGL_AUTO_ROWSTRIDE);
+
+    gegl_parallel_distribute (4, floyd_steinberg_channels, &band);
+
+    for (i = 0; i < band.rows * band.width; i++)
+      for (ch = 0; ch < 4; ch++)
+        band_buf [i * 4 + ch] = band.planes [ch] [i];
+
+    gegl_buffer_set (output, &band_rect, babl_format ("RGBA u16"), band_buf, GEGL_AUTO_ROWSTRIDE);
+  }
+
+  for (ch = 0; ch < 4; ch++)
+  {
+    g_free (band.planes [ch]);
+    g_free (band.error_buf [ch] [0]);
+    g_free (band.error_buf [ch] [1]);
+  }
+
+  g_free (band_buf);
+}
+
+/* Blue noise threshold matrix, built with Ulichney's void-and-cluster
+ * method: a sparse random pattern is relaxed until evenly spread, then
+ * ranks are handed out by removing its tightest clusters and filling the
+ * largest voids, measured with a Gaussian energy that wraps around the
+ * matrix edges. Unlike error diffusion every pixel is independent.
+ */
+
+#define BLUE_NOISE_SIZE  64
+#define BLUE_NOISE_SIGMA 1.5
+#define BLUE_NOISE_SEED  1
+
+typedef struct
+{
+  gboolean *pattern;
+  gdouble  *energy;
+  gdouble  *kernel;
+} VoidAndCluster;
+
+static void
+void_and_cluster_toggle (VoidAndCluster *vc,
+                         gint            p)
+{
+  gint    px   = p % BLUE_NOISE_SIZE;
+  gint    py   = p / BLUE_NOISE_SIZE;
+  gdouble sign = vc->pattern [p] ? -1.0 : 1.0;
+  gint    x, y;
+
+  vc->pattern [p] = !vc->pattern [p];
+
+  for (y = 0; y < BLUE_NOISE_SIZE; y++)
+    for (x = 0; x < BLUE_NOISE_SIZE; x++)
+      vc->energy [y * BLUE_NOISE_SIZE + x] +=
+        sign * vc->kernel [((y - py) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE +
+                           ((x - px) & (BLUE_NOISE_SIZE - 1))];
+}
+
+/* the set pixel with the highest energy, or the unset one with the lowest */
+static gint
+void_and_cluster_find (VoidAndCluster *vc,
+                       gboolean        cluster)
+{
+  gint best = -1;
+  gint i;
 
-    /* Serpentine scanning; reverse direction every row */
+  for (i = 0; i < BLUE_NOISE_SIZE * BLUE_NOISE_SIZE; i++)
+    if (vc->pattern [i] == cluster &&
+        (best < 0 ||
+         (cluster ? vc->energy [i] > vc->energy [best]
+                  : vc->energy [i] < vc->energy [best])))
+      best = i;
 
-    if (y & 1)
+  return best;
+}
+
+static gpointer
+blue_noise_matrix_new (gpointer data)
+{
+  const gint      size             = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+  gfloat         *matrix           = g_new (gfloat, size);
+  gboolean       *prototype        = g_new (gboolean, size);
+  gdouble        *prototype_energy = g_new (gdouble, size);
+  VoidAndCluster  vc;
+  GRand          *rand;
+  gint            ones = 0;
+  gint            rank;
+  gint            i, x, y;
+
+  vc.pattern = g_new0 (gboolean, size);
+  vc.energy  = g_new0 (gdouble, size);
+  vc.kernel  = g_new (gdouble, size);
+
+  for (y = 0; y < BLUE_NOISE_SIZE; y++)
+    for (x = 0; x < BLUE_NOISE_SIZE; x++)
     {
-      start_x = result->width - 1;
-      end_x   = -1;
-      step    = -1;
+      gint dx = MIN (x, BLUE_NOISE_SIZE - x);
+      gint dy = MIN (y, BLUE_NOISE_SIZE - y);
+
+      vc.kernel [y * BLUE_NOISE_SIZE + x] =
+        exp (-(dx * dx + dy * dy) / (2.0 * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
     }
-    else
+
+  /* initial pattern, a tenth of the pixels set at random */
+
+  rand = g_rand_new_with_seed (BLUE_NOISE_SEED);
+  while (ones < size / 10)
+  {
+    i = g_rand_int_range (rand, 0, size);
+    if (!vc.pattern [i])
     {
-      start_x = 0;
-      end_x   = result->width;
-      step    = 1;
+      void_and_cluster_toggle (&vc, i);
+      ones++;
     }
+  }
+  g_rand_free (rand);
 
-    /* Pull input row */
+  /* move the tightest cluster into the largest void until it stays put */
 
-    gegl_buffer_get (input, 1.0, &line_rect, babl_format ("RGBA u16"), line_buf, GEGL_AUTO_ROWSTRIDE);
+  for (i = 0; i < size; i++)
+  {
+    gint cluster = void_and_cluster_find (&vc, TRUE);
+    gint hole;
+
+    void_and_cluster_toggle (&vc, cluster);
+    hole = void_and_cluster_find (&vc, FALSE);
+    void_and_cluster_toggle (&vc, hole);
+
+    if (hole == cluster)
+      break;
+  }
+
+  memcpy (prototype, vc.pattern, size * sizeof (gboolean));
+  memcpy (prototype_energy, vc.energy, size * sizeof (gdouble));
 
-    /* Process the row */
+  /* rank the pattern's pixels by removing its tightest clusters */
 
-    for (x = start_x; x != end_x; x += step)
+  for (rank = ones - 1; rank >= 0; rank--)
+  {
+    i = void_and_cluster_find (&vc, TRUE);
+    void_and_cluster_toggle (&vc, i);
+    matrix [i] = rank;
+  }
+
+  /* and the remaining ones by filling the largest voids */
+
+  memcpy (vc.pattern, prototype, size * sizeof (gboolean));
+  memcpy (vc.energy, prototype_energy, size * sizeof (gdouble));
+
+  for (rank = ones; rank < size; rank++)
+  {
+    i = void_and_cluster_find (&vc, FALSE);
+    void_and_cluster_toggle (&vc, i);
+    matrix [i] = rank;
+  }
+
+  /* thresholds centered in their rank, -0.5 to 0.5 */
+
+  for (i = 0; i < size; i++)
+    matrix [i] = (matrix [i] + 0.5) / size - 0.5;
+
+  g_free (vc.pattern);
+  g_free (vc.energy);
+  g_free (vc.kernel);
+  g_free (prototype);
+  g_free (prototype_energy);
+
+  return matrix;
+}
+
+static const gfloat *
+get_blue_noise_matrix (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  return g_once (&once, blue_noise_matrix_new, NULL);
+}
+
+typedef struct
+{
+  const gfloat        *matrix;
+  guint16             *band_buf;
+  const GeglRectangle *band_rect;
+  guint               *channel_bits;
+  guint                channel_mask [4];
+} BlueNoiseBand;
+
+static void
+blue_noise_rows (gint     thread,
+                 gint     threads,
+                 gpointer data)
+{
+  BlueNoiseBand       *band      = data;
+  const GeglRectangle *band_rect = band->band_rect;
+  gint                 first     = band_rect->height * thread / threads;
+  gint                 last      = band_rect->height * (thread + 1) / threads;
+  gint                 y;
+
+  for (y = first; y < last; y++)
+  {
+    const gfloat *matrix_row = band->matrix +
+                               ((band_rect->y + y) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE;
+    guint16      *pixel      = band->band_buf + y * band_rect->width * 4;
+    gint          x;
+
+    for (x = 0; x < band_rect->width; x++, pixel += 4)
     {
-      guint16  *pixel = &line_buf [x * 4];
-      guint     ch;
+      gdouble threshold = matrix_row [(band_rect->x + x) & (BLUE_NOISE_SIZE - 1)];
+      guint   ch;
 
       for (ch = 0; ch < 4; ch++)
       {
         gdouble value;
         gdouble value_clamped;
         gdouble quantized;
-        gdouble qerror;
 
-        value         = pixel [ch] + error_buf [0] [x * 4 + ch];
+        value         = pixel [ch] + threshold * 65536.0 / (1 << (band->channel_bits [ch] - 1));
         value_clamped = CLAMP (value, 0.0, 65535.0);
-        quantized     = quantize_value ((guint) (value_clamped + 0.5), channel_bits [ch], channel_mask [ch]);
-        qerror        = value - quantized;
+        quantized     = quantize_value ((guint) (value_clamped + 0.5), band->channel_bits [ch], band->channel_mask [ch]);
 
         pixel [ch] = (guint16) quantized;
+      }
+    }
+  }
+}
 
-        /* Distribute the error */
+static void
+process_blue_noise (GeglBuffer *input,
+                    GeglBuffer *output,
+                    const GeglRectangle *result,
+                    guint *channel_bits)
+{
+  BlueNoiseBand        band;
+  GeglRectangle        band_rect;
+  guint16             *band_buf;
+  gint                 y;
 
-        error_buf [1] [x * 4 + ch] += qerror * 5.0 / 16.0;  /* Down */
+  band_buf = g_new (guint16, result->width * DITHER_BAND_HEIGHT * 4);
 
-        if (x + step >= 0 && x + step < result->width)
-        {
-          error_buf [0] [(x + step) * 4 + ch] += qerror * 6.0 / 16.0;  /* Ahead */
-          error_buf [1] [(x + step) * 4 + ch] += qerror * 1.0 / 16.0;  /* Down, ahead */
-        }
+  band.matrix       = get_blue_noise_matrix ();
+  band.band_buf     = band_buf;
+  band.band_rect    = &band_rect;
+  band.channel_bits = channel_bits;
 
-        if (x - step >= 0 && x - step < result->width)
-        {
-          error_buf [1] [(x - step) * 4 + ch] += qerror * 3.0 / 16.0;  /* Down, behind */
-        }
-      }
-    }
+  generate_channel_masks (channel_bits, band.channel_mask);
 
-    /* Swap error accumulation rows */
+  band_rect.x     = result->x;
+  band_rect.width = result->width;
 
-    error_buf_swap = error_buf [0];
-    error_buf [0]  = error_buf [1];
-    error_buf [1]  = error_buf_swap;
-
-    /* Clear error buffer for next-plus-one line */
+  for (y = 0; y < result->height; y += DITHER_BAND_HEIGHT)
+  {
+    band_rect.y      = result->y + y;
+    band_rect.height = MIN (DITHER_BAND_HEIGHT, result->height - y);
 
-    memset (error_buf [1], 0, line_rect.width * 4 * sizeof (gdouble));
+    gegl_buffer_get (input, 1.0, &band_rect, babl_format ("RGBA u16"), band_buf, GEGL_AUTO_ROWSTRIDE);
 
-    /* Push output row */
+    gegl_parallel_distribute (band_rect.height, blue_noise_rows, &band);
 
-    gegl_buffer_set (output, &line_rect, babl_format ("RGBA u16"), line_buf, GEGL_AUTO_ROWSTRIDE);
-    line_rect.y++;
+    gegl_buffer_set (output, &band_rect, babl_format ("RGBA u16"), band_buf, GEGL_AUTO_ROWSTRIDE);
   }
 
-  g_free (line_buf);
-  g_free (error_buf [0]);
-  g_free (error_buf [1]);
+  g_free (band_buf);
 }
 
 static const gdouble bayer_matrix_8x8 [] =
@@ -223,7 +518,7 @@ process_bayer (GeglBuffer *input,
         gdouble value_clamped;
         gdouble quantized;
 
-        value         = pixel [ch] + ((bayer_matrix_8x8 [(y % 8) * 8 + (x % 8)] - 32) * 65536.0 / 65.0) / (1 << (channel_bits [ch] - 1));
+        value         = pixel [ch] + ((bayer_matrix_8x8 [((result->y + y) & 7) * 8 + ((result->x + x) & 7)] - 32) * 65536.0 / 65.0) / (1 << (channel_bits [ch] - 1));
         value_clamped = CLAMP (value, 0.0, 65535.0);
         quantized     = quantize_value ((guint) (value_clamped + 0.5), channel_bits [ch], channel_mask [ch]);
 
@@ -387,11 +682,25 @@ process_no_dither (GeglBuffer *input,
   g_free (line_buf);
 }
 
+/* Error diffusion carries errors across the whole image, the other
+ * strategies only look at the pixel itself.
+ */
+static gboolean
+needs_whole_input (GeglOperation *self)
+{
+  GeglChantO *o = GEGL_CHANT_PROPERTIES (self);
+
+  return o->dither_type && !strcasecmp (o->dither_type, "floyd-steinberg");
+}
+
 static GeglRectangle
 get_required_for_output (GeglOperation        *self,
                          const gchar         *input_pad,
                          const GeglRectangle *roi)
 {
+  if (!needs_whole_input (self))
+    return *roi;
+
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
@@ -399,6 +708,9 @@ static GeglRectangle
 get_cached_region (GeglOperation       *self,
                    const GeglRectangle *roi)
 {
+  if (!needs_whole_input (self))
+    return *roi;
+
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
@@ -424,6 +736,8 @@ process (GeglOperation       *operation,
     process_random_covariant (input, output, result, channel_bits);
   else if (!strcasecmp (o->dither_type, "bayer"))
     process_bayer (input, output, result, channel_bits);
+  else if (!strcasecmp (o->dither_type, "blue-noise"))
+    process_blue_noise (input, output, result, channel_bits);
   else if (!strcasecmp (o->dither_type, "floyd-steinberg"))
     process_floyd_steinberg (input, output, result, channel_bits);
   else
@@ -32,51 +32,115 @@ gegl_chant_int (pattern, _("Bayer pattern"), 0, 3, 0,
 #define GEGL_CHANT_C_FILE       "demosaic-bimedian.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
 
+/* Number of rows fetched, demosaiced and stored at a time. */
+#define DEMOSAIC_BAND_HEIGHT 64
+
 /* Returns the median of four floats. We define the median as the average of
- * the central two elements.
+ * the central two elements. The central two are found with a min/max
+ * network rather than by sorting, which keeps the loops free of
+ * data dependent branches.
  */
 static inline gfloat
 m4 (gfloat a, gfloat b, gfloat c, gfloat d)
 {
-  gfloat t;
+  gfloat lo1 = MIN (a, b);
+  gfloat hi1 = MAX (a, b);
+  gfloat lo2 = MIN (c, d);
+  gfloat hi2 = MAX (c, d);
 
-  /* Sort ab */
-  if (a > b)
-    {
-      t = b;
-      b = a;
-      a = t;
-    }
-  /* Sort abc */
-  if (b > c)
+  return (MAX (lo1, lo2) + MIN (hi1, hi2)) / 2.0;
+}
+
+/* Defines to make the row/col offsets below obvious. */
+#define ROW src_width
+#define COL 1
+
+typedef struct
+{
+  gint                 pattern;
+  const gfloat        *src_buf;
+  gint                 src_width;
+  gfloat              *dst_buf;
+  const GeglRectangle *band;
+} DemosaicRows;
+
+/* Demosaics rows of band, src_buf holds the band with a one pixel border
+ * around all four sides.
+ */
+static void
+demosaic_rows (gint     thread,
+               gint     threads,
+               gpointer data)
+{
+  DemosaicRows        *rows      = data;
+  const GeglRectangle *band      = rows->band;
+  const gint           src_width = rows->src_width;
+  gint                 first     = band->height * thread / threads;
+  gint                 last      = band->height * (thread + 1) / threads;
+  gint                 y;
+
+  for (y = first; y < last; y++)
     {
-      t = c;
-      c = b;
-      if (a > t)
+      const gfloat *src_buf = rows->src_buf;
+      gfloat       *dst     = rows->dst_buf + y * band->width * 3;
+      gint          offset  = (y + 1) * ROW + COL;
+      gint          odd_col = (band->x + rows->pattern / 2) & 1;
+      gint          green;
+      gint          site;
+      gint          other;
+      gint          x;
+
+      /* The colour sampled at the non green sites of this row, red or
+       * blue, the one sampled in the rows above and below, and whether
+       * the row starts on a green site.
+       */
+      if (((band->y + y + rows->pattern % 2) & 1) == 0)
         {
-          b = a;
-          a = t;
+          site  = 2;
+          other = 0;
+          green = odd_col;
         }
       else
-    b = t;
+        {
+          site  = 0;
+          other = 2;
+          green = !odd_col;
+        }
+
+      for (x = 0; x < band->width; x++, offset++, dst += 3, green = !green)
+        {
+          if (green)
+            {
+              /* GSG
+               * OGO
+               * GSG
+               */
+              dst[site]  = (src_buf[offset-COL]+src_buf[offset+COL])/2.0;
+              dst[1]     = src_buf[offset];
+              dst[other] = (src_buf[offset-ROW]+src_buf[offset+ROW])/2.0;
+            }
+          else
+            {
+              /* OGO
+               * GSG
+               * OGO
+               */
+              dst[site]  = src_buf[offset];
+              dst[1]     = m4 (src_buf[offset-ROW], src_buf[offset-COL],
+                               src_buf[offset+COL], src_buf[offset+ROW]);
+              dst[other] = m4 (src_buf[offset-ROW-COL], src_buf[offset-ROW+COL],
+                               src_buf[offset+ROW-COL], src_buf[offset+ROW+COL]);
+            }
+        }
     }
-  /* Return average of central two elements. */
-  if (d >= c) /* Sorted order would be abcd */
-    return (b + c) / 2.0;
-  else if (d >= a) /* Sorted order would be either abdc or adbc */
-    return (b + d) / 2.0;
-  else /* Sorted order would be dabc */
-    return (a + b) / 2.0;
 }
 
-/* Defines to make the row/col offsets below obvious. */
-#define ROW src_rect->width
-#define COL 1
-
 /* We expect src_extent to have a one pixel border around all four sides
- * of dst_extent.
+ * of dst_extent. dst_extent is processed in bands of DEMOSAIC_BAND_HEIGHT
+ * rows, the rows of each band being split across threads.
  */
 static void
 demosaic (GeglChantO          *op,
@@ -85,89 +149,42 @@ demosaic (GeglChantO          *op,
           GeglBuffer          *dst,
           const GeglRectangle *dst_rect)
 {
-  gint x,y;
-  gint offset, doffset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-
-  src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 1);
-  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 3);
-
-  gegl_buffer_get (src, 1.0, src_rect, babl_format ("Y float"), src_buf,
-           GEGL_AUTO_ROWSTRIDE);
-
-  offset = ROW + COL;
-  doffset = 0;
-  for (y=dst_rect->y; y<dst_rect->height + dst_rect->y; y++)
+  GeglRectangle  band;
+  DemosaicRows   rows;
+  gfloat        *src_buf;
+  gfloat        *dst_buf;
+  gint           band_height = MIN (DEMOSAIC_BAND_HEIGHT, dst_rect->height);
+
+  src_buf = g_new (gfloat, src_rect->width * (band_height + 2));
+  dst_buf = g_new (gfloat, dst_rect->width * band_height * 3);
+
+  rows.pattern   = op->pattern;
+  rows.src_buf   = src_buf;
+  rows.src_width = src_rect->width;
+  rows.dst_buf   = dst_buf;
+  rows.band      = &band;
+
+  band = *dst_rect;
+  for (band.y = dst_rect->y;
+       band.y < dst_rect->y + dst_rect->height;
+       band.y += band_height)
     {
-      for (x=dst_rect->x; x<dst_rect->width + dst_rect->x; x++)
-        {
-          gfloat red=0.0;
-          gfloat green=0.0;
-          gfloat blue=0.0;
+      GeglRectangle src_band;
 
-          if ((y + op->pattern%2)%2==0)
-            {
-              if ((x+op->pattern/2)%2==1)
-                {
-                  /* GRG
-                   * BGB
-                   * GRG
-                   */
-                  blue =(src_buf[offset-COL]+src_buf[offset+COL])/2.0;
-                  green=src_buf[offset];
-                  red  =(src_buf[offset-ROW]+src_buf[offset+ROW])/2.0;
-                }
-              else
-                {
-                  /* RGR
-                   * GBG
-                   * RGR
-                   */
-                  blue =src_buf[offset];
-                  green=m4(src_buf[offset-ROW], src_buf[offset-COL],
-                           src_buf[offset+COL], src_buf[offset+ROW]);
-                  red  =m4(src_buf[offset-ROW-COL], src_buf[offset-ROW+COL],
-                           src_buf[offset+ROW-COL], src_buf[offset+ROW+COL]);
-                }
-            }
-          else
-            {
-              if ((x+op->pattern/2)%2==1)
-                {
-                  /* BGB
-                   * GRG
-                   * BGB
-                   */
-                  blue =m4(src_buf[offset-ROW-COL], src_buf[offset-ROW+COL],
-                       src_buf[offset+ROW-COL], src_buf[offset+ROW+COL]);
-                  green=m4(src_buf[offset-ROW], src_buf[offset-COL],
-                       src_buf[offset+COL], src_buf[offset+ROW]);
-                  red  =src_buf[offset];
-                }
-              else
-                {
-                  /* GBG
-                   * RGR
-                   * GBG
-                   */
-                  blue =(src_buf[offset-ROW]+src_buf[offset+ROW])/2.0;
-                  green=src_buf[offset];
-                  red  =(src_buf[offset-COL]+src_buf[offset+COL])/2.0;
-                }
-            }
+      band.height = MIN (band_height, dst_rect->y + dst_rect->height - band.y);
 
-          dst_buf [doffset*3+0] = red;
-          dst_buf [doffset*3+1] = green;
-          dst_buf [doffset*3+2] = blue;
+      gegl_rectangle_set (&src_band,
+                          src_rect->x, band.y - 1,
+                          src_rect->width, band.height + 2);
+      gegl_buffer_get (src, 1.0, &src_band, babl_format ("Y float"), src_buf,
+                       GEGL_AUTO_ROWSTRIDE);
 
-          offset++;
-          doffset++;
-        }
-      offset+=2;
+      gegl_parallel_distribute (band.height, demosaic_rows, &rows);
+
+      gegl_buffer_set (dst, &band, babl_format ("RGB float"), dst_buf,
+                       GEGL_AUTO_ROWSTRIDE);
     }
 
-  gegl_buffer_set (dst, dst_rect, babl_format ("RGB float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
   g_free (src_buf);
   g_free (dst_buf);
 }
@@ -31,79 +31,134 @@ gegl_chant_int (pattern, _("Bayer pattern"), 0, 3, 0,
 #define GEGL_CHANT_C_FILE       "demosaic-simple.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
+/* Number of rows fetched, demosaiced and stored at a time. */
+#define DEMOSAIC_BAND_HEIGHT 64
+
+typedef struct
+{
+  gint                 pattern;
+  const gfloat        *src_buf;
+  gint                 src_width;
+  gfloat              *dst_buf;
+  const GeglRectangle *band;
+} DemosaicRows;
+
+/* Demosaics rows of band, src_buf holds the band with a one pixel border
+ * on the right and bottom sides.
+ */
 static void
-demosaic (GeglChantO          *op,
-          GeglBuffer          *src,
-          const GeglRectangle *src_rect,
-          GeglBuffer          *dst,
-          const GeglRectangle *dst_rect)
+demosaic_rows (gint     thread,
+               gint     threads,
+               gpointer data)
 {
-  gint x,y;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-
-  src_buf = g_new0 (gfloat, src_rect->width * src_rect->height * 1);
-  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 3);
-
-  gegl_buffer_get (src, 1.0, src_rect, babl_format ("Y float"), src_buf, GEGL_AUTO_ROWSTRIDE);
-
-  offset=0;
-  for (y=src_rect->y; y < dst_rect->height + src_rect->y; y++)
+  DemosaicRows        *rows    = data;
+  const GeglRectangle *band    = rows->band;
+  const gfloat        *src_buf = rows->src_buf;
+  gint                 first   = band->height * thread / threads;
+  gint                 last    = band->height * (thread + 1) / threads;
+  gint                 y;
+
+  for (y = first; y < last; y++)
     {
-      gint src_offset = (y-src_rect->y) * src_rect->width;
-      for (x=src_rect->x; x < dst_rect->width + src_rect->x; x++)
+      gint    src_offset = y * rows->src_width;
+      gint    width      = rows->src_width;
+      gfloat *dst        = rows->dst_buf + y * band->width * 3;
+      gint    even_row   = ((band->y + y + rows->pattern % 2) & 1) == 0;
+      gint    x;
+
+      for (x = band->x; x < band->x + band->width; x++, src_offset++, dst += 3)
         {
-          gfloat red=0.0;
-          gfloat green=0.0;
-          gfloat blue=0.0;
+          gfloat red;
+          gfloat green;
+          gfloat blue;
 
-          if (y<dst_rect->height+dst_rect->y &&
-              x<dst_rect->width+dst_rect->x)
+          if (even_row)
             {
-          if ((y + op->pattern%2)%2==0)
-            {
-              if ((x+op->pattern/2)%2==1)
+              if ((x+rows->pattern/2)&1)
                 {
                   blue=src_buf[src_offset+1];
                   green=src_buf[src_offset];
-                  red=src_buf[src_offset + src_rect->width];
+                  red=src_buf[src_offset + width];
                 }
               else
                 {
                   blue=src_buf[src_offset];
                   green=src_buf[src_offset+1];
-                  red=src_buf[src_offset+1+src_rect->width];
+                  red=src_buf[src_offset+1+width];
                 }
             }
           else
             {
-              if ((x+op->pattern/2)%2==1)
+              if ((x+rows->pattern/2)&1)
                 {
-                  blue=src_buf[src_offset + src_rect->width + 1];
+                  blue=src_buf[src_offset + width + 1];
                   green=src_buf[src_offset + 1];
                   red=src_buf[src_offset];
                 }
               else
                 {
-                  blue=src_buf[src_offset + src_rect->width];
+                  blue=src_buf[src_offset + width];
                   green=src_buf[src_offset];
                   red=src_buf[src_offset + 1];
                 }
             }
-          }
-
-          dst_buf [offset*3+0] = red;
-          dst_buf [offset*3+1] = green;
-          dst_buf [offset*3+2] = blue;
 
-          offset++;
-          src_offset++;
+          dst[0] = red;
+          dst[1] = green;
+          dst[2] = blue;
         }
     }
+}
+
+/* src_rect has a one pixel border on the right and bottom of dst_rect,
+ * which is processed in bands of DEMOSAIC_BAND_HEIGHT rows, the rows of
+ * each band being split across threads.
+ */
+static void
+demosaic (GeglChantO          *op,
+          GeglBuffer          *src,
+          const GeglRectangle *src_rect,
+          GeglBuffer          *dst,
+          const GeglRectangle *dst_rect)
+{
+  GeglRectangle  band;
+  DemosaicRows   rows;
+  gfloat        *src_buf;
+  gfloat        *dst_buf;
+  gint           band_height = MIN (DEMOSAIC_BAND_HEIGHT, dst_rect->height);
+
+  src_buf = g_new (gfloat, src_rect->width * (band_height + 1));
+  dst_buf = g_new (gfloat, dst_rect->width * band_height * 3);
+
+  rows.pattern   = op->pattern;
+  rows.src_buf   = src_buf;
+  rows.src_width = src_rect->width;
+  rows.dst_buf   = dst_buf;
+  rows.band      = &band;
+
+  band = *dst_rect;
+  for (band.y = dst_rect->y;
+       band.y < dst_rect->y + dst_rect->height;
+       band.y += band_height)
+    {
+      GeglRectangle src_band;
+
+      band.height = MIN (band_height, dst_rect->y + dst_rect->height - band.y);
+
+      gegl_rectangle_set (&src_band,
+                          src_rect->x, band.y,
+                          src_rect->width, band.height + 1);
+      gegl_buffer_get (src, 1.0, &src_band, babl_format ("Y float"), src_buf,
+                       GEGL_AUTO_ROWSTRIDE);
+
+      gegl_parallel_distribute (band.height, demosaic_rows, &rows);
+
+      gegl_buffer_set (dst, &band, babl_format ("RGB float"), dst_buf,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
 
-  gegl_buffer_set (dst, dst_rect, babl_format ("RGB float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
   g_free (src_buf);
   g_free (dst_buf);
 }
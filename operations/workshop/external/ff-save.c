@@ -37,6 +37,7 @@ gegl_chant_double (fps, _("FPS"), 0.0, 100.0, 25, _("frames per second"))
 #define GEGL_CHANT_C_FILE       "ff-save.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
 #ifdef HAVE_LIBAVFORMAT_AVFORMAT_H
 #include <libavformat/avformat.h>
@@ -51,6 +52,8 @@ typedef struct
   gdouble    width;
   gdouble    height;
   GeglBuffer *input;
+  gint        input_width;  /* size of the frame in input */
+  gint        input_height;
 
   AVOutputFormat *fmt;
   AVFormatContext *oc;
@@ -105,8 +108,31 @@ typedef struct
   int       audio_input_frame_size;
   int16_t  *samples;
   uint8_t  *audio_outbuf;
+
+  GThread  *encoder;   /* encoding thread, or NULL when encoding in process */
+  GMutex   *mutex;     /* protects queued, done and closing */
+  GCond    *cond;      /* signalled when queued changes or on closing */
+  GQueue    queued;    /* FfSaveFrames to encode, oldest first */
+  GQueue    done;      /* encoded FfSaveFrames, for process to release */
+  gboolean  closing;
 } Priv;
 
+/* A rendered frame waiting for the encoding thread. The buffer shares its
+ * tiles with the input of process, so it is only released from the
+ * rendering thread, like the input buffer itself.
+ */
+typedef struct
+{
+  GeglBuffer *buffer;
+  gint        width;
+  gint        height;
+} FfSaveFrame;
+
+/* number of rendered frames that can wait for the encoding thread before
+ * process blocks
+ */
+#define FF_SAVE_QUEUE 4
+
 #define DISABLE_AUDIO
 
 static void
@@ -633,8 +659,8 @@ fill_yuv_image (GeglChantO *op,
    op->input_pad[0]->data,
 
           op->input_pad[0]->width * op->input_pad[0]->height * 3);*/
-  GeglRectangle rect={0,0,width,height};
-  gegl_buffer_get (p->input, 1.0, &rect, babl_format ("R'G'B' u8"), pict->data[0], GEGL_AUTO_ROWSTRIDE);
+  GeglRectangle rect={0,0,MIN (width, p->input_width),MIN (height, p->input_height)};
+  gegl_buffer_get (p->input, 1.0, &rect, babl_format ("R'G'B' u8"), pict->data[0], pict->linesize[0]);
 }
 
 static void
@@ -802,6 +828,99 @@ filechanged (GeglChantOperation *op, const char *att)
 }
 #endif
 
+static void
+encode_frame (GeglChantO *o,
+              GeglBuffer *input,
+              gint        width,
+              gint        height)
+{
+  Priv *p = (Priv*)o->chant_data;
+
+  p->input        = input;
+  p->input_width  = width;
+  p->input_height = height;
+
+  write_video_frame (o, p->oc, p->video_st);
+  if (p->audio_st)
+    write_audio_frame (o, p->oc, p->audio_st);
+
+  p->input = NULL;
+}
+
+/* converts and encodes the queued frames in order, while the following
+ * frames are being rendered
+ */
+static gpointer
+encoder_thread (gpointer data)
+{
+  GeglChantO *o = data;
+  Priv       *p = (Priv*)o->chant_data;
+
+  g_mutex_lock (p->mutex);
+  for (;;)
+    {
+      FfSaveFrame *frame;
+
+      while (g_queue_is_empty (&p->queued) && !p->closing)
+        g_cond_wait (p->cond, p->mutex);
+
+      frame = g_queue_pop_head (&p->queued);
+      if (!frame)
+        break;
+
+      g_cond_broadcast (p->cond);
+      g_mutex_unlock (p->mutex);
+
+      encode_frame (o, frame->buffer, frame->width, frame->height);
+
+      g_mutex_lock (p->mutex);
+      g_queue_push_tail (&p->done, frame);
+    }
+  g_mutex_unlock (p->mutex);
+
+  return NULL;
+}
+
+/* releases the frames the encoding thread is done with */
+static void
+release_encoded (Priv *p)
+{
+  GQueue       done;
+  FfSaveFrame *frame;
+
+  g_mutex_lock (p->mutex);
+  done = p->done;
+  g_queue_init (&p->done);
+  g_mutex_unlock (p->mutex);
+
+  while ((frame = g_queue_pop_head (&done)))
+    {
+      g_object_unref (frame->buffer);
+      g_slice_free (FfSaveFrame, frame);
+    }
+}
+
+/* encodes the frames still queued and stops the encoding thread */
+static void
+stop_encoder (Priv *p)
+{
+  if (!p->encoder)
+    return;
+
+  g_mutex_lock (p->mutex);
+  p->closing = TRUE;
+  g_cond_broadcast (p->cond);
+  g_mutex_unlock (p->mutex);
+
+  g_thread_join (p->encoder);
+  p->encoder = NULL;
+
+  release_encoded (p);
+
+  g_mutex_free (p->mutex);
+  g_cond_free (p->cond);
+}
+
 static gboolean
 process (GeglOperation       *operation,
          GeglBuffer          *input,
@@ -817,19 +936,49 @@ process (GeglOperation       *operation,
     init (o);
   p = (Priv*)o->chant_data;
 
-  p->width = result->width;
-  p->height = result->height;
-  p->input = input;
-
   if (!inited)
     {
+      /* the stream gets the size of the first frame */
+      p->width = result->width;
+      p->height = result->height;
       tfile (o);
       inited = 1;
     }
 
-  write_video_frame (o, p->oc, p->video_st);
-  if (p->audio_st)
-    write_audio_frame (o, p->oc, p->audio_st);
+  if (!p->encoder && g_thread_supported () &&
+      gegl_parallel_get_n_threads () > 1)
+    {
+      p->mutex = g_mutex_new ();
+      p->cond = g_cond_new ();
+      p->encoder = g_thread_create (encoder_thread, o, TRUE, NULL);
+    }
+
+  if (p->encoder)
+    {
+      FfSaveFrame *frame;
+
+      release_encoded (p);
+
+      /* the copy shares the tiles of input until the next frame is
+       * rendered into them, so handing the frame over is cheap.
+       */
+      frame         = g_slice_new (FfSaveFrame);
+      frame->buffer = gegl_buffer_new (result, gegl_buffer_get_format (input));
+      frame->width  = result->width;
+      frame->height = result->height;
+      gegl_buffer_copy (input, result, frame->buffer, result);
+
+      g_mutex_lock (p->mutex);
+      while (g_queue_get_length (&p->queued) >= FF_SAVE_QUEUE)
+        g_cond_wait (p->cond, p->mutex);
+      g_queue_push_tail (&p->queued, frame);
+      g_cond_broadcast (p->cond);
+      g_mutex_unlock (p->mutex);
+    }
+  else
+    {
+      encode_frame (o, input, result->width, result->height);
+    }
 
   return  TRUE;
 }
@@ -842,6 +991,8 @@ finalize (GObject *object)
     {
       Priv *p = (Priv*)o->chant_data;
 
+      stop_encoder (p);
+
     if (p->oc)
       {
         gint i;
@@ -32,165 +32,106 @@ gegl_chant_double (radius, _("Radius"), 0.0, 50.0, 4.0,
 
 #include "gegl-chant.h"
 #include <math.h>
+#include "area-statistics.h"
 
-static inline void
-compute_rectangle (gfloat *buf,
-                   gint    buf_width,
-                   gint    buf_height,
-                   gint    x0,
-                   gint    y0,
-                   gint    width,
-                   gint    height,
-                   gint    component,
-                   gfloat *pmin,
-                   gfloat *pmax,
-                   gfloat *pmean,
-                   gfloat *pvariance)
+static void
+kuwahara (GeglBuffer          *src,
+          GeglBuffer          *dst,
+          const GeglRectangle *dst_rect,
+          const GeglRectangle *valid,
+          gint                 radius)
 {
-  gint    x, y;
-  gfloat  max   = -1000000000.0;
-  gfloat  min   =  1000000000.0;
-  gfloat  mean  =  0.0;
-  glong   count =  0;
-
-  gint offset = (y0 * buf_width + x0) * 4 + component;
-
-  for (y=y0; y<y0+height; y++)
+  GeglRectangle    src_rect;
+  GeglRectangle    src_valid;
+  gfloat          *src_buf;
+  gfloat          *dst_buf;
+  gfloat          *min[3];
+  gfloat          *max[3];
+  gint             map_width;
+  gint             component;
+  gint             u, v;
+  gint             offset;
+
+  src_rect         = *dst_rect;
+  src_rect.x      -= radius;
+  src_rect.y      -= radius;
+  src_rect.width  += radius * 2;
+  src_rect.height += radius * 2;
+
+  /* only pixels within the input count towards the quadrants */
+  src_valid = src_rect;
+  if (valid)
+    gegl_rectangle_intersect (&src_valid, &src_rect, valid);
+  src_valid.x -= src_rect.x;
+  src_valid.y -= src_rect.y;
+
+  src_buf = g_new0 (gfloat, src_rect.width * src_rect.height * 4);
+  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
+
+  gegl_buffer_get (src, 1.0, &src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
+
+  /* min and max of every (radius+1)x(radius+1) square, by its top left
+   * corner
+   */
+  map_width = src_rect.width - radius;
+  for (component=0; component<3; component++)
     {
-    for (x=x0; x<x0+width; x++)
-      {
-        if (x>=0 && x<buf_width &&
-            y>=0 && y<buf_height)
-          {
-            if (buf [offset] > max)
-              max = buf[offset];
-            if (buf [offset] < min)
-              min = buf[offset];
-            mean += buf[offset];
-            count++;
-          }
-        offset+=4;
-      }
-      offset+= (buf_width * 4) - 4 * width;
+      min[component] = g_new (gfloat, map_width * (src_rect.height - radius));
+      max[component] = g_new (gfloat, map_width * (src_rect.height - radius));
+      box_extreme_map_clipped (src_buf, src_rect.width, src_rect.height, 4,
+                               component, &src_valid, radius + 1, FALSE,
+                               min[component]);
+      box_extreme_map_clipped (src_buf, src_rect.width, src_rect.height, 4,
+                               component, &src_valid, radius + 1, TRUE,
+                               max[component]);
     }
-  if (pmin)
-    *pmin = min;
-  if (pmax)
-    *pmax = max;
-  if (pmean && count)
-    *pmean = mean/count;
-  if (pvariance)
-    *pvariance = max-min;
-}
-
-static void
-kuwahara (GeglBuffer *src,
-          GeglBuffer *dst,
-          gint        radius)
-{
-  gint u,v;
-  gint offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-
-  src_buf = g_new0 (gfloat, gegl_buffer_get_pixel_count (src) * 4);
-  dst_buf = g_new0 (gfloat, gegl_buffer_get_pixel_count (dst) * 4);
-
-  gegl_buffer_get (src, 1.0, NULL, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
 
   offset = 0;
-  for (v=0; v<gegl_buffer_get_height (dst); v++)
-    for (u=0; u<gegl_buffer_get_width (dst); u++)
+  for (v=0; v<dst_rect->height; v++)
+    for (u=0; u<dst_rect->width; u++)
       {
-        gint component;
-
-        for (component=0; component<3; component++)
+        gfloat best[3] = { G_MAXFLOAT, G_MAXFLOAT, G_MAXFLOAT };
+        gint   quadrant;
+
+        /* the four (radius+1)x(radius+1) quadrants sharing the center pixel,
+         * (u + radius, v + radius) in src_buf, as a corner; the one with
+         * the smallest range of values wins
+         */
+        for (quadrant=0; quadrant<4; quadrant++)
           {
-            gfloat value=0.0;
-            gfloat best=1000000.0;
-
-            gfloat max = 0.0;
-            gfloat variance = 0.0;
-
-            compute_rectangle (src_buf,
-                               gegl_buffer_get_width (src),
-                               gegl_buffer_get_height (src),
-                               u - radius - 1,
-                               v - radius - 1,
-                               1 + radius,
-                               1 + radius,
-                               component,
-                               NULL, /* min */
-                               &max, /* max */
-                               NULL,
-                               &variance);
-            if (variance<best)
-              {
-                value = max;
-                best = variance;
-              }
-
-            compute_rectangle (src_buf,
-                               gegl_buffer_get_width (src),
-                               gegl_buffer_get_height (src),
-                               u,
-                               v - radius - 1,
-                               1 + radius,
-                               1 + radius,
-                               component,
-                               NULL, /* min */
-                               &max, /* max */
-                               NULL,
-                               &variance);
-            if (variance<best)
-              {
-                value = max;
-                best = variance;
-              }
+            gint          x0 = u + ((quadrant & 1) ? radius : 0);
+            gint          y0 = v + ((quadrant & 2) ? radius : 0);
+            GeglRectangle square = { x0, y0, radius + 1, radius + 1 };
+            GeglRectangle inside;
 
-            compute_rectangle (src_buf,
-                               gegl_buffer_get_width (src),
-                               gegl_buffer_get_height (src),
-                               u - radius - 1,
-                               v,
-                               1 + radius,
-                               1 + radius,
-                               component,
-                               NULL, /* min */
-                               &max, /* max */
-                               NULL,
-                               &variance);
-            if (variance<best)
-              {
-                value = max;
-                best = variance;
-              }
+            if (!gegl_rectangle_intersect (&inside, &square, &src_valid))
+              continue;
 
-            compute_rectangle (src_buf,
-                               gegl_buffer_get_width (src),
-                               gegl_buffer_get_height (src),
-                               u,
-                               v,
-                               1 + radius,
-                               1 + radius,
-                               component,
-                               NULL, /* min */
-                               &max, /* max */
-                               NULL,
-                               &variance);
-
-            if (variance<best)
+            for (component=0; component<3; component++)
               {
-                value = max;
-                best = variance;
+                gfloat range = max[component][y0 * map_width + x0] -
+                               min[component][y0 * map_width + x0];
+
+                if (range < best[component])
+                  {
+                    best[component] = range;
+                    dst_buf [offset + component] =
+                      max[component][y0 * map_width + x0];
+                  }
               }
-            dst_buf [offset++] = value;
           }
-          dst_buf [offset] = src_buf[offset];
-          offset++;
+
+        dst_buf [offset + 3] =
+          src_buf [((v + radius) * src_rect.width + u + radius) * 4 + 3];
+        offset += 4;
       }
 
-  gegl_buffer_set (dst, NULL, babl_format ("RGBA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (dst, dst_rect, babl_format ("RGBA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
+  for (component=0; component<3; component++)
+    {
+      g_free (min[component]);
+      g_free (max[component]);
+    }
   g_free (src_buf);
   g_free (dst_buf);
 }
@@ -210,14 +151,11 @@ process (GeglOperation       *operation,
          GeglBuffer          *output,
          const GeglRectangle *result)
 {
-  GeglChantO   *o = GEGL_CHANT_PROPERTIES (operation);
-  GeglBuffer   *temp_in;
-  GeglRectangle compute = gegl_operation_get_required_for_output (operation, "input", result);
-
-  temp_in = gegl_buffer_create_sub_buffer (input, &compute);
+  GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
 
-  kuwahara (temp_in, output, o->radius);
-  g_object_unref (temp_in);
+  kuwahara (input, output, result,
+            gegl_operation_source_get_bounding_box (operation, "input"),
+            o->radius);
 
   return  TRUE;
 }
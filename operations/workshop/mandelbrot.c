@@ -37,34 +37,117 @@ gegl_chant_int (maxiter, _("Iterations"), 0, 512, 128,
 #define GEGL_CHANT_C_FILE           "mandelbrot.c"
 
 #include "gegl-chant.h"
+#include "gegl-parallel.h"
 
-static gfloat
-mandel_calc(GeglChantO *o, gfloat x, gfloat y)
+/* Number of pixels iterated in lockstep. The lanes are plain arrays walked
+ * by fixed length loops the compiler can vectorize; a lane that escapes is
+ * masked out, and the block stops as soon as all of its lanes escaped.
+ */
+#define MANDEL_LANES 8
+
+static void
+mandel_calc (GeglChantO   *o,
+             const gfloat *x,
+             const gfloat *y,
+             gfloat       *value)
 {
   gfloat fViewRectReal = o->real;
   gfloat fViewRectImg  = o->img;
   gfloat fMagLevel     = o->level;
 
-  gfloat fCReal = fViewRectReal + x * fMagLevel;
-  gfloat fCImg  = fViewRectImg + y * fMagLevel;
-  gfloat fZReal = fCReal;
-  gfloat fZImg  = fCImg;
+  gfloat   fCReal[MANDEL_LANES];
+  gfloat   fCImg[MANDEL_LANES];
+  gfloat   fZReal[MANDEL_LANES];
+  gfloat   fZImg[MANDEL_LANES];
+  gint     escaped[MANDEL_LANES];
+  gboolean active[MANDEL_LANES];
+  gint     n_active = MANDEL_LANES;
+  gint     lane;
+  gint     n;
+
+  for (lane = 0; lane < MANDEL_LANES; lane++)
+    {
+      fCReal[lane]  = fViewRectReal + x[lane] * fMagLevel;
+      fCImg[lane]   = fViewRectImg + y[lane] * fMagLevel;
+      fZReal[lane]  = fCReal[lane];
+      fZImg[lane]   = fCImg[lane];
+      escaped[lane] = o->maxiter;
+      active[lane]  = TRUE;
+    }
+
+  for (n = 0; n < o->maxiter && n_active; n++)
+    {
+      for (lane = 0; lane < MANDEL_LANES; lane++)
+        {
+          gfloat fZRealSquared = fZReal[lane] * fZReal[lane];
+          gfloat fZImgSquared  = fZImg[lane] * fZImg[lane];
+
+          if (active[lane] && fZRealSquared + fZImgSquared > 4)
+            {
+              active[lane]  = FALSE;
+              escaped[lane] = n;
+              n_active--;
+            }
+
+          /* -- z = z^2 + c, escaped lanes are left alone */
+          if (active[lane])
+            {
+              fZImg[lane]  = 2 * fZReal[lane] * fZImg[lane] + fCImg[lane];
+              fZReal[lane] = fZRealSquared - fZImgSquared + fCReal[lane];
+            }
+        }
+    }
+
+  for (lane = 0; lane < MANDEL_LANES; lane++)
+    value[lane] = active[lane] ? 1.0 : 1.0 * escaped[lane] / (o->maxiter);
+}
+
+typedef struct
+{
+  GeglChantO          *o;
+  const GeglRectangle *result;
+  gfloat              *buf;
+} MandelRows;
+
+static void
+mandel_rows (gint     thread,
+             gint     threads,
+             gpointer data)
+{
+  MandelRows          *rows   = data;
+  const GeglRectangle *result = rows->result;
+  gint                 first  = result->height * thread / threads;
+  gint                 last   = result->height * (thread + 1) / threads;
+  gint                 y;
+
+  for (y = first; y < last; y++)
+    {
+      gfloat *dst = rows->buf + y * result->width;
+      gint    x;
+
+      for (x = 0; x < result->width; x += MANDEL_LANES)
+        {
+          gfloat nx[MANDEL_LANES];
+          gfloat ny[MANDEL_LANES];
+          gfloat value[MANDEL_LANES];
+          gint   lane;
 
-        gint n;
+          /* lanes past the end of the row repeat its last pixel */
+          for (lane = 0; lane < MANDEL_LANES; lane++)
+            {
+              nx[lane] = MIN (x + lane, result->width - 1) + result->x;
+              ny[lane] = y + result->y;
 
-        for (n=0;n<o->maxiter;n++)
-          {
-                gfloat fZRealSquared = fZReal * fZReal;
-                gfloat fZImgSquared = fZImg * fZImg;
+              nx[lane] = (nx[lane]/512);
+              ny[lane] = (ny[lane]/512);
+            }
 
-                if (fZRealSquared + fZImgSquared > 4)
-                        return 1.0*n/(o->maxiter);
+          mandel_calc (rows->o, nx, ny, value);
 
-/*                -- z = z^2 + c*/
-                fZImg = 2 * fZReal * fZImg + fCImg;
-                fZReal = fZRealSquared - fZImgSquared + fCReal;
-          }
-        return 1.0;
+          for (lane = 0; lane < MANDEL_LANES && x + lane < result->width; lane++)
+            dst[x + lane] = value[lane];
+        }
+    }
 }
 
 static void prepare (GeglOperation *operation)
@@ -85,6 +168,7 @@ process (GeglOperation       *operation,
          const GeglRectangle *result)
 {
   GeglChantO *o = GEGL_CHANT_PROPERTIES (operation);
+  MandelRows  rows;
   gfloat     *buf;
   gint        pxsize;
 
@@ -92,29 +176,11 @@ process (GeglOperation       *operation,
 
   buf = g_malloc (result->width * result->height * pxsize);
 
-    {
-      gfloat *dst = buf;
-      gint y;
-      for (y=0; y < result->height; y++)
-        {
-          gint x;
-          for (x=0; x < result->width ; x++)
-            {
-              gfloat value;
-              gfloat nx,ny;
-
-              nx = (x + result->x);
-              ny = (y + result->y);
+  rows.o      = o;
+  rows.result = result;
+  rows.buf    = buf;
 
-              nx = (nx/512);
-              ny = (ny/512);
-
-              value = mandel_calc (o, nx, ny);
-
-              *dst++ = value;
-            }
-        }
-    }
+  gegl_parallel_distribute (result->height, mandel_rows, &rows);
 
   gegl_buffer_set (output, NULL, babl_format ("Y float"), buf,
                    GEGL_AUTO_ROWSTRIDE);
@@ -0,0 +1,370 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Luminance histogram shared by the percentile filters.
+ *
+ * Pixels are binned by their luminance, quantized to
+ * PERCENTILE_HISTOGRAM_LEVELS levels over the 0.0-1.0 range (values
+ * outside it land in the end bins). Every fine bin keeps the indices of
+ * the source pixels binned in it, and the percentile is picked among the
+ * pixels of its bin by their exact luminance, so the color returned is the
+ * same pixel sorting the whole window by luminance would give. A coarse
+ * histogram on top keeps the bin lookup at COARSE + FINE steps.
+ *
+ * Adding and removing single pixels is O(1), which lets
+ * percentile_histogram_filter slide a window over the image in a
+ * serpentine scan, only updating the pixels entering and leaving it
+ * (Huang's algorithm), instead of rebuilding the window for every pixel.
+ */
+
+#ifndef __PERCENTILE_HISTOGRAM_H__
+#define __PERCENTILE_HISTOGRAM_H__
+
+#include <string.h>
+
+#define PERCENTILE_HISTOGRAM_COARSE 32
+#define PERCENTILE_HISTOGRAM_FINE   32
+#define PERCENTILE_HISTOGRAM_LEVELS (PERCENTILE_HISTOGRAM_COARSE * \
+                                     PERCENTILE_HISTOGRAM_FINE)
+
+typedef struct
+{
+  gint   *pixels;     /* indices of the source pixels in the bin */
+  gint    items;
+  gint    size;
+  gfloat  luma;       /* luminance of the first pixel binned ... */
+  gint    other;      /* ... and the number of pixels differing from it */
+} PercentileBin;
+
+typedef struct
+{
+  const gfloat  *src_buf;
+  gfloat        *lumas;  /* luminance of every source pixel */
+  gint          *slots;  /* position of every source pixel in its bin */
+  gint           items;
+  gint           coarse[PERCENTILE_HISTOGRAM_COARSE];
+  PercentileBin  bins[PERCENTILE_HISTOGRAM_LEVELS];
+} PercentileHistogram;
+
+static inline gfloat
+percentile_luma (const gfloat *pixel)
+{
+  return pixel[0] * 0.212671 +
+         pixel[1] * 0.715160 +
+         pixel[2] * 0.072169;
+}
+
+static inline gint
+percentile_histogram_level (gfloat luma)
+{
+  gint level = luma * (PERCENTILE_HISTOGRAM_LEVELS - 1) + 0.5;
+
+  return CLAMP (level, 0, PERCENTILE_HISTOGRAM_LEVELS - 1);
+}
+
+/* Reorders the n source pixel indices so that the one with the rank-th
+ * lowest luminance ends up at pixels[rank], and returns it.
+ */
+static inline gint
+percentile_select (gint         *pixels,
+                   gint          n,
+                   const gfloat *lumas,
+                   gint          rank)
+{
+  gint lo = 0;
+  gint hi = n - 1;
+
+  while (lo < hi)
+    {
+      gfloat pivot = lumas[pixels[(lo + hi) / 2]];
+      gint   i     = lo;
+      gint   j     = hi;
+
+      while (i <= j)
+        {
+          while (lumas[pixels[i]] < pivot)
+            i++;
+          while (lumas[pixels[j]] > pivot)
+            j--;
+          if (i <= j)
+            {
+              gint tmp  = pixels[i];
+              pixels[i] = pixels[j];
+              pixels[j] = tmp;
+              i++;
+              j--;
+            }
+        }
+
+      if (rank <= j)
+        hi = j;
+      else if (rank >= i)
+        lo = i;
+      else
+        break;
+    }
+
+  return pixels[rank];
+}
+
+/* the rank a percentile (0.0-1.0) of items sorted pixels falls on */
+static inline gint
+percentile_rank (gint    items,
+                 gdouble percentile)
+{
+  if (percentile >= 1.0)
+    percentile = 1.0;
+
+  return MIN (ceil (items * percentile), items - 1);
+}
+
+static inline PercentileHistogram *
+percentile_histogram_new (const gfloat *src_buf,
+                          gint          n_pixels)
+{
+  PercentileHistogram *hist = g_new0 (PercentileHistogram, 1);
+  gint                 i;
+
+  hist->src_buf = src_buf;
+  hist->lumas   = g_new (gfloat, n_pixels);
+  hist->slots   = g_new (gint, n_pixels);
+
+  for (i = 0; i < n_pixels; i++)
+    hist->lumas[i] = percentile_luma (src_buf + i * 4);
+
+  return hist;
+}
+
+static inline void
+percentile_histogram_free (PercentileHistogram *hist)
+{
+  gint level;
+
+  for (level = 0; level < PERCENTILE_HISTOGRAM_LEVELS; level++)
+    g_free (hist->bins[level].pixels);
+
+  g_free (hist->lumas);
+  g_free (hist->slots);
+  g_free (hist);
+}
+
+static inline void
+percentile_histogram_add (PercentileHistogram *hist,
+                          gint                 index)
+{
+  gfloat         luma  = hist->lumas[index];
+  gint           level = percentile_histogram_level (luma);
+  PercentileBin *bin   = &hist->bins[level];
+
+  if (bin->items == bin->size)
+    {
+      bin->size   = MAX (bin->size * 2, 8);
+      bin->pixels = g_renew (gint, bin->pixels, bin->size);
+    }
+
+  if (bin->items == 0)
+    bin->luma = luma;
+  else if (luma != bin->luma)
+    bin->other++;
+
+  hist->slots[index]         = bin->items;
+  bin->pixels[bin->items++]  = index;
+
+  hist->items++;
+  hist->coarse[level / PERCENTILE_HISTOGRAM_FINE]++;
+}
+
+/* removes a pixel that has been added, pixels can only be in the
+ * histogram once
+ */
+static inline void
+percentile_histogram_remove (PercentileHistogram *hist,
+                             gint                 index)
+{
+  gfloat         luma  = hist->lumas[index];
+  gint           level = percentile_histogram_level (luma);
+  PercentileBin *bin   = &hist->bins[level];
+  gint           slot  = hist->slots[index];
+  gint           last  = bin->pixels[--bin->items];
+
+  bin->pixels[slot]  = last;
+  hist->slots[last]  = slot;
+
+  if (luma != bin->luma)
+    bin->other--;
+
+  hist->items--;
+  hist->coarse[level / PERCENTILE_HISTOGRAM_FINE]--;
+}
+
+/* Stores the pixel at the given percentile (0.0-1.0) of the pixels in the
+ * histogram in result, the one sorting them by luminance and walking
+ * percentile * items steps would pick.
+ */
+static inline void
+percentile_histogram_get (PercentileHistogram *hist,
+                          gdouble              percentile,
+                          gfloat              *result)
+{
+  PercentileBin *bin;
+  gint           rank;
+  gint           seen = 0;
+  gint           coarse;
+  gint           level;
+  gint           index;
+  gint           i;
+
+  if (hist->items == 0)
+    {
+      result[0] = result[1] = result[2] = result[3] = 0.0;
+      return;
+    }
+
+  rank = percentile_rank (hist->items, percentile);
+
+  for (coarse = 0; coarse < PERCENTILE_HISTOGRAM_COARSE - 1; coarse++)
+    {
+      if (seen + hist->coarse[coarse] > rank)
+        break;
+      seen += hist->coarse[coarse];
+    }
+
+  for (level = coarse * PERCENTILE_HISTOGRAM_FINE;
+       level < PERCENTILE_HISTOGRAM_LEVELS - 1;
+       level++)
+    {
+      if (seen + hist->bins[level].items > rank)
+        break;
+      seen += hist->bins[level].items;
+    }
+
+  bin = &hist->bins[level];
+
+  if (bin->other == 0)
+    {
+      /* all pixels of the bin are equally bright, which is the common
+       * case in flat areas, any of them will do
+       */
+      index = bin->pixels[0];
+    }
+  else
+    {
+      index = percentile_select (bin->pixels, bin->items, hist->lumas,
+                                 rank - seen);
+      for (i = 0; i < bin->items; i++)
+        hist->slots[bin->pixels[i]] = i;
+    }
+
+  memcpy (result, hist->src_buf + index * 4, sizeof (gfloat) * 4);
+}
+
+static inline void
+percentile_histogram_update (PercentileHistogram *hist,
+                             const gfloat        *src_buf,
+                             const GeglRectangle *valid,
+                             gint                 src_width,
+                             gint                 u,
+                             gint                 v,
+                             gboolean             add)
+{
+  if (u <  valid->x || u >= valid->x + valid->width ||
+      v <  valid->y || v >= valid->y + valid->height)
+    return;
+
+  if (add)
+    percentile_histogram_add (hist, u + v * src_width);
+  else
+    percentile_histogram_remove (hist, u + v * src_width);
+}
+
+/* Runs a sliding window percentile filter over the src_width x src_height
+ * RGBA float pixels of src_buf, writing dst_width x dst_height RGBA float
+ * pixels to dst_buf. The window for dst pixel
+ * (x, y) is centered on src pixel (x + radius, y + radius) and covers the
+ * pixels (dx, dy) away from it with |dx| <= half_widths[dy + radius];
+ * the window must be symmetric under transposition (like squares and
+ * discs). Source pixels outside of valid are not counted.
+ */
+static inline void
+percentile_histogram_filter (const gfloat        *src_buf,
+                             gint                 src_width,
+                             gint                 src_height,
+                             const GeglRectangle *valid,
+                             gfloat              *dst_buf,
+                             gint                 dst_width,
+                             gint                 dst_height,
+                             gint                 radius,
+                             const gint          *half_widths,
+                             gdouble              percentile)
+{
+  PercentileHistogram *hist = percentile_histogram_new (src_buf,
+                                                        src_width * src_height);
+  const gint          *w    = half_widths + radius;
+  gint                 x = 0, y, d, i;
+
+  for (d = -radius; d <= radius; d++)
+    for (i = -w[d]; i <= w[d]; i++)
+      percentile_histogram_update (hist, src_buf, valid, src_width,
+                                   radius + i, radius + d, TRUE);
+
+  for (y = 0; y < dst_height; y++)
+    {
+      gint step = (y % 2 == 0) ? 1 : -1;
+
+      if (y > 0)
+        {
+          /* move the window down by one row, keeping x */
+          for (d = -radius; d <= radius; d++)
+            {
+              if (w[d] < 0)
+                continue;
+              percentile_histogram_update (hist, src_buf, valid, src_width,
+                                           x + radius + d,
+                                           y - 1 + radius - w[d], FALSE);
+              percentile_histogram_update (hist, src_buf, valid, src_width,
+                                           x + radius + d,
+                                           y + radius + w[d], TRUE);
+            }
+        }
+
+      while (TRUE)
+        {
+          percentile_histogram_get (hist, percentile,
+                                    dst_buf + (x + y * dst_width) * 4);
+
+          if (x + step < 0 || x + step >= dst_width)
+            break;
+
+          /* move the window horizontally by one column */
+          for (d = -radius; d <= radius; d++)
+            {
+              if (w[d] < 0)
+                continue;
+              percentile_histogram_update (hist, src_buf, valid, src_width,
+                                           x + radius - step * w[d],
+                                           y + radius + d, FALSE);
+              percentile_histogram_update (hist, src_buf, valid, src_width,
+                                           x + step + radius + step * w[d],
+                                           y + radius + d, TRUE);
+            }
+          x += step;
+        }
+    }
+
+  percentile_histogram_free (hist);
+}
+
+#endif
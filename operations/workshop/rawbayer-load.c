@@ -39,6 +39,9 @@ gegl_chant_string (path, _("File"), "/tmp/test.raw", _("Path of file to load."))
 #define MAX_SAMPLE 65535
 #define ERROR -1
 
+/* Number of sensor rows read from dcraw at a time. */
+#define BAND_HEIGHT 64
+
 static void
 load_buffer (GeglChantO *op_raw_load)
 {
@@ -66,32 +69,50 @@ load_buffer (GeglChantO *op_raw_load)
         GeglRectangle extent = { 0, 0, width, height };
         op_raw_load->chant_data = (void*)gegl_buffer_new (&extent, babl_format ("Y u16"));
       }
-         {
-           guchar *buf = g_new (guchar, width * height * 3 * 2);
-           fread (buf, 1, width * height * 3 * 2, pfp);
-           if(strstr (op_raw_load->path, "rawbayerS")){
-             gint i;
-             for (i=0;i<width*height*3;i++)
-               {
-                guchar tmp = buf[i*2];
-                buf[i*2] = buf[i*2+1];
-                buf[i*2+1] = tmp;
-               }
-           }
-           gegl_buffer_set (GEGL_BUFFER (op_raw_load->chant_data),
-                            NULL,
-                            babl_format_new (
-                                 babl_model ("RGB"),
-                                 babl_type ("u16"),
-                                 babl_component ("R"),
-                                 babl_component ("G"),
-                                 babl_component ("B"),
-                                 NULL),
-                            buf,
-                            GEGL_AUTO_ROWSTRIDE);
-           g_free (buf);
-         }
-       fclose (pfp);
+      {
+        const Babl    *format = babl_format_new (babl_model ("RGB"),
+                                                 babl_type ("u16"),
+                                                 babl_component ("R"),
+                                                 babl_component ("G"),
+                                                 babl_component ("B"),
+                                                 NULL);
+        gboolean       swap   = strstr (op_raw_load->path, "rawbayerS") != NULL;
+        gsize          stride = width * 3 * 2;
+        guchar        *buf    = g_new (guchar, stride * MIN (BAND_HEIGHT, height));
+        GeglRectangle  band   = { 0, 0, width, 0 };
+
+        /* copy the sensor rows into the buffer a band at a time as they
+         * arrive from dcraw, rather than staging the whole image
+         */
+        for (band.y = 0; band.y < height; band.y += BAND_HEIGHT)
+          {
+            band.height = MIN (BAND_HEIGHT, height - band.y);
+
+            if (fread (buf, stride, band.height, pfp) != (gsize) band.height)
+              {
+                g_warning ("short read of raw data");
+                break;
+              }
+
+            if (swap)
+              {
+                gsize i;
+
+                for (i = 0; i < stride * band.height; i += 2)
+                  {
+                    guchar tmp = buf[i];
+                    buf[i] = buf[i+1];
+                    buf[i+1] = tmp;
+                  }
+              }
+
+            gegl_buffer_set (GEGL_BUFFER (op_raw_load->chant_data), &band,
+                             format, buf, GEGL_AUTO_ROWSTRIDE);
+          }
+
+        g_free (buf);
+      }
+      pclose (pfp);
     }
 }
 
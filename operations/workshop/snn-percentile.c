@@ -33,24 +33,13 @@ gegl_chant_double (percentile, _("Percentile"), 0.0, 100.0, 50.0,
 
 #else
 
-#define MAX_SAMPLES 20000 /* adapted to percentile level of radius */
-
 #define GEGL_CHANT_TYPE_AREA_FILTER
 #define GEGL_CHANT_C_FILE       "snn-percentile.c"
 
 #include "gegl-chant.h"
 #include <math.h>
 
-#define RGB_LUMINANCE_RED    (0.212671)
-#define RGB_LUMINANCE_GREEN  (0.715160)
-#define RGB_LUMINANCE_BLUE   (0.072169)
-
-static inline gfloat rgb2luminance (gfloat *pix)
-{
-  return pix[0] * RGB_LUMINANCE_RED +
-         pix[1] * RGB_LUMINANCE_GREEN +
-         pix[2] * RGB_LUMINANCE_BLUE;
-}
+#include "percentile-histogram.h"
 
 #define POW2(a)((a)*(a))
 
@@ -62,116 +51,70 @@ static inline gfloat colordiff (gfloat *pixA,
          POW2(pixA[2]-pixB[2]);
 }
 
-typedef struct
-{
-  int       head;
-  int       next[MAX_SAMPLES];
-  float     luma[MAX_SAMPLES];
-  float    *pixel[MAX_SAMPLES];
-  int       items;
-} RankList;
-
-static void
-list_clear (RankList * p)
-{
-  p->items = 0;
-  p->next[0] = -1;
-}
-
-static inline void
-list_add (RankList *p,
-          gfloat    lumniosity,
-          gfloat   *pixel)
-{
-  gint location;
-
-  location = p->items;
-
-  p->items++;
-  p->luma[location] = lumniosity;
-  p->pixel[location] = pixel;
-  p->next[location] = -1;
-
-  if (p->items == 1)
-    {
-      p->head = location;
-      return;
-    }
-  if (lumniosity <= p->luma[p->head])
-    {
-      p->next[location] = p->head;
-      p->head = location;
-    }
-  else
-    {
-      gint   prev, i;
-      prev = p->head;
-      i = prev;
-      while (i >= 0 && p->luma[i] < lumniosity)
-        {
-          prev = i;
-          i = p->next[i];
-        }
-      p->next[location] = p->next[prev];
-      p->next[prev] = location;
-    }
-}
-
-static inline gfloat *
-list_percentile (RankList *p,
-                 gdouble   percentile)
-{
-  gint       i = p->head;
-  gint       pos = 0;
-  if (!p->items)
-    return NULL;
-  if (percentile >= 1.0)
-    percentile = 1.0;
-  while (pos < p->items * percentile &&
-         p->pixel[p->next[i]])
-    {
-      i = p->next[i];
-      pos++;
-    }
-  return p->pixel[i];
-}
-
 static void
-snn_percentile (GeglBuffer *src,
-                GeglBuffer *dst,
-                gdouble     radius,
-                gdouble     percentile,
-                gint        pairs)
+snn_percentile (GeglBuffer          *src,
+                GeglBuffer          *dst,
+                const GeglRectangle *dst_rect,
+                const GeglRectangle *valid,
+                gint                 radius,
+                gdouble              percentile,
+                gint                 pairs)
 {
-  gint    x, y;
-  gint    offset;
-  gfloat *src_buf;
-  gfloat *dst_buf;
-  RankList list = {0};
-
-  src_buf = g_new0 (gfloat, gegl_buffer_get_pixel_count (src) * 4);
-  dst_buf = g_new0 (gfloat, gegl_buffer_get_pixel_count (dst) * 4);
-
-  gegl_buffer_get (src, 1.0, NULL, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
+  gint                 x, y;
+  gint                 offset;
+  GeglRectangle        src_rect = *dst_rect;
+  GeglRectangle        src_valid;
+  gint                 src_width;
+  gfloat              *src_buf;
+  gfloat              *dst_buf;
+  gfloat              *lumas;
+  gint                *selected;
+  gint                 n_selected;
+  gint                 i;
+
+  src_rect.x      -= radius;
+  src_rect.y      -= radius;
+  src_rect.width  += radius * 2;
+  src_rect.height += radius * 2;
+  src_width = src_rect.width;
+
+  /* pairs reaching outside of the input are not considered */
+  src_valid = src_rect;
+  if (valid)
+    gegl_rectangle_intersect (&src_valid, &src_rect, valid);
+  src_valid.x -= src_rect.x;
+  src_valid.y -= src_rect.y;
+
+  src_buf = g_new0 (gfloat, src_rect.width * src_rect.height * 4);
+  dst_buf = g_new0 (gfloat, dst_rect->width * dst_rect->height * 4);
+  selected = g_new (gint, (radius + 1) * (radius * 2 + 1));
+  lumas = g_new (gfloat, src_rect.width * src_rect.height);
+
+  gegl_buffer_get (src, 1.0, &src_rect, babl_format ("RGBA float"), src_buf, GEGL_AUTO_ROWSTRIDE);
+
+  for (i = 0; i < src_rect.width * src_rect.height; i++)
+    lumas[i] = percentile_luma (src_buf + i * 4);
 
   offset = 0;
   percentile/= 100.0;
 
-  for (y=0; y<gegl_buffer_get_height (dst); y++)
-    for (x=0; x<gegl_buffer_get_width (dst); x++)
+  for (y=0; y<dst_rect->height; y++)
+    for (x=0; x<dst_rect->width; x++)
       {
         gint u,v;
-        gfloat *center_pix = src_buf + offset * 4;
+        gint cx = x + radius;
+        gint cy = y + radius;
+        gint center = cx + cy * src_width;
+        gfloat *center_pix = src_buf + center * 4;
 
-        list_clear (&list);
+        n_selected = 0;
 
         /* iterate through the upper left quater of pixels */
         for (v=-radius;v<=0;v++)
           for (u=-radius;u<= (pairs==1?radius:0);u++)
             {
-              gfloat *selected_pix = center_pix;
+              gint    selected_pix = center;
               gfloat  best_diff = 1000.0;
-              gint    i;
 
               /* skip computations for the center pixel */
               if (u != 0 &&
@@ -180,39 +123,46 @@ snn_percentile (GeglBuffer *src,
                   /* compute the coordinates of the symmetric pairs for
                    * this locaiton in the quadrant
                    */
-                  gint xs[4] = {x+u, x-u, x-u, x+u};
-                  gint ys[4] = {y+v, y-v, y+v, y-v};
+                  gint xs[4] = {cx+u, cx-u, cx-u, cx+u};
+                  gint ys[4] = {cy+v, cy-v, cy+v, cy-v};
 
                   /* check which member of the symmetric quadruple to use */
                   for (i=0;i<pairs*2;i++)
                     {
-                      if (xs[i] >= 0 && xs[i] < gegl_buffer_get_width (src) &&
-                          ys[i] >= 0 && ys[i] < gegl_buffer_get_height (src))
+                      if (xs[i] >= src_valid.x &&
+                          xs[i] <  src_valid.x + src_valid.width &&
+                          ys[i] >= src_valid.y &&
+                          ys[i] <  src_valid.y + src_valid.height)
                         {
-                          gfloat *tpix = src_buf + (xs[i]+ys[i]*gegl_buffer_get_width (src))*4;
-                          gfloat diff = colordiff (tpix, center_pix);
+                          gint    t    = xs[i]+ys[i]*src_width;
+                          gfloat  diff = colordiff (src_buf + t * 4, center_pix);
                           if (diff < best_diff)
                             {
                               best_diff = diff;
-                              selected_pix = tpix;
+                              selected_pix = t;
                             }
                         }
                     }
                 }
 
-              list_add (&list, rgb2luminance(selected_pix), selected_pix);
+              selected[n_selected++] = selected_pix;
 
               if (u==0 && v==0)
                 break; /* to avoid doubly processing when using only 1 pair */
             }
-        {
-          gfloat *result = list_percentile (&list, percentile);
-          for (u=0; u<4; u++)
-            dst_buf[offset*4+u] = result[u];
-        }
+
+        /* the selection depends on the center pixel, so pick the
+         * percentile among the selected pixels directly
+         */
+        i = percentile_select (selected, n_selected, lumas,
+                               percentile_rank (n_selected, percentile));
+        memcpy (dst_buf + offset * 4, src_buf + i * 4, sizeof (gfloat) * 4);
+
         offset++;
       }
-  gegl_buffer_set (dst, NULL, babl_format ("RGBA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (dst, dst_rect, babl_format ("RGBA float"), dst_buf, GEGL_AUTO_ROWSTRIDE);
+  g_free (selected);
+  g_free (lumas);
   g_free (src_buf);
   g_free (dst_buf);
 }
@@ -244,7 +194,9 @@ process (GeglOperation       *operation,
   else
     {
       temp_in = gegl_buffer_create_sub_buffer (input, &compute);
-      snn_percentile (temp_in, output, o->radius, o->percentile, o->pairs);
+      snn_percentile (temp_in, output, result,
+                      gegl_operation_source_get_bounding_box (operation, "input"),
+                      o->radius, o->percentile, o->pairs);
       g_object_unref (temp_in);
     }
 
@@ -0,0 +1,44 @@
+#include "test-common.h"
+
+static void
+test_scale (GeglBuffer  *buffer,
+            const gchar *filter,
+            gdouble      factor,
+            const gchar *id)
+{
+  GeglBuffer *buffer2;
+  GeglNode   *gegl, *sink;
+
+  gegl = gegl_graph (sink = gegl_node ("gegl:buffer-sink", "buffer", &buffer2, NULL,
+                            gegl_node ("gegl:scale", "x", factor, "y", factor,
+                                                     "filter", filter, NULL,
+                            gegl_node ("gegl:buffer-source", "buffer", buffer, NULL))));
+
+  test_start ();
+  gegl_node_process (sink);
+  test_end (id, gegl_buffer_get_pixel_count (buffer2) * 16);
+
+  g_object_unref (buffer2);
+  g_object_unref (gegl);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglBuffer *buffer;
+
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  buffer = test_buffer (1024, 1024, babl_format ("RGBA float"));
+
+  test_scale (buffer, "lanczos", 1.5, "scale-lanczos-up");
+  test_scale (buffer, "lanczos", 0.7, "scale-lanczos-down");
+  test_scale (buffer, "lohalo", 1.5, "scale-lohalo-up");
+  test_scale (buffer, "lohalo", 0.3, "scale-lohalo-down");
+
+  g_object_unref (buffer);
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/affine-mipmap/" #function, function);
+
+#define SIZE   256
+#define SCALE  0.25
+#define OUT    ((gint) (SIZE * SCALE))
+#define BORDER 4
+
+
+/* a one pixel checkerboard, every 2x2 block of it averages to 0.5 */
+static GeglBuffer *
+checker_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, SIZE, SIZE };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("Y float"));
+  gfloat        *pixels = g_new (gfloat, SIZE * SIZE);
+  gint           x, y;
+
+  for (y = 0; y < SIZE; y++)
+    for (x = 0; x < SIZE; x++)
+      pixels[y * SIZE + x] = (x + y) & 1;
+
+  gegl_buffer_set (buffer, &extent, babl_format ("Y float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_free (pixels);
+
+  return buffer;
+}
+
+/* scales the checkerboard down by SCALE with filter at the given quality */
+static gfloat *
+scale_checker (const gchar *filter,
+               gdouble      quality)
+{
+  GeglBuffer    *buffer = checker_buffer ();
+  GeglRectangle  rect   = { 0, 0, OUT, OUT };
+  gfloat        *pixels = g_new (gfloat, OUT * OUT);
+  GeglNode      *graph, *source, *scale;
+
+  g_object_set (gegl_config (), "quality", quality, NULL);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  scale  = gegl_node_new_child (graph,
+                                "operation", "gegl:scale",
+                                "x", SCALE,
+                                "y", SCALE,
+                                "filter", filter,
+                                NULL);
+  gegl_node_link (source, scale);
+
+  gegl_node_blit (scale, 1.0, &rect, babl_format ("Y float"), pixels,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+  g_object_set (gegl_config (), "quality", 1.0, NULL);
+
+  return pixels;
+}
+
+/**
+ * Tests that a downscale by 4x at reduced quality resamples the mipmap
+ * level, where the checkerboard has been averaged to a flat grey, instead
+ * of point sampling the full resolution pixels.
+ **/
+static void
+downscale_reads_mipmap (void)
+{
+  gfloat *pixels = scale_checker ("linear", 0.5);
+  gint    x, y;
+
+  for (y = BORDER; y < OUT - BORDER; y++)
+    for (x = BORDER; x < OUT - BORDER; x++)
+      g_assert_cmpfloat (fabs (pixels[y * OUT + x] - 0.5), <, 1e-4);
+
+  g_free (pixels);
+}
+
+/**
+ * Tests that nearest keeps picking source pixels at reduced quality,
+ * rather than the averages from the mipmap level.
+ **/
+static void
+nearest_skips_mipmap (void)
+{
+  gfloat *pixels = scale_checker ("nearest", 0.5);
+  gint    x, y;
+
+  for (y = BORDER; y < OUT - BORDER; y++)
+    for (x = BORDER; x < OUT - BORDER; x++)
+      g_assert (pixels[y * OUT + x] == 0.0 || pixels[y * OUT + x] == 1.0);
+
+  g_free (pixels);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (downscale_reads_mipmap);
+  ADD_TEST (nearest_skips_mipmap);
+
+  return g_test_run ();
+}
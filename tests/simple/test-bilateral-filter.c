@@ -0,0 +1,207 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares gegl:bilateral-filter against a direct evaluation of the
+ * bilateral filter. Small radii run the direct filter in the operation and
+ * must match closely. Large radii run the bilateral grid, which weights
+ * every channel by its own differences and samples the grid at one
+ * standard deviation, on this image that stays within a mean absolute
+ * error of 0.02 and a maximum error of 0.15, the maximum being reached
+ * next to the strong edge.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define SIZE     128
+#define MARGIN   40  /* keeps the neighbourhoods of the roi inside the image */
+
+typedef struct
+{
+  gdouble radius;
+  gdouble preserve;
+  gdouble max_mean_error;
+  gdouble max_error;
+} BilateralTestCase;
+
+static BilateralTestCase tests[] =
+{
+  /* direct filter */
+  {  4.0, 8.0, 1e-5, 1e-4 },
+  {  8.0, 2.0, 1e-5, 1e-4 },
+  /* bilateral grid */
+  { 12.0, 8.0, 0.02, 0.15 },
+  { 30.0, 8.0, 0.02, 0.15 }
+};
+
+static gfloat
+noise (gint x,
+       gint y)
+{
+  guint32 hash = (x * 73856093u) ^ (y * 19349663u);
+
+  hash ^= hash >> 13;
+  hash *= 0x5bd1e995u;
+  hash ^= hash >> 15;
+
+  return (hash & 0xffff) / 65535.0f - 0.5f;
+}
+
+static void
+make_image (gfloat *pixels)
+{
+  gint x, y;
+
+  for (y = 0; y < SIZE; y++)
+    for (x = 0; x < SIZE; x++)
+      {
+        gfloat *pixel = pixels + (y * SIZE + x) * 4;
+        gfloat  base  = x + y * 0.5 > SIZE * 0.7 ? 0.8 : 0.2;
+
+        pixel[0] = base + 0.002 * x + 0.03 * noise (x, y);
+        pixel[1] = base * 0.5 + 0.1 * sin (y * 0.05);
+        pixel[2] = 1.0 - base + 0.03 * noise (y, x);
+        pixel[3] = 1.0;
+      }
+}
+
+static void
+reference (const gfloat *pixels,
+           gint          x,
+           gint          y,
+           gdouble       radius,
+           gdouble       preserve,
+           gfloat       *result)
+{
+  const gfloat *center  = pixels + (y * SIZE + x) * 4;
+  gint          iradius = radius;
+  gdouble       sum[4]  = { 0.0, 0.0, 0.0, 0.0 };
+  gdouble       count   = 0.0;
+  gint          u, v, c;
+
+  for (v = -iradius; v <= iradius; v++)
+    for (u = -iradius; u <= iradius; u++)
+      {
+        const gfloat *pixel = pixels + ((y + v) * SIZE + x + u) * 4;
+        gdouble       diff  = 0.0;
+        gdouble       weight;
+
+        for (c = 0; c < 3; c++)
+          diff += (center[c] - pixel[c]) * (center[c] - pixel[c]);
+
+        weight = exp (-diff * preserve) * exp (-0.5 * (u * u + v * v) / radius);
+
+        for (c = 0; c < 4; c++)
+          sum[c] += pixel[c] * weight;
+        count += weight;
+      }
+
+  for (c = 0; c < 4; c++)
+    result[c] = sum[c] / count;
+}
+
+static gboolean
+test_bilateral_filter (GeglNode                *filter,
+                       const gfloat            *pixels,
+                       const BilateralTestCase *test)
+{
+  GeglRectangle roi    = { MARGIN, MARGIN, SIZE - 2 * MARGIN, SIZE - 2 * MARGIN };
+  gfloat       *output = g_new (gfloat, roi.width * roi.height * 4);
+  gdouble       mean   = 0.0;
+  gdouble       max    = 0.0;
+  gint          x, y, c;
+
+  gegl_node_set (filter,
+                 "blur_radius",       test->radius,
+                 "edge_preservation", test->preserve,
+                 NULL);
+  gegl_node_blit (filter, 1.0, &roi, babl_format ("RGBA float"), output,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (y = 0; y < roi.height; y++)
+    for (x = 0; x < roi.width; x++)
+      {
+        gfloat expected[4];
+
+        reference (pixels, roi.x + x, roi.y + y,
+                   test->radius, test->preserve, expected);
+
+        for (c = 0; c < 4; c++)
+          {
+            gdouble error = fabs (output[(y * roi.width + x) * 4 + c] -
+                                  expected[c]);
+
+            mean += error;
+            max   = MAX (max, error);
+          }
+      }
+
+  mean /= roi.width * roi.height * 4;
+  g_free (output);
+
+  if (mean > test->max_mean_error || max > test->max_error)
+    {
+      g_printerr ("bilateral-filter radius %g preservation %g: "
+                  "mean error %g, max error %g\n",
+                  test->radius, test->preserve, mean, max);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+int main (int argc, char *argv[])
+{
+  GeglRectangle  extent = { 0, 0, SIZE, SIZE };
+  gfloat        *pixels = g_new (gfloat, SIZE * SIZE * 4);
+  GeglBuffer    *buffer;
+  GeglNode      *graph, *source, *filter;
+  gboolean       result = TRUE;
+  gint           i;
+
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  make_image (pixels);
+  buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer",    buffer,
+                                NULL);
+  filter = gegl_node_new_child (graph,
+                                "operation", "gegl:bilateral-filter",
+                                NULL);
+  gegl_node_link (source, filter);
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    result = test_bilateral_filter (filter, pixels, &tests[i]) && result;
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+  g_free (pixels);
+  gegl_exit ();
+
+  return result ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,257 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include <gegl.h>
+#include "gegl-buffer-index.h"
+
+
+#define ADD_TEST(function) g_test_add_func ("/buffer-save/" #function, function);
+
+#define WIDTH  300
+#define HEIGHT 200
+
+#define TILE_WIDTH  64
+#define TILE_HEIGHT 64
+
+
+static GeglBuffer *
+pattern_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+  gint           x, y;
+
+  /* smooth gradients, with a noisy corner that won't compress */
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        gfloat *p = pixels + (y * WIDTH + x) * 4;
+
+        p[0] = x / (gfloat) WIDTH;
+        p[1] = y / (gfloat) HEIGHT;
+        p[2] = (x < 40 && y < 40) ? g_random_double () : 0.5;
+        p[3] = 1.0;
+      }
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_free (pixels);
+
+  return buffer;
+}
+
+static gboolean
+buffers_equal (GeglBuffer *a,
+               GeglBuffer *b)
+{
+  GeglRectangle  all = { 0, 0, WIDTH, HEIGHT };
+  gint           n = WIDTH * HEIGHT * 4;
+  gfloat        *pa = g_new (gfloat, n);
+  gfloat        *pb = g_new (gfloat, n);
+  gboolean       equal;
+
+  gegl_buffer_get (a, 1.0, &all, babl_format ("RGBA float"), pa,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_get (b, 1.0, &all, babl_format ("RGBA float"), pb,
+                   GEGL_AUTO_ROWSTRIDE);
+  equal = !memcmp (pa, pb, n * sizeof (gfloat));
+
+  g_free (pa);
+  g_free (pb);
+
+  return equal;
+}
+
+static gchar *
+temporary_path (void)
+{
+  gchar *path;
+  gint   fd;
+
+  fd = g_file_open_tmp ("test-buffer-save-XXXXXX", &path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+
+  return path;
+}
+
+/* checks that path loads back as the pixels of buffer, both through
+ * gegl_buffer_load and gegl_buffer_open
+ */
+static void
+assert_loads_as (const gchar *path,
+                 GeglBuffer  *buffer)
+{
+  GeglBuffer *loaded;
+
+  loaded = gegl_buffer_load (path);
+  g_assert (loaded != NULL);
+  g_assert (buffers_equal (buffer, loaded));
+  g_object_unref (loaded);
+
+  loaded = gegl_buffer_open (path);
+  g_assert (loaded != NULL);
+  g_assert (buffers_equal (buffer, loaded));
+  g_object_unref (loaded);
+}
+
+static void
+round_trip (gint threads)
+{
+  GeglBuffer  *buffer = pattern_buffer ();
+  struct stat  st;
+  gchar       *path   = temporary_path ();
+
+  g_object_set (gegl_config (), "threads", threads, NULL);
+  gegl_buffer_save (buffer, path, NULL);
+
+  g_assert (g_stat (path, &st) == 0);
+  g_assert (st.st_size < (goffset) (WIDTH * HEIGHT * 4 * sizeof (gfloat) / 3));
+
+  assert_loads_as (path, buffer);
+  g_object_set (gegl_config (), "threads", 1, NULL);
+
+  g_unlink (path);
+  g_free (path);
+  g_object_unref (buffer);
+}
+
+/**
+ * Tests that a saved buffer comes back bit exact through both
+ * gegl_buffer_load and gegl_buffer_open, and that the compressed tiles
+ * make the file smaller than the pixel data.
+ **/
+static void
+save_load_round_trip (void)
+{
+  round_trip (1);
+}
+
+/**
+ * Tests the same with the tiles compressed and decompressed on several
+ * threads.
+ **/
+static void
+save_load_round_trip_threaded (void)
+{
+  round_trip (4);
+}
+
+/* Writes buffer the way revision 0 of the format stored it: the header, an
+ * index of GeglBufferTile entries chained through block.next, then the raw
+ * tiles in the order of the index.
+ */
+static void
+save_revision_0 (GeglBuffer  *buffer,
+                 const gchar *path)
+{
+  const Babl       *format     = babl_format ("RGBA float");
+  gint              bpp        = babl_format_get_bytes_per_pixel (format);
+  gint              tiles_x    = (WIDTH  + TILE_WIDTH  - 1) / TILE_WIDTH;
+  gint              tiles_y    = (HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  gint              n_tiles    = tiles_x * tiles_y;
+  gsize             tile_size  = TILE_WIDTH * TILE_HEIGHT * bpp;
+  guint64           data_start = sizeof (GeglBufferHeader) +
+                                 n_tiles * sizeof (GeglBufferTile);
+  GeglBufferHeader  header;
+  guchar           *data       = g_malloc (tile_size);
+  FILE             *fp         = fopen (path, "wb");
+  gsize             written;
+  gint              i;
+
+  g_assert (fp);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, "GEGL", 4);
+  header.flags           = GEGL_FLAG_FLUSHED | GEGL_FLAG_IS_HEADER;
+  header.next            = sizeof (GeglBufferHeader);
+  header.tile_width      = TILE_WIDTH;
+  header.tile_height     = TILE_HEIGHT;
+  header.bytes_per_pixel = bpp;
+  header.width           = WIDTH;
+  header.height          = HEIGHT;
+  strcpy (header.description, babl_get_name (format));
+  written = fwrite (&header, sizeof (header), 1, fp);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GeglBufferTile entry;
+
+      memset (&entry, 0, sizeof (entry));
+      entry.block.length = sizeof (GeglBufferTile);
+      entry.block.flags  = GEGL_FLAG_TILE;
+      entry.block.next   = i + 1 < n_tiles ?
+                           sizeof (GeglBufferHeader) +
+                           (i + 1) * sizeof (GeglBufferTile) : 0;
+      entry.offset       = data_start + i * tile_size;
+      entry.x            = i % tiles_x;
+      entry.y            = i / tiles_x;
+      written += fwrite (&entry, sizeof (entry), 1, fp);
+    }
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GeglRectangle rect = { (i % tiles_x) * TILE_WIDTH,
+                             (i / tiles_x) * TILE_HEIGHT,
+                             TILE_WIDTH, TILE_HEIGHT };
+
+      gegl_buffer_get (buffer, 1.0, &rect, format, data, GEGL_AUTO_ROWSTRIDE);
+      written += fwrite (data, tile_size, 1, fp);
+    }
+
+  g_assert_cmpint (written, ==, 1 + 2 * n_tiles);
+  fclose (fp);
+  g_free (data);
+}
+
+/**
+ * Tests that files written before tiles were compressed still load, both
+ * through gegl_buffer_load and gegl_buffer_open.
+ **/
+static void
+load_revision_0 (void)
+{
+  GeglBuffer *buffer = pattern_buffer ();
+  gchar      *path   = temporary_path ();
+
+  save_revision_0 (buffer, path);
+  assert_loads_as (path, buffer);
+
+  g_unlink (path);
+  g_free (path);
+  g_object_unref (buffer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (save_load_round_trip);
+  ADD_TEST (save_load_round_trip_threaded);
+  ADD_TEST (load_revision_0);
+
+  return g_test_run ();
+}
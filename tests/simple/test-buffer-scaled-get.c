@@ -0,0 +1,138 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/buffer-scaled-get/" #function, function);
+
+#define SIZE 300
+
+/* the u8 box filter rounds the source to 8bit and truncates the weighted
+ * sum, the u16 one does the same at 16bit
+ */
+#define U8_TOLERANCE  (2.0 / 255.0)
+#define U16_TOLERANCE (3.0 / 65535.0)
+
+/* scales at and between mipmap levels, 0.5 and 0.25 are read from a level
+ * with a remaining scale of 1.0 and box filtered all the same
+ */
+static const gdouble scales[] = { 0.75, 0.5, 0.3, 0.25, 0.1 };
+
+
+static GeglBuffer *
+noise_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, SIZE, SIZE };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *pixels = g_new (gfloat, SIZE * SIZE * 4);
+  GRand         *rand   = g_rand_new_with_seed (SIZE);
+  gint           i;
+
+  for (i = 0; i < SIZE * SIZE; i++)
+    {
+      pixels[i * 4 + 0] = g_rand_double (rand);
+      pixels[i * 4 + 1] = g_rand_double (rand);
+      pixels[i * 4 + 2] = (i % SIZE) / (gfloat) SIZE;
+      pixels[i * 4 + 3] = 1.0;
+    }
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_rand_free (rand);
+  g_free (pixels);
+
+  return buffer;
+}
+
+/* reads the scaled buffer in format, and hands it back as floats */
+static gfloat *
+get_scaled (GeglBuffer          *buffer,
+            gdouble              scale,
+            const GeglRectangle *rect,
+            const gchar         *format)
+{
+  const Babl *babl   = babl_format (format);
+  gint        n      = rect->width * rect->height * 4;
+  guchar     *scaled = g_malloc (n * babl_format_get_bytes_per_pixel (babl) / 4);
+  gfloat     *pixels = g_new (gfloat, n);
+  gint        i;
+
+  gegl_buffer_get (buffer, scale, rect, babl, scaled, GEGL_AUTO_ROWSTRIDE);
+
+  for (i = 0; i < n; i++)
+    {
+      if (babl_format_get_type (babl, 0) == babl_type ("u8"))
+        pixels[i] = scaled[i] / 255.0;
+      else if (babl_format_get_type (babl, 0) == babl_type ("u16"))
+        pixels[i] = ((guint16 *) scaled)[i] / 65535.0;
+      else
+        pixels[i] = ((gfloat *) scaled)[i];
+    }
+
+  g_free (scaled);
+
+  return pixels;
+}
+
+/**
+ * Tests that scaled reads in u16 and float, which have box filters of their
+ * own, give the same pixels as the u8 box filter within the precision of
+ * each type.
+ **/
+static void
+box_filters_agree (void)
+{
+  GeglBuffer *buffer = noise_buffer ();
+  gint        i;
+
+  for (i = 0; i < G_N_ELEMENTS (scales); i++)
+    {
+      GeglRectangle  rect = { 3, 5,
+                              (SIZE - 10) * scales[i],
+                              (SIZE - 10) * scales[i] };
+      gfloat        *u8   = get_scaled (buffer, scales[i], &rect, "RGBA u8");
+      gfloat        *u16  = get_scaled (buffer, scales[i], &rect, "RGBA u16");
+      gfloat        *fl   = get_scaled (buffer, scales[i], &rect, "RGBA float");
+      gint           j;
+
+      for (j = 0; j < rect.width * rect.height * 4; j++)
+        {
+          g_assert_cmpfloat (fabs (fl[j] - u8[j]), <=, U8_TOLERANCE);
+          g_assert_cmpfloat (fabs (fl[j] - u16[j]), <=, U16_TOLERANCE);
+        }
+
+      g_free (u8);
+      g_free (u16);
+      g_free (fl);
+    }
+
+  g_object_unref (buffer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (box_filters_agree);
+
+  return g_test_run ();
+}
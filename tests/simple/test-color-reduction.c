@@ -0,0 +1,266 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/color-reduction/" #function, function);
+
+/* more rows than one band of the operation, mixed bit depths */
+#define WIDTH  203
+#define HEIGHT 150
+
+static const guint channel_bits[4] = { 3, 5, 2, 4 };
+
+
+static guint16 *
+pattern (void)
+{
+  guint16 *pixels = g_new (guint16, WIDTH * HEIGHT * 4);
+  GRand   *rand   = g_rand_new_with_seed (HEIGHT);
+  gint     i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      gint x = i % WIDTH;
+      gint y = i / WIDTH;
+
+      pixels[i * 4 + 0] = x * 65535 / (WIDTH - 1);
+      pixels[i * 4 + 1] = y * 65535 / (HEIGHT - 1);
+      pixels[i * 4 + 2] = g_rand_int_range (rand, 0, 65536);
+      pixels[i * 4 + 3] = (x + y) * 65535 / (WIDTH + HEIGHT - 2);
+    }
+
+  g_rand_free (rand);
+
+  return pixels;
+}
+
+static guint16 *
+render (const gchar   *dither_type,
+        const guint16 *pixels,
+        gint           threads)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA u16"));
+  guint16       *output = g_new (guint16, WIDTH * HEIGHT * 4);
+  GeglNode      *graph, *source, *filter;
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA u16"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  filter = gegl_node_new_child (graph,
+                                "operation", "gegl:color-reduction",
+                                "red-bits", channel_bits[0],
+                                "green-bits", channel_bits[1],
+                                "blue-bits", channel_bits[2],
+                                "alpha-bits", channel_bits[3],
+                                "dither-type", dither_type,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  /* the random strategies draw from the global generator */
+  g_random_set_seed (WIDTH);
+  g_object_set (gegl_config (), "threads", threads, NULL);
+
+  gegl_node_blit (filter, 1.0, &extent, babl_format ("RGBA u16"), output,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  g_object_unref (graph);
+  g_object_unref (buffer);
+
+  return output;
+}
+
+static guint
+quantize_value (guint value,
+                guint n_bits,
+                guint mask)
+{
+  gint i;
+
+  value &= mask;
+
+  for (i = n_bits; i < 16; i += n_bits)
+    value |= value >> i;
+
+  return value;
+}
+
+/* Serial Floyd-Steinberg, as the operation did before it was threaded */
+static void
+floyd_steinberg (guint16 *pixels)
+{
+  gdouble *error_buf[2];
+  guint    channel_mask[4];
+  gint     ch, x, y;
+
+  error_buf[0] = g_new0 (gdouble, WIDTH * 4);
+  error_buf[1] = g_new0 (gdouble, WIDTH * 4);
+
+  for (ch = 0; ch < 4; ch++)
+    channel_mask[ch] = ~((1 << (16 - channel_bits[ch])) - 1);
+
+  for (y = 0; y < HEIGHT; y++)
+    {
+      guint16 *line = pixels + y * WIDTH * 4;
+      gdouble *error_buf_swap;
+      gint     step    = (y & 1) ? -1 : 1;
+      gint     start_x = (y & 1) ? WIDTH - 1 : 0;
+      gint     end_x   = (y & 1) ? -1 : WIDTH;
+
+      for (x = start_x; x != end_x; x += step)
+        for (ch = 0; ch < 4; ch++)
+          {
+            gdouble value;
+            gdouble value_clamped;
+            gdouble quantized;
+            gdouble qerror;
+
+            value         = line[x * 4 + ch] + error_buf[0][x * 4 + ch];
+            value_clamped = CLAMP (value, 0.0, 65535.0);
+            quantized     = quantize_value ((guint) (value_clamped + 0.5),
+                                            channel_bits[ch],
+                                            channel_mask[ch]);
+            qerror        = value - quantized;
+
+            line[x * 4 + ch] = (guint16) quantized;
+
+            error_buf[1][x * 4 + ch] += qerror * 5.0 / 16.0;
+
+            if (x + step >= 0 && x + step < WIDTH)
+              {
+                error_buf[0][(x + step) * 4 + ch] += qerror * 6.0 / 16.0;
+                error_buf[1][(x + step) * 4 + ch] += qerror * 1.0 / 16.0;
+              }
+
+            if (x - step >= 0 && x - step < WIDTH)
+              error_buf[1][(x - step) * 4 + ch] += qerror * 3.0 / 16.0;
+          }
+
+      error_buf_swap = error_buf[0];
+      error_buf[0]   = error_buf[1];
+      error_buf[1]   = error_buf_swap;
+
+      memset (error_buf[1], 0, WIDTH * 4 * sizeof (gdouble));
+    }
+
+  g_free (error_buf[0]);
+  g_free (error_buf[1]);
+}
+
+static void
+test_threads (const gchar *dither_type)
+{
+  guint16 *pixels = pattern ();
+  guint16 *single = render (dither_type, pixels, 1);
+  guint16 *multi  = render (dither_type, pixels, 4);
+
+  g_assert (!memcmp (single, multi, WIDTH * HEIGHT * 4 * sizeof (guint16)));
+
+  g_free (pixels);
+  g_free (single);
+  g_free (multi);
+}
+
+/**
+ * Tests that every dither strategy gives the same output on one and on
+ * several threads.
+ **/
+static void
+threads_match_single_thread (void)
+{
+  static const gchar *dither_types[] =
+    { "none", "random", "random-covariant", "bayer", "blue-noise",
+      "floyd-steinberg" };
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (dither_types); i++)
+    test_threads (dither_types[i]);
+}
+
+/**
+ * Tests that the threaded Floyd-Steinberg is bit identical to diffusing
+ * the error of all channels serially.
+ **/
+static void
+floyd_steinberg_matches_serial (void)
+{
+  guint16 *pixels = pattern ();
+  guint16 *output = render ("floyd-steinberg", pixels, 4);
+
+  floyd_steinberg (pixels);
+
+  g_assert (!memcmp (pixels, output, WIDTH * HEIGHT * 4 * sizeof (guint16)));
+
+  g_free (pixels);
+  g_free (output);
+}
+
+/**
+ * Tests that the blue noise dither only gives levels of the reduced depth,
+ * and that it is brighter where the input is.
+ **/
+static void
+blue_noise_quantizes (void)
+{
+  guint16 *pixels = pattern ();
+  guint16 *output = render ("blue-noise", pixels, 4);
+  gdouble  sum[2] = { 0.0, 0.0 };
+  gint     i, ch;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      for (ch = 0; ch < 4; ch++)
+        {
+          guint16 value = output[i * 4 + ch];
+
+          g_assert_cmpuint (value, ==,
+                            quantize_value (value, channel_bits[ch],
+                                            ~((1 << (16 - channel_bits[ch])) - 1)));
+        }
+
+      sum[i % WIDTH < WIDTH / 2] += output[i * 4];
+    }
+
+  /* red ramps up from left to right */
+  g_assert_cmpfloat (sum[0], >, sum[1]);
+
+  g_free (pixels);
+  g_free (output);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (threads_match_single_thread);
+  ADD_TEST (floyd_steinberg_matches_serial);
+  ADD_TEST (blue_noise_quantizes);
+
+  return g_test_run ();
+}
@@ -0,0 +1,159 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/image-cache/" #function, function);
+
+#define WIDTH  300
+#define HEIGHT 200
+
+
+static GeglBuffer *
+pattern_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("Y u8"));
+  guchar        *pixels = g_new (guchar, WIDTH * HEIGHT);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    pixels[i] = (i * 7 + i / WIDTH) & 0xff;
+
+  gegl_buffer_set (buffer, &extent, babl_format ("Y u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_free (pixels);
+
+  return buffer;
+}
+
+static gboolean
+buffers_equal (GeglBuffer          *a,
+               const GeglRectangle *a_rect,
+               GeglBuffer          *b,
+               const GeglRectangle *b_rect)
+{
+  gint     n = a_rect->width * a_rect->height;
+  guchar  *pa = g_new (guchar, n);
+  guchar  *pb = g_new (guchar, n);
+  gboolean equal;
+
+  gegl_buffer_get (a, 1.0, a_rect, babl_format ("Y u8"), pa,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_get (b, 1.0, b_rect, babl_format ("Y u8"), pb,
+                   GEGL_AUTO_ROWSTRIDE);
+  equal = !memcmp (pa, pb, n);
+
+  g_free (pa);
+  g_free (pb);
+
+  return equal;
+}
+
+/**
+ * Tests that copies between buffers with aligned tiles, which share the
+ * tiles, and unaligned copies give the same pixels, and that writing to
+ * the copy leaves the original alone.
+ **/
+static void
+copy_shares_tiles (void)
+{
+  GeglBuffer    *src    = pattern_buffer ();
+  GeglBuffer    *dst    = gegl_buffer_new (gegl_buffer_get_extent (src),
+                                           babl_format ("Y u8"));
+  GeglBuffer    *ref    = pattern_buffer ();
+  GeglRectangle  all    = { 0, 0, WIDTH, HEIGHT };
+  GeglRectangle  from   = { 3, 5, 250, 150 };
+  GeglRectangle  to     = { 10, 20, 250, 150 };
+  GeglRectangle  dot    = { 150, 100, 20, 20 };
+  guchar         ones[20 * 20];
+
+  gegl_buffer_copy (src, NULL, dst, NULL);
+  g_assert (buffers_equal (src, &all, dst, &all));
+
+  memset (ones, 1, sizeof (ones));
+  gegl_buffer_set (dst, &dot, babl_format ("Y u8"), ones, GEGL_AUTO_ROWSTRIDE);
+  g_assert (buffers_equal (src, &all, ref, &all));
+  g_assert (!buffers_equal (src, &all, dst, &all));
+
+  gegl_buffer_copy (src, &all, dst, &all);
+  g_assert (buffers_equal (src, &all, dst, &all));
+
+  gegl_buffer_copy (src, &from, dst, &to);
+  g_assert (buffers_equal (src, &from, dst, &to));
+
+  g_object_unref (src);
+  g_object_unref (dst);
+  g_object_unref (ref);
+}
+
+/**
+ * Tests that a stored image is found again for the same file and
+ * parameters only, and no longer once the file changed.
+ **/
+static void
+lookup_by_file (void)
+{
+  GeglBuffer    *buffer = pattern_buffer ();
+  GeglBuffer    *cached;
+  GeglRectangle  all = { 0, 0, WIDTH, HEIGHT };
+  gchar         *path;
+  FILE          *fp;
+  gint           fd;
+
+  fd = g_file_open_tmp ("test-image-cache-XXXXXX", &path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+
+  gegl_image_cache_insert (path, "scale=1", buffer, &all);
+
+  cached = gegl_image_cache_lookup (path, "scale=1");
+  g_assert (cached != NULL);
+  g_assert (buffers_equal (buffer, &all, cached, &all));
+  g_object_unref (cached);
+
+  g_assert (gegl_image_cache_lookup (path, "scale=2") == NULL);
+
+  fp = g_fopen (path, "ab");
+  fputs ("changed", fp);
+  fclose (fp);
+
+  g_assert (gegl_image_cache_lookup (path, "scale=1") == NULL);
+
+  g_unlink (path);
+  g_free (path);
+  g_object_unref (buffer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (copy_shares_tiles);
+  ADD_TEST (lookup_by_file);
+
+  return g_test_run ();
+}
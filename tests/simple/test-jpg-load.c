@@ -0,0 +1,141 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the scale property of gegl:jpg-load. The image has to come out
+ * at the size libjpeg decodes it at, the smallest of 1/8, 1/4, 1/2 or full
+ * size not below the requested scale, and its mean colour has to stay
+ * close to the one of the full size image.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define MAX_MEAN_ERROR 0.01
+
+typedef struct
+{
+  gdouble scale;
+  gint    denom;
+} JpgScaleTestCase;
+
+static JpgScaleTestCase tests[] =
+{
+  { 1.0,   1 },
+  { 0.75,  1 },
+  { 0.5,   2 },
+  { 0.3,   2 },
+  { 0.25,  4 },
+  { 0.125, 8 },
+  { 0.01,  8 }
+};
+
+static void
+load_mean (GeglNode      *load,
+           gdouble        scale,
+           GeglRectangle *extent,
+           gdouble       *mean)
+{
+  gfloat *pixels;
+  gint    i, c;
+
+  gegl_node_set (load, "scale", scale, NULL);
+  *extent = gegl_node_get_bounding_box (load);
+
+  pixels = g_new (gfloat, extent->width * extent->height * 3);
+  gegl_node_blit (load, 1.0, extent, babl_format ("R'G'B' float"), pixels,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (c = 0; c < 3; c++)
+    mean[c] = 0.0;
+
+  for (i = 0; i < extent->width * extent->height; i++)
+    for (c = 0; c < 3; c++)
+      mean[c] += pixels[i * 3 + c];
+
+  for (c = 0; c < 3; c++)
+    mean[c] /= extent->width * extent->height;
+
+  g_free (pixels);
+}
+
+int main (int argc, char *argv[])
+{
+  const gchar   *srcdir = g_getenv ("ABS_TOP_SRCDIR");
+  gchar         *path;
+  GeglNode      *graph, *load;
+  GeglRectangle  full;
+  gdouble        full_mean[3];
+  gboolean       loaded;
+  gboolean       result = TRUE;
+  gint           i, c;
+
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  path = g_build_filename (srcdir ? srcdir : "../..",
+                           "tests", "compositions", "data",
+                           "parliament_0.jpg", NULL);
+
+  graph = gegl_node_new ();
+  load  = gegl_node_new_child (graph,
+                               "operation", "gegl:jpg-load",
+                               "path",      path,
+                               NULL);
+
+  load_mean (load, 1.0, &full, full_mean);
+
+  /* the means of an empty image are NaN, which no comparison catches */
+  loaded = full.width > 0 && full.height > 0;
+  if (!loaded)
+    {
+      g_printerr ("jpg-load: could not load %s\n", path);
+      result = FALSE;
+    }
+
+  for (i = 0; loaded && i < G_N_ELEMENTS (tests); i++)
+    {
+      GeglRectangle extent;
+      gdouble       mean[3];
+      gdouble       error = 0.0;
+
+      load_mean (load, tests[i].scale, &extent, mean);
+
+      for (c = 0; c < 3; c++)
+        error = MAX (error, fabs (mean[c] - full_mean[c]));
+
+      if (extent.width  != (full.width  + tests[i].denom - 1) / tests[i].denom ||
+          extent.height != (full.height + tests[i].denom - 1) / tests[i].denom ||
+          !(error <= MAX_MEAN_ERROR))
+        {
+          g_printerr ("jpg-load scale %g: got %dx%d, expected 1/%d of %dx%d, "
+                      "mean error %g\n",
+                      tests[i].scale, extent.width, extent.height,
+                      tests[i].denom, full.width, full.height, error);
+          result = FALSE;
+        }
+    }
+
+  g_object_unref (graph);
+  g_free (path);
+  gegl_exit ();
+
+  return result ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,215 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/kuwahara/" #function, function);
+
+#define WIDTH  53
+#define HEIGHT 41
+
+typedef enum
+{
+  KUWAHARA_MEAN,
+  KUWAHARA_MIN,
+  KUWAHARA_MAX
+} KuwaharaOutput;
+
+static const gint radii[] = { 1, 4, 9 };
+
+
+static gfloat *
+pattern (void)
+{
+  gfloat *pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand  *rand   = g_rand_new_with_seed (HEIGHT);
+  gint    i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      gint x = i % WIDTH;
+      gint y = i / WIDTH;
+
+      /* edges between noisy regions of different brightness */
+      pixels[i * 4 + 0] = (x > y ? 0.7 : 0.2) + g_rand_double (rand) * 0.2;
+      pixels[i * 4 + 1] = (x > 30 ? 0.6 : 0.1) + g_rand_double (rand) * 0.3;
+      pixels[i * 4 + 2] = g_rand_double (rand);
+      pixels[i * 4 + 3] = 0.5 + g_rand_double (rand) * 0.5;
+    }
+
+  g_rand_free (rand);
+
+  return pixels;
+}
+
+static gfloat *
+render (const gchar  *operation,
+        const gfloat *pixels,
+        gint          radius)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *output = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GeglNode      *graph, *source, *filter;
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  filter = gegl_node_new_child (graph,
+                                "operation", operation,
+                                "radius", (gdouble) radius,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  gegl_node_blit (filter, 1.0, &extent, babl_format ("RGBA float"), output,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+
+  return output;
+}
+
+/* The quadrant with the smallest range of values, looking only at pixels
+ * inside the image, the first one on ties.
+ */
+static gfloat
+reference (const gfloat   *pixels,
+           gint            x,
+           gint            y,
+           gint            component,
+           gint            radius,
+           KuwaharaOutput  kind)
+{
+  gfloat best   = G_MAXFLOAT;
+  gfloat result = 0.0;
+  gint   quadrant;
+
+  for (quadrant = 0; quadrant < 4; quadrant++)
+    {
+      gint    x0    = x - ((quadrant & 1) ? 0 : radius);
+      gint    y0    = y - ((quadrant & 2) ? 0 : radius);
+      gfloat  min   = G_MAXFLOAT;
+      gfloat  max   = -G_MAXFLOAT;
+      gdouble sum   = 0.0;
+      gint    count = 0;
+      gint    u, v;
+
+      for (v = y0; v <= y0 + radius; v++)
+        for (u = x0; u <= x0 + radius; u++)
+          if (u >= 0 && u < WIDTH && v >= 0 && v < HEIGHT)
+            {
+              gfloat value = pixels[(v * WIDTH + u) * 4 + component];
+
+              min  = MIN (min, value);
+              max  = MAX (max, value);
+              sum += value;
+              count++;
+            }
+
+      if (count && max - min < best)
+        {
+          best   = max - min;
+          result = kind == KUWAHARA_MEAN ? sum / count :
+                   kind == KUWAHARA_MIN  ? min : max;
+        }
+    }
+
+  return result;
+}
+
+static void
+test_kuwahara (const gchar    *operation,
+               KuwaharaOutput  kind)
+{
+  gfloat *pixels = pattern ();
+  gint    r;
+
+  for (r = 0; r < G_N_ELEMENTS (radii); r++)
+    {
+      gfloat *output = render (operation, pixels, radii[r]);
+      gint    x, y, c;
+
+      for (y = 0; y < HEIGHT; y++)
+        for (x = 0; x < WIDTH; x++)
+          {
+            gfloat *pixel = output + (y * WIDTH + x) * 4;
+
+            for (c = 0; c < 3; c++)
+              g_assert_cmpfloat (fabs (pixel[c] - reference (pixels, x, y, c,
+                                                             radii[r], kind)),
+                                 <, 1e-5);
+
+            g_assert_cmpfloat (pixel[3], ==, pixels[(y * WIDTH + x) * 4 + 3]);
+          }
+
+      g_free (output);
+    }
+
+  g_free (pixels);
+}
+
+/**
+ * Tests that gegl:kuwahara gives the mean of the quadrant with the least
+ * range, counting only pixels inside the input.
+ **/
+static void
+mean_of_flattest_quadrant (void)
+{
+  test_kuwahara ("gegl:kuwahara", KUWAHARA_MEAN);
+}
+
+/**
+ * Tests that gegl:kuwahara-min gives the minimum of the quadrant with the
+ * least range.
+ **/
+static void
+min_of_flattest_quadrant (void)
+{
+  test_kuwahara ("gegl:kuwahara-min", KUWAHARA_MIN);
+}
+
+/**
+ * Tests that gegl:kuwahara-max gives the maximum of the quadrant with the
+ * least range.
+ **/
+static void
+max_of_flattest_quadrant (void)
+{
+  test_kuwahara ("gegl:kuwahara-max", KUWAHARA_MAX);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (mean_of_flattest_quadrant);
+  ADD_TEST (min_of_flattest_quadrant);
+  ADD_TEST (max_of_flattest_quadrant);
+
+  return g_test_run ();
+}
@@ -0,0 +1,189 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/matting-levin/" #function, function);
+
+#define WIDTH  64
+#define HEIGHT 48
+
+/* how far the conjugate gradient solution may be from the factorization,
+ * it stops at a relative residual of 1e-6
+ */
+#define MAX_DIFFERENCE  0.02
+#define MEAN_DIFFERENCE 0.002
+
+
+/* A soft edged disc on a gradient, with a cross of foreground scribbles in
+ * the disc and a background border.
+ */
+static void
+pattern_buffers (GeglBuffer **image,
+                 GeglBuffer **trimap)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  gdouble       *pixels = g_new (gdouble, WIDTH * HEIGHT * 3);
+  gdouble       *marks  = g_new (gdouble, WIDTH * HEIGHT * 2);
+  gint           x, y;
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        gdouble  dx     = x - WIDTH / 2.0;
+        gdouble  dy     = y - HEIGHT / 2.0;
+        gdouble  r      = sqrt (dx * dx + dy * dy);
+        gdouble  radius = HEIGHT * 0.3;
+        gdouble  alpha  = CLAMP ((radius + 2 - r) / 4, 0.0, 1.0);
+        gdouble  fg[3]  = { 0.8 + 0.1 * sin (x * 0.3),
+                            0.3 + 0.05 * cos (y * 0.4),
+                            0.2 };
+        gdouble  bg[3]  = { 0.1 + 0.3 * x / WIDTH,
+                            0.5,
+                            0.7 - 0.3 * y / HEIGHT };
+        gdouble *p      = pixels + (y * WIDTH + x) * 3;
+        gdouble *m      = marks  + (y * WIDTH + x) * 2;
+        gint     c;
+
+        for (c = 0; c < 3; c++)
+          p[c] = alpha * fg[c] + (1 - alpha) * bg[c];
+
+        m[0] = m[1] = 0.0;
+        if (r < radius * 0.4 &&
+            (ABS (x - WIDTH / 2) < 2 || ABS (y - HEIGHT / 2) < 2))
+          m[0] = m[1] = 1.0;
+        if (x < 3 || x >= WIDTH - 3 || y < 3 || y >= HEIGHT - 3)
+          {
+            m[0] = 0.0;
+            m[1] = 1.0;
+          }
+      }
+
+  *image  = gegl_buffer_new (&extent, babl_format ("R'G'B' double"));
+  *trimap = gegl_buffer_new (&extent, babl_format ("Y'A double"));
+  gegl_buffer_set (*image, &extent, babl_format ("R'G'B' double"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (*trimap, &extent, babl_format ("Y'A double"), marks,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+  g_free (marks);
+}
+
+/* a single full resolution solve, with the factorization or iteratively */
+static gdouble *
+solve (gboolean exact)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  gdouble       *alpha  = g_new (gdouble, WIDTH * HEIGHT);
+  GeglBuffer    *image, *trimap;
+  GeglNode      *graph, *source, *aux, *matting;
+
+  pattern_buffers (&image, &trimap);
+
+  graph   = gegl_node_new ();
+  source  = gegl_node_new_child (graph,
+                                 "operation", "gegl:buffer-source",
+                                 "buffer", image,
+                                 NULL);
+  aux     = gegl_node_new_child (graph,
+                                 "operation", "gegl:buffer-source",
+                                 "buffer", trimap,
+                                 NULL);
+  matting = gegl_node_new_child (graph,
+                                 "operation", "gegl:matting-levin",
+                                 "levels", 0,
+                                 "active_levels", 0,
+                                 "exact", exact,
+                                 NULL);
+  gegl_node_link (source, matting);
+  gegl_node_connect_to (aux, "output", matting, "aux");
+
+  gegl_node_blit (matting, 1.0, &extent, babl_format ("Y' double"), alpha,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+  g_object_unref (image);
+  g_object_unref (trimap);
+
+  return alpha;
+}
+
+/**
+ * Tests that the conjugate gradient solver finds the same matte as the
+ * UMFPACK factorization, within the accuracy it iterates to.
+ **/
+static void
+iterative_matches_exact (void)
+{
+  gdouble *exact     = solve (TRUE);
+  gdouble *iterative = solve (FALSE);
+  gdouble  max_diff  = 0.0;
+  gdouble  sum_diff  = 0.0;
+  gint     i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      gdouble diff = fabs (exact[i] - iterative[i]);
+
+      max_diff  = MAX (max_diff, diff);
+      sum_diff += diff;
+    }
+
+  g_assert_cmpfloat (max_diff, <, MAX_DIFFERENCE);
+  g_assert_cmpfloat (sum_diff / (WIDTH * HEIGHT), <, MEAN_DIFFERENCE);
+
+  g_free (exact);
+  g_free (iterative);
+}
+
+/**
+ * Tests that the conjugate gradient solver gives the same result whatever
+ * the number of threads.
+ **/
+static void
+iterative_thread_independent (void)
+{
+  gdouble *serial, *threaded;
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  serial = solve (FALSE);
+  g_object_set (gegl_config (), "threads", 4, NULL);
+  threaded = solve (FALSE);
+  g_object_set (gegl_config (), "threads", 1, NULL);
+
+  g_assert (!memcmp (serial, threaded, WIDTH * HEIGHT * sizeof (gdouble)));
+
+  g_free (serial);
+  g_free (threaded);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (iterative_matches_exact);
+  ADD_TEST (iterative_thread_independent);
+
+  return g_test_run ();
+}
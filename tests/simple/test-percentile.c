@@ -0,0 +1,267 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/percentile/" #function, function);
+
+#define WIDTH  61
+#define HEIGHT 47
+
+static const gint    radii[]       = { 1, 3, 6 };
+static const gdouble percentiles[] = { 0.0, 25.0, 50.0, 90.0, 100.0 };
+
+static gfloat *pixels = NULL;
+static gfloat *lumas  = NULL;
+
+
+/* noise with flat patches, where many pixels share their luminance */
+static GeglBuffer *
+pattern_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  GRand         *rand   = g_rand_new_with_seed (WIDTH);
+  gint           i, c;
+
+  if (!pixels)
+    {
+      pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+      lumas  = g_new (gfloat, WIDTH * HEIGHT);
+    }
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      gint     x    = i % WIDTH;
+      gint     y    = i / WIDTH;
+      gboolean flat = (x / 12 + y / 9) % 3 == 0;
+
+      for (c = 0; c < 4; c++)
+        pixels[i * 4 + c] = flat ? 0.25 : g_rand_double (rand);
+
+      lumas[i] = pixels[i * 4 + 0] * 0.212671 +
+                 pixels[i * 4 + 1] * 0.715160 +
+                 pixels[i * 4 + 2] * 0.072169;
+    }
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_rand_free (rand);
+
+  return buffer;
+}
+
+static gfloat *
+render (const gchar *operation,
+        gint         radius,
+        gdouble      percentile)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = pattern_buffer ();
+  gfloat        *output = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GeglNode      *graph, *source, *filter;
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  filter = gegl_node_new_child (graph,
+                                "operation", operation,
+                                "radius", (gdouble) radius,
+                                "percentile", percentile,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  gegl_node_blit (filter, 1.0, &extent, babl_format ("RGBA float"), output,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+
+  return output;
+}
+
+static gint
+compare_luma (gconstpointer a,
+              gconstpointer b)
+{
+  gfloat la = lumas[*(const gint *) a];
+  gfloat lb = lumas[*(const gint *) b];
+
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+/* The window pixels of (x, y) within the image sorted by luminance, and
+ * walked to the percentile, like the filters did with a sorted list.
+ */
+static const gfloat *
+sorted_percentile (gint        x,
+                   gint        y,
+                   const gint *half_widths,
+                   gint        radius,
+                   gdouble     percentile)
+{
+  gint *window = g_new (gint, (radius * 2 + 1) * (radius * 2 + 1));
+  gint  n      = 0;
+  gint  rank;
+  gint  u, v;
+
+  for (v = -radius; v <= radius; v++)
+    for (u = -half_widths[v + radius]; u <= half_widths[v + radius]; u++)
+      if (x + u >= 0 && x + u < WIDTH &&
+          y + v >= 0 && y + v < HEIGHT)
+        window[n++] = (x + u) + (y + v) * WIDTH;
+
+  qsort (window, n, sizeof (gint), compare_luma);
+
+  rank = MIN (ceil (n * percentile / 100.0), n - 1);
+  rank = window[rank];
+  g_free (window);
+
+  return pixels + rank * 4;
+}
+
+static void
+test_window (const gchar *operation,
+             gboolean     disc)
+{
+  gint r, p;
+
+  for (r = 0; r < G_N_ELEMENTS (radii); r++)
+    {
+      gint  radius      = radii[r];
+      gint *half_widths = g_new (gint, radius * 2 + 1);
+      gint  v;
+
+      for (v = -radius; v <= radius; v++)
+        {
+          gint w = radius;
+
+          if (disc)
+            {
+              /* the disc covers the pixels strictly inside the circle */
+              w = -1;
+              while ((w + 1) * (w + 1) + v * v < radius * radius)
+                w++;
+            }
+
+          half_widths[v + radius] = w;
+        }
+
+      for (p = 0; p < G_N_ELEMENTS (percentiles); p++)
+        {
+          gfloat *output = render (operation, radius, percentiles[p]);
+          gint    x, y;
+
+          for (y = 0; y < HEIGHT; y++)
+            for (x = 0; x < WIDTH; x++)
+              {
+                const gfloat *expected = sorted_percentile (x, y, half_widths,
+                                                            radius,
+                                                            percentiles[p]);
+
+                g_assert (!memcmp (output + (x + y * WIDTH) * 4, expected,
+                                   sizeof (gfloat) * 4));
+              }
+
+          g_free (output);
+        }
+
+      g_free (half_widths);
+    }
+}
+
+/**
+ * Tests that gegl:box-percentile gives the pixel that sorting the square
+ * window by luminance gives.
+ **/
+static void
+box_matches_sort (void)
+{
+  test_window ("gegl:box-percentile", FALSE);
+}
+
+/**
+ * Tests that gegl:disc-percentile gives the pixel that sorting the disc
+ * shaped window by luminance gives.
+ **/
+static void
+disc_matches_sort (void)
+{
+  test_window ("gegl:disc-percentile", TRUE);
+}
+
+/**
+ * Tests that gegl:snn-percentile picks one of the pixels of the window,
+ * rather than a color that is not in the image.
+ **/
+static void
+snn_picks_pixels (void)
+{
+  gint r;
+
+  for (r = 0; r < G_N_ELEMENTS (radii); r++)
+    {
+      gint    radius = radii[r];
+      gfloat *output = render ("gegl:snn-percentile", radius, 50.0);
+      gint    x, y;
+
+      for (y = 0; y < HEIGHT; y++)
+        for (x = 0; x < WIDTH; x++)
+          {
+            gboolean found = FALSE;
+            gint     u, v;
+
+            for (v = MAX (y - radius, 0); v <= MIN (y + radius, HEIGHT - 1); v++)
+              for (u = MAX (x - radius, 0); u <= MIN (x + radius, WIDTH - 1); u++)
+                if (!memcmp (output + (x + y * WIDTH) * 4,
+                             pixels + (u + v * WIDTH) * 4,
+                             sizeof (gfloat) * 4))
+                  found = TRUE;
+
+            g_assert (found);
+          }
+
+      g_free (output);
+    }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint result;
+
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (box_matches_sort);
+  ADD_TEST (disc_matches_sort);
+  ADD_TEST (snn_picks_pixels);
+
+  result = g_test_run ();
+
+  g_free (pixels);
+  g_free (lumas);
+
+  return result;
+}
@@ -0,0 +1,216 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that gegl:png-save writes the same image with one thread and with
+ * several, where the IDAT stream is deflated in bands. Every file has to
+ * decode through gegl:png-load to exactly the pixels that were saved.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define THREADS  4
+
+typedef struct
+{
+  gint         width;
+  gint         height;
+  const gchar *format;
+  gint         bitdepth;
+} PngSaveTestCase;
+
+/* rows of 36000 and 40000 bytes are longer than the 32KB deflate window,
+ * the other sizes give several bands and batches of bands per image
+ */
+static PngSaveTestCase tests[] =
+{
+  {    1,  40, "R'G'B' u8",    8 },
+  {  300, 400, "R'G'B' u8",    8 },
+  { 9000,  50, "R'G'B'A u8",   8 },
+  { 5000,  40, "R'G'B'A u16", 16 },
+  {  700, 300, "Y'A u16",     16 },
+  { 1000, 200, "Y' u16",      16 }
+};
+
+/* smooth ramps with patches of noise, so that both matches and literals
+ * end up in the stream
+ */
+static GeglBuffer *
+pattern_buffer (const PngSaveTestCase *test,
+                guchar               **pixels)
+{
+  GeglRectangle  extent = { 0, 0, test->width, test->height };
+  const Babl    *format = babl_format (test->format);
+  gint           bpp    = babl_format_get_bytes_per_pixel (format);
+  gsize          size   = (gsize) test->width * test->height * bpp;
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, format);
+  GRand         *rand   = g_rand_new_with_seed (test->width * test->height);
+  gsize          i;
+
+  *pixels = g_malloc (size);
+  for (i = 0; i < size; i++)
+    {
+      gsize pixel = i / bpp;
+      gint  x     = pixel % test->width;
+      gint  y     = pixel / test->width;
+
+      if ((x / 64 + y / 16) % 5 == 0)
+        (*pixels)[i] = g_rand_int_range (rand, 0, 256);
+      else
+        (*pixels)[i] = (x + y * 3 + (i % bpp) * 40) & 0xff;
+    }
+
+  gegl_buffer_set (buffer, &extent, format, *pixels, GEGL_AUTO_ROWSTRIDE);
+  g_rand_free (rand);
+
+  return buffer;
+}
+
+static void
+save_png (GeglBuffer  *buffer,
+          const gchar *path,
+          gint         bitdepth,
+          gint         compression,
+          gint         threads)
+{
+  GeglNode *graph, *source, *save;
+
+  g_object_set (gegl_config (), "threads", threads, NULL);
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  save   = gegl_node_new_child (graph,
+                                "operation", "gegl:png-save",
+                                "path", path,
+                                "bitdepth", bitdepth,
+                                "compression", compression,
+                                NULL);
+  gegl_node_link (source, save);
+  gegl_node_process (save);
+
+  g_object_unref (graph);
+  g_object_set (gegl_config (), "threads", 1, NULL);
+}
+
+/* returns the decoded pixels in format, or NULL when the size is wrong */
+static guchar *
+load_png (const gchar           *path,
+          const PngSaveTestCase *test)
+{
+  GeglRectangle  extent;
+  const Babl    *format = babl_format (test->format);
+  guchar        *pixels = NULL;
+  GeglNode      *graph, *load;
+
+  graph = gegl_node_new ();
+  load  = gegl_node_new_child (graph,
+                               "operation", "gegl:png-load",
+                               "path", path,
+                               NULL);
+
+  extent = gegl_node_get_bounding_box (load);
+  if (extent.width == test->width && extent.height == test->height)
+    {
+      pixels = g_malloc ((gsize) extent.width * extent.height *
+                         babl_format_get_bytes_per_pixel (format));
+      gegl_node_blit (load, 1.0, &extent, format, pixels,
+                      GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+    }
+
+  g_object_unref (graph);
+
+  return pixels;
+}
+
+static gboolean
+test_png_save (const PngSaveTestCase *test,
+               gint                   index)
+{
+  GeglBuffer *buffer;
+  guchar     *pixels;
+  gsize       size;
+  gboolean    result = TRUE;
+  gint        level;
+
+  buffer = pattern_buffer (test, &pixels);
+  size   = (gsize) test->width * test->height *
+           babl_format_get_bytes_per_pixel (babl_format (test->format));
+
+  for (level = 1; level <= 9; level++)
+    {
+      guchar *decoded[2];
+      gint    threads[2] = { 1, THREADS };
+      gint    i;
+
+      for (i = 0; i < 2; i++)
+        {
+          /* a file name of its own, so no cached decode is picked up */
+          gchar *path = g_strdup_printf ("%s/test-png-save-%d-%d-%d-%d.png",
+                                         g_get_tmp_dir (), (gint) getpid (),
+                                         index, level, threads[i]);
+
+          save_png (buffer, path, test->bitdepth, level, threads[i]);
+          decoded[i] = load_png (path, test);
+
+          g_unlink (path);
+          g_free (path);
+        }
+
+      if (!decoded[0] || !decoded[1] ||
+          memcmp (decoded[0], pixels, size) ||
+          memcmp (decoded[1], decoded[0], size))
+        {
+          g_printerr ("png-save %dx%d %s level %d: %s differs\n",
+                      test->width, test->height, test->format, level,
+                      !decoded[0] || memcmp (decoded[0], pixels, size) ?
+                      "single threaded" : "threaded");
+          result = FALSE;
+        }
+
+      g_free (decoded[0]);
+      g_free (decoded[1]);
+    }
+
+  g_object_unref (buffer);
+  g_free (pixels);
+
+  return result;
+}
+
+int main (int argc, char *argv[])
+{
+  gboolean result = TRUE;
+  gint     i;
+
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    result = test_png_save (&tests[i], i) && result;
+
+  gegl_exit ();
+
+  return result ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,194 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include "gegl.h"
+#include "gegl-plugin.h"
+
+#include "poisson-solver.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define MAX_CYCLES 50
+
+typedef struct
+{
+  gint   width;
+  gint   height;
+  gfloat max_error;
+} PoissonTestCase;
+
+/* The solver stops at a relative residual, the error that leaves grows
+ * with the inverse of the smallest eigenvalue of the Laplacian, so long
+ * grids get larger bounds. Each is about three times what the solver
+ * reaches.
+ */
+static PoissonTestCase tests[] =
+{
+  {    1,   1, 1e-6 },
+  {    5,   3, 1e-6 },
+  {   64,  64, 3e-5 },
+  {  101,  57, 2e-4 },
+  {  300, 200, 3e-3 },
+  { 1023,  17, 2e-2 }
+};
+
+/* the Laplacian the solver inverts, see poisson-solver.h */
+static void
+laplacian (const gfloat *u,
+           gfloat       *f,
+           gint          width,
+           gint          height)
+{
+  gint x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gfloat c   = u[y * width + x];
+        gfloat sum = 0.0f;
+
+        if (x > 0)          sum += u[y * width + x - 1] - c;
+        if (x < width - 1)  sum += u[y * width + x + 1] - c;
+        if (y > 0)          sum += u[(y - 1) * width + x] - c;
+        if (y < height - 1) sum += u[(y + 1) * width + x] - c;
+
+        f[y * width + x] = sum;
+      }
+}
+
+static gdouble
+mean (const gfloat *u,
+      gint          size)
+{
+  gdouble sum = 0.0;
+  gint    i;
+
+  for (i = 0; i < size; i++)
+    sum += u[i];
+
+  return sum / size;
+}
+
+static gboolean
+test_poisson_solve (const PoissonTestCase *test)
+{
+  gint     size     = test->width * test->height;
+  gfloat  *expected = g_new (gfloat, size);
+  gfloat  *f        = g_new (gfloat, size);
+  gfloat  *u        = g_new0 (gfloat, size);
+  gdouble  expected_mean, u_mean;
+  gdouble  error = 0.0;
+  gint     cycles;
+  gint     x, y, i;
+
+  for (y = 0; y < test->height; y++)
+    for (x = 0; x < test->width; x++)
+      expected[y * test->width + x] = sin (x * 0.05) * cos (y * 0.07) +
+                                      0.001 * ((x * 7 + y * 13) % 17);
+
+  laplacian (expected, f, test->width, test->height);
+
+  cycles = poisson_solve (f, u, test->width, test->height, 1e-5, MAX_CYCLES);
+
+  /* solutions are only defined up to a constant */
+  expected_mean = mean (expected, size);
+  u_mean        = mean (u, size);
+
+  for (i = 0; i < size; i++)
+    error = MAX (error, fabs ((u[i] - u_mean) - (expected[i] - expected_mean)));
+
+  g_free (expected);
+  g_free (f);
+  g_free (u);
+
+  if (cycles >= MAX_CYCLES || error > test->max_error)
+    {
+      g_printerr ("poisson_solve %dx%d: %d cycles, error %g\n",
+                  test->width, test->height, cycles, error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+test_dot_product (void)
+{
+  gint     n = 3 * POISSON_SOLVER_BLOCK + 5;
+  gfloat  *a = g_new (gfloat, n);
+  gfloat  *b = g_new (gfloat, n);
+  gdouble  expected = 0.0;
+  gdouble  result;
+  gint     i;
+
+  for (i = 0; i < n; i++)
+    {
+      a[i] = (i % 11) * 0.5f;
+      b[i] = (i % 7) - 3.0f;
+    }
+
+  /* same block order as the solver, so the sums are identical */
+  for (i = 0; i < n; i += POISSON_SOLVER_BLOCK)
+    {
+      gdouble sum = 0.0;
+      gint    j;
+
+      for (j = i; j < MIN (i + POISSON_SOLVER_BLOCK, n); j++)
+        sum += a[j] * b[j];
+      expected += sum;
+    }
+
+  result = poisson_solver_dot (n, a, b);
+
+  g_free (a);
+  g_free (b);
+
+  if (result != expected)
+    {
+      g_printerr ("poisson_solver_dot: %f, expected %f\n", result, expected);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+int main (int argc, char *argv[])
+{
+  gboolean result = TRUE;
+  gint     threads;
+  gint     i;
+
+  gegl_init (&argc, &argv);
+
+  /* run everything both serially and split across threads */
+  for (threads = 1; threads <= 4; threads += 3)
+    {
+      g_object_set (gegl_config (), "threads", threads, NULL);
+
+      for (i = 0; i < G_N_ELEMENTS (tests); i++)
+        result = test_poisson_solve (&tests[i]) && result;
+
+      result = test_dot_product () && result;
+    }
+
+  gegl_exit ();
+
+  return result ? SUCCESS : FAILURE;
+}
@@ -0,0 +1,151 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/sampler-lanczos/" #function, function);
+
+#define SIZE    64
+#define WIDTH   4    /* the lanczos_width gegl_buffer_sampler_new uses */
+#define SAMPLES 2000
+
+/* the phase tables are 4000 steps per pixel, so a sample is at most 1/8000
+ * of a pixel off, which moves the result on noise by about 2e-4
+ */
+#define MAX_ERROR 1e-3
+
+
+static gdouble
+sinc (gdouble x)
+{
+  if (x == 0.0)
+    return 1.0;
+
+  return sin (x * G_PI) / (x * G_PI);
+}
+
+/* the normalized weights of the taps at pixels floor (x) - WIDTH ... */
+static void
+exact_kernel (gdouble  x,
+              gdouble *kernel)
+{
+  gdouble sum = 0.0;
+  gint    k;
+
+  for (k = 0; k < WIDTH * 2 + 1; k++)
+    {
+      gdouble d = (x - floor (x)) - (k - WIDTH);
+
+      kernel[k] = fabs (d) < WIDTH ? sinc (d) * sinc (d / WIDTH) : 0.0;
+      sum += kernel[k];
+    }
+
+  for (k = 0; k < WIDTH * 2 + 1; k++)
+    kernel[k] /= sum;
+}
+
+/**
+ * Tests that samples taken with the phase quantized kernel tables stay
+ * close to a convolution with the exact Lanczos kernel, on uniform noise
+ * where interpolation errors are largest.
+ **/
+static void
+quantized_matches_exact (void)
+{
+  GeglRectangle  extent = { 0, 0, SIZE, SIZE };
+  gfloat        *pixels = g_new (gfloat, SIZE * SIZE * 4);
+  GRand         *rand   = g_rand_new_with_seed (SIZE);
+  GeglBuffer    *buffer;
+  GeglSampler   *sampler;
+  gint           i;
+
+  for (i = 0; i < SIZE * SIZE; i++)
+    {
+      pixels[i * 4 + 0] = g_rand_double (rand);
+      pixels[i * 4 + 1] = g_rand_double (rand);
+      pixels[i * 4 + 2] = g_rand_double (rand);
+      pixels[i * 4 + 3] = 1.0;
+    }
+
+  buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  sampler = gegl_buffer_sampler_new (buffer, babl_format ("RGBA float"),
+                                     GEGL_SAMPLER_LANCZOS);
+
+  for (i = 0; i < SAMPLES; i++)
+    {
+      gdouble x = g_rand_double_range (rand, WIDTH + 1, SIZE - WIDTH - 2);
+      gdouble y = g_rand_double_range (rand, WIDTH + 1, SIZE - WIDTH - 2);
+      gdouble x_kernel[WIDTH * 2 + 1];
+      gdouble y_kernel[WIDTH * 2 + 1];
+      gdouble exact[3] = { 0.0, 0.0, 0.0 };
+      gfloat  sampled[4];
+      gint    ix = floor (x);
+      gint    iy = floor (y);
+      gint    j, k, c;
+
+      exact_kernel (x, x_kernel);
+      exact_kernel (y, y_kernel);
+
+      for (j = 0; j < WIDTH * 2 + 1; j++)
+        for (k = 0; k < WIDTH * 2 + 1; k++)
+          {
+            gfloat *p = pixels + ((iy + j - WIDTH) * SIZE + ix + k - WIDTH) * 4;
+
+            for (c = 0; c < 3; c++)
+              exact[c] += y_kernel[j] * x_kernel[k] * p[c];
+          }
+
+      gegl_sampler_get (sampler, x, y, NULL, sampled);
+
+      for (c = 0; c < 3; c++)
+        g_assert_cmpfloat (fabs (sampled[c] - exact[c]), <, MAX_ERROR);
+      g_assert_cmpfloat (fabs (sampled[3] - 1.0), <, 1e-5);
+    }
+
+  g_object_unref (sampler);
+  g_object_unref (buffer);
+  g_rand_free (rand);
+  g_free (pixels);
+}
+
+/**
+ * Tests that "lanczos" names the Lanczos sampler, as used by the filter
+ * property of the transform ops.
+ **/
+static void
+type_from_string (void)
+{
+  g_assert_cmpint (gegl_sampler_type_from_string ("lanczos"), ==,
+                   GEGL_SAMPLER_LANCZOS);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (quantized_matches_exact);
+  ADD_TEST (type_from_string);
+
+  return g_test_run ();
+}
@@ -0,0 +1,169 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+
+
+#define ADD_TEST(function) g_test_add_func ("/spray/" #function, function);
+
+#define WIDTH  97
+#define HEIGHT 83
+
+/* sizes of the pieces rendered separately, not aligned with the tiles
+ * the operations split their work in
+ */
+#define PIECE_WIDTH  31
+#define PIECE_HEIGHT 26
+
+
+static GeglBuffer *
+pattern_buffer (void)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = gegl_buffer_new (&extent, babl_format ("RGBA float"));
+  gfloat        *pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+  GRand         *rand   = g_rand_new_with_seed (WIDTH);
+  gint           i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      gint x = i % WIDTH;
+      gint y = i / WIDTH;
+
+      pixels[i * 4 + 0] = (x > y ? 0.8 : 0.3) + g_rand_double (rand) * 0.2;
+      pixels[i * 4 + 1] = g_rand_double (rand);
+      pixels[i * 4 + 2] = (y > 40 ? 0.6 : 0.1) + g_rand_double (rand) * 0.3;
+      /* a transparent patch, whose samples get redrawn */
+      pixels[i * 4 + 3] = (x / 10 + y / 10) % 5 == 0 ? 0.0 : 1.0;
+    }
+
+  gegl_buffer_set (buffer, &extent, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_rand_free (rand);
+  g_free (pixels);
+
+  return buffer;
+}
+
+/* renders operation over the whole image, either at once or piece by piece,
+ * with a fresh graph so that nothing is served from a cache
+ */
+static gfloat *
+render (const gchar *operation,
+        gboolean     pieces)
+{
+  GeglRectangle  extent = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer = pattern_buffer ();
+  gfloat        *output = g_new0 (gfloat, WIDTH * HEIGHT * 4);
+  GeglNode      *graph, *source, *filter;
+
+  graph  = gegl_node_new ();
+  source = gegl_node_new_child (graph,
+                                "operation", "gegl:buffer-source",
+                                "buffer", buffer,
+                                NULL);
+  filter = gegl_node_new_child (graph,
+                                "operation", operation,
+                                "radius", 20,
+                                "samples", 5,
+                                "iterations", 6,
+                                NULL);
+  gegl_node_link (source, filter);
+
+  if (!pieces)
+    {
+      gegl_node_blit (filter, 1.0, &extent, babl_format ("RGBA float"),
+                      output, GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+    }
+  else
+    {
+      gint x, y;
+
+      for (y = 0; y < HEIGHT; y += PIECE_HEIGHT)
+        for (x = 0; x < WIDTH; x += PIECE_WIDTH)
+          {
+            GeglRectangle piece = { x, y,
+                                    MIN (PIECE_WIDTH,  WIDTH  - x),
+                                    MIN (PIECE_HEIGHT, HEIGHT - y) };
+
+            gegl_node_blit (filter, 1.0, &piece, babl_format ("RGBA float"),
+                            output + (y * WIDTH + x) * 4,
+                            WIDTH * 4 * sizeof (gfloat), GEGL_BLIT_DEFAULT);
+          }
+    }
+
+  g_object_unref (graph);
+  g_object_unref (buffer);
+
+  return output;
+}
+
+static void
+test_pieces (const gchar *operation)
+{
+  gfloat *whole;
+  gfloat *pieces;
+  gint    i;
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+  whole = render (operation, FALSE);
+
+  g_object_set (gegl_config (), "threads", 4, NULL);
+  pieces = render (operation, TRUE);
+
+  g_object_set (gegl_config (), "threads", 1, NULL);
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    g_assert (!memcmp (whole + i * 4, pieces + i * 4, sizeof (gfloat) * 4));
+
+  g_free (whole);
+  g_free (pieces);
+}
+
+/**
+ * Tests that gegl:c2g gives the same pixels whether the image is rendered
+ * at once on one thread or in pieces on several threads.
+ **/
+static void
+c2g_pieces_match_whole (void)
+{
+  test_pieces ("gegl:c2g");
+}
+
+/**
+ * Tests that gegl:stress gives the same pixels whether the image is
+ * rendered at once on one thread or in pieces on several threads.
+ **/
+static void
+stress_pieces_match_whole (void)
+{
+  test_pieces ("gegl:stress");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (c2g_pieces_match_whole);
+  ADD_TEST (stress_pieces_match_whole);
+
+  return g_test_run ();
+}